@@ -212,6 +212,9 @@ LRESULT CALLBACK CDepthBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, L
                 SetStatusMessage(L"Failed to initialize the Direct2D draw device.");
             }
 
+            // Offer the depth palettes
+            InitializePaletteList();
+
             // Look for a connected Kinect, and create it if found
             CreateFirstConnected();
         }
@@ -241,6 +244,16 @@ LRESULT CALLBACK CDepthBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, L
                     m_pNuiSensor->NuiImageStreamSetImageFrameFlags(m_pDepthStreamHandle, m_bNearMode ? NUI_IMAGE_STREAM_FLAG_ENABLE_NEAR_MODE : 0);
                 }
             }
+
+            // If it was for the palette list and the selection changed, switch palettes
+            if (IDC_COMBO_PALETTE == LOWORD(wParam) && CBN_SELCHANGE == HIWORD(wParam))
+            {
+                LRESULT selection = SendDlgItemMessageW(m_hWnd, IDC_COMBO_PALETTE, CB_GETCURSEL, 0, 0);
+                if (CB_ERR != selection)
+                {
+                    m_depthColorMap.SetPalette(static_cast<DepthColorMap::Palette>(selection));
+                }
+            }
             break;
     }
 
@@ -352,42 +365,12 @@ void CDepthBasics::ProcessDepth()
         int minDepth = (nearMode ? NUI_IMAGE_DEPTH_MINIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MINIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
         int maxDepth = (nearMode ? NUI_IMAGE_DEPTH_MAXIMUM_NEAR_MODE : NUI_IMAGE_DEPTH_MAXIMUM) >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
 
-        BYTE * rgbrun = m_depthRGBX;
         const NUI_DEPTH_IMAGE_PIXEL * pBufferRun = reinterpret_cast<const NUI_DEPTH_IMAGE_PIXEL *>(LockedRect.pBits);
 
-        // end pixel is start + width*height - 1
-        const NUI_DEPTH_IMAGE_PIXEL * pBufferEnd = pBufferRun + (cDepthWidth * cDepthHeight);
-
-        while ( pBufferRun < pBufferEnd )
-        {
-            // discard the portion of the depth that contains only the player index
-            USHORT depth = pBufferRun->depth;
-
-            // To convert to a byte, we're discarding the most-significant
-            // rather than least-significant bits.
-            // We're preserving detail, although the intensity will "wrap."
-            // Values outside the reliable depth range are mapped to 0 (black).
-
-            // Note: Using conditionals in this loop could degrade performance.
-            // Consider using a lookup table instead when writing production code.
-            BYTE intensity = static_cast<BYTE>(depth >= minDepth && depth <= maxDepth ? depth % 256 : 0);
-
-            // Write out blue byte
-            *(rgbrun++) = intensity;
-
-            // Write out green byte
-            *(rgbrun++) = intensity;
-
-            // Write out red byte
-            *(rgbrun++) = intensity;
-
-            // We're outputting BGR, the last byte in the 32 bits is unused so skip it
-            // If we were outputting BGRA, we would write alpha here.
-            ++rgbrun;
-
-            // Increment our index into the Kinect's depth buffer
-            ++pBufferRun;
-        }
+        // Map depth to color through the color map's lookup table.
+        // Values outside the reliable depth range are mapped to 0 (black).
+        m_depthColorMap.SetDepthRange(static_cast<USHORT>(minDepth), static_cast<USHORT>(maxDepth));
+        m_depthColorMap.Colorize(pBufferRun, cDepthWidth * cDepthHeight, m_depthRGBX);
 
         // Draw the data with Direct2D
         m_pDrawDepth->Draw(m_depthRGBX, cDepthWidth * cDepthHeight * cBytesPerPixel);
@@ -403,6 +386,22 @@ ReleaseFrame:
     m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
 }
 
+/// <summary>
+/// Fill the palette list and select the palette in use
+/// </summary>
+void CDepthBasics::InitializePaletteList()
+{
+    // In the order of DepthColorMap::Palette
+    const WCHAR* paletteNames[DepthColorMap::PaletteCount] = { L"Turbo", L"Jet", L"Grayscale", L"Equalized" };
+
+    for (int i = 0; i < DepthColorMap::PaletteCount; ++i)
+    {
+        SendDlgItemMessageW(m_hWnd, IDC_COMBO_PALETTE, CB_ADDSTRING, 0, (LPARAM)paletteNames[i]);
+    }
+
+    SendDlgItemMessageW(m_hWnd, IDC_COMBO_PALETTE, CB_SETCURSEL, m_depthColorMap.GetPalette(), 0);
+}
+
 /// <summary>
 /// Set the status bar message
 /// </summary>
@@ -9,6 +9,7 @@
 #include "resource.h"
 #include "NuiApi.h"
 #include "ImageRenderer.h"
+#include "DepthColorMap.h"
 
 class CDepthBasics
 {
@@ -73,6 +74,9 @@ private:
 
     BYTE*                   m_depthRGBX;
 
+    // Maps depth to colors
+    DepthColorMap           m_depthColorMap;
+
     /// <summary>
     /// Main processing function
     /// </summary>
@@ -89,6 +93,11 @@ private:
     /// </summary>
     void                    ProcessDepth();
 
+    /// <summary>
+    /// Fill the palette list and select the palette in use
+    /// </summary>
+    void                    InitializePaletteList();
+
     /// <summary>
     /// Set the status bar message
     /// </summary>
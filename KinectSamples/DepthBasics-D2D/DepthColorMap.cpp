@@ -0,0 +1,317 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthColorMap.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include <math.h>
+#include <emmintrin.h>
+#include "DepthColorMap.h"
+
+namespace
+{
+    /// <summary>
+    /// Converts a color channel from 0..1 to a byte, clamping values outside the range
+    /// </summary>
+    inline DWORD ChannelToByte(float value)
+    {
+        if (value <= 0.0f)
+        {
+            return 0;
+        }
+
+        if (value >= 1.0f)
+        {
+            return 255;
+        }
+
+        return static_cast<DWORD>(value * 255.0f + 0.5f);
+    }
+
+    /// <summary>
+    /// Packs a color in the BGRX layout the renderer draws
+    /// </summary>
+    inline DWORD PackColor(float red, float green, float blue)
+    {
+        return ChannelToByte(blue) | (ChannelToByte(green) << 8) | (ChannelToByte(red) << 16);
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+DepthColorMap::DepthColorMap() :
+    m_palette(PaletteTurbo),
+    m_minDepth(NUI_IMAGE_DEPTH_MINIMUM >> NUI_IMAGE_PLAYER_INDEX_SHIFT),
+    m_maxDepth(NUI_IMAGE_DEPTH_MAXIMUM >> NUI_IMAGE_PLAYER_INDEX_SHIFT),
+    m_bTableStale(true),
+    m_bHaveStatistics(false)
+{
+    // create heap storage for a color per depth
+    m_pTable = new DWORD[cTableSize];
+
+    ZeroMemory(m_histogram, sizeof(m_histogram));
+    ZeroMemory(m_blendedHistogram, sizeof(m_blendedHistogram));
+    ZeroMemory(m_distribution, sizeof(m_distribution));
+    ZeroMemory(m_tableDistribution, sizeof(m_tableDistribution));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+DepthColorMap::~DepthColorMap()
+{
+    delete[] m_pTable;
+}
+
+/// <summary>
+/// Switches to a palette. The table is rebuilt on the next frame.
+/// </summary>
+/// <param name="palette">palette to use</param>
+void DepthColorMap::SetPalette(Palette palette)
+{
+    if (palette >= 0 && palette < PaletteCount && palette != m_palette)
+    {
+        m_palette = palette;
+        m_bTableStale = true;
+    }
+}
+
+/// <summary>
+/// Gets the palette in use
+/// </summary>
+/// <returns>palette in use</returns>
+DepthColorMap::Palette DepthColorMap::GetPalette() const
+{
+    return m_palette;
+}
+
+/// <summary>
+/// Sets the range of reliable depths. Depths outside it are drawn black.
+/// </summary>
+/// <param name="minDepth">nearest reliable depth in millimeters</param>
+/// <param name="maxDepth">farthest reliable depth in millimeters</param>
+void DepthColorMap::SetDepthRange(USHORT minDepth, USHORT maxDepth)
+{
+    // The histogram only has bins up to this depth
+    const USHORT deepestBinnedDepth = (cBinCount << cBinShift) - 1;
+    maxDepth = min(maxDepth, deepestBinnedDepth);
+    minDepth = min(minDepth, maxDepth);
+
+    if (minDepth != m_minDepth || maxDepth != m_maxDepth)
+    {
+        m_minDepth = minDepth;
+        m_maxDepth = maxDepth;
+
+        // The old statistics were gathered over a different range, so start over
+        m_bHaveStatistics = false;
+        m_bTableStale = true;
+    }
+}
+
+/// <summary>
+/// Maps a depth frame to BGRX colors. The frame's histogram is blended into the
+/// statistics of earlier frames, and the table is only rebuilt when the blended
+/// distribution has moved further than cRebuildThreshold since the last build.
+/// </summary>
+/// <param name="pDepth">depth pixels to map</param>
+/// <param name="pixelCount">number of pixels in the frame</param>
+/// <param name="pRGBX">buffer in which to return 4 bytes per pixel</param>
+void DepthColorMap::Colorize(const NUI_DEPTH_IMAGE_PIXEL* pDepth, UINT pixelCount, BYTE* pRGBX)
+{
+    CountDepths(pDepth, pixelCount);
+
+    UINT distributionShift = UpdateStatistics();
+    if (m_bTableStale || distributionShift > cRebuildThreshold)
+    {
+        BuildTable();
+    }
+
+    const DWORD* pTable = m_pTable;
+    DWORD* pOut = reinterpret_cast<DWORD*>(pRGBX);
+
+    for (UINT i = 0; i < pixelCount; ++i)
+    {
+        pOut[i] = pTable[pDepth[i].depth];
+    }
+}
+
+/// <summary>
+/// Counts the depths of a frame into m_histogram, eight at a time
+/// </summary>
+/// <param name="pDepth">depth pixels to count</param>
+/// <param name="pixelCount">number of pixels in the frame</param>
+void DepthColorMap::CountDepths(const NUI_DEPTH_IMAGE_PIXEL* pDepth, UINT pixelCount)
+{
+    // Consecutive pixels usually fall in the same bin, so spread them over several
+    // histograms to keep each increment from waiting on the one before
+    const int histogramCount = 4;
+    UINT histograms[histogramCount][cBinCount + 1];
+    ZeroMemory(histograms, sizeof(histograms));
+
+    const __m128i minDepth = _mm_set1_epi16(m_minDepth);
+    const __m128i maxDepth = _mm_set1_epi16(m_maxDepth);
+    const __m128i outOfRangeBin = _mm_set1_epi16(cBinCount);
+
+    UINT stepCount = pixelCount / 8;
+    const __m128i* pIn = reinterpret_cast<const __m128i*>(pDepth);
+
+    for (UINT i = 0; i < stepCount; ++i, pIn += 2)
+    {
+        // Depth is the high half of each pixel. Narrowing saturates depths past 32767,
+        // which are out of range either way.
+        __m128i depths = _mm_packs_epi32(_mm_srli_epi32(_mm_loadu_si128(pIn + 0), 16), _mm_srli_epi32(_mm_loadu_si128(pIn + 1), 16));
+
+        __m128i outOfRange = _mm_or_si128(_mm_cmplt_epi16(depths, minDepth), _mm_cmpgt_epi16(depths, maxDepth));
+        __m128i bins = _mm_or_si128(_mm_andnot_si128(outOfRange, _mm_srli_epi16(depths, cBinShift)), _mm_and_si128(outOfRange, outOfRangeBin));
+
+        USHORT binIndices[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(binIndices), bins);
+
+        ++histograms[0][binIndices[0]];
+        ++histograms[1][binIndices[1]];
+        ++histograms[2][binIndices[2]];
+        ++histograms[3][binIndices[3]];
+        ++histograms[0][binIndices[4]];
+        ++histograms[1][binIndices[5]];
+        ++histograms[2][binIndices[6]];
+        ++histograms[3][binIndices[7]];
+    }
+
+    for (UINT i = stepCount * 8; i < pixelCount; ++i)
+    {
+        USHORT depth = pDepth[i].depth;
+        ++histograms[0][depth >= m_minDepth && depth <= m_maxDepth ? depth >> cBinShift : cBinCount];
+    }
+
+    for (int bin = 0; bin <= cBinCount; ++bin)
+    {
+        m_histogram[bin] = histograms[0][bin] + histograms[1][bin] + histograms[2][bin] + histograms[3][bin];
+    }
+}
+
+/// <summary>
+/// Blends m_histogram into the statistics of earlier frames and recomputes the distribution
+/// </summary>
+/// <returns>largest gap between the new distribution and the one the table was built from</returns>
+UINT DepthColorMap::UpdateStatistics()
+{
+    ULONGLONG total = 0;
+    for (int bin = 0; bin < cBinCount; ++bin)
+    {
+        UINT count = m_histogram[bin] << cFixedShift;
+
+        // Move each bin part of the way towards the newest frame
+        m_blendedHistogram[bin] = m_bHaveStatistics ?
+            m_blendedHistogram[bin] - (m_blendedHistogram[bin] >> cSmoothingShift) + (count >> cSmoothingShift) :
+            count;
+
+        total += m_blendedHistogram[bin];
+    }
+
+    m_bHaveStatistics = true;
+
+    ULONGLONG cumulative = 0;
+    UINT largestShift = 0;
+    for (int bin = 0; bin < cBinCount; ++bin)
+    {
+        cumulative += m_blendedHistogram[bin];
+        m_distribution[bin] = total > 0 ? static_cast<UINT>(cumulative * cDistributionScale / total) : 0;
+
+        UINT shift = m_distribution[bin] > m_tableDistribution[bin] ?
+            m_distribution[bin] - m_tableDistribution[bin] :
+            m_tableDistribution[bin] - m_distribution[bin];
+        largestShift = max(largestShift, shift);
+    }
+
+    return largestShift;
+}
+
+/// <summary>
+/// Fills the table for the current palette, range and distribution
+/// </summary>
+void DepthColorMap::BuildTable()
+{
+    // Depths out of the reliable range are mapped to 0 (black)
+    ZeroMemory(m_pTable, cTableSize * sizeof(DWORD));
+
+    // Stretch the linear palettes over the depths actually present, ignoring a few
+    // outliers at each end, or over the whole range if the frame is nearly empty
+    USHORT nearDepth = FindPercentile(cClipFraction);
+    USHORT farDepth = FindPercentile(cDistributionScale - cClipFraction);
+    if (farDepth <= nearDepth)
+    {
+        nearDepth = m_minDepth;
+        farDepth = m_maxDepth;
+    }
+
+    for (UINT depth = m_minDepth; depth <= m_maxDepth; ++depth)
+    {
+        float position;
+        if (PaletteEqualized == m_palette)
+        {
+            position = static_cast<float>(m_distribution[depth >> cBinShift]) / cDistributionScale;
+        }
+        else
+        {
+            position = static_cast<float>(static_cast<int>(depth) - nearDepth) / (farDepth - nearDepth);
+            position = min(max(position, 0.0f), 1.0f);
+        }
+
+        m_pTable[depth] = PaletteColor(position);
+    }
+
+    CopyMemory(m_tableDistribution, m_distribution, sizeof(m_distribution));
+    m_bTableStale = false;
+}
+
+/// <summary>
+/// Finds the first depth at which the distribution reaches a fraction of the pixels
+/// </summary>
+/// <param name="fraction">fraction of the pixels, out of cDistributionScale</param>
+/// <returns>depth in millimeters</returns>
+USHORT DepthColorMap::FindPercentile(UINT fraction) const
+{
+    for (int bin = m_minDepth >> cBinShift; bin <= m_maxDepth >> cBinShift; ++bin)
+    {
+        if (m_distribution[bin] >= fraction)
+        {
+            // Use the middle of the bin, kept within the reliable range
+            USHORT depth = static_cast<USHORT>((bin << cBinShift) + (1 << (cBinShift - 1)));
+            return min(max(depth, m_minDepth), m_maxDepth);
+        }
+    }
+
+    return m_maxDepth;
+}
+
+/// <summary>
+/// Computes a color of the palette
+/// </summary>
+/// <param name="position">position within the palette, from 0 for near to 1 for far</param>
+/// <returns>color in BGRX</returns>
+DWORD DepthColorMap::PaletteColor(float position) const
+{
+    float t = position;
+
+    switch (m_palette)
+    {
+    case PaletteTurbo:
+        // Polynomial fit of the Turbo colormap
+        return PackColor(
+            0.13572138f + t * (4.61539260f + t * (-42.66032258f + t * (132.13108234f + t * (-152.94239396f + t * 59.28637943f)))),
+            0.09140261f + t * (2.19418839f + t * (4.84296658f + t * (-14.18503333f + t * (4.27729857f + t * 2.82956604f)))),
+            0.10667330f + t * (12.64194608f + t * (-60.58204836f + t * (110.36276771f + t * (-89.90310912f + t * 27.34824973f)))));
+
+    case PaletteJet:
+        return PackColor(
+            1.5f - fabsf(4.0f * t - 3.0f),
+            1.5f - fabsf(4.0f * t - 2.0f),
+            1.5f - fabsf(4.0f * t - 1.0f));
+
+    default:
+        // Grayscale and equalized are both bright for near and dark for far
+        return PackColor(1.0f - t, 1.0f - t, 1.0f - t);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthColorMap.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Maps depth frames to colors through a lookup table driven by the depth histogram
+
+#pragma once
+
+#include "NuiApi.h"
+
+class DepthColorMap
+{
+public:
+    /// <summary>
+    /// Color schemes depth can be drawn with
+    /// </summary>
+    enum Palette
+    {
+        // Perceptually ordered rainbow, blue for near through red for far
+        PaletteTurbo,
+
+        // Classic rainbow, blue for near through red for far
+        PaletteJet,
+
+        // White for near through black for far
+        PaletteGrayscale,
+
+        // Grayscale spread so each intensity covers about as many pixels as any other
+        PaletteEqualized,
+
+        PaletteCount
+    };
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    DepthColorMap();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~DepthColorMap();
+
+    /// <summary>
+    /// Switches to a palette. The table is rebuilt on the next frame.
+    /// </summary>
+    /// <param name="palette">palette to use</param>
+    void                    SetPalette(Palette palette);
+
+    /// <summary>
+    /// Gets the palette in use
+    /// </summary>
+    /// <returns>palette in use</returns>
+    Palette                 GetPalette() const;
+
+    /// <summary>
+    /// Sets the range of reliable depths. Depths outside it are drawn black.
+    /// </summary>
+    /// <param name="minDepth">nearest reliable depth in millimeters</param>
+    /// <param name="maxDepth">farthest reliable depth in millimeters</param>
+    void                    SetDepthRange(USHORT minDepth, USHORT maxDepth);
+
+    /// <summary>
+    /// Maps a depth frame to BGRX colors. The frame's histogram is blended into the
+    /// statistics of earlier frames, and the table is only rebuilt when the blended
+    /// distribution has moved further than cRebuildThreshold since the last build.
+    /// </summary>
+    /// <param name="pDepth">depth pixels to map</param>
+    /// <param name="pixelCount">number of pixels in the frame</param>
+    /// <param name="pRGBX">buffer in which to return 4 bytes per pixel</param>
+    void                    Colorize(const NUI_DEPTH_IMAGE_PIXEL* pDepth, UINT pixelCount, BYTE* pRGBX);
+
+private:
+    // Each histogram bin covers this power of two of millimeters
+    static const int        cBinShift = 3;
+
+    // Bins cover depths up to 4095mm, past the farthest reliable depth in either range
+    static const int        cBinCount = 4096 >> cBinShift;
+
+    // A table entry for every possible depth
+    static const int        cTableSize = 65536;
+
+    // Weight of the newest frame in the blended histogram, as a power of two
+    static const int        cSmoothingShift = 2;
+
+    // Fixed point fraction bits of the blended histogram
+    static const int        cFixedShift = 8;
+
+    // Cumulative distributions are scaled to this value
+    static const UINT       cDistributionScale = 65535;
+
+    // Largest gap between the blended distribution and the one the table was built
+    // from that is tolerated before rebuilding, about 2% of the pixels
+    static const UINT       cRebuildThreshold = cDistributionScale / 50;
+
+    // Fraction of pixels, out of cDistributionScale, clipped at each end when the linear
+    // palettes are stretched over the depths present
+    static const UINT       cClipFraction = cDistributionScale / 100;
+
+    Palette                 m_palette;
+    USHORT                  m_minDepth;
+    USHORT                  m_maxDepth;
+
+    // Color of each depth, in BGRX
+    DWORD*                  m_pTable;
+    bool                    m_bTableStale;
+
+    // Depth counts of the current frame, with a last bin for depths out of range
+    UINT                    m_histogram[cBinCount + 1];
+
+    // Blend of the histograms of recent frames, in fixed point
+    UINT                    m_blendedHistogram[cBinCount];
+    bool                    m_bHaveStatistics;
+
+    // Cumulative distribution of the blended histogram, and the one the table was built from
+    UINT                    m_distribution[cBinCount];
+    UINT                    m_tableDistribution[cBinCount];
+
+    /// <summary>
+    /// Counts the depths of a frame into m_histogram, eight at a time
+    /// </summary>
+    /// <param name="pDepth">depth pixels to count</param>
+    /// <param name="pixelCount">number of pixels in the frame</param>
+    void                    CountDepths(const NUI_DEPTH_IMAGE_PIXEL* pDepth, UINT pixelCount);
+
+    /// <summary>
+    /// Blends m_histogram into the statistics of earlier frames and recomputes the distribution
+    /// </summary>
+    /// <returns>largest gap between the new distribution and the one the table was built from</returns>
+    UINT                    UpdateStatistics();
+
+    /// <summary>
+    /// Fills the table for the current palette, range and distribution
+    /// </summary>
+    void                    BuildTable();
+
+    /// <summary>
+    /// Finds the first depth at which the distribution reaches a fraction of the pixels
+    /// </summary>
+    /// <param name="fraction">fraction of the pixels, out of cDistributionScale</param>
+    /// <returns>depth in millimeters</returns>
+    USHORT                  FindPercentile(UINT fraction) const;
+
+    /// <summary>
+    /// Computes a color of the palette
+    /// </summary>
+    /// <param name="position">position within the palette, from 0 for near to 1 for far</param>
+    /// <returns>color in BGRX</returns>
+    DWORD                   PaletteColor(float position) const;
+};
\ No newline at end of file
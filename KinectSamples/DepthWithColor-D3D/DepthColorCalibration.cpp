@@ -0,0 +1,611 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthColorCalibration.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DepthColorCalibration.h"
+#include <malloc.h>
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+#include <strsafe.h>
+#include <emmintrin.h>
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDepthColorCalibration::CDepthColorCalibration()
+{
+    m_colorResolution = NUI_IMAGE_RESOLUTION_INVALID;
+    m_depthResolution = NUI_IMAGE_RESOLUTION_INVALID;
+    m_depthWidth = 0;
+    m_depthHeight = 0;
+    m_sensorId[0] = L'\0';
+
+    m_gridColumns = 0;
+    m_gridRows = 0;
+    m_pNodes = NULL;
+
+    m_pOffsetX = NULL;
+    m_pScaleX = NULL;
+    m_pOffsetY = NULL;
+    m_pScaleY = NULL;
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CDepthColorCalibration::~CDepthColorCalibration()
+{
+    Release();
+}
+
+/// <summary>
+/// Frees the model
+/// </summary>
+void CDepthColorCalibration::Release()
+{
+    delete[] m_pNodes;
+    _aligned_free(m_pOffsetX);
+
+    m_pNodes = NULL;
+    m_pOffsetX = NULL;
+    m_pScaleX = NULL;
+    m_pOffsetY = NULL;
+    m_pScaleY = NULL;
+
+    m_gridColumns = 0;
+    m_gridRows = 0;
+}
+
+/// <summary>
+/// Sets the resolutions of the model and allocates its grid
+/// </summary>
+/// <param name="colorResolution">resolution of the color frames</param>
+/// <param name="depthResolution">resolution of the depth frames</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::Allocate(NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution)
+{
+    Release();
+
+    DWORD width = 0;
+    DWORD height = 0;
+
+    NuiImageResolutionToSize(colorResolution, width, height);
+    if (0 == width)
+    {
+        return E_INVALIDARG;
+    }
+
+    NuiImageResolutionToSize(depthResolution, width, height);
+    if (0 == width)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_colorResolution = colorResolution;
+    m_depthResolution = depthResolution;
+    m_depthWidth  = static_cast<LONG>(width);
+    m_depthHeight = static_cast<LONG>(height);
+
+    // Enough nodes to cover the frame, the last ones sitting on the last column and row
+    m_gridColumns = (m_depthWidth + cGridStep - 2) / cGridStep + 1;
+    m_gridRows = (m_depthHeight + cGridStep - 2) / cGridStep + 1;
+
+    m_pNodes = new (std::nothrow) Node[m_gridColumns*m_gridRows];
+    if (NULL == m_pNodes)
+    {
+        Release();
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the depth pixel column or row a grid node sits on
+/// </summary>
+/// <param name="node">grid column or row</param>
+/// <param name="size">depth width or height</param>
+/// <returns>depth pixel column or row</returns>
+LONG CDepthColorCalibration::GridNodePosition(LONG node, LONG size)
+{
+    return min(node * cGridStep, size - 1);
+}
+
+/// <summary>
+/// Gets the depth the sensor's mapping is sampled at for calibration
+/// </summary>
+/// <param name="index">index of the depth, 0 for the nearest; half steps fall between calibration depths</param>
+/// <returns>depth in millimeters</returns>
+USHORT CDepthColorCalibration::GetCalibrationDepth(float index)
+{
+    // Spread evenly in inverse depth, which the color position is linear in
+    float nearInverse = 1.0f / cMinCalibrationDepth;
+    float farInverse = 1.0f / cMaxCalibrationDepth;
+    float inverse = nearInverse + (farInverse - nearInverse) * index / (cCalibrationDepthCount - 1);
+
+    return static_cast<USHORT>(1.0f / inverse + 0.5f);
+}
+
+/// <summary>
+/// Asks the sensor where each depth pixel of a frame of a single depth maps to
+/// </summary>
+/// <param name="pNuiSensor">sensor to ask</param>
+/// <param name="depth">depth of every pixel in millimeters</param>
+/// <param name="pDepth">buffer for the depth frame</param>
+/// <param name="pColorCoordinates">buffer in which to return an x, y pair for each depth pixel</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::SampleSensor(INuiSensor* pNuiSensor, USHORT depth, USHORT* pDepth, LONG* pColorCoordinates) const
+{
+    const DWORD depthPixelCount = m_depthWidth*m_depthHeight;
+    const USHORT depthPixel = static_cast<USHORT>(depth << NUI_IMAGE_PLAYER_INDEX_SHIFT);
+
+    for (DWORD i = 0; i < depthPixelCount; ++i)
+    {
+        pDepth[i] = depthPixel;
+    }
+
+    return pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
+        m_colorResolution,
+        m_depthResolution,
+        depthPixelCount,
+        pDepth,
+        depthPixelCount*2,
+        pColorCoordinates
+        );
+}
+
+/// <summary>
+/// Fits the model to the mapping of a sensor
+/// </summary>
+/// <param name="pNuiSensor">initialized sensor to sample</param>
+/// <param name="colorResolution">resolution of the color frames</param>
+/// <param name="depthResolution">resolution of the depth frames</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::Calibrate(INuiSensor* pNuiSensor, NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution)
+{
+    if (NULL == pNuiSensor)
+    {
+        return E_POINTER;
+    }
+
+    HRESULT hr = Allocate(colorResolution, depthResolution);
+    if (FAILED(hr)) { return hr; }
+
+    const LONG depthPixelCount = m_depthWidth*m_depthHeight;
+    const LONG nodeCount = m_gridColumns*m_gridRows;
+
+    USHORT* pDepth = new (std::nothrow) USHORT[depthPixelCount];
+    LONG* pColorCoordinates = new (std::nothrow) LONG[depthPixelCount*2];
+
+    // Sums for a least squares fit of each coordinate against inverse depth at every node
+    double* pSums = new (std::nothrow) double[nodeCount*4];
+
+    if (NULL == pDepth || NULL == pColorCoordinates || NULL == pSums)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+    else
+    {
+        ZeroMemory(pSums, nodeCount*4*sizeof(double));
+    }
+
+    double sumInverse = 0.0;
+    double sumInverseSquared = 0.0;
+
+    for (int i = 0; SUCCEEDED(hr) && i < cCalibrationDepthCount; ++i)
+    {
+        USHORT depth = GetCalibrationDepth(static_cast<float>(i));
+        hr = SampleSensor(pNuiSensor, depth, pDepth, pColorCoordinates);
+        if (FAILED(hr)) { break; }
+
+        double inverse = 1.0 / depth;
+        sumInverse += inverse;
+        sumInverseSquared += inverse * inverse;
+
+        for (LONG row = 0; row < m_gridRows; ++row)
+        {
+            for (LONG column = 0; column < m_gridColumns; ++column)
+            {
+                LONG depthIndex = GridNodePosition(column, m_depthWidth) + GridNodePosition(row, m_depthHeight) * m_depthWidth;
+                double colorX = pColorCoordinates[depthIndex * 2];
+                double colorY = pColorCoordinates[depthIndex * 2 + 1];
+
+                double* pNodeSums = pSums + (column + row * m_gridColumns) * 4;
+                pNodeSums[0] += colorX;
+                pNodeSums[1] += colorX * inverse;
+                pNodeSums[2] += colorY;
+                pNodeSums[3] += colorY * inverse;
+            }
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        const double n = cCalibrationDepthCount;
+        const double determinant = n * sumInverseSquared - sumInverse * sumInverse;
+
+        for (LONG i = 0; i < nodeCount; ++i)
+        {
+            const double* pNodeSums = pSums + i * 4;
+
+            double scaleX = (n * pNodeSums[1] - sumInverse * pNodeSums[0]) / determinant;
+            double scaleY = (n * pNodeSums[3] - sumInverse * pNodeSums[2]) / determinant;
+
+            m_pNodes[i].offsetX = static_cast<float>((pNodeSums[0] - scaleX * sumInverse) / n);
+            m_pNodes[i].scaleX = static_cast<float>(scaleX);
+            m_pNodes[i].offsetY = static_cast<float>((pNodeSums[2] - scaleY * sumInverse) / n);
+            m_pNodes[i].scaleY = static_cast<float>(scaleY);
+        }
+
+        BSTR sensorId = pNuiSensor->NuiUniqueId();
+        StringCchCopyW(m_sensorId, _countof(m_sensorId), NULL != sensorId ? sensorId : L"");
+
+        hr = BuildTables();
+    }
+
+    delete[] pDepth;
+    delete[] pColorCoordinates;
+    delete[] pSums;
+
+    if (FAILED(hr))
+    {
+        Release();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Interpolates the grid to every depth pixel
+/// </summary>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::BuildTables()
+{
+    // One allocation holding the four tables
+    const LONG depthPixelCount = m_depthWidth*m_depthHeight;
+    m_pOffsetX = static_cast<float*>(_aligned_malloc(depthPixelCount*4*sizeof(float), 16));
+    if (NULL == m_pOffsetX)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_pScaleX = m_pOffsetX + depthPixelCount;
+    m_pOffsetY = m_pScaleX + depthPixelCount;
+    m_pScaleY = m_pOffsetY + depthPixelCount;
+
+    for (LONG y = 0; y < m_depthHeight; ++y)
+    {
+        LONG row = min(y / cGridStep, m_gridRows - 2);
+        LONG top = GridNodePosition(row, m_depthHeight);
+        float fy = static_cast<float>(y - top) / (GridNodePosition(row + 1, m_depthHeight) - top);
+
+        for (LONG x = 0; x < m_depthWidth; ++x)
+        {
+            LONG column = min(x / cGridStep, m_gridColumns - 2);
+            LONG left = GridNodePosition(column, m_depthWidth);
+            float fx = static_cast<float>(x - left) / (GridNodePosition(column + 1, m_depthWidth) - left);
+
+            const Node& topLeft = m_pNodes[column + row * m_gridColumns];
+            const Node& topRight = m_pNodes[column + 1 + row * m_gridColumns];
+            const Node& bottomLeft = m_pNodes[column + (row + 1) * m_gridColumns];
+            const Node& bottomRight = m_pNodes[column + 1 + (row + 1) * m_gridColumns];
+
+            float weightTopLeft = (1.0f - fx) * (1.0f - fy);
+            float weightTopRight = fx * (1.0f - fy);
+            float weightBottomLeft = (1.0f - fx) * fy;
+            float weightBottomRight = fx * fy;
+
+            LONG i = x + y * m_depthWidth;
+            m_pOffsetX[i] = topLeft.offsetX * weightTopLeft + topRight.offsetX * weightTopRight + bottomLeft.offsetX * weightBottomLeft + bottomRight.offsetX * weightBottomRight;
+            m_pScaleX[i] = topLeft.scaleX * weightTopLeft + topRight.scaleX * weightTopRight + bottomLeft.scaleX * weightBottomLeft + bottomRight.scaleX * weightBottomRight;
+            m_pOffsetY[i] = topLeft.offsetY * weightTopLeft + topRight.offsetY * weightTopRight + bottomLeft.offsetY * weightBottomLeft + bottomRight.offsetY * weightBottomRight;
+            m_pScaleY[i] = topLeft.scaleY * weightTopLeft + topRight.scaleY * weightTopRight + bottomLeft.scaleY * weightBottomLeft + bottomRight.scaleY * weightBottomRight;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Compares the model with the mapping of a sensor at depths it was not fitted at
+/// </summary>
+/// <param name="pNuiSensor">initialized sensor to compare with</param>
+/// <param name="pReport">report to fill in</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::Evaluate(INuiSensor* pNuiSensor, Report* pReport) const
+{
+    if (NULL == pNuiSensor || NULL == pReport)
+    {
+        return E_POINTER;
+    }
+
+    if (NULL == m_pOffsetX)
+    {
+        return E_UNEXPECTED;
+    }
+
+    ZeroMemory(pReport, sizeof(Report));
+
+    const LONG depthPixelCount = m_depthWidth*m_depthHeight;
+    USHORT* pDepth = new (std::nothrow) USHORT[depthPixelCount];
+    LONG* pSensorCoordinates = new (std::nothrow) LONG[depthPixelCount*2];
+    LONG* pModelCoordinates = new (std::nothrow) LONG[depthPixelCount*2];
+
+    HRESULT hr = S_OK;
+    if (NULL == pDepth || NULL == pSensorCoordinates || NULL == pModelCoordinates)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER sensorTicks = {0};
+    LARGE_INTEGER modelTicks = {0};
+    QueryPerformanceFrequency(&frequency);
+
+    double sumError = 0.0;
+    int frameCount = 0;
+
+    // Halfway between the depths the model was fitted at
+    for (int i = 0; SUCCEEDED(hr) && i < cCalibrationDepthCount - 1; ++i)
+    {
+        LARGE_INTEGER start;
+        LARGE_INTEGER middle;
+        LARGE_INTEGER end;
+
+        QueryPerformanceCounter(&start);
+        hr = SampleSensor(pNuiSensor, GetCalibrationDepth(i + 0.5f), pDepth, pSensorCoordinates);
+        QueryPerformanceCounter(&middle);
+        if (FAILED(hr)) { break; }
+
+        MapDepthFrame(pDepth, pModelCoordinates);
+        QueryPerformanceCounter(&end);
+
+        sensorTicks.QuadPart += middle.QuadPart - start.QuadPart;
+        modelTicks.QuadPart += end.QuadPart - middle.QuadPart;
+        ++frameCount;
+
+        for (LONG j = 0; j < depthPixelCount; ++j)
+        {
+            LONG errorX = pModelCoordinates[j * 2] - pSensorCoordinates[j * 2];
+            LONG errorY = pModelCoordinates[j * 2 + 1] - pSensorCoordinates[j * 2 + 1];
+            float error = sqrtf(static_cast<float>(errorX * errorX + errorY * errorY));
+
+            ++pReport->sampleCount;
+            if (0 == errorX && 0 == errorY)
+            {
+                ++pReport->exactCount;
+            }
+            if (abs(errorX) <= 1 && abs(errorY) <= 1)
+            {
+                ++pReport->withinOnePixelCount;
+            }
+
+            sumError += error;
+            pReport->maxError = max(pReport->maxError, error);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pReport->meanError = static_cast<float>(sumError / pReport->sampleCount);
+        pReport->sensorMilliseconds = static_cast<float>(1000.0 * sensorTicks.QuadPart / frequency.QuadPart / frameCount);
+        pReport->modelMilliseconds = static_cast<float>(1000.0 * modelTicks.QuadPart / frequency.QuadPart / frameCount);
+    }
+
+    delete[] pDepth;
+    delete[] pSensorCoordinates;
+    delete[] pModelCoordinates;
+
+    return hr;
+}
+
+/// <summary>
+/// Loads a model saved by Save
+/// </summary>
+/// <param name="pPath">path of the calibration file</param>
+/// <param name="colorResolution">color resolution the model must be for</param>
+/// <param name="depthResolution">depth resolution the model must be for</param>
+/// <param name="pNuiSensor">sensor the model must have been fitted to, or NULL to accept any sensor</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::Load(const WCHAR* pPath, NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution, INuiSensor* pNuiSensor)
+{
+    HANDLE hFile = CreateFileW(pPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    DWORD bytesRead = 0;
+
+    FileHeader header;
+    if (!ReadFile(hFile, &header, sizeof(header), &bytesRead, NULL) || bytesRead != sizeof(header))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else if (cFileSignature != header.signature || cFileVersion != header.version || cGridStep != header.gridStep)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else if (colorResolution != header.colorResolution || depthResolution != header.depthResolution)
+    {
+        // Fitted for other resolutions
+        hr = E_FAIL;
+    }
+
+    // Do not rely on the file to end the string
+    header.sensorId[_countof(header.sensorId) - 1] = L'\0';
+
+    if (SUCCEEDED(hr) && NULL != pNuiSensor)
+    {
+        // Fitted to another sensor
+        BSTR sensorId = pNuiSensor->NuiUniqueId();
+        if (0 != wcscmp(header.sensorId, NULL != sensorId ? sensorId : L""))
+        {
+            hr = E_FAIL;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = Allocate(header.colorResolution, header.depthResolution);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        if (header.gridColumns != m_gridColumns || header.gridRows != m_gridRows)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        DWORD nodeBytes = m_gridColumns*m_gridRows*sizeof(Node);
+        if (!ReadFile(hFile, m_pNodes, nodeBytes, &bytesRead, NULL) || bytesRead != nodeBytes)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        StringCchCopyW(m_sensorId, _countof(m_sensorId), header.sensorId);
+
+        hr = BuildTables();
+    }
+
+    CloseHandle(hFile);
+
+    if (FAILED(hr))
+    {
+        Release();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Saves the model
+/// </summary>
+/// <param name="pPath">path of the calibration file</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::Save(const WCHAR* pPath) const
+{
+    if (NULL == m_pNodes)
+    {
+        return E_UNEXPECTED;
+    }
+
+    FileHeader header;
+    ZeroMemory(&header, sizeof(header));
+    header.signature = cFileSignature;
+    header.version = cFileVersion;
+    header.colorResolution = m_colorResolution;
+    header.depthResolution = m_depthResolution;
+    header.gridStep = cGridStep;
+    header.gridColumns = m_gridColumns;
+    header.gridRows = m_gridRows;
+    StringCchCopyW(header.sensorId, _countof(header.sensorId), m_sensorId);
+
+    HANDLE hFile = CreateFileW(pPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    DWORD bytesWritten = 0;
+    DWORD nodeBytes = m_gridColumns*m_gridRows*sizeof(Node);
+
+    if (!WriteFile(hFile, &header, sizeof(header), &bytesWritten, NULL) ||
+        !WriteFile(hFile, m_pNodes, nodeBytes, &bytesWritten, NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(hFile);
+
+    return hr;
+}
+
+/// <summary>
+/// Checks whether the model was fitted to a sensor
+/// </summary>
+/// <param name="pNuiSensor">sensor to check</param>
+/// <returns>true if a model is loaded and was fitted to the sensor, false otherwise</returns>
+bool CDepthColorCalibration::IsFittedTo(INuiSensor* pNuiSensor) const
+{
+    if (NULL == m_pOffsetX || NULL == pNuiSensor)
+    {
+        return false;
+    }
+
+    BSTR sensorId = pNuiSensor->NuiUniqueId();
+    return 0 == wcscmp(m_sensorId, NULL != sensorId ? sensorId : L"");
+}
+
+/// <summary>
+/// Finds the color pixel each depth pixel of a frame maps to. Pixels without a depth,
+/// or with the depth the sensor reports when it could not measure one, map to -1, -1.
+/// </summary>
+/// <param name="pDepth">depth frame, packed depth pixels</param>
+/// <param name="pColorCoordinates">buffer in which to return an x, y pair for each depth pixel</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorCalibration::MapDepthFrame(const USHORT* pDepth, LONG* pColorCoordinates) const
+{
+    if (NULL == m_pOffsetX)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (NULL == pDepth || NULL == pColorCoordinates)
+    {
+        return E_POINTER;
+    }
+
+    const LONG depthPixelCount = m_depthWidth*m_depthHeight;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i unknownDepth = _mm_set1_epi32(cUnknownDepth);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    LONG i = 0;
+    for (; i + 4 <= depthPixelCount; i += 4)
+    {
+        // Unpack four depths to 32 bits, dropping the player index
+        __m128i depth = _mm_srli_epi32(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pDepth + i)), zero), NUI_IMAGE_PLAYER_INDEX_SHIFT);
+        __m128i noDepth = _mm_or_si128(_mm_cmpeq_epi32(depth, zero), _mm_cmpeq_epi32(depth, unknownDepth));
+        __m128 inverse = _mm_div_ps(one, _mm_cvtepi32_ps(depth));
+
+        __m128 colorX = _mm_add_ps(_mm_load_ps(m_pOffsetX + i), _mm_mul_ps(_mm_load_ps(m_pScaleX + i), inverse));
+        __m128 colorY = _mm_add_ps(_mm_load_ps(m_pOffsetY + i), _mm_mul_ps(_mm_load_ps(m_pScaleY + i), inverse));
+
+        __m128i x = _mm_or_si128(_mm_andnot_si128(noDepth, _mm_cvtps_epi32(colorX)), _mm_and_si128(noDepth, minusOne));
+        __m128i y = _mm_or_si128(_mm_andnot_si128(noDepth, _mm_cvtps_epi32(colorY)), _mm_and_si128(noDepth, minusOne));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pColorCoordinates + i * 2), _mm_unpacklo_epi32(x, y));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pColorCoordinates + i * 2 + 4), _mm_unpackhi_epi32(x, y));
+    }
+
+    for (; i < depthPixelCount; ++i)
+    {
+        USHORT depth = NuiDepthPixelToDepth(pDepth[i]);
+        if (0 == depth || cUnknownDepth == depth)
+        {
+            pColorCoordinates[i * 2] = -1;
+            pColorCoordinates[i * 2 + 1] = -1;
+            continue;
+        }
+
+        // Round the same way the vector loop does
+        float inverse = 1.0f / depth;
+        pColorCoordinates[i * 2] = _mm_cvtss_si32(_mm_set_ss(m_pOffsetX[i] + m_pScaleX[i] * inverse));
+        pColorCoordinates[i * 2 + 1] = _mm_cvtss_si32(_mm_set_ss(m_pOffsetY[i] + m_pScaleY[i] * inverse));
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,205 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthColorCalibration.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+#include "NuiApi.h"
+
+/// <summary>
+/// Maps depth pixels to color pixels without asking the sensor. For a depth pixel the
+/// color pixel is close to A + B / depth on each axis, with A and B varying slowly
+/// across the frame. Calibration samples the sensor's mapping at a range of depths,
+/// fits A and B at a grid of depth pixels and interpolates them to every pixel, so a
+/// frame is mapped with a multiply and an add per coordinate. The grid can be saved
+/// to a file and loaded later without the sensor.
+/// </summary>
+class CDepthColorCalibration
+{
+public:
+    /// <summary>
+    /// How well the model matches the sensor's mapping
+    /// </summary>
+    struct Report
+    {
+        // Pixels compared, and how many of them land exactly on or within one pixel of the sensor's
+        UINT                            sampleCount;
+        UINT                            exactCount;
+        UINT                            withinOnePixelCount;
+
+        // Distance from the sensor's color pixel, in pixels
+        float                           meanError;
+        float                           maxError;
+
+        // Time to map one frame with the sensor and with the model, in milliseconds
+        float                           sensorMilliseconds;
+        float                           modelMilliseconds;
+    };
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDepthColorCalibration();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CDepthColorCalibration();
+
+    /// <summary>
+    /// Fits the model to the mapping of a sensor
+    /// </summary>
+    /// <param name="pNuiSensor">initialized sensor to sample</param>
+    /// <param name="colorResolution">resolution of the color frames</param>
+    /// <param name="depthResolution">resolution of the depth frames</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             Calibrate(INuiSensor* pNuiSensor, NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution);
+
+    /// <summary>
+    /// Compares the model with the mapping of a sensor at depths it was not fitted at
+    /// </summary>
+    /// <param name="pNuiSensor">initialized sensor to compare with</param>
+    /// <param name="pReport">report to fill in</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             Evaluate(INuiSensor* pNuiSensor, Report* pReport) const;
+
+    /// <summary>
+    /// Loads a model saved by Save
+    /// </summary>
+    /// <param name="pPath">path of the calibration file</param>
+    /// <param name="colorResolution">color resolution the model must be for</param>
+    /// <param name="depthResolution">depth resolution the model must be for</param>
+    /// <param name="pNuiSensor">sensor the model must have been fitted to, or NULL to accept any sensor</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             Load(const WCHAR* pPath, NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution, INuiSensor* pNuiSensor);
+
+    /// <summary>
+    /// Saves the model
+    /// </summary>
+    /// <param name="pPath">path of the calibration file</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             Save(const WCHAR* pPath) const;
+
+    /// <summary>
+    /// Checks whether the model was fitted to a sensor
+    /// </summary>
+    /// <param name="pNuiSensor">sensor to check</param>
+    /// <returns>true if a model is loaded and was fitted to the sensor, false otherwise</returns>
+    bool                                IsFittedTo(INuiSensor* pNuiSensor) const;
+
+    /// <summary>
+    /// Finds the color pixel each depth pixel of a frame maps to. Pixels without a depth,
+    /// or with the depth the sensor reports when it could not measure one, map to -1, -1.
+    /// </summary>
+    /// <param name="pDepth">depth frame, packed depth pixels</param>
+    /// <param name="pColorCoordinates">buffer in which to return an x, y pair for each depth pixel</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             MapDepthFrame(const USHORT* pDepth, LONG* pColorCoordinates) const;
+
+private:
+    /// <summary>
+    /// Model coefficients at a grid node
+    /// </summary>
+    struct Node
+    {
+        float                           offsetX;
+        float                           scaleX;
+        float                           offsetY;
+        float                           scaleY;
+    };
+
+    /// <summary>
+    /// Layout of the start of a calibration file, followed by the grid nodes row by row
+    /// </summary>
+    struct FileHeader
+    {
+        DWORD                           signature;
+        DWORD                           version;
+        NUI_IMAGE_RESOLUTION            colorResolution;
+        NUI_IMAGE_RESOLUTION            depthResolution;
+        LONG                            gridStep;
+        LONG                            gridColumns;
+        LONG                            gridRows;
+        WCHAR                           sensorId[128];
+    };
+
+    // "KDCC" in the first bytes of the file
+    static const DWORD                  cFileSignature = 0x4343444B;
+    static const DWORD                  cFileVersion = 1;
+
+    // Depth pixels between grid nodes
+    static const LONG                   cGridStep = 8;
+
+    // Depth the sensor reports for pixels it could not measure, in millimeters. Like a depth
+    // of 0 it is not a distance, so it is not mapped.
+    static const USHORT                 cUnknownDepth = 0x1FFF;
+
+    // Depths the sensor's mapping is sampled at, in millimeters
+    static const int                    cCalibrationDepthCount = 32;
+    static const USHORT                 cMinCalibrationDepth = 400;
+    static const USHORT                 cMaxCalibrationDepth = 4000;
+
+    NUI_IMAGE_RESOLUTION                m_colorResolution;
+    NUI_IMAGE_RESOLUTION                m_depthResolution;
+    LONG                                m_depthWidth;
+    LONG                                m_depthHeight;
+    WCHAR                               m_sensorId[128];
+
+    LONG                                m_gridColumns;
+    LONG                                m_gridRows;
+    Node*                               m_pNodes;
+
+    // Model coefficients interpolated to every depth pixel
+    float*                              m_pOffsetX;
+    float*                              m_pScaleX;
+    float*                              m_pOffsetY;
+    float*                              m_pScaleY;
+
+    /// <summary>
+    /// Frees the model
+    /// </summary>
+    void                                Release();
+
+    /// <summary>
+    /// Sets the resolutions of the model and allocates its grid
+    /// </summary>
+    /// <param name="colorResolution">resolution of the color frames</param>
+    /// <param name="depthResolution">resolution of the depth frames</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             Allocate(NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution);
+
+    /// <summary>
+    /// Gets the depth pixel column or row a grid node sits on
+    /// </summary>
+    /// <param name="node">grid column or row</param>
+    /// <param name="size">depth width or height</param>
+    /// <returns>depth pixel column or row</returns>
+    static LONG                         GridNodePosition(LONG node, LONG size);
+
+    /// <summary>
+    /// Interpolates the grid to every depth pixel
+    /// </summary>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             BuildTables();
+
+    /// <summary>
+    /// Gets the depth the sensor's mapping is sampled at for calibration
+    /// </summary>
+    /// <param name="index">index of the depth, 0 for the nearest; half steps fall between calibration depths</param>
+    /// <returns>depth in millimeters</returns>
+    static USHORT                       GetCalibrationDepth(float index);
+
+    /// <summary>
+    /// Asks the sensor where each depth pixel of a frame of a single depth maps to
+    /// </summary>
+    /// <param name="pNuiSensor">sensor to ask</param>
+    /// <param name="depth">depth of every pixel in millimeters</param>
+    /// <param name="pDepth">buffer for the depth frame</param>
+    /// <param name="pColorCoordinates">buffer in which to return an x, y pair for each depth pixel</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             SampleSensor(INuiSensor* pNuiSensor, USHORT depth, USHORT* pDepth, LONG* pColorCoordinates) const;
+};
\ No newline at end of file
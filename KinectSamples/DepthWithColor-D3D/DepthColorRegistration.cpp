@@ -0,0 +1,466 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthColorRegistration.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DepthColorRegistration.h"
+#include <limits.h>
+#include <malloc.h>
+#include <new>
+#include <emmintrin.h>
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDepthColorRegistration::CDepthColorRegistration()
+{
+    m_colorWidth = 0;
+    m_colorHeight = 0;
+    m_depthWidth = 0;
+    m_depthHeight = 0;
+
+    m_pDepthColumns = NULL;
+    m_pDepthRowStarts = NULL;
+    m_pColorIndices = NULL;
+    m_indexRowStride = 0;
+
+    m_pWork = NULL;
+    m_bandCount = 1;
+
+    m_pass = PassColorIndices;
+    m_passRowCount = 0;
+    m_nextBand = 0;
+    m_pColorCoordinates = NULL;
+    m_pColorRGBX = NULL;
+    m_pDepth = NULL;
+    m_pDest = NULL;
+    m_destPitch = 0;
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CDepthColorRegistration::~CDepthColorRegistration()
+{
+    Release();
+
+    if (NULL != m_pWork)
+    {
+        CloseThreadpoolWork(m_pWork);
+    }
+}
+
+/// <summary>
+/// Frees the tables
+/// </summary>
+void CDepthColorRegistration::Release()
+{
+    delete[] m_pDepthColumns;
+    delete[] m_pDepthRowStarts;
+    _aligned_free(m_pColorIndices);
+
+    m_pDepthColumns = NULL;
+    m_pDepthRowStarts = NULL;
+    m_pColorIndices = NULL;
+}
+
+/// <summary>
+/// Prepares registration between a color and a depth resolution
+/// </summary>
+/// <param name="colorResolution">resolution of the color frames</param>
+/// <param name="depthResolution">resolution of the depth frames</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorRegistration::Initialize(NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution)
+{
+    Release();
+
+    DWORD width = 0;
+    DWORD height = 0;
+
+    NuiImageResolutionToSize(colorResolution, width, height);
+    m_colorWidth  = static_cast<LONG>(width);
+    m_colorHeight = static_cast<LONG>(height);
+
+    NuiImageResolutionToSize(depthResolution, width, height);
+    m_depthWidth  = static_cast<LONG>(width);
+    m_depthHeight = static_cast<LONG>(height);
+
+    if (0 == m_colorWidth || 0 == m_depthWidth)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pDepthColumns = new (std::nothrow) LONG[m_colorWidth];
+    m_pDepthRowStarts = new (std::nothrow) LONG[m_colorHeight];
+    m_pColorIndices = static_cast<LONG*>(_aligned_malloc(m_depthWidth*m_depthHeight*sizeof(LONG), 16));
+    if (NULL == m_pDepthColumns || NULL == m_pDepthRowStarts || NULL == m_pColorIndices)
+    {
+        Release();
+        return E_OUTOFMEMORY;
+    }
+
+    // Scale color pixels down to the depth pixel under them once, instead of dividing per pixel every frame
+    for (LONG x = 0; x < m_colorWidth; ++x)
+    {
+        m_pDepthColumns[x] = x * m_depthWidth / m_colorWidth;
+    }
+
+    for (LONG y = 0; y < m_colorHeight; ++y)
+    {
+        m_pDepthRowStarts[y] = y * m_depthHeight / m_colorHeight * m_depthWidth;
+    }
+
+    if (NULL == m_pWork)
+    {
+        m_pWork = CreateThreadpoolWork(BandWorkCallback, this, NULL);
+        if (NULL == m_pWork)
+        {
+            Release();
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    // A band per processor, the calling thread taking one of them
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    m_bandCount = max(1, static_cast<LONG>(systemInfo.dwNumberOfProcessors));
+
+    return S_OK;
+}
+
+/// <summary>
+/// Builds a color image at color resolution in which every pixel shows the color seen by
+/// the depth pixel under it, so it lines up with the depth frame. Pixels whose depth
+/// pixel maps outside the color frame are black.
+/// </summary>
+/// <param name="pColorCoordinates">x, y pair of the color pixel each depth pixel maps to</param>
+/// <param name="pColorRGBX">color frame, 4 bytes per pixel</param>
+/// <param name="pDest">buffer in which to return the registered color image</param>
+/// <param name="destPitch">bytes between the starts of destination rows</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorRegistration::MapColorToDepth(const LONG* pColorCoordinates, const BYTE* pColorRGBX, BYTE* pDest, UINT destPitch)
+{
+    if (NULL == m_pColorIndices)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (NULL == pColorCoordinates || NULL == pColorRGBX || NULL == pDest)
+    {
+        return E_POINTER;
+    }
+
+    if (destPitch < m_colorWidth*sizeof(LONG))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pColorCoordinates = pColorCoordinates;
+    m_pColorRGBX = pColorRGBX;
+    m_pDest = pDest;
+    m_destPitch = destPitch;
+    m_indexRowStride = m_colorWidth;
+
+    RunPass(PassColorIndices, m_depthHeight);
+    RunPass(PassGatherColor, m_colorHeight);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Builds a depth image at color resolution in which every depth pixel is moved to the
+/// color pixel it maps to, so it lines up with the color frame. Where several depth
+/// pixels land on the same color pixel the nearest is kept, and color pixels no depth
+/// pixel lands on are 0.
+/// </summary>
+/// <param name="pColorCoordinates">x, y pair of the color pixel each depth pixel maps to</param>
+/// <param name="pDepth">depth frame, packed depth pixels</param>
+/// <param name="pDest">buffer in which to return the registered depth image</param>
+/// <param name="destPitch">bytes between the starts of destination rows</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthColorRegistration::MapDepthToColor(const LONG* pColorCoordinates, const USHORT* pDepth, BYTE* pDest, UINT destPitch)
+{
+    if (NULL == m_pColorIndices)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (NULL == pColorCoordinates || NULL == pDepth || NULL == pDest)
+    {
+        return E_POINTER;
+    }
+
+    // Destination rows are indexed in whole pixels, by a stride the index pass multiplies in 16 bits
+    if (destPitch < m_colorWidth*sizeof(USHORT) || 0 != destPitch % sizeof(USHORT) || destPitch / sizeof(USHORT) > SHRT_MAX)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pColorCoordinates = pColorCoordinates;
+    m_pDepth = pDepth;
+    m_pDest = pDest;
+    m_destPitch = destPitch;
+
+    // Index the destination directly, so scattering needs no divide to find the row
+    m_indexRowStride = static_cast<LONG>(destPitch / sizeof(USHORT));
+
+    RunPass(PassColorIndices, m_depthHeight);
+    RunPass(PassClearDepth, m_colorHeight);
+    RunPass(PassScatterDepth, m_depthHeight);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Runs the current pass over all rows, in bands on the calling thread and the thread pool
+/// </summary>
+/// <param name="pass">pass to run</param>
+/// <param name="rowCount">number of rows the pass covers</param>
+void CDepthColorRegistration::RunPass(Pass pass, LONG rowCount)
+{
+    m_pass = pass;
+    m_passRowCount = rowCount;
+    m_nextBand = 0;
+
+    // Small frames are not worth waking other threads for
+    LONG helperCount = min(m_bandCount, rowCount / cMinBandRows) - 1;
+    for (LONG i = 0; i < helperCount; ++i)
+    {
+        SubmitThreadpoolWork(m_pWork);
+    }
+
+    RunBands();
+
+    if (helperCount > 0)
+    {
+        WaitForThreadpoolWorkCallbacks(m_pWork, FALSE);
+    }
+}
+
+/// <summary>
+/// Takes bands of the current pass and runs them until none are left
+/// </summary>
+void CDepthColorRegistration::RunBands()
+{
+    const LONG bandCount = max(1, min(m_bandCount, m_passRowCount / cMinBandRows));
+
+    for (LONG band = InterlockedIncrement(&m_nextBand) - 1; band < bandCount; band = InterlockedIncrement(&m_nextBand) - 1)
+    {
+        // Spread the rows evenly, the first bands taking one more when they do not divide
+        LONG firstRow = band * m_passRowCount / bandCount;
+        LONG rowCount = (band + 1) * m_passRowCount / bandCount - firstRow;
+
+        switch (m_pass)
+        {
+        case PassColorIndices:
+            ComputeColorIndices(firstRow, rowCount);
+            break;
+
+        case PassGatherColor:
+            GatherColor(firstRow, rowCount);
+            break;
+
+        case PassClearDepth:
+            ClearDepth(firstRow, rowCount);
+            break;
+
+        case PassScatterDepth:
+            ScatterDepth(firstRow, rowCount);
+            break;
+        }
+    }
+}
+
+/// <summary>
+/// Thread pool callback that helps run the current pass
+/// </summary>
+VOID CALLBACK CDepthColorRegistration::BandWorkCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WORK pWork)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWork);
+
+    static_cast<CDepthColorRegistration*>(pContext)->RunBands();
+}
+
+/// <summary>
+/// Turns the color coordinates of a band of depth rows into color pixel indices
+/// </summary>
+/// <param name="firstRow">first depth row of the band</param>
+/// <param name="rowCount">number of rows in the band</param>
+void CDepthColorRegistration::ComputeColorIndices(LONG firstRow, LONG rowCount)
+{
+    const __m128i colorWidth = _mm_set1_epi32(m_colorWidth);
+    const __m128i colorHeight = _mm_set1_epi32(m_colorHeight);
+    const __m128i rowStride = _mm_set1_epi32(m_indexRowStride);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i lowWordMask = _mm_set1_epi32(0x0000FFFF);
+
+    LONG first = firstRow * m_depthWidth;
+    LONG end = first + rowCount * m_depthWidth;
+    LONG i = first;
+
+    for (; i + 4 <= end; i += 4)
+    {
+        // Split four x, y pairs into four x and four y
+        __m128 low = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_pColorCoordinates + i * 2)));
+        __m128 high = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_pColorCoordinates + i * 2 + 4)));
+        __m128i x = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i y = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        // Make sure the depth pixel maps to a valid point in color space
+        __m128i valid = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(x, minusOne), _mm_cmplt_epi32(x, colorWidth)),
+            _mm_and_si128(_mm_cmpgt_epi32(y, minusOne), _mm_cmplt_epi32(y, colorHeight)));
+
+        // For valid pixels y and the row stride both fit in 16 bits, so one multiply-add of the
+        // low words gives y * stride
+        __m128i index = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(y, lowWordMask), rowStride), x);
+
+        // Invalid pixels get cInvalidIndex, which is all bits set
+        index = _mm_or_si128(_mm_and_si128(valid, index), _mm_andnot_si128(valid, minusOne));
+        _mm_store_si128(reinterpret_cast<__m128i*>(m_pColorIndices + i), index);
+    }
+
+    for (; i < end; ++i)
+    {
+        LONG colorInDepthX = m_pColorCoordinates[i * 2];
+        LONG colorInDepthY = m_pColorCoordinates[i * 2 + 1];
+
+        bool valid = colorInDepthX >= 0 && colorInDepthX < m_colorWidth && colorInDepthY >= 0 && colorInDepthY < m_colorHeight;
+        m_pColorIndices[i] = valid ? colorInDepthX + colorInDepthY * m_indexRowStride : cInvalidIndex;
+    }
+}
+
+/// <summary>
+/// Gathers color pixels for a band of destination rows
+/// </summary>
+/// <param name="firstRow">first destination row of the band</param>
+/// <param name="rowCount">number of rows in the band</param>
+void CDepthColorRegistration::GatherColor(LONG firstRow, LONG rowCount)
+{
+    const LONG* pColor = reinterpret_cast<const LONG*>(m_pColorRGBX);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+
+    for (LONG y = firstRow; y < firstRow + rowCount; ++y)
+    {
+        const LONG* pIndices = m_pColorIndices + m_pDepthRowStarts[y];
+        LONG* pDest = reinterpret_cast<LONG*>(m_pDest + m_destPitch * y);
+
+        LONG x = 0;
+        if (m_depthWidth == m_colorWidth)
+        {
+            // Columns map one to one, so the indices of four pixels are next to each other
+            for (; x + 4 <= m_colorWidth; x += 4)
+            {
+                __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIndices + x));
+                __m128i pixels = _mm_set_epi32(pColor[max(pIndices[x + 3], 0)], pColor[max(pIndices[x + 2], 0)],
+                    pColor[max(pIndices[x + 1], 0)], pColor[max(pIndices[x], 0)]);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + x), _mm_andnot_si128(_mm_cmpeq_epi32(indices, minusOne), pixels));
+            }
+        }
+
+        for (; x + 4 <= m_colorWidth; x += 4)
+        {
+            LONG index0 = pIndices[m_pDepthColumns[x]];
+            LONG index1 = pIndices[m_pDepthColumns[x + 1]];
+            LONG index2 = pIndices[m_pDepthColumns[x + 2]];
+            LONG index3 = pIndices[m_pDepthColumns[x + 3]];
+
+            // Load through index 0 for invalid pixels, then clear them
+            __m128i indices = _mm_set_epi32(index3, index2, index1, index0);
+            __m128i pixels = _mm_set_epi32(pColor[max(index3, 0)], pColor[max(index2, 0)], pColor[max(index1, 0)], pColor[max(index0, 0)]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDest + x), _mm_andnot_si128(_mm_cmpeq_epi32(indices, minusOne), pixels));
+        }
+
+        for (; x < m_colorWidth; ++x)
+        {
+            LONG index = pIndices[m_pDepthColumns[x]];
+            pDest[x] = cInvalidIndex == index ? 0 : pColor[index];
+        }
+    }
+}
+
+/// <summary>
+/// Clears a band of destination rows of the registered depth image
+/// </summary>
+/// <param name="firstRow">first destination row of the band</param>
+/// <param name="rowCount">number of rows in the band</param>
+void CDepthColorRegistration::ClearDepth(LONG firstRow, LONG rowCount)
+{
+    for (LONG y = firstRow; y < firstRow + rowCount; ++y)
+    {
+        ZeroMemory(m_pDest + m_destPitch * y, m_colorWidth*sizeof(USHORT));
+    }
+}
+
+/// <summary>
+/// Moves the pixels of a band of depth rows to the color pixels they map to
+/// </summary>
+/// <param name="firstRow">first depth row of the band</param>
+/// <param name="rowCount">number of rows in the band</param>
+void CDepthColorRegistration::ScatterDepth(LONG firstRow, LONG rowCount)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i minusOne = _mm_set1_epi32(-1);
+
+    LONG first = firstRow * m_depthWidth;
+    LONG end = first + rowCount * m_depthWidth;
+    LONG i = first;
+
+    for (; i + 8 <= end; i += 8)
+    {
+        // Flag eight depth pixels that are unknown or map outside the color frame, one bit pair each
+        __m128i depths = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_pDepth + i)), NUI_IMAGE_PLAYER_INDEX_SHIFT);
+        __m128i invalid = _mm_packs_epi32(
+            _mm_cmpeq_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(m_pColorIndices + i)), minusOne),
+            _mm_cmpeq_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(m_pColorIndices + i + 4)), minusOne));
+        int skipped = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(depths, zero), invalid));
+
+        // Most groups lie entirely inside or entirely outside the color frame
+        if (0xFFFF == skipped)
+        {
+            continue;
+        }
+
+        for (LONG lane = 0; lane < 8; ++lane)
+        {
+            if (0 == (skipped & (1 << (lane * 2))))
+            {
+                StoreNearestDepth(m_pColorIndices[i + lane], m_pDepth[i + lane]);
+            }
+        }
+    }
+
+    for (; i < end; ++i)
+    {
+        if (cInvalidIndex != m_pColorIndices[i] && 0 != NuiDepthPixelToDepth(m_pDepth[i]))
+        {
+            StoreNearestDepth(m_pColorIndices[i], m_pDepth[i]);
+        }
+    }
+}
+
+/// <summary>
+/// Writes a depth pixel to a destination pixel unless a nearer one is already there
+/// </summary>
+/// <param name="destIndex">index of the destination pixel</param>
+/// <param name="depthPixel">packed depth pixel</param>
+void CDepthColorRegistration::StoreNearestDepth(LONG destIndex, USHORT depthPixel)
+{
+    volatile SHORT* pDestPixel = reinterpret_cast<volatile SHORT*>(m_pDest) + destIndex;
+
+    // Depth pixels of other bands may land on the same pixel at the same time. Packed pixels
+    // order by depth, so the nearer one is the smaller, and 0 is a pixel nothing landed on yet.
+    SHORT current = *pDestPixel;
+    while (0 == current || depthPixel < static_cast<USHORT>(current))
+    {
+        SHORT previous = InterlockedCompareExchange16(pDestPixel, static_cast<SHORT>(depthPixel), current);
+        if (previous == current)
+        {
+            return;
+        }
+
+        current = previous;
+    }
+}
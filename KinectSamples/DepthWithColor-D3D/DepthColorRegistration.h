@@ -0,0 +1,169 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DepthColorRegistration.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+#include "NuiApi.h"
+
+/// <summary>
+/// Registers color and depth frames with each other, given the color pixel each depth
+/// pixel maps to. The mapping from output pixels to depth pixels is computed once per
+/// resolution pair, so color and depth may have any resolutions. Each frame first turns
+/// the color coordinates into color pixel indices, four at a time with SSE2, and then
+/// gathers color through them or scatters depth through them, with every pass split
+/// into row bands on the thread pool.
+/// </summary>
+class CDepthColorRegistration
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDepthColorRegistration();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CDepthColorRegistration();
+
+    /// <summary>
+    /// Prepares registration between a color and a depth resolution
+    /// </summary>
+    /// <param name="colorResolution">resolution of the color frames</param>
+    /// <param name="depthResolution">resolution of the depth frames</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             Initialize(NUI_IMAGE_RESOLUTION colorResolution, NUI_IMAGE_RESOLUTION depthResolution);
+
+    /// <summary>
+    /// Builds a color image at color resolution in which every pixel shows the color seen by
+    /// the depth pixel under it, so it lines up with the depth frame. Pixels whose depth
+    /// pixel maps outside the color frame are black.
+    /// </summary>
+    /// <param name="pColorCoordinates">x, y pair of the color pixel each depth pixel maps to</param>
+    /// <param name="pColorRGBX">color frame, 4 bytes per pixel</param>
+    /// <param name="pDest">buffer in which to return the registered color image</param>
+    /// <param name="destPitch">bytes between the starts of destination rows</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             MapColorToDepth(const LONG* pColorCoordinates, const BYTE* pColorRGBX, BYTE* pDest, UINT destPitch);
+
+    /// <summary>
+    /// Builds a depth image at color resolution in which every depth pixel is moved to the
+    /// color pixel it maps to, so it lines up with the color frame. Where several depth
+    /// pixels land on the same color pixel the nearest is kept, and color pixels no depth
+    /// pixel lands on are 0.
+    /// </summary>
+    /// <param name="pColorCoordinates">x, y pair of the color pixel each depth pixel maps to</param>
+    /// <param name="pDepth">depth frame, packed depth pixels</param>
+    /// <param name="pDest">buffer in which to return the registered depth image</param>
+    /// <param name="destPitch">bytes between the starts of destination rows</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             MapDepthToColor(const LONG* pColorCoordinates, const USHORT* pDepth, BYTE* pDest, UINT destPitch);
+
+private:
+    /// <summary>
+    /// Passes a frame is split into
+    /// </summary>
+    enum Pass
+    {
+        PassColorIndices,
+        PassGatherColor,
+        PassClearDepth,
+        PassScatterDepth
+    };
+
+    // Rows are not split into bands smaller than this
+    static const LONG                   cMinBandRows = 16;
+
+    // Color pixel index of depth pixels that map outside the color frame
+    static const LONG                   cInvalidIndex = -1;
+
+    LONG                                m_colorWidth;
+    LONG                                m_colorHeight;
+    LONG                                m_depthWidth;
+    LONG                                m_depthHeight;
+
+    // Depth pixel under each color column, and index of the first depth pixel of the row under each color row
+    LONG*                               m_pDepthColumns;
+    LONG*                               m_pDepthRowStarts;
+
+    // Color pixel index each depth pixel of the current frame maps to, or cInvalidIndex, and
+    // the pixels between the starts of color rows it is computed with
+    LONG*                               m_pColorIndices;
+    LONG                                m_indexRowStride;
+
+    // Thread pool work that runs bands, and the number of bands a pass is split into
+    PTP_WORK                            m_pWork;
+    LONG                                m_bandCount;
+
+    // Pass being run, its inputs and the next band to take
+    Pass                                m_pass;
+    LONG                                m_passRowCount;
+    volatile LONG                       m_nextBand;
+    const LONG*                         m_pColorCoordinates;
+    const BYTE*                         m_pColorRGBX;
+    const USHORT*                       m_pDepth;
+    BYTE*                               m_pDest;
+    UINT                                m_destPitch;
+
+    /// <summary>
+    /// Frees the tables
+    /// </summary>
+    void                                Release();
+
+    /// <summary>
+    /// Runs the current pass over all rows, in bands on the calling thread and the thread pool
+    /// </summary>
+    /// <param name="pass">pass to run</param>
+    /// <param name="rowCount">number of rows the pass covers</param>
+    void                                RunPass(Pass pass, LONG rowCount);
+
+    /// <summary>
+    /// Takes bands of the current pass and runs them until none are left
+    /// </summary>
+    void                                RunBands();
+
+    /// <summary>
+    /// Thread pool callback that helps run the current pass
+    /// </summary>
+    static VOID CALLBACK                BandWorkCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_WORK pWork);
+
+    /// <summary>
+    /// Turns the color coordinates of a band of depth rows into color pixel indices
+    /// </summary>
+    /// <param name="firstRow">first depth row of the band</param>
+    /// <param name="rowCount">number of rows in the band</param>
+    void                                ComputeColorIndices(LONG firstRow, LONG rowCount);
+
+    /// <summary>
+    /// Gathers color pixels for a band of destination rows
+    /// </summary>
+    /// <param name="firstRow">first destination row of the band</param>
+    /// <param name="rowCount">number of rows in the band</param>
+    void                                GatherColor(LONG firstRow, LONG rowCount);
+
+    /// <summary>
+    /// Clears a band of destination rows of the registered depth image
+    /// </summary>
+    /// <param name="firstRow">first destination row of the band</param>
+    /// <param name="rowCount">number of rows in the band</param>
+    void                                ClearDepth(LONG firstRow, LONG rowCount);
+
+    /// <summary>
+    /// Moves the pixels of a band of depth rows to the color pixels they map to
+    /// </summary>
+    /// <param name="firstRow">first depth row of the band</param>
+    /// <param name="rowCount">number of rows in the band</param>
+    void                                ScatterDepth(LONG firstRow, LONG rowCount);
+
+    /// <summary>
+    /// Writes a depth pixel to a destination pixel unless a nearer one is already there
+    /// </summary>
+    /// <param name="destIndex">index of the destination pixel</param>
+    /// <param name="depthPixel">packed depth pixel</param>
+    void                                StoreNearestDepth(LONG destIndex, USHORT depthPixel);
+};
\ No newline at end of file
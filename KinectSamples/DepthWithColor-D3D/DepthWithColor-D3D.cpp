@@ -9,8 +9,22 @@
 // Global Variables
 CDepthWithColorD3D g_Application;  // Application class
 
+// Name of the file the depth to color calibration is stored in
+static const WCHAR g_calibrationFileName[] = L"DepthWithColor-D3D.calibration";
+
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
+/// <summary>
+/// Rounds a pixel buffer size up so that the buffer after it stays aligned
+/// </summary>
+/// <param name="size">size of the buffer in bytes</param>
+/// <param name="alignment">alignment in bytes, a power of two</param>
+/// <returns>aligned size in bytes</returns>
+static size_t AlignPixelBufferSize(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
 /// <summary>
 /// Entry point for the application
 /// </summary>
@@ -34,6 +48,9 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
         return 0;
     }
 
+    // Without a stored calibration the sensor's mapping is used until one is made
+    g_Application.LoadCalibration();
+
     if ( FAILED( g_Application.CreateFirstConnected() ) )
     {
         MessageBox(NULL, L"No ready Kinect found!", L"Error", MB_ICONHAND | MB_OK);
@@ -107,8 +124,6 @@ CDepthWithColorD3D::CDepthWithColorD3D()
     m_colorWidth  = static_cast<LONG>(width);
     m_colorHeight = static_cast<LONG>(height);
 
-    m_colorToDepthDivisor = m_colorWidth/m_depthWidth;
-
     m_hInst = NULL;
     m_hWnd = NULL;
     m_featureLevel = D3D_FEATURE_LEVEL_11_0;
@@ -147,12 +162,31 @@ CDepthWithColorD3D::CDepthWithColorD3D()
     m_hNextColorFrameEvent = INVALID_HANDLE_VALUE;
     m_pColorStreamHandle = INVALID_HANDLE_VALUE;
 
-    m_depthD16 = new USHORT[m_depthWidth*m_depthHeight];
-    m_colorCoordinates = new LONG[m_depthWidth*m_depthHeight*2];
-    m_colorRGBX = new BYTE[m_colorWidth*m_colorHeight*cBytesPerPixel];
+    // One 64-byte aligned allocation holds all pixel data, with each buffer starting on its own cache line
+    const size_t depthD16Bytes = AlignPixelBufferSize(m_depthWidth*m_depthHeight*sizeof(USHORT), cPixelBufferAlignment);
+    const size_t colorCoordinatesBytes = AlignPixelBufferSize(m_depthWidth*m_depthHeight*2*sizeof(LONG), cPixelBufferAlignment);
+    const size_t colorRGBXBytes = AlignPixelBufferSize(m_colorWidth*m_colorHeight*cBytesPerPixel, cPixelBufferAlignment);
+
+    m_pPixelData = static_cast<BYTE*>(_aligned_malloc(depthD16Bytes + colorCoordinatesBytes + colorRGBXBytes, cPixelBufferAlignment));
+    if (NULL != m_pPixelData)
+    {
+        m_depthD16 = reinterpret_cast<USHORT*>(m_pPixelData);
+        m_colorCoordinates = reinterpret_cast<LONG*>(m_pPixelData + depthD16Bytes);
+        m_colorRGBX = m_pPixelData + depthD16Bytes + colorCoordinatesBytes;
+    }
+    else
+    {
+        m_depthD16 = NULL;
+        m_colorCoordinates = NULL;
+        m_colorRGBX = NULL;
+    }
 
     m_bNearMode = false;
 
+    m_bUseCalibration = false;
+
+    m_bMapDepthToColor = false;
+
     m_bPaused = false;
 }
 
@@ -194,9 +228,7 @@ CDepthWithColorD3D::~CDepthWithColorD3D()
     CloseHandle(m_hNextColorFrameEvent);
 
     // done with pixel data
-    delete[] m_colorRGBX;
-    delete[] m_colorCoordinates;
-    delete[] m_depthD16;
+    _aligned_free(m_pPixelData);
 }
 
 /// <summary>
@@ -280,6 +312,14 @@ LRESULT CDepthWithColorD3D::HandleMessages(HWND hWnd, UINT uMsg, WPARAM wParam,
             {
                 ToggleNearMode();
             }
+            else if (nKey == 'C')
+            {
+                Recalibrate();
+            }
+            else if (nKey == 'R')
+            {
+                ToggleRegistration();
+            }
             break;
         }
     }
@@ -296,6 +336,12 @@ HRESULT CDepthWithColorD3D::CreateFirstConnected()
     INuiSensor * pNuiSensor = NULL;
     HRESULT hr;
 
+    // The pixel buffers could not be allocated
+    if (NULL == m_pPixelData) { return E_OUTOFMEMORY; }
+
+    hr = m_registration.Initialize(cColorResolution, cDepthResolution);
+    if (FAILED(hr) ) { return hr; }
+
     int iSensorCount = 0;
     hr = NuiGetSensorCount(&iSensorCount);
     if (FAILED(hr) ) { return hr; }
@@ -357,6 +403,9 @@ HRESULT CDepthWithColorD3D::CreateFirstConnected()
         &m_pColorStreamHandle );
     if (FAILED(hr) ) { return hr; }
 
+    // Map depth to color with a calibration when we can, asking the sensor every frame otherwise
+    PrepareCalibration(false);
+
     // Start with near mode on
     ToggleNearMode();
 
@@ -385,6 +434,22 @@ HRESULT CDepthWithColorD3D::ToggleNearMode()
     return hr;
 }
 
+/// <summary>
+/// Toggles between drawing a point per depth pixel, colored by the color registered to
+/// depth, and a point per color pixel, placed by the depth registered to color.
+/// Does nothing unless color and depth have the same resolution.
+/// </summary>
+void CDepthWithColorD3D::ToggleRegistration()
+{
+    // The shader draws a point per texel of the depth texture, which is sized for depth
+    if (m_colorWidth != m_depthWidth || m_colorHeight != m_depthHeight)
+    {
+        return;
+    }
+
+    m_bMapDepthToColor = !m_bMapDepthToColor;
+}
+
 /// <summary>
 /// Compile and set layout for shaders
 /// </summary>
@@ -693,6 +758,12 @@ HRESULT CDepthWithColorD3D::ProcessDepth()
 
     hr = m_pNuiSensor->NuiImageStreamReleaseFrame(m_pDepthStreamHandle, &imageFrame);
 
+    // depth registered to color is written to the texture once it is mapped
+    if (m_bMapDepthToColor)
+    {
+        return hr;
+    }
+
     // copy to our d3d 11 depth texture
     D3D11_MAPPED_SUBRESOURCE msT;
     hr = m_pImmediateContext->Map(m_pDepthTexture2D, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &msT);
@@ -731,66 +802,205 @@ HRESULT CDepthWithColorD3D::ProcessColor()
 }
 
 /// <summary>
-/// Process color data received from Kinect
+/// Gets the color pixel each depth pixel maps to, for the current depth frame
 /// </summary>
 /// <returns>S_OK for success, or failure code</returns>
-HRESULT CDepthWithColorD3D::MapColorToDepth()
+HRESULT CDepthWithColorD3D::MapColorCoordinates()
 {
     HRESULT hr;
 
     // Get of x, y coordinates for color in depth space
     // This will allow us to later compensate for the differences in location, angle, etc between the depth and color cameras
-    m_pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
-        cColorResolution,
-        cDepthResolution,
-        m_depthWidth*m_depthHeight,
-        m_depthD16,
-        m_depthWidth*m_depthHeight*2,
-        m_colorCoordinates
-        );
+    if (m_bUseCalibration)
+    {
+        hr = m_calibration.MapDepthFrame(m_depthD16, m_colorCoordinates);
+    }
+    else
+    {
+        hr = m_pNuiSensor->NuiImageGetColorPixelCoordinateFrameFromDepthPixelFrameAtResolution(
+            cColorResolution,
+            cDepthResolution,
+            m_depthWidth*m_depthHeight,
+            m_depthD16,
+            m_depthWidth*m_depthHeight*2,
+            m_colorCoordinates
+            );
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Process color data received from Kinect
+/// </summary>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthWithColorD3D::MapColorToDepth()
+{
+    HRESULT hr = MapColorCoordinates();
+    if ( FAILED(hr) ) { return hr; }
 
     // copy to our d3d 11 color texture
     D3D11_MAPPED_SUBRESOURCE msT;
     hr = m_pImmediateContext->Map(m_pColorTexture2D, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &msT);
     if ( FAILED(hr) ) { return hr; }
-    
-    // loop over each row and column of the color
+
+    // pick the color each depth pixel sees for every pixel of the texture
+    hr = m_registration.MapColorToDepth(m_colorCoordinates, m_colorRGBX, static_cast<BYTE*>(msT.pData), msT.RowPitch);
+
+    m_pImmediateContext->Unmap(m_pColorTexture2D, NULL);
+
+    return hr;
+}
+
+/// <summary>
+/// Adjust depth to the same space as color
+/// </summary>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthWithColorD3D::MapDepthToColor()
+{
+    HRESULT hr = MapColorCoordinates();
+    if ( FAILED(hr) ) { return hr; }
+
+    // move each depth pixel to the color pixel it sees, in our d3d 11 depth texture
+    D3D11_MAPPED_SUBRESOURCE msT;
+    hr = m_pImmediateContext->Map(m_pDepthTexture2D, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &msT);
+    if ( FAILED(hr) ) { return hr; }
+
+    hr = m_registration.MapDepthToColor(m_colorCoordinates, m_depthD16, static_cast<BYTE*>(msT.pData), msT.RowPitch);
+
+    m_pImmediateContext->Unmap(m_pDepthTexture2D, NULL);
+    if ( FAILED(hr) ) { return hr; }
+
+    // the color frame already lines up with the depth texture, so copy it as it is
+    hr = m_pImmediateContext->Map(m_pColorTexture2D, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &msT);
+    if ( FAILED(hr) ) { return hr; }
+
     for (LONG y = 0; y < m_colorHeight; ++y)
     {
-        LONG* pDest = (LONG*)((BYTE*)msT.pData + msT.RowPitch * y);
-        for (LONG x = 0; x < m_colorWidth; ++x)
-        {
-            // calculate index into depth array
-            int depthIndex = x/m_colorToDepthDivisor + y/m_colorToDepthDivisor * m_depthWidth;
+        memcpy(static_cast<BYTE*>(msT.pData) + msT.RowPitch * y, m_colorRGBX + m_colorWidth * cBytesPerPixel * y, m_colorWidth * cBytesPerPixel);
+    }
 
-            // retrieve the depth to color mapping for the current depth pixel
-            LONG colorInDepthX = m_colorCoordinates[depthIndex * 2];
-            LONG colorInDepthY = m_colorCoordinates[depthIndex * 2 + 1];
+    m_pImmediateContext->Unmap(m_pColorTexture2D, NULL);
 
-            // make sure the depth pixel maps to a valid point in color space
-            if ( colorInDepthX >= 0 && colorInDepthX < m_colorWidth && colorInDepthY >= 0 && colorInDepthY < m_colorHeight )
-            {
-                // calculate index into color array
-                LONG colorIndex = colorInDepthX + colorInDepthY * m_colorWidth;
+    return hr;
+}
 
-                // set source for copy to the color pixel
-                LONG* pSrc = (LONG *)m_colorRGBX + colorIndex;
-                *pDest = *pSrc;
-            }
-            else
-            {
-                *pDest = 0;
-            }
+/// <summary>
+/// Loads the stored calibration, which needs no sensor, so depth can be mapped to color
+/// with it before one is connected
+/// </summary>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthWithColorD3D::LoadCalibration()
+{
+    WCHAR path[MAX_PATH];
+    HRESULT hr = GetCalibrationPath(path, _countof(path));
+    if (SUCCEEDED(hr))
+    {
+        hr = m_calibration.Load(path, cColorResolution, cDepthResolution, NULL);
+    }
+
+    m_bUseCalibration = SUCCEEDED(hr);
+
+    return hr;
+}
+
+/// <summary>
+/// Keeps the loaded calibration if it was fitted to the sensor, otherwise loads the stored
+/// calibration of the sensor, or calibrates against the sensor and stores the result when
+/// there is none
+/// </summary>
+/// <param name="bRecalibrate">calibrate even if a stored calibration exists</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthWithColorD3D::PrepareCalibration(bool bRecalibrate)
+{
+    if (!bRecalibrate && m_bUseCalibration && m_calibration.IsFittedTo(m_pNuiSensor))
+    {
+        return S_OK;
+    }
+
+    WCHAR path[MAX_PATH];
+    bool bHavePath = SUCCEEDED(GetCalibrationPath(path, _countof(path)));
 
-            pDest++;
+    HRESULT hr = E_FAIL;
+    if (bHavePath && !bRecalibrate)
+    {
+        hr = m_calibration.Load(path, cColorResolution, cDepthResolution, m_pNuiSensor);
+    }
+
+    if (FAILED(hr))
+    {
+        hr = m_calibration.Calibrate(m_pNuiSensor, cColorResolution, cDepthResolution);
+        if (SUCCEEDED(hr) && bHavePath)
+        {
+            // The calibration is still used for this run if it cannot be stored
+            m_calibration.Save(path);
         }
     }
 
-    m_pImmediateContext->Unmap(m_pColorTexture2D, NULL);
+    m_bUseCalibration = SUCCEEDED(hr);
 
     return hr;
 }
 
+/// <summary>
+/// Recalibrates against the sensor and shows how well the calibration matches it
+/// </summary>
+void CDepthWithColorD3D::Recalibrate()
+{
+    CDepthColorCalibration::Report report;
+    WCHAR message[512];
+
+    HRESULT hr = PrepareCalibration(true);
+    if (FAILED(hr))
+    {
+        StringCchPrintfW(message, _countof(message), L"Calibration failed (0x%08X), the sensor's mapping is used instead.", hr);
+        MessageBox(m_hWnd, message, L"Calibration", MB_ICONWARNING | MB_OK);
+        return;
+    }
+
+    hr = m_calibration.Evaluate(m_pNuiSensor, &report);
+    if (FAILED(hr))
+    {
+        StringCchPrintfW(message, _countof(message), L"Could not compare the calibration with the sensor's mapping (0x%08X).", hr);
+        MessageBox(m_hWnd, message, L"Calibration", MB_ICONWARNING | MB_OK);
+        return;
+    }
+
+    StringCchPrintfW(message, _countof(message),
+        L"Compared with the sensor's mapping at %u depth pixel samples:\n\n"
+        L"Exact: %.2f%%\nWithin one pixel: %.2f%%\nMean error: %.3f pixels\nMax error: %.3f pixels\n\n"
+        L"Time per frame: %.2f ms with the sensor, %.2f ms with the calibration",
+        report.sampleCount,
+        100.0 * report.exactCount / report.sampleCount,
+        100.0 * report.withinOnePixelCount / report.sampleCount,
+        report.meanError,
+        report.maxError,
+        report.sensorMilliseconds,
+        report.modelMilliseconds);
+    MessageBox(m_hWnd, message, L"Calibration", MB_ICONINFORMATION | MB_OK);
+}
+
+/// <summary>
+/// Gets the path of the calibration file, next to the executable
+/// </summary>
+/// <param name="pPath">buffer in which to return the path</param>
+/// <param name="pathSize">size of the buffer in characters</param>
+/// <returns>S_OK for success, or failure code</returns>
+HRESULT CDepthWithColorD3D::GetCalibrationPath(WCHAR* pPath, UINT pathSize)
+{
+    DWORD length = GetModuleFileNameW(NULL, pPath, pathSize);
+    if (0 == length || pathSize == length)
+    {
+        return E_FAIL;
+    }
+
+    // Replace the executable's name with the calibration file's
+    WCHAR* pFileName = wcsrchr(pPath, L'\\');
+    pFileName = (NULL != pFileName) ? pFileName + 1 : pPath;
+
+    return StringCchCopyW(pFileName, pathSize - (pFileName - pPath), g_calibrationFileName);
+}
+
 /// <summary>
 /// Renders a frame
 /// </summary>
@@ -830,7 +1040,14 @@ HRESULT CDepthWithColorD3D::Render()
 
     if (needToMapColorToDepth)
     {
-        MapColorToDepth();
+        if (m_bMapDepthToColor)
+        {
+            MapDepthToColor();
+        }
+        else
+        {
+            MapColorToDepth();
+        }
     }
 
     // Clear the back buffer
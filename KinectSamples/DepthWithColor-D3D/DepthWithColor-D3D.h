@@ -7,6 +7,8 @@
 #pragma once
 
 #include <windows.h>
+#include <malloc.h>
+#include <strsafe.h>
 
 // This file requires the installation of the DirectX SDK, a link for which is included in the Toolkit Browser
 #include <d3d11.h>
@@ -15,6 +17,8 @@
 #include "NuiApi.h"
 
 #include "Camera.h"
+#include "DepthColorCalibration.h"
+#include "DepthColorRegistration.h"
 #include "DX11Utils.h"
 #include "resource.h"
 
@@ -31,6 +35,7 @@ struct CBChangesEveryFrame
 class CDepthWithColorD3D
 {
     static const int                    cBytesPerPixel   = 4;
+    static const size_t                 cPixelBufferAlignment = 64;
 
     static const NUI_IMAGE_RESOLUTION   cDepthResolution = NUI_IMAGE_RESOLUTION_640x480;
     static const NUI_IMAGE_RESOLUTION   cColorResolution = NUI_IMAGE_RESOLUTION_640x480;
@@ -58,6 +63,13 @@ public:
     /// <returns>S_OK for success, or failure code</returns>
     HRESULT                             InitDevice();
 
+    /// <summary>
+    /// Loads the stored calibration, which needs no sensor, so depth can be mapped to color
+    /// with it before one is connected
+    /// </summary>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             LoadCalibration();
+
     /// <summary>
     /// Create the first connected Kinect found 
     /// </summary>
@@ -108,7 +120,13 @@ private:
     LONG                                m_colorWidth;
     LONG                                m_colorHeight;
 
-    LONG                                m_colorToDepthDivisor;
+    // Registers color frames to the depth frame, or depth frames to the color frame
+    CDepthColorRegistration             m_registration;
+    bool                                m_bMapDepthToColor;
+
+    // Maps depth pixels to color pixels without asking the sensor, when a calibration is available
+    CDepthColorCalibration              m_calibration;
+    bool                                m_bUseCalibration;
 
     float                               m_xyScale;
 
@@ -132,7 +150,8 @@ private:
     ID3D11ShaderResourceView*           m_pColorTextureRV;
     ID3D11SamplerState*                 m_pColorSampler;
 
-    // for mapping depth to color
+    // for mapping depth to color, all carved out of one aligned allocation
+    BYTE*                               m_pPixelData;
     USHORT*                             m_depthD16;
     BYTE*                               m_colorRGBX;
     LONG*                               m_colorCoordinates;
@@ -153,6 +172,13 @@ private:
     /// <returns>S_OK for success, or failure code</returns>
     HRESULT                             ToggleNearMode();
 
+    /// <summary>
+    /// Toggles between drawing a point per depth pixel, colored by the color registered to
+    /// depth, and a point per color pixel, placed by the depth registered to color.
+    /// Does nothing unless color and depth have the same resolution.
+    /// </summary>
+    void                                ToggleRegistration();
+
     /// <summary>
     /// Process depth data received from Kinect
     /// </summary>
@@ -171,6 +197,40 @@ private:
     /// <returns>S_OK on success, otherwise failure code</returns>
     HRESULT                             MapColorToDepth();
 
+    /// <summary>
+    /// Adjust depth to the same space as color
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                             MapDepthToColor();
+
+    /// <summary>
+    /// Gets the color pixel each depth pixel maps to, for the current depth frame
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                             MapColorCoordinates();
+
+    /// <summary>
+    /// Keeps the loaded calibration if it was fitted to the sensor, otherwise loads the stored
+    /// calibration of the sensor, or calibrates against the sensor and stores the result when
+    /// there is none
+    /// </summary>
+    /// <param name="bRecalibrate">calibrate even if a stored calibration exists</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             PrepareCalibration(bool bRecalibrate);
+
+    /// <summary>
+    /// Recalibrates against the sensor and shows how well the calibration matches it
+    /// </summary>
+    void                                Recalibrate();
+
+    /// <summary>
+    /// Gets the path of the calibration file, next to the executable
+    /// </summary>
+    /// <param name="pPath">buffer in which to return the path</param>
+    /// <param name="pathSize">size of the buffer in characters</param>
+    /// <returns>S_OK for success, or failure code</returns>
+    HRESULT                             GetCalibrationPath(WCHAR* pPath, UINT pathSize);
+
     /// <summary>
     /// Compile and set layout for shaders
     /// </summary>
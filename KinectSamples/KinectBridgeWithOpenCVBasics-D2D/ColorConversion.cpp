@@ -0,0 +1,246 @@
+//-----------------------------------------------------------------------------
+// <copyright file="ColorConversion.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "ColorConversion.h"
+#include "PixelKernels.h"
+#include <emmintrin.h>
+#include <string.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pixels converted per SSE2 step
+    const UINT PIXELS_PER_STEP = 16;
+
+    // Per-pixel kernels, which also convert what is left of a row after the SSE2 steps
+    typedef PixelKernel<BgrxPixelFormat, RgbaPixelFormat> RgbaKernel;
+    typedef PixelKernel<BgrxPixelFormat, BgrPixelFormat> BgrKernel;
+    typedef PixelKernel<BgrxPixelFormat, Gray8PixelFormat> GrayKernel;
+
+    /// <summary>
+    /// Converts BGRX pixels one at a time
+    /// </summary>
+    template <typename Destination>
+    void ConvertScalar(const BYTE* pSource, BYTE* pDestination, UINT pixelCount)
+    {
+        const UINT32* pIn = reinterpret_cast<const UINT32*>(pSource);
+        typename Destination::Element* pOut = reinterpret_cast<typename Destination::Element*>(pDestination);
+
+        for (UINT i = 0; i < pixelCount; ++i)
+        {
+            PixelKernel<BgrxPixelFormat, Destination>::Convert(pIn + i, pOut + i * Destination::ELEMENTS_PER_PIXEL);
+        }
+    }
+
+    /// <summary>
+    /// Swaps red and blue and sets alpha in four BGRX pixels
+    /// </summary>
+    inline __m128i BgrxToRgba(__m128i pixels)
+    {
+        const __m128i greenMask = _mm_set1_epi32(0x0000FF00);
+        const __m128i byteMask = _mm_set1_epi32(0x000000FF);
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+        __m128i green = _mm_and_si128(pixels, greenMask);
+        __m128i red = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+        __m128i blue = _mm_slli_epi32(_mm_and_si128(pixels, byteMask), 16);
+        return _mm_or_si128(_mm_or_si128(green, alpha), _mm_or_si128(red, blue));
+    }
+
+    /// <summary>
+    /// Packs four BGRX pixels into the low 12 bytes of the result as BGR
+    /// </summary>
+    inline __m128i BgrxToBgr(__m128i pixels)
+    {
+        const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i lowPixelMask = _mm_set_epi32(0, -1, 0, -1);
+        const __m128i lowLaneMask = _mm_set_epi32(0, 0, 0x0000FFFF, -1);
+        const __m128i highLaneMask = _mm_set_epi32(0, -1, static_cast<int>(0xFFFF0000), 0);
+
+        // Close the gap between the two pixels of each 64-bit lane, giving 6 bytes per lane
+        __m128i colors = _mm_and_si128(pixels, colorMask);
+        __m128i lanes = _mm_or_si128(_mm_and_si128(colors, lowPixelMask),
+            _mm_srli_epi64(_mm_andnot_si128(lowPixelMask, colors), 8));
+
+        // Then close the gap between the two lanes
+        return _mm_or_si128(_mm_and_si128(lanes, lowLaneMask), _mm_and_si128(_mm_srli_si128(lanes, 2), highLaneMask));
+    }
+
+    /// <summary>
+    /// Computes the luma of four BGRX pixels as 32-bit values
+    /// </summary>
+    inline __m128i BgrxToLuma(__m128i pixels)
+    {
+        const __m128i pairMask = _mm_set1_epi32(0x00FF00FF);
+        const __m128i blueRedWeights = _mm_set1_epi32((GrayKernel::RED_WEIGHT << 16) | GrayKernel::BLUE_WEIGHT);
+        const __m128i greenWeights = _mm_set1_epi32(GrayKernel::GREEN_WEIGHT);
+        const __m128i rounding = _mm_set1_epi32(128);
+
+        // Blue and red sit in the 16-bit halves of each pixel, as do green and the padding byte
+        __m128i blueRed = _mm_madd_epi16(_mm_and_si128(pixels, pairMask), blueRedWeights);
+        __m128i green = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(pixels, 8), pairMask), greenWeights);
+        return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(blueRed, green), rounding), 8);
+    }
+
+    /// <summary>
+    /// Converts BGRX pixels into RGBA, sixteen at a time
+    /// </summary>
+    void ConvertToRgba(const BYTE* pSource, BYTE* pDestination, UINT pixelCount)
+    {
+        UINT stepCount = pixelCount / PIXELS_PER_STEP;
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(pSource);
+        __m128i* pOut = reinterpret_cast<__m128i*>(pDestination);
+
+        for (UINT i = 0; i < stepCount; ++i, pIn += 4, pOut += 4)
+        {
+            _mm_storeu_si128(pOut + 0, BgrxToRgba(_mm_loadu_si128(pIn + 0)));
+            _mm_storeu_si128(pOut + 1, BgrxToRgba(_mm_loadu_si128(pIn + 1)));
+            _mm_storeu_si128(pOut + 2, BgrxToRgba(_mm_loadu_si128(pIn + 2)));
+            _mm_storeu_si128(pOut + 3, BgrxToRgba(_mm_loadu_si128(pIn + 3)));
+        }
+
+        UINT done = stepCount * PIXELS_PER_STEP;
+        ConvertScalar<RgbaPixelFormat>(pSource + done * 4, pDestination + done * 4, pixelCount - done);
+    }
+
+    /// <summary>
+    /// Converts BGRX pixels into BGR, sixteen at a time
+    /// </summary>
+    void ConvertToBgr(const BYTE* pSource, BYTE* pDestination, UINT pixelCount)
+    {
+        UINT stepCount = pixelCount / PIXELS_PER_STEP;
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(pSource);
+        BYTE* pOut = pDestination;
+
+        for (UINT i = 0; i < stepCount; ++i, pIn += 4)
+        {
+            for (int j = 0; j < 4; ++j, pOut += 12)
+            {
+                // Write the 12 packed bytes as 8 + 4, so nothing past the row is touched
+                __m128i packed = BgrxToBgr(_mm_loadu_si128(pIn + j));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut), packed);
+                int last = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+                memcpy(pOut + 8, &last, sizeof(last));
+            }
+        }
+
+        UINT done = stepCount * PIXELS_PER_STEP;
+        ConvertScalar<BgrPixelFormat>(pSource + done * 4, pDestination + done * 3, pixelCount - done);
+    }
+
+    /// <summary>
+    /// Converts BGRX pixels into gray, sixteen at a time
+    /// </summary>
+    void ConvertToGray(const BYTE* pSource, BYTE* pDestination, UINT pixelCount)
+    {
+        UINT stepCount = pixelCount / PIXELS_PER_STEP;
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(pSource);
+        __m128i* pOut = reinterpret_cast<__m128i*>(pDestination);
+
+        for (UINT i = 0; i < stepCount; ++i, pIn += 4, ++pOut)
+        {
+            // Luma is at most 255, so narrowing with saturation never clamps
+            __m128i low = _mm_packs_epi32(BgrxToLuma(_mm_loadu_si128(pIn + 0)), BgrxToLuma(_mm_loadu_si128(pIn + 1)));
+            __m128i high = _mm_packs_epi32(BgrxToLuma(_mm_loadu_si128(pIn + 2)), BgrxToLuma(_mm_loadu_si128(pIn + 3)));
+            _mm_storeu_si128(pOut, _mm_packus_epi16(low, high));
+        }
+
+        UINT done = stepCount * PIXELS_PER_STEP;
+        ConvertScalar<Gray8PixelFormat>(pSource + done * 4, pDestination + done, pixelCount - done);
+    }
+}
+
+/// <summary>
+/// Gets the number of bytes a pixel takes in the given format
+/// </summary>
+/// <param name="format">pixel format</param>
+/// <returns>bytes per pixel, or 0 if the format is not valid</returns>
+UINT Microsoft::KinectBridge::GetColorImageBytesPerPixel(ColorImageFormat format)
+{
+    switch (format)
+    {
+    case COLOR_IMAGE_FORMAT_BGRX:
+    case COLOR_IMAGE_FORMAT_RGBA:
+        return 4;
+    case COLOR_IMAGE_FORMAT_BGR:
+        return 3;
+    case COLOR_IMAGE_FORMAT_GRAY:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/// <summary>
+/// Converts a row of BGRX pixels into the given format. Sixteen pixels are converted
+/// per SSE2 step, and the remainder one at a time with the same arithmetic, so the
+/// result does not depend on the row length or alignment.
+/// </summary>
+/// <param name="pSource">BGRX pixels to convert</param>
+/// <param name="pDestination">buffer in which to return the converted pixels</param>
+/// <param name="pixelCount">number of pixels in the row</param>
+/// <param name="format">format to convert into</param>
+void Microsoft::KinectBridge::ConvertColorRow(const BYTE* pSource, BYTE* pDestination, UINT pixelCount, ColorImageFormat format)
+{
+    switch (format)
+    {
+    case COLOR_IMAGE_FORMAT_BGRX:
+        memcpy(pDestination, pSource, pixelCount * 4);
+        break;
+    case COLOR_IMAGE_FORMAT_RGBA:
+        ConvertToRgba(pSource, pDestination, pixelCount);
+        break;
+    case COLOR_IMAGE_FORMAT_BGR:
+        ConvertToBgr(pSource, pDestination, pixelCount);
+        break;
+    case COLOR_IMAGE_FORMAT_GRAY:
+        ConvertToGray(pSource, pDestination, pixelCount);
+        break;
+    }
+}
+
+/// <summary>
+/// Converts a BGRX image into the given format. When both images have no padding
+/// between rows the whole image is converted as a single row.
+/// </summary>
+/// <param name="pSource">BGRX pixels to convert</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pDestination">buffer in which to return the converted pixels</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="width">width of the image in pixels</param>
+/// <param name="height">height of the image in pixels</param>
+/// <param name="format">format to convert into</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::ConvertColorImage(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch,
+    UINT width, UINT height, ColorImageFormat format)
+{
+    if (!pSource || !pDestination)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the format is unknown or the rows would overlap
+    UINT bytesPerPixel = GetColorImageBytesPerPixel(format);
+    INT rowSize = static_cast<INT>(width * bytesPerPixel);
+    if (bytesPerPixel == 0 || sourcePitch < static_cast<INT>(width * 4) || destinationPitch < rowSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (sourcePitch == static_cast<INT>(width * 4) && destinationPitch == rowSize)
+    {
+        ConvertColorRow(pSource, pDestination, width * height, format);
+        return S_OK;
+    }
+
+    for (UINT y = 0; y < height; ++y)
+    {
+        ConvertColorRow(pSource + y * sourcePitch, pDestination + y * destinationPitch, width, format);
+    }
+
+    return S_OK;
+}
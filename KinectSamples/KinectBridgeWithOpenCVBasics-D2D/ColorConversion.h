@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// <copyright file="ColorConversion.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Pixel layouts a Kinect color frame can be converted into
+        /// </summary>
+        enum ColorImageFormat
+        {
+            // 4 bytes per pixel, exactly as the sensor captured it
+            COLOR_IMAGE_FORMAT_BGRX,
+
+            // 4 bytes per pixel with red first and an opaque alpha
+            COLOR_IMAGE_FORMAT_RGBA,
+
+            // 3 bytes per pixel, padding byte dropped
+            COLOR_IMAGE_FORMAT_BGR,
+
+            // 1 byte per pixel of luma, using the Rec. 601 weights
+            COLOR_IMAGE_FORMAT_GRAY,
+
+            COLOR_IMAGE_FORMAT_COUNT
+        };
+
+        /// <summary>
+        /// Gets the number of bytes a pixel takes in the given format
+        /// </summary>
+        /// <param name="format">pixel format</param>
+        /// <returns>bytes per pixel, or 0 if the format is not valid</returns>
+        UINT GetColorImageBytesPerPixel(ColorImageFormat format);
+
+        /// <summary>
+        /// Converts a row of BGRX pixels into the given format. Sixteen pixels are converted
+        /// per SSE2 step, and the remainder one at a time with the same arithmetic, so the
+        /// result does not depend on the row length or alignment.
+        /// </summary>
+        /// <param name="pSource">BGRX pixels to convert</param>
+        /// <param name="pDestination">buffer in which to return the converted pixels</param>
+        /// <param name="pixelCount">number of pixels in the row</param>
+        /// <param name="format">format to convert into</param>
+        void ConvertColorRow(const BYTE* pSource, BYTE* pDestination, UINT pixelCount, ColorImageFormat format);
+
+        /// <summary>
+        /// Converts a BGRX image into the given format. When both images have no padding
+        /// between rows the whole image is converted as a single row.
+        /// </summary>
+        /// <param name="pSource">BGRX pixels to convert</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">buffer in which to return the converted pixels</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <param name="width">width of the image in pixels</param>
+        /// <param name="height">height of the image in pixels</param>
+        /// <param name="format">format to convert into</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        HRESULT ConvertColorImage(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch,
+            UINT width, UINT height, ColorImageFormat format);
+    }
+}
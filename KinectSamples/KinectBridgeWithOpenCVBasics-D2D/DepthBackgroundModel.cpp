@@ -0,0 +1,529 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthBackgroundModel.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "DepthBackgroundModel.h"
+#include "DepthFilters.h"
+#include "PerformanceCounter.h"
+#include <emmintrin.h>
+#include <strsafe.h>
+
+using namespace cv;
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pixels updated per SSE2 step
+    const int PIXELS_PER_STEP = 8;
+
+    // Age at which a pixel is first tested against its background, and at which it stops counting
+    const BYTE MIN_TESTED_AGE = 2;
+    const BYTE MAX_AGE = 255;
+
+    // Frames a pixel stays foreground before its background is forgotten, so objects that
+    // stay still become background after about 5 seconds
+    const BYTE MAX_FOREGROUND_FRAMES = 150;
+
+    /// <summary>
+    /// Gets the variances of the sensor's depths at four depths
+    /// </summary>
+    inline __m128 GetSensorVariances(__m128 depths)
+    {
+        __m128 deviations = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(DEPTH_NOISE_COEFFICIENT), depths), depths);
+        return _mm_max_ps(_mm_mul_ps(deviations, deviations), _mm_set1_ps(MIN_DEPTH_VARIANCE));
+    }
+
+    /// <summary>
+    /// Picks the lanes of one value where a mask is set and of another where it is clear
+    /// </summary>
+    inline __m128 Select(__m128 mask, __m128 ifSet, __m128 ifClear)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, ifSet), _mm_andnot_ps(mask, ifClear));
+    }
+
+    inline __m128i Select(__m128i mask, __m128i ifSet, __m128i ifClear)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+    }
+
+    /// <summary>
+    /// Adds a depth to the model of a pixel and tests it against the background
+    /// </summary>
+    /// <returns>true if the depth is foreground, false otherwise</returns>
+    inline bool UpdatePixel(USHORT depth, float* pMean, float* pVariance, BYTE* pAge, BYTE* pForegroundFrames,
+        float learningRate, float thresholdSquared)
+    {
+        // Pixels without a depth are neither learned nor foreground
+        if (0 == depth || depth > MAX_FILTER_DEPTH)
+        {
+            return false;
+        }
+
+        float sample = static_cast<float>(depth);
+        float difference = sample - *pMean;
+        bool isForeground = *pAge >= MIN_TESTED_AGE &&
+            difference * difference > thresholdSquared * (*pVariance + GetSensorVariance(sample));
+
+        if (isForeground)
+        {
+            // Leave the background behind foreground as it is, and forget it once the
+            // foreground has stayed long enough to be learned in its place
+            if (++*pForegroundFrames >= MAX_FOREGROUND_FRAMES)
+            {
+                *pAge = 0;
+            }
+        }
+        else if (0 == *pAge)
+        {
+            *pMean = sample;
+            *pVariance = GetSensorVariance(sample);
+            *pAge = 1;
+            *pForegroundFrames = 0;
+        }
+        else
+        {
+            // Exponentially weighted mean and variance, updated in place. A pixel averages its
+            // first frames evenly, then settles at the learning rate.
+            float rate = max(1.0f / *pAge, learningRate);
+            float step = rate * difference;
+            *pMean += step;
+            *pVariance = (1.0f - rate) * (*pVariance + difference * step);
+            *pForegroundFrames = 0;
+            if (*pAge < MAX_AGE)
+            {
+                ++*pAge;
+            }
+        }
+
+        return isForeground;
+    }
+
+    // Half a step of pixels, as loaded for testing and learning
+    struct HalfStep
+    {
+        __m128 samples;
+        __m128 means;
+        __m128 variances;
+        __m128 sensorVariances;
+        __m128 differences;
+    };
+
+    /// <summary>
+    /// Loads half a step of pixels and tests their depths against their backgrounds
+    /// </summary>
+    /// <returns>mask of the lanes whose depths differ from their background by more than the threshold</returns>
+    inline __m128 TestHalfStep(__m128i depths, const float* pMeans, const float* pVariances, __m128 thresholdsSquared, HalfStep* pHalf)
+    {
+        pHalf->samples = _mm_cvtepi32_ps(depths);
+        pHalf->means = _mm_loadu_ps(pMeans);
+        pHalf->variances = _mm_loadu_ps(pVariances);
+        pHalf->sensorVariances = GetSensorVariances(pHalf->samples);
+        pHalf->differences = _mm_sub_ps(pHalf->samples, pHalf->means);
+
+        return _mm_cmpgt_ps(_mm_mul_ps(pHalf->differences, pHalf->differences),
+            _mm_mul_ps(thresholdsSquared, _mm_add_ps(pHalf->variances, pHalf->sensorVariances)));
+    }
+
+    /// <summary>
+    /// Learns the depths of half a step of pixels where they are background, and starts over where they are new
+    /// </summary>
+    inline void LearnHalfStep(const HalfStep& half, __m128i ages, __m128 learningRates, __m128i learnMask, __m128i startMask,
+        float* pMeans, float* pVariances)
+    {
+        // Lanes of age 0 divide by zero, but they start over rather than learn
+        __m128 rates = _mm_max_ps(_mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(ages)), learningRates);
+        __m128 steps = _mm_mul_ps(rates, half.differences);
+        __m128 learnedMeans = _mm_add_ps(half.means, steps);
+        __m128 learnedVariances = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), rates),
+            _mm_add_ps(half.variances, _mm_mul_ps(half.differences, steps)));
+
+        __m128 learn = _mm_castsi128_ps(learnMask);
+        __m128 start = _mm_castsi128_ps(startMask);
+        _mm_storeu_ps(pMeans, Select(learn, learnedMeans, Select(start, half.samples, half.means)));
+        _mm_storeu_ps(pVariances, Select(learn, learnedVariances, Select(start, half.sensorVariances, half.variances)));
+    }
+
+    /// <summary>
+    /// Updates the models of a step of pixels as UpdatePixel does, and writes their foreground mask if there is one
+    /// </summary>
+    /// <returns>bit i set if pixel i of the step is foreground</returns>
+    inline int UpdateStep(const USHORT* pDepths, float* pMeans, float* pVariances, BYTE* pAges, BYTE* pForegroundFrames,
+        BYTE* pMask, __m128 learningRates, __m128 thresholdsSquared)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        // Depths of at most MAX_FILTER_DEPTH are positive as signed 16-bit values, and larger ones are not valid
+        __m128i depths = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepths));
+        __m128i isValid = _mm_and_si128(_mm_cmpgt_epi16(depths, zero),
+            _mm_cmplt_epi16(depths, _mm_set1_epi16(MAX_FILTER_DEPTH + 1)));
+
+        __m128i ages = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pAges)), zero);
+        __m128i foregroundFrames = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pForegroundFrames)), zero);
+        __m128i isTested = _mm_and_si128(isValid, _mm_cmpgt_epi16(ages, _mm_set1_epi16(MIN_TESTED_AGE - 1)));
+        __m128i start = _mm_and_si128(isValid, _mm_cmpeq_epi16(ages, zero));
+
+        // Whether a pixel is foreground decides how it learns, so test both halves before learning
+        HalfStep low, high;
+        __m128 lowOutliers = TestHalfStep(_mm_unpacklo_epi16(depths, zero), pMeans, pVariances, thresholdsSquared, &low);
+        __m128 highOutliers = TestHalfStep(_mm_unpackhi_epi16(depths, zero), pMeans + 4, pVariances + 4, thresholdsSquared, &high);
+
+        __m128i outliers = _mm_packs_epi32(_mm_castps_si128(lowOutliers), _mm_castps_si128(highOutliers));
+        __m128i isForeground = _mm_and_si128(isTested, outliers);
+        __m128i learn = _mm_andnot_si128(_mm_or_si128(isForeground, start), isValid);
+
+        LearnHalfStep(low, _mm_unpacklo_epi16(ages, zero), learningRates, _mm_unpacklo_epi16(learn, learn), _mm_unpacklo_epi16(start, start),
+            pMeans, pVariances);
+        LearnHalfStep(high, _mm_unpackhi_epi16(ages, zero), learningRates, _mm_unpackhi_epi16(learn, learn), _mm_unpackhi_epi16(start, start),
+            pMeans + 4, pVariances + 4);
+
+        // Foreground counts its frames, and valid background starts counting again
+        foregroundFrames = Select(isForeground, _mm_sub_epi16(foregroundFrames, isForeground), _mm_andnot_si128(isValid, foregroundFrames));
+
+        // Learning ages a pixel up to MAX_AGE, starting makes it 1, and staying foreground too long makes it 0
+        ages = _mm_min_epi16(_mm_sub_epi16(ages, learn), _mm_set1_epi16(MAX_AGE));
+        ages = Select(start, _mm_set1_epi16(1), ages);
+        ages = _mm_andnot_si128(_mm_and_si128(isForeground, _mm_cmpgt_epi16(foregroundFrames, _mm_set1_epi16(MAX_FOREGROUND_FRAMES - 1))), ages);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pAges), _mm_packus_epi16(ages, zero));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pForegroundFrames), _mm_packus_epi16(foregroundFrames, zero));
+
+        __m128i foregroundBytes = _mm_packs_epi16(isForeground, zero);
+        if (pMask)
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pMask), foregroundBytes);
+        }
+
+        return _mm_movemask_epi8(foregroundBytes);
+    }
+}
+
+const float DepthBackgroundModel::DEFAULT_LEARNING_RATE = 0.02f;
+const float DepthBackgroundModel::DEFAULT_THRESHOLD_DEVIATIONS = 4.0f;
+
+/// <summary>
+/// Constructor
+/// </summary>
+DepthBackgroundModel::DepthBackgroundModel() :
+    m_learningRate(DEFAULT_LEARNING_RATE),
+    m_thresholdDeviations(DEFAULT_THRESHOLD_DEVIATIONS),
+    m_width(0),
+    m_height(0),
+    m_tileColumns(0),
+    m_tileRows(0),
+    m_lastRegionShare(0.0),
+    m_frameCount(0),
+    m_pixelCount(0),
+    m_foregroundPixelCount(0),
+    m_regionPixelCount(0),
+    m_totalTicks(0)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_ticksPerSecond = frequency.QuadPart;
+}
+
+/// <summary>
+/// Sets the share of each frame the background mean and variance learn
+/// </summary>
+/// <param name="learningRate">learning rate, above 0 and at most 1</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the rate is out of range</returns>
+HRESULT DepthBackgroundModel::SetLearningRate(float learningRate)
+{
+    if (!(learningRate > 0.0f && learningRate <= 1.0f))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_learningRate = learningRate;
+    return S_OK;
+}
+
+/// <summary>
+/// Sets the distance from the background, in standard deviations, at which a pixel is foreground
+/// </summary>
+/// <param name="deviations">threshold in standard deviations, above 0</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the threshold is out of range</returns>
+HRESULT DepthBackgroundModel::SetThreshold(float deviations)
+{
+    if (!(deviations > 0.0f))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_thresholdDeviations = deviations;
+    return S_OK;
+}
+
+/// <summary>
+/// Forgets the background, so it is learned again from the next frame
+/// </summary>
+void DepthBackgroundModel::Reset()
+{
+    if (!m_ages.empty())
+    {
+        ZeroMemory(&m_ages[0], m_ages.size());
+    }
+}
+
+/// <summary>
+/// Adds a frame to the model and finds its foreground
+/// </summary>
+/// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+/// <param name="pForegroundMask">pointer in which to return 255 for foreground pixels and 0 for the others, of type CV_8U, or NULL</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the depth image is not valid, an error code otherwise</returns>
+HRESULT DepthBackgroundModel::Update(const Mat& depthImage, Mat* pForegroundMask)
+{
+    if (depthImage.empty() || depthImage.type() != CV_16U)
+    {
+        return E_INVALIDARG;
+    }
+
+    LONGLONG startTicks = GetTicks();
+
+    if (pForegroundMask && (pForegroundMask->size() != depthImage.size() || pForegroundMask->type() != CV_8U))
+    {
+        pForegroundMask->create(depthImage.size(), CV_8U);
+    }
+
+    PrepareModel(depthImage.cols, depthImage.rows);
+
+    const float thresholdSquared = m_thresholdDeviations * m_thresholdDeviations;
+    const __m128 learningRates = _mm_set1_ps(m_learningRate);
+    const __m128 thresholdsSquared = _mm_set1_ps(thresholdSquared);
+    LONGLONG foregroundPixelCount = 0;
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        const USHORT* pDepthRow = depthImage.ptr<USHORT>(y);
+        BYTE* pMaskRow = pForegroundMask ? pForegroundMask->ptr<BYTE>(y) : NULL;
+        size_t rowOffset = static_cast<size_t>(y) * m_width;
+        float* pMeans = &m_means[rowOffset];
+        float* pVariances = &m_variances[rowOffset];
+        BYTE* pAges = &m_ages[rowOffset];
+        BYTE* pForegroundFrames = &m_foregroundFrames[rowOffset];
+        int tileIndex = (y / TILE_SIZE) * m_tileColumns;
+
+        // Walk the row one tile at a time, so each tile's counts and bounds are updated once per row
+        for (int tileLeft = 0; tileLeft < m_width; tileLeft += TILE_SIZE, ++tileIndex)
+        {
+            int tileRight = min(tileLeft + TILE_SIZE, m_width);
+            int count = 0;
+            int left = 0;
+            int right = 0;
+            int x = tileLeft;
+
+            for (; x + PIXELS_PER_STEP <= tileRight; x += PIXELS_PER_STEP)
+            {
+                int foregroundBits = UpdateStep(pDepthRow + x, pMeans + x, pVariances + x, pAges + x, pForegroundFrames + x,
+                    pMaskRow ? pMaskRow + x : NULL, learningRates, thresholdsSquared);
+
+                // Foreground is rare, so its pixels are gathered one at a time
+                for (int i = 0; foregroundBits != 0; ++i, foregroundBits >>= 1)
+                {
+                    if (foregroundBits & 1)
+                    {
+                        if (0 == count)
+                        {
+                            left = x + i;
+                        }
+
+                        right = x + i + 1;
+                        ++count;
+                    }
+                }
+            }
+
+            for (; x < tileRight; ++x)
+            {
+                bool isForeground = UpdatePixel(pDepthRow[x], pMeans + x, pVariances + x, pAges + x, pForegroundFrames + x,
+                    m_learningRate, thresholdSquared);
+
+                if (isForeground)
+                {
+                    if (0 == count)
+                    {
+                        left = x;
+                    }
+
+                    right = x + 1;
+                    ++count;
+                }
+
+                if (pMaskRow)
+                {
+                    pMaskRow[x] = isForeground ? 255 : 0;
+                }
+            }
+
+            if (count > 0)
+            {
+                RECT& bounds = m_tileBounds[tileIndex];
+                if (0 == m_tileCounts[tileIndex])
+                {
+                    bounds.left = left;
+                    bounds.top = y;
+                    bounds.right = right;
+                }
+                else
+                {
+                    bounds.left = min(bounds.left, static_cast<LONG>(left));
+                    bounds.right = max(bounds.right, static_cast<LONG>(right));
+                }
+
+                bounds.bottom = y + 1;
+                m_tileCounts[tileIndex] = static_cast<USHORT>(m_tileCounts[tileIndex] + count);
+                foregroundPixelCount += count;
+            }
+        }
+    }
+
+    FindForegroundRegions();
+
+    LONGLONG pixelCount = static_cast<LONGLONG>(m_width) * m_height;
+    LONGLONG regionPixelCount = 0;
+    for (size_t i = 0; i < m_foregroundRegions.size(); ++i)
+    {
+        regionPixelCount += m_foregroundRegions[i].area();
+    }
+
+    m_lastRegionShare = static_cast<double>(regionPixelCount) / pixelCount;
+
+    m_totalTicks += GetTicks() - startTicks;
+    m_foregroundPixelCount += foregroundPixelCount;
+    m_regionPixelCount += regionPixelCount;
+    m_pixelCount += pixelCount;
+    ++m_frameCount;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the frame count, the mean share of foreground pixels and of the pixels in the
+/// foreground regions, which is the share of work restricted stages do, and the mean
+/// time per frame to the debugger output
+/// </summary>
+/// <param name="modelName">name of the model to write before the figures</param>
+void DepthBackgroundModel::Report(LPCWSTR modelName) const
+{
+    if (0 == m_frameCount)
+    {
+        return;
+    }
+
+    WCHAR line[256];
+    StringCchPrintf(line, _countof(line), L"KinectBridge background model %s: n=%I64d foreground=%.2f%% of pixels regions=%.2f%% of pixels mean=%.1f microseconds\n",
+        modelName, m_frameCount, 100.0 * m_foregroundPixelCount / m_pixelCount,
+        100.0 * m_regionPixelCount / m_pixelCount,
+        1000000.0 * m_totalTicks / m_ticksPerSecond / m_frameCount);
+    OutputDebugString(line);
+}
+
+/// <summary>
+/// Sizes the model and tiles for a resolution, forgetting the model if it is not already that size
+/// </summary>
+/// <param name="width">width of the frames in pixels</param>
+/// <param name="height">height of the frames in pixels</param>
+void DepthBackgroundModel::PrepareModel(int width, int height)
+{
+    if (width != m_width || height != m_height)
+    {
+        size_t pixelCount = static_cast<size_t>(width) * height;
+        m_means.assign(pixelCount, 0.0f);
+        m_variances.assign(pixelCount, 0.0f);
+        m_ages.assign(pixelCount, 0);
+        m_foregroundFrames.assign(pixelCount, 0);
+
+        m_width = width;
+        m_height = height;
+        m_tileColumns = (width + TILE_SIZE - 1) / TILE_SIZE;
+        m_tileRows = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+        size_t tileCount = static_cast<size_t>(m_tileColumns) * m_tileRows;
+        m_tileBounds.resize(tileCount);
+        m_tileVisited.resize(tileCount);
+        m_tileStack.reserve(tileCount);
+        m_tileCounts.resize(tileCount);
+    }
+
+    ZeroMemory(&m_tileCounts[0], m_tileCounts.size() * sizeof(USHORT));
+}
+
+/// <summary>
+/// Gathers the foreground tiles into bounding boxes and work regions
+/// </summary>
+void DepthBackgroundModel::FindForegroundRegions()
+{
+    m_foregroundBoxes.clear();
+    m_foregroundRegions.clear();
+    ZeroMemory(&m_tileVisited[0], m_tileVisited.size());
+
+    // One region per run of foreground tiles along each row of tiles
+    for (int tileY = 0; tileY < m_tileRows; ++tileY)
+    {
+        const USHORT* pCounts = &m_tileCounts[tileY * m_tileColumns];
+        int top = tileY * TILE_SIZE;
+        int bottom = min(top + TILE_SIZE, m_height);
+
+        for (int tileX = 0; tileX < m_tileColumns; ++tileX)
+        {
+            if (pCounts[tileX] < MIN_TILE_FOREGROUND_PIXELS)
+            {
+                continue;
+            }
+
+            int firstTileX = tileX;
+            while (tileX + 1 < m_tileColumns && pCounts[tileX + 1] >= MIN_TILE_FOREGROUND_PIXELS)
+            {
+                ++tileX;
+            }
+
+            int left = firstTileX * TILE_SIZE;
+            int right = min((tileX + 1) * TILE_SIZE, m_width);
+            m_foregroundRegions.push_back(Rect(left, top, right - left, bottom - top));
+        }
+    }
+
+    // One box per group of foreground tiles touching at an edge or corner, bounding their foreground pixels
+    for (int start = 0; start < static_cast<int>(m_tileCounts.size()); ++start)
+    {
+        if (m_tileVisited[start] || m_tileCounts[start] < MIN_TILE_FOREGROUND_PIXELS)
+        {
+            continue;
+        }
+
+        RECT box = m_tileBounds[start];
+        m_tileVisited[start] = 1;
+        m_tileStack.push_back(start);
+
+        while (!m_tileStack.empty())
+        {
+            int tile = m_tileStack.back();
+            m_tileStack.pop_back();
+
+            const RECT& bounds = m_tileBounds[tile];
+            box.left = min(box.left, bounds.left);
+            box.top = min(box.top, bounds.top);
+            box.right = max(box.right, bounds.right);
+            box.bottom = max(box.bottom, bounds.bottom);
+
+            int tileX = tile % m_tileColumns;
+            int tileY = tile / m_tileColumns;
+            for (int neighborY = max(tileY - 1, 0); neighborY <= min(tileY + 1, m_tileRows - 1); ++neighborY)
+            {
+                for (int neighborX = max(tileX - 1, 0); neighborX <= min(tileX + 1, m_tileColumns - 1); ++neighborX)
+                {
+                    int neighbor = neighborY * m_tileColumns + neighborX;
+                    if (!m_tileVisited[neighbor] && m_tileCounts[neighbor] >= MIN_TILE_FOREGROUND_PIXELS)
+                    {
+                        m_tileVisited[neighbor] = 1;
+                        m_tileStack.push_back(neighbor);
+                    }
+                }
+            }
+        }
+
+        m_foregroundBoxes.push_back(Rect(box.left, box.top, box.right - box.left, box.bottom - box.top));
+    }
+}
@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthBackgroundModel.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+// Suppress warnings that come from compiling OpenCV code since we have no control over it
+#pragma warning(push)
+#pragma warning(disable : 6294 6031)
+#include <opencv2/core/core.hpp>
+#pragma warning(pop)
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Learns the static background of a depth stream and finds what stands in front of it.
+        /// Each pixel keeps a running mean and variance of its depth, learned at a set rate, and is
+        /// foreground when its depth is further from the mean than its own noise and the sensor's
+        /// would explain. Foreground depths are not learned, so moving objects leave no trails, but
+        /// a pixel that stays foreground long enough becomes background at its new depth.
+        /// Foreground pixels are gathered into tiles, so later stages can restrict
+        /// their work to the foreground tiles, and into tight bounding boxes of the connected
+        /// foreground tiles. The model is kept from frame to frame and only reallocated when the
+        /// resolution changes. Not safe to use from several threads at once.
+        /// </summary>
+        class DepthBackgroundModel
+        {
+        public:
+            // Constants:
+            // Width and height of a tile in pixels. Work regions start on tile boundaries, so
+            // stages may rely on their left edge being a multiple of it.
+            static const int TILE_SIZE = 16;
+
+            // Foreground pixels a tile needs to count as foreground, so stray pixels of noise do not
+            static const int MIN_TILE_FOREGROUND_PIXELS = 8;
+
+            // Learning rate and threshold used until they are set
+            static const float DEFAULT_LEARNING_RATE;
+            static const float DEFAULT_THRESHOLD_DEVIATIONS;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            DepthBackgroundModel();
+
+            /// <summary>
+            /// Sets the share of each frame the background mean and variance learn
+            /// </summary>
+            /// <param name="learningRate">learning rate, above 0 and at most 1</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the rate is out of range</returns>
+            HRESULT SetLearningRate(float learningRate);
+
+            /// <summary>
+            /// Sets the distance from the background, in standard deviations, at which a pixel is foreground
+            /// </summary>
+            /// <param name="deviations">threshold in standard deviations, above 0</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the threshold is out of range</returns>
+            HRESULT SetThreshold(float deviations);
+
+            /// <summary>
+            /// Forgets the background, so it is learned again from the next frame
+            /// </summary>
+            void Reset();
+
+            /// <summary>
+            /// Adds a frame to the model and finds its foreground
+            /// </summary>
+            /// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+            /// <param name="pForegroundMask">pointer in which to return 255 for foreground pixels and 0 for the others, of type CV_8U, or NULL</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the depth image is not valid, an error code otherwise</returns>
+            HRESULT Update(const cv::Mat& depthImage, cv::Mat* pForegroundMask);
+
+            /// <summary>
+            /// Gets the tight bounding boxes of the groups of connected foreground tiles in the last frame
+            /// </summary>
+            /// <returns>bounding boxes in pixels</returns>
+            const std::vector<cv::Rect>& GetForegroundBoxes() const { return m_foregroundBoxes; }
+
+            /// <summary>
+            /// Gets the regions later stages need to process to cover the foreground tiles of the
+            /// last frame: one per run of foreground tiles along a row of tiles, clipped to the frame
+            /// </summary>
+            /// <returns>regions in pixels, which start on tile boundaries and do not overlap</returns>
+            const std::vector<cv::Rect>& GetForegroundRegions() const { return m_foregroundRegions; }
+
+            /// <summary>
+            /// Gets the share of the last frame's pixels the foreground regions cover
+            /// </summary>
+            /// <returns>share from 0 to 1</returns>
+            double GetForegroundRegionShare() const { return m_lastRegionShare; }
+
+            /// <summary>
+            /// Writes the frame count, the mean share of foreground pixels and of the pixels in the
+            /// foreground regions, which is the share of work restricted stages do, and the mean
+            /// time per frame to the debugger output
+            /// </summary>
+            /// <param name="modelName">name of the model to write before the figures</param>
+            void Report(LPCWSTR modelName) const;
+
+        private:
+            // Functions:
+            /// <summary>
+            /// Sizes the model and tiles for a resolution, forgetting the model if it is not already that size
+            /// </summary>
+            /// <param name="width">width of the frames in pixels</param>
+            /// <param name="height">height of the frames in pixels</param>
+            void PrepareModel(int width, int height);
+
+            /// <summary>
+            /// Gathers the foreground tiles into bounding boxes and work regions
+            /// </summary>
+            void FindForegroundRegions();
+
+            // Variables:
+            float m_learningRate;
+            float m_thresholdDeviations;
+
+            // Model of each pixel: mean and variance of its background depth in millimeters, frames
+            // it has been learned over, up to 255 (0 for none), and frames it has been foreground for
+            std::vector<float> m_means;
+            std::vector<float> m_variances;
+            std::vector<BYTE> m_ages;
+            std::vector<BYTE> m_foregroundFrames;
+
+            // Size of the frames and of the tile grid
+            int m_width;
+            int m_height;
+            int m_tileColumns;
+            int m_tileRows;
+
+            // Foreground pixel count of each tile, and the bounds of its foreground pixels
+            std::vector<USHORT> m_tileCounts;
+            std::vector<RECT> m_tileBounds;
+
+            // Tiles whose neighbors are yet to be gathered into the current box; each is pushed once
+            std::vector<int> m_tileStack;
+            std::vector<BYTE> m_tileVisited;
+
+            // Boxes and regions of the last frame, and the share of its pixels the regions cover
+            std::vector<cv::Rect> m_foregroundBoxes;
+            std::vector<cv::Rect> m_foregroundRegions;
+            double m_lastRegionShare;
+
+            // Figures for Report
+            LONGLONG m_frameCount;
+            LONGLONG m_pixelCount;
+            LONGLONG m_foregroundPixelCount;
+            LONGLONG m_regionPixelCount;
+            LONGLONG m_totalTicks;
+            LONGLONG m_ticksPerSecond;
+        };
+    }
+}
@@ -0,0 +1,399 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthColorizer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "DepthColorizer.h"
+#include <new>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pixel value the sensor uses for pixels it has no depth for
+    const USHORT INVALID_DEPTH_PIXEL = 0xFFFF;
+
+    // Largest depth a packed pixel can hold, in millimeters
+    const USHORT MAX_PACKED_DEPTH = 0xFFFF >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+
+    /// <summary>
+    /// Packs a color the way OpenCVFrameHelper lays out depth images, red first with an alpha of 1
+    /// </summary>
+    inline DWORD PackColor(BYTE red, BYTE green, BYTE blue)
+    {
+        return red | (green << 8) | (blue << 16) | (1 << 24);
+    }
+}
+
+/// <summary>
+/// Constructor. Starts with DEPTH_PALETTE_PLAYERS and the default depth range.
+/// </summary>
+DepthColorizer::DepthColorizer() :
+    m_palette(DEPTH_PALETTE_PLAYERS),
+    m_nearDepth(DEFAULT_NEAR_DEPTH),
+    m_farDepth(DEFAULT_FAR_DEPTH),
+    m_pTable(NULL),
+    m_isTableStale(true)
+{
+    InitializeSRWLock(&m_lock);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+DepthColorizer::~DepthColorizer()
+{
+    delete [] m_pTable;
+}
+
+/// <summary>
+/// Switches to a palette
+/// </summary>
+/// <param name="palette">palette to use</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the palette is unknown</returns>
+HRESULT DepthColorizer::SetPalette(DepthPalette palette)
+{
+    if (palette < 0 || palette >= DEPTH_PALETTE_COUNT)
+    {
+        return E_INVALIDARG;
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+    if (palette != m_palette)
+    {
+        m_palette = palette;
+        m_isTableStale = true;
+    }
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the palette in use
+/// </summary>
+/// <returns>palette in use</returns>
+DepthPalette DepthColorizer::GetPalette() const
+{
+    AcquireSRWLockShared(&m_lock);
+    DepthPalette palette = m_palette;
+    ReleaseSRWLockShared(&m_lock);
+
+    return palette;
+}
+
+/// <summary>
+/// Sets the depths the palette is stretched over. Nearer depths are drawn as the
+/// near depth, farther ones as the far depth.
+/// </summary>
+/// <param name="nearDepth">nearest depth in millimeters</param>
+/// <param name="farDepth">farthest depth in millimeters</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the range is empty or beyond the sensor's</returns>
+HRESULT DepthColorizer::SetDepthRange(USHORT nearDepth, USHORT farDepth)
+{
+    if (nearDepth >= farDepth || farDepth > MAX_PACKED_DEPTH)
+    {
+        return E_INVALIDARG;
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+    if (nearDepth != m_nearDepth || farDepth != m_farDepth)
+    {
+        m_nearDepth = nearDepth;
+        m_farDepth = farDepth;
+        m_isTableStale = true;
+    }
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the depths the palette is stretched over
+/// </summary>
+/// <param name="pNearDepth">pointer in which to return the nearest depth in millimeters</param>
+/// <param name="pFarDepth">pointer in which to return the farthest depth in millimeters</param>
+void DepthColorizer::GetDepthRange(USHORT* pNearDepth, USHORT* pFarDepth) const
+{
+    AcquireSRWLockShared(&m_lock);
+    *pNearDepth = m_nearDepth;
+    *pFarDepth = m_farDepth;
+    ReleaseSRWLockShared(&m_lock);
+}
+
+/// <summary>
+/// Converts a packed depth image into colors. When both images have no padding
+/// between rows the whole image is converted as a single row.
+/// </summary>
+/// <param name="pSource">packed depth pixels to convert</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pDestination">buffer in which to return the colors</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="width">width of the image in pixels</param>
+/// <param name="height">height of the image in pixels</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT DepthColorizer::Colorize(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch,
+    UINT width, UINT height) const
+{
+    HRESULT hr = LockTable();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    hr = ColorizeLocked(pSource, sourcePitch, pDestination, destinationPitch, width, height);
+    UnlockTable();
+
+    return hr;
+}
+
+/// <summary>
+/// Converts a plane of depths in millimeters and a plane of player indices into colors,
+/// as if they had been packed into depth pixels. Depths the packed pixels cannot hold
+/// are drawn as invalid.
+/// </summary>
+/// <param name="pDepth">depths to convert</param>
+/// <param name="depthPitch">bytes between the starts of depth rows</param>
+/// <param name="pPlayers">player indices to convert</param>
+/// <param name="playersPitch">bytes between the starts of player index rows</param>
+/// <param name="pDestination">buffer in which to return the colors</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="width">width of the image in pixels</param>
+/// <param name="height">height of the image in pixels</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT DepthColorizer::ColorizePlanes(const BYTE* pDepth, INT depthPitch, const BYTE* pPlayers, INT playersPitch,
+    BYTE* pDestination, INT destinationPitch, UINT width, UINT height) const
+{
+    HRESULT hr = LockTable();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    hr = ColorizePlanesLocked(pDepth, depthPitch, pPlayers, playersPitch, pDestination, destinationPitch, width, height);
+    UnlockTable();
+
+    return hr;
+}
+
+/// <summary>
+/// Brings the table up to date and keeps the palette and depth range from changing
+/// until UnlockTable is called. Must not be called again before then on the same thread.
+/// </summary>
+/// <returns>S_OK if successful, in which case the caller must call UnlockTable, an error code otherwise</returns>
+HRESULT DepthColorizer::LockTable() const
+{
+    AcquireSRWLockShared(&m_lock);
+    while (m_isTableStale)
+    {
+        ReleaseSRWLockShared(&m_lock);
+
+        AcquireSRWLockExclusive(&m_lock);
+        HRESULT hr = m_isTableStale ? BuildTable() : S_OK;
+        ReleaseSRWLockExclusive(&m_lock);
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        AcquireSRWLockShared(&m_lock);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Lets the palette and depth range change again after LockTable
+/// </summary>
+void DepthColorizer::UnlockTable() const
+{
+    ReleaseSRWLockShared(&m_lock);
+}
+
+/// <summary>
+/// Converts a packed depth image into colors, like Colorize, while the table is locked
+/// with LockTable. May be called from any thread.
+/// </summary>
+/// <param name="pSource">packed depth pixels to convert</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pDestination">buffer in which to return the colors</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="width">width of the image in pixels</param>
+/// <param name="height">height of the image in pixels</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT DepthColorizer::ColorizeLocked(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch,
+    UINT width, UINT height) const
+{
+    if (!pSource || !pDestination)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the rows would overlap
+    INT sourceRowSize = static_cast<INT>(width * sizeof(USHORT));
+    INT destinationRowSize = static_cast<INT>(width * sizeof(DWORD));
+    if (sourcePitch < sourceRowSize || destinationPitch < destinationRowSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Treat an image without padding as one long row
+    if (sourcePitch == sourceRowSize && destinationPitch == destinationRowSize)
+    {
+        width *= height;
+        height = 1;
+    }
+
+    const DWORD* pTable = m_pTable;
+    for (UINT y = 0; y < height; ++y)
+    {
+        const USHORT* pSourceRow = reinterpret_cast<const USHORT*>(pSource + y * sourcePitch);
+        DWORD* pDestinationRow = reinterpret_cast<DWORD*>(pDestination + y * destinationPitch);
+
+        for (UINT x = 0; x < width; ++x)
+        {
+            pDestinationRow[x] = pTable[pSourceRow[x]];
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Converts a plane of depths in millimeters and a plane of player indices into colors,
+/// like ColorizePlanes, while the table is locked with LockTable. May be called from any thread.
+/// </summary>
+/// <param name="pDepth">depths to convert</param>
+/// <param name="depthPitch">bytes between the starts of depth rows</param>
+/// <param name="pPlayers">player indices to convert</param>
+/// <param name="playersPitch">bytes between the starts of player index rows</param>
+/// <param name="pDestination">buffer in which to return the colors</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="width">width of the image in pixels</param>
+/// <param name="height">height of the image in pixels</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT DepthColorizer::ColorizePlanesLocked(const BYTE* pDepth, INT depthPitch, const BYTE* pPlayers, INT playersPitch,
+    BYTE* pDestination, INT destinationPitch, UINT width, UINT height) const
+{
+    if (!pDepth || !pPlayers || !pDestination)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the rows would overlap
+    if (depthPitch < static_cast<INT>(width * sizeof(USHORT)) || playersPitch < static_cast<INT>(width) ||
+        destinationPitch < static_cast<INT>(width * sizeof(DWORD)))
+    {
+        return E_INVALIDARG;
+    }
+
+    const DWORD* pTable = m_pTable;
+    for (UINT y = 0; y < height; ++y)
+    {
+        const USHORT* pDepthRow = reinterpret_cast<const USHORT*>(pDepth + y * depthPitch);
+        const BYTE* pPlayersRow = pPlayers + y * playersPitch;
+        DWORD* pDestinationRow = reinterpret_cast<DWORD*>(pDestination + y * destinationPitch);
+
+        for (UINT x = 0; x < width; ++x)
+        {
+            USHORT depth = pDepthRow[x];
+            USHORT pixel = depth > MAX_PACKED_DEPTH ? INVALID_DEPTH_PIXEL :
+                static_cast<USHORT>((depth << NUI_IMAGE_PLAYER_INDEX_SHIFT) | (pPlayersRow[x] & NUI_IMAGE_PLAYER_INDEX_MASK));
+            pDestinationRow[x] = pTable[pixel];
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Fills the table for the current palette and depth range. Called with m_lock held exclusively.
+/// </summary>
+/// <returns>S_OK if successful, E_OUTOFMEMORY if the table could not be allocated</returns>
+HRESULT DepthColorizer::BuildTable() const
+{
+    if (!m_pTable)
+    {
+        m_pTable = new (std::nothrow) DWORD[TABLE_SIZE];
+        if (!m_pTable)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    for (UINT pixel = 0; pixel < TABLE_SIZE; ++pixel)
+    {
+        m_pTable[pixel] = ColorizePixel(static_cast<USHORT>(pixel));
+    }
+
+    m_isTableStale = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Computes the color of a packed depth pixel
+/// </summary>
+/// <param name="pixel">packed depth pixel</param>
+/// <returns>color, red in the lowest byte</returns>
+DWORD DepthColorizer::ColorizePixel(USHORT pixel) const
+{
+    if (pixel == INVALID_DEPTH_PIXEL)
+    {
+        return 0;
+    }
+
+    USHORT realDepth = NuiDepthPixelToDepth(pixel);
+    USHORT playerIndex = NuiDepthPixelToPlayerIndex(pixel);
+
+    // Position of the depth within the range, from 0 at the near end to 255 at the far end
+    UINT position = 0;
+    if (realDepth > m_nearDepth)
+    {
+        position = min(255u, 256u * (realDepth - m_nearDepth) / (m_farDepth - m_nearDepth));
+    }
+
+    // Convert depth info into an intensity for display
+    BYTE b = static_cast<BYTE>(255 - position);
+
+    switch (m_palette)
+    {
+    case DEPTH_PALETTE_GRAYSCALE:
+        return realDepth == 0 ? PackColor(0, 0, 0) : PackColor(b, b, b);
+
+    case DEPTH_PALETTE_RAINBOW:
+        {
+            if (realDepth == 0)
+            {
+                return PackColor(0, 0, 0);
+            }
+
+            BYTE middle = static_cast<BYTE>(255 - (position < 128 ? 127 - position : position - 128) * 2);
+            return PackColor(b, middle, static_cast<BYTE>(position));
+        }
+
+    default:
+        // Color the output based on the player index
+        switch (playerIndex)
+        {
+        case 0:
+            return PackColor(b / 2, b / 2, b / 2);
+        case 1:
+            return PackColor(b, 0, 0);
+        case 2:
+            return PackColor(0, b, 0);
+        case 3:
+            return PackColor(b / 4, b, b);
+        case 4:
+            return PackColor(b, b, b / 4);
+        case 5:
+            return PackColor(b, b / 4, b);
+        case 6:
+            return PackColor(b / 2, b / 2, b);
+        default:
+            return PackColor(255 - (b / 2), 255 - (b / 2), 255 - (b / 2));
+        }
+    }
+}
@@ -0,0 +1,198 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthColorizer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Color schemes depth frames can be drawn with
+        /// </summary>
+        enum DepthPalette
+        {
+            // Gray by distance, tinted by player index
+            DEPTH_PALETTE_PLAYERS,
+
+            // Gray by distance, players ignored
+            DEPTH_PALETTE_GRAYSCALE,
+
+            // Red for near through green to blue for far, players ignored
+            DEPTH_PALETTE_RAINBOW,
+
+            DEPTH_PALETTE_COUNT
+        };
+
+        /// <summary>
+        /// Converts packed depth pixels into 4-byte colors through a table with an entry for
+        /// every possible 16-bit pixel, so a pixel costs one lookup no matter how its depth and
+        /// player index are decoded. The table is rebuilt on the first conversion after the
+        /// palette or depth range changes. Colors are stored red first with an alpha of 1, and
+        /// pixels the sensor marked invalid become 0. Settings may be changed from any thread
+        /// while frames are converted, and several threads may convert at once. To convert an
+        /// image in bands on several threads, lock the table once around all the bands and
+        /// convert each band with the Locked functions, so every band uses the same palette.
+        /// </summary>
+        class DepthColorizer
+        {
+        public:
+            // Constants:
+            // Depth range, in millimeters, used until SetDepthRange is called
+            static const USHORT DEFAULT_NEAR_DEPTH = 0;
+            static const USHORT DEFAULT_FAR_DEPTH = 0x0fff;
+
+            // Functions:
+            /// <summary>
+            /// Constructor. Starts with DEPTH_PALETTE_PLAYERS and the default depth range.
+            /// </summary>
+            DepthColorizer();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~DepthColorizer();
+
+            /// <summary>
+            /// Switches to a palette
+            /// </summary>
+            /// <param name="palette">palette to use</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the palette is unknown</returns>
+            HRESULT SetPalette(DepthPalette palette);
+
+            /// <summary>
+            /// Gets the palette in use
+            /// </summary>
+            /// <returns>palette in use</returns>
+            DepthPalette GetPalette() const;
+
+            /// <summary>
+            /// Sets the depths the palette is stretched over. Nearer depths are drawn as the
+            /// near depth, farther ones as the far depth.
+            /// </summary>
+            /// <param name="nearDepth">nearest depth in millimeters</param>
+            /// <param name="farDepth">farthest depth in millimeters</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the range is empty or beyond the sensor's</returns>
+            HRESULT SetDepthRange(USHORT nearDepth, USHORT farDepth);
+
+            /// <summary>
+            /// Gets the depths the palette is stretched over
+            /// </summary>
+            /// <param name="pNearDepth">pointer in which to return the nearest depth in millimeters</param>
+            /// <param name="pFarDepth">pointer in which to return the farthest depth in millimeters</param>
+            void GetDepthRange(USHORT* pNearDepth, USHORT* pFarDepth) const;
+
+            /// <summary>
+            /// Converts a packed depth image into colors. When both images have no padding
+            /// between rows the whole image is converted as a single row.
+            /// </summary>
+            /// <param name="pSource">packed depth pixels to convert</param>
+            /// <param name="sourcePitch">bytes between the starts of source rows</param>
+            /// <param name="pDestination">buffer in which to return the colors</param>
+            /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+            /// <param name="width">width of the image in pixels</param>
+            /// <param name="height">height of the image in pixels</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Colorize(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch,
+                UINT width, UINT height) const;
+
+            /// <summary>
+            /// Converts a plane of depths in millimeters and a plane of player indices into colors,
+            /// as if they had been packed into depth pixels. Depths the packed pixels cannot hold
+            /// are drawn as invalid.
+            /// </summary>
+            /// <param name="pDepth">depths to convert</param>
+            /// <param name="depthPitch">bytes between the starts of depth rows</param>
+            /// <param name="pPlayers">player indices to convert</param>
+            /// <param name="playersPitch">bytes between the starts of player index rows</param>
+            /// <param name="pDestination">buffer in which to return the colors</param>
+            /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+            /// <param name="width">width of the image in pixels</param>
+            /// <param name="height">height of the image in pixels</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ColorizePlanes(const BYTE* pDepth, INT depthPitch, const BYTE* pPlayers, INT playersPitch,
+                BYTE* pDestination, INT destinationPitch, UINT width, UINT height) const;
+
+            /// <summary>
+            /// Brings the table up to date and keeps the palette and depth range from changing
+            /// until UnlockTable is called. Must not be called again before then on the same thread.
+            /// </summary>
+            /// <returns>S_OK if successful, in which case the caller must call UnlockTable, an error code otherwise</returns>
+            HRESULT LockTable() const;
+
+            /// <summary>
+            /// Lets the palette and depth range change again after LockTable
+            /// </summary>
+            void UnlockTable() const;
+
+            /// <summary>
+            /// Converts a packed depth image into colors, like Colorize, while the table is locked
+            /// with LockTable. May be called from any thread.
+            /// </summary>
+            /// <param name="pSource">packed depth pixels to convert</param>
+            /// <param name="sourcePitch">bytes between the starts of source rows</param>
+            /// <param name="pDestination">buffer in which to return the colors</param>
+            /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+            /// <param name="width">width of the image in pixels</param>
+            /// <param name="height">height of the image in pixels</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ColorizeLocked(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch,
+                UINT width, UINT height) const;
+
+            /// <summary>
+            /// Converts a plane of depths in millimeters and a plane of player indices into colors,
+            /// like ColorizePlanes, while the table is locked with LockTable. May be called from any thread.
+            /// </summary>
+            /// <param name="pDepth">depths to convert</param>
+            /// <param name="depthPitch">bytes between the starts of depth rows</param>
+            /// <param name="pPlayers">player indices to convert</param>
+            /// <param name="playersPitch">bytes between the starts of player index rows</param>
+            /// <param name="pDestination">buffer in which to return the colors</param>
+            /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+            /// <param name="width">width of the image in pixels</param>
+            /// <param name="height">height of the image in pixels</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ColorizePlanesLocked(const BYTE* pDepth, INT depthPitch, const BYTE* pPlayers, INT playersPitch,
+                BYTE* pDestination, INT destinationPitch, UINT width, UINT height) const;
+
+        private:
+            // Constants:
+            // Number of table entries, one per 16-bit pixel value
+            static const UINT TABLE_SIZE = 0x10000;
+
+            // Colorizers are not copied, since they own the table
+            DepthColorizer(const DepthColorizer&);
+            DepthColorizer& operator=(const DepthColorizer&);
+
+            // Functions:
+            /// <summary>
+            /// Fills the table for the current palette and depth range. Called with m_lock held exclusively.
+            /// </summary>
+            /// <returns>S_OK if successful, E_OUTOFMEMORY if the table could not be allocated</returns>
+            HRESULT BuildTable() const;
+
+            /// <summary>
+            /// Computes the color of a packed depth pixel
+            /// </summary>
+            /// <param name="pixel">packed depth pixel</param>
+            /// <returns>color, red in the lowest byte</returns>
+            DWORD ColorizePixel(USHORT pixel) const;
+
+            // Variables:
+            // Guards everything below, which the UI may change while frames are converted.
+            // Conversions share it, so bands of one image can be converted in parallel.
+            mutable SRWLOCK m_lock;
+            DepthPalette m_palette;
+            USHORT m_nearDepth;
+            USHORT m_farDepth;
+
+            // Color of every packed pixel value, and whether it is out of date. Built lazily by Colorize.
+            mutable DWORD* m_pTable;
+            mutable bool m_isTableStale;
+        };
+    }
+}
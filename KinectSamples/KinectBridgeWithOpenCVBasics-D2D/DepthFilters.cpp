@@ -0,0 +1,863 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthFilters.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "DepthFilters.h"
+#include <emmintrin.h>
+#include <strsafe.h>
+#include <vector>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pixels filtered per SSE2 step
+    const UINT PIXELS_PER_STEP = 8;
+
+    // Pixels on each side of the center of the bilateral window
+    const int BILATERAL_RADIUS = 2;
+
+    // Pixels on each side of the center of the hole filling and speckle windows
+    const int NEIGHBOR_RADIUS = 1;
+
+    // Binomial weights along each axis of the bilateral window. The spatial weights are their
+    // products, which sum to 256, so the weights of a window times a range weight of at most 255
+    // sum to less than 65536.
+    const USHORT BINOMIAL_WEIGHTS[2 * BILATERAL_RADIUS + 1] = {1, 4, 6, 4, 1};
+
+    // Resolutions the filter costs are reported at
+    const NUI_IMAGE_RESOLUTION REPORTED_RESOLUTIONS[] =
+    {
+        NUI_IMAGE_RESOLUTION_80x60,
+        NUI_IMAGE_RESOLUTION_320x240,
+        NUI_IMAGE_RESOLUTION_640x480
+    };
+
+    // Names of the filters, in the order of DepthPlaneFilter
+    const LPCWSTR FILTER_NAMES[DEPTH_PLANE_FILTER_COUNT] =
+    {
+        L"bilateral",
+        L"fill holes",
+        L"remove speckles"
+    };
+
+    /// <summary>
+    /// Gets whether a depth is a measurement
+    /// </summary>
+    inline bool IsValidDepth(USHORT depth)
+    {
+        return depth > 0 && depth <= MAX_FILTER_DEPTH;
+    }
+
+    /// <summary>
+    /// Gets whether each of eight depths is a measurement. Depths above 32767 compare as
+    /// negative, so they fail the first test.
+    /// </summary>
+    inline __m128i AreValidDepths(__m128i depths)
+    {
+        return _mm_and_si128(_mm_cmpgt_epi16(depths, _mm_setzero_si128()),
+            _mm_cmplt_epi16(depths, _mm_set1_epi16(MAX_FILTER_DEPTH + 1)));
+    }
+
+    /// <summary>
+    /// Gets the unsigned differences between eight pairs of depths
+    /// </summary>
+    inline __m128i AbsoluteDifferences(__m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+    }
+
+    /// <summary>
+    /// Chooses between eight pairs of values by a mask
+    /// </summary>
+    inline __m128i Select(__m128i mask, __m128i ifSet, __m128i ifClear)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+    }
+
+    /// <summary>
+    /// Reads a depth, treating pixels outside the image as invalid
+    /// </summary>
+    inline USHORT ReadDepth(const BYTE* pSource, INT sourcePitch, UINT width, UINT height, int x, int y)
+    {
+        if (x < 0 || y < 0 || x >= static_cast<int>(width) || y >= static_cast<int>(height))
+        {
+            return 0;
+        }
+
+        return reinterpret_cast<const USHORT*>(pSource + y * sourcePitch)[x];
+    }
+
+    /// <summary>
+    /// Gets a row of a plane
+    /// </summary>
+    template <typename T>
+    inline const T* GetRow(const BYTE* pPlane, INT pitch, UINT y)
+    {
+        return reinterpret_cast<const T*>(pPlane + y * pitch);
+    }
+
+    /// <summary>
+    /// Divides weighted depth sums by their weights and rounds to the nearest depth, in single
+    /// precision so that pixels filtered one at a time round the same way as those filtered eight at a time
+    /// </summary>
+    inline USHORT DivideScalar(int weightedSum, int weightSum)
+    {
+        return static_cast<USHORT>(_mm_cvtss_si32(_mm_div_ss(_mm_cvtsi32_ss(_mm_setzero_ps(), weightedSum),
+            _mm_cvtsi32_ss(_mm_setzero_ps(), weightSum))));
+    }
+
+    /// <summary>
+    /// Bilateral filters one pixel
+    /// </summary>
+    USHORT FilterBilateralPixel(UINT width, UINT height, const BYTE* pSource, INT sourcePitch, const BYTE* pPlayers, INT playersPitch,
+        int x, int y, USHORT rangeWidth)
+    {
+        USHORT center = ReadDepth(pSource, sourcePitch, width, height, x, y);
+        if (!IsValidDepth(center))
+        {
+            return center;
+        }
+
+        BYTE centerPlayer = pPlayers ? GetRow<BYTE>(pPlayers, playersPitch, y)[x] : 0;
+
+        int weightSum = 0;
+        int weightedSum = 0;
+        for (int dy = -BILATERAL_RADIUS; dy <= BILATERAL_RADIUS; ++dy)
+        {
+            for (int dx = -BILATERAL_RADIUS; dx <= BILATERAL_RADIUS; ++dx)
+            {
+                USHORT depth = ReadDepth(pSource, sourcePitch, width, height, x + dx, y + dy);
+                if (!IsValidDepth(depth) || (pPlayers && GetRow<BYTE>(pPlayers, playersPitch, y + dy)[x + dx] != centerPlayer))
+                {
+                    continue;
+                }
+
+                int difference = abs(static_cast<int>(depth) - static_cast<int>(center));
+                if (difference >= rangeWidth)
+                {
+                    continue;
+                }
+
+                int weight = BINOMIAL_WEIGHTS[dy + BILATERAL_RADIUS] * BINOMIAL_WEIGHTS[dx + BILATERAL_RADIUS] * (rangeWidth - difference);
+                weightSum += weight;
+                weightedSum += weight * depth;
+            }
+        }
+
+        // The center always counts, so the weights never sum to 0
+        return DivideScalar(weightedSum, weightSum);
+    }
+
+    /// <summary>
+    /// Bilateral filters eight pixels of a row at least BILATERAL_RADIUS pixels from every border
+    /// </summary>
+    template <bool UsePlayers>
+    void FilterBilateralStep(const BYTE* pSource, INT sourcePitch, const BYTE* pPlayers, INT playersPitch, USHORT* pOut,
+        UINT x, UINT y, __m128i rangeWidths)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(GetRow<USHORT>(pSource, sourcePitch, y) + x));
+        __m128i centerPlayers = zero;
+        if (UsePlayers)
+        {
+            centerPlayers = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(GetRow<BYTE>(pPlayers, playersPitch, y) + x)), zero);
+        }
+
+        // Weight sums fit in 16 bits; weighted depth sums need 32, kept as low and high four lanes
+        __m128i weightSums = zero;
+        __m128i weightedSumsLow = zero;
+        __m128i weightedSumsHigh = zero;
+
+        for (int dy = -BILATERAL_RADIUS; dy <= BILATERAL_RADIUS; ++dy)
+        {
+            const USHORT* pRow = GetRow<USHORT>(pSource, sourcePitch, y + dy) + x;
+            const BYTE* pPlayerRow = UsePlayers ? GetRow<BYTE>(pPlayers, playersPitch, y + dy) + x : NULL;
+
+            for (int dx = -BILATERAL_RADIUS; dx <= BILATERAL_RADIUS; ++dx)
+            {
+                __m128i depths = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + dx));
+                __m128i counted = AreValidDepths(depths);
+                if (UsePlayers)
+                {
+                    __m128i players = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pPlayerRow + dx)), zero);
+                    counted = _mm_and_si128(counted, _mm_cmpeq_epi16(players, centerPlayers));
+                }
+
+                // Range weights fall from the range width to 0 as the difference grows
+                __m128i rangeWeights = _mm_and_si128(counted, _mm_subs_epu16(rangeWidths, AbsoluteDifferences(depths, center)));
+                __m128i spatialWeight = _mm_set1_epi16(BINOMIAL_WEIGHTS[dy + BILATERAL_RADIUS] * BINOMIAL_WEIGHTS[dx + BILATERAL_RADIUS]);
+                __m128i weights = _mm_mullo_epi16(rangeWeights, spatialWeight);
+                weightSums = _mm_add_epi16(weightSums, weights);
+
+                __m128i productsLow = _mm_mullo_epi16(weights, depths);
+                __m128i productsHigh = _mm_mulhi_epu16(weights, depths);
+                weightedSumsLow = _mm_add_epi32(weightedSumsLow, _mm_unpacklo_epi16(productsLow, productsHigh));
+                weightedSumsHigh = _mm_add_epi32(weightedSumsHigh, _mm_unpackhi_epi16(productsLow, productsHigh));
+            }
+        }
+
+        // Invalid centers count nothing, so guard their division by making the weights 1
+        __m128i validCenters = AreValidDepths(center);
+        weightSums = _mm_or_si128(weightSums, _mm_andnot_si128(validCenters, _mm_set1_epi16(1)));
+
+        __m128 quotientsLow = _mm_div_ps(_mm_cvtepi32_ps(weightedSumsLow), _mm_cvtepi32_ps(_mm_unpacklo_epi16(weightSums, zero)));
+        __m128 quotientsHigh = _mm_div_ps(_mm_cvtepi32_ps(weightedSumsHigh), _mm_cvtepi32_ps(_mm_unpackhi_epi16(weightSums, zero)));
+        __m128i filtered = _mm_packs_epi32(_mm_cvtps_epi32(quotientsLow), _mm_cvtps_epi32(quotientsHigh));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + x), Select(validCenters, filtered, center));
+    }
+
+    /// <summary>
+    /// Fills one pixel if it is a hole
+    /// </summary>
+    USHORT FillHolePixel(UINT width, UINT height, const BYTE* pSource, INT sourcePitch, int x, int y, UINT minValidNeighbors)
+    {
+        USHORT center = ReadDepth(pSource, sourcePitch, width, height, x, y);
+        if (IsValidDepth(center))
+        {
+            return center;
+        }
+
+        UINT validCount = 0;
+        USHORT farthest = 0;
+        for (int dy = -NEIGHBOR_RADIUS; dy <= NEIGHBOR_RADIUS; ++dy)
+        {
+            for (int dx = -NEIGHBOR_RADIUS; dx <= NEIGHBOR_RADIUS; ++dx)
+            {
+                USHORT depth = ReadDepth(pSource, sourcePitch, width, height, x + dx, y + dy);
+                if ((dx != 0 || dy != 0) && IsValidDepth(depth))
+                {
+                    ++validCount;
+                    farthest = max(farthest, depth);
+                }
+            }
+        }
+
+        return validCount >= minValidNeighbors ? farthest : center;
+    }
+
+    /// <summary>
+    /// Fills the holes among eight pixels of a row at least NEIGHBOR_RADIUS pixels from every border
+    /// </summary>
+    void FillHoleStep(const BYTE* pSource, INT sourcePitch, USHORT* pOut, UINT x, UINT y, __m128i minValidNeighbors)
+    {
+        __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(GetRow<USHORT>(pSource, sourcePitch, y) + x));
+        __m128i validCounts = _mm_setzero_si128();
+        __m128i farthest = _mm_setzero_si128();
+
+        for (int dy = -NEIGHBOR_RADIUS; dy <= NEIGHBOR_RADIUS; ++dy)
+        {
+            const USHORT* pRow = GetRow<USHORT>(pSource, sourcePitch, y + dy) + x;
+            for (int dx = -NEIGHBOR_RADIUS; dx <= NEIGHBOR_RADIUS; ++dx)
+            {
+                if (0 == dx && 0 == dy)
+                {
+                    continue;
+                }
+
+                // Valid depths are below 32768, so the signed maximum orders them correctly
+                __m128i depths = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + dx));
+                __m128i valid = AreValidDepths(depths);
+                validCounts = _mm_sub_epi16(validCounts, valid);
+                farthest = _mm_max_epi16(farthest, _mm_and_si128(valid, depths));
+            }
+        }
+
+        __m128i filled = _mm_andnot_si128(AreValidDepths(center), _mm_cmpgt_epi16(validCounts, minValidNeighbors));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + x), Select(filled, farthest, center));
+    }
+
+    /// <summary>
+    /// Invalidates one pixel if it is a speckle
+    /// </summary>
+    USHORT RemoveSpecklePixel(UINT width, UINT height, const BYTE* pSource, INT sourcePitch, int x, int y, USHORT maxDifference, UINT minSupport)
+    {
+        USHORT center = ReadDepth(pSource, sourcePitch, width, height, x, y);
+        if (!IsValidDepth(center))
+        {
+            return center;
+        }
+
+        UINT support = 0;
+        for (int dy = -NEIGHBOR_RADIUS; dy <= NEIGHBOR_RADIUS; ++dy)
+        {
+            for (int dx = -NEIGHBOR_RADIUS; dx <= NEIGHBOR_RADIUS; ++dx)
+            {
+                USHORT depth = ReadDepth(pSource, sourcePitch, width, height, x + dx, y + dy);
+                if ((dx != 0 || dy != 0) && IsValidDepth(depth) && abs(static_cast<int>(depth) - static_cast<int>(center)) <= maxDifference)
+                {
+                    ++support;
+                }
+            }
+        }
+
+        return support >= minSupport ? center : 0;
+    }
+
+    /// <summary>
+    /// Invalidates the speckles among eight pixels of a row at least NEIGHBOR_RADIUS pixels from every border
+    /// </summary>
+    void RemoveSpeckleStep(const BYTE* pSource, INT sourcePitch, USHORT* pOut, UINT x, UINT y, __m128i maxDifferences, __m128i minSupports)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(GetRow<USHORT>(pSource, sourcePitch, y) + x));
+        __m128i supports = zero;
+
+        for (int dy = -NEIGHBOR_RADIUS; dy <= NEIGHBOR_RADIUS; ++dy)
+        {
+            const USHORT* pRow = GetRow<USHORT>(pSource, sourcePitch, y + dy) + x;
+            for (int dx = -NEIGHBOR_RADIUS; dx <= NEIGHBOR_RADIUS; ++dx)
+            {
+                if (0 == dx && 0 == dy)
+                {
+                    continue;
+                }
+
+                // A difference is within the limit when subtracting the limit saturates to 0
+                __m128i depths = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + dx));
+                __m128i close = _mm_cmpeq_epi16(_mm_subs_epu16(AbsoluteDifferences(depths, center), maxDifferences), zero);
+                supports = _mm_sub_epi16(supports, _mm_and_si128(close, AreValidDepths(depths)));
+            }
+        }
+
+        __m128i removed = _mm_and_si128(AreValidDepths(center), _mm_cmplt_epi16(supports, minSupports));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + x), _mm_andnot_si128(removed, center));
+    }
+
+    /// <summary>
+    /// Gets the region covering a range of whole rows
+    /// </summary>
+    HRESULT GetRowRegion(UINT firstRow, UINT rowCount, UINT width, UINT height, RECT* pRegion)
+    {
+        if (firstRow > height || rowCount > height - firstRow)
+        {
+            return E_INVALIDARG;
+        }
+
+        pRegion->left = 0;
+        pRegion->top = static_cast<LONG>(firstRow);
+        pRegion->right = static_cast<LONG>(width);
+        pRegion->bottom = static_cast<LONG>(firstRow + rowCount);
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Checks the arguments the filters share
+    /// </summary>
+    HRESULT CheckFilterArguments(const RECT& region, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+        const BYTE* pDestination, INT destinationPitch)
+    {
+        if (!pSource || !pDestination)
+        {
+            return E_POINTER;
+        }
+
+        // Fail if the rows would overlap, if the destination would overwrite pixels still to be
+        // read, or if the region is not within the image
+        INT rowSize = static_cast<INT>(width * sizeof(USHORT));
+        if (sourcePitch < rowSize || destinationPitch < rowSize || pSource == pDestination ||
+            region.left < 0 || region.top < 0 || region.left > region.right || region.top > region.bottom ||
+            static_cast<UINT>(region.right) > width || static_cast<UINT>(region.bottom) > height)
+        {
+            return E_INVALIDARG;
+        }
+
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Gets the first pixel of a row's columns past the last the SSE2 steps can filter, which is
+    /// where filtering one pixel at a time resumes, or 0 if the columns are filtered one pixel at
+    /// a time. The steps start at the first column, or at the border if that is further in.
+    /// </summary>
+    inline UINT GetStepEnd(UINT firstColumn, UINT columnEnd, UINT width, UINT y, UINT height, int radius)
+    {
+        UINT border = static_cast<UINT>(radius);
+        if (y < border || y + border >= height || width < 2 * border + PIXELS_PER_STEP)
+        {
+            return 0;
+        }
+
+        UINT stepStart = max(firstColumn, border);
+        UINT stepLimit = min(columnEnd, width - border);
+        if (stepLimit < stepStart + PIXELS_PER_STEP)
+        {
+            return 0;
+        }
+
+        return stepStart + (stepLimit - stepStart) / PIXELS_PER_STEP * PIXELS_PER_STEP;
+    }
+
+    /// <summary>
+    /// Bilateral filters a region
+    /// </summary>
+    template <bool UsePlayers>
+    void FilterBilateralRegion(const RECT& region, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+        const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch, USHORT rangeWidth)
+    {
+        const __m128i rangeWidths = _mm_set1_epi16(rangeWidth);
+        const UINT firstColumn = static_cast<UINT>(region.left);
+        const UINT columnEnd = static_cast<UINT>(region.right);
+
+        for (UINT y = static_cast<UINT>(region.top); y < static_cast<UINT>(region.bottom); ++y)
+        {
+            USHORT* pOut = reinterpret_cast<USHORT*>(pDestination + y * destinationPitch);
+            UINT stepEnd = GetStepEnd(firstColumn, columnEnd, width, y, height, BILATERAL_RADIUS);
+            UINT x = firstColumn;
+
+            for (; x < BILATERAL_RADIUS && x < columnEnd; ++x)
+            {
+                pOut[x] = FilterBilateralPixel(width, height, pSource, sourcePitch, pPlayers, playersPitch, x, y, rangeWidth);
+            }
+
+            for (; x < stepEnd; x += PIXELS_PER_STEP)
+            {
+                FilterBilateralStep<UsePlayers>(pSource, sourcePitch, pPlayers, playersPitch, pOut, x, y, rangeWidths);
+            }
+
+            for (; x < columnEnd; ++x)
+            {
+                pOut[x] = FilterBilateralPixel(width, height, pSource, sourcePitch, pPlayers, playersPitch, x, y, rangeWidth);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Bilateral filters a region after checking the arguments
+    /// </summary>
+    HRESULT FilterBilateral(const RECT& region, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+        const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch, USHORT rangeWidth)
+    {
+        HRESULT hr = CheckFilterArguments(region, width, height, pSource, sourcePitch, pDestination, destinationPitch);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        if (0 == rangeWidth || rangeWidth > MAX_BILATERAL_RANGE_WIDTH || (pPlayers && playersPitch < static_cast<INT>(width)))
+        {
+            return E_INVALIDARG;
+        }
+
+        if (pPlayers)
+        {
+            FilterBilateralRegion<true>(region, width, height, pSource, sourcePitch, pPlayers, playersPitch, pDestination, destinationPitch, rangeWidth);
+        }
+        else
+        {
+            FilterBilateralRegion<false>(region, width, height, pSource, sourcePitch, NULL, 0, pDestination, destinationPitch, rangeWidth);
+        }
+
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Fills the holes of a region after checking the arguments
+    /// </summary>
+    HRESULT FillHoles(const RECT& region, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+        BYTE* pDestination, INT destinationPitch, UINT minValidNeighbors)
+    {
+        HRESULT hr = CheckFilterArguments(region, width, height, pSource, sourcePitch, pDestination, destinationPitch);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        if (0 == minValidNeighbors || minValidNeighbors > 8)
+        {
+            return E_INVALIDARG;
+        }
+
+        // Counts are compared as greater than one less than the minimum
+        const __m128i countThresholds = _mm_set1_epi16(static_cast<short>(minValidNeighbors - 1));
+        const UINT firstColumn = static_cast<UINT>(region.left);
+        const UINT columnEnd = static_cast<UINT>(region.right);
+
+        for (UINT y = static_cast<UINT>(region.top); y < static_cast<UINT>(region.bottom); ++y)
+        {
+            USHORT* pOut = reinterpret_cast<USHORT*>(pDestination + y * destinationPitch);
+            UINT stepEnd = GetStepEnd(firstColumn, columnEnd, width, y, height, NEIGHBOR_RADIUS);
+            UINT x = firstColumn;
+
+            for (; x < NEIGHBOR_RADIUS && x < columnEnd; ++x)
+            {
+                pOut[x] = FillHolePixel(width, height, pSource, sourcePitch, x, y, minValidNeighbors);
+            }
+
+            for (; x < stepEnd; x += PIXELS_PER_STEP)
+            {
+                FillHoleStep(pSource, sourcePitch, pOut, x, y, countThresholds);
+            }
+
+            for (; x < columnEnd; ++x)
+            {
+                pOut[x] = FillHolePixel(width, height, pSource, sourcePitch, x, y, minValidNeighbors);
+            }
+        }
+
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Removes the speckles of a region after checking the arguments
+    /// </summary>
+    HRESULT RemoveSpeckles(const RECT& region, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+        BYTE* pDestination, INT destinationPitch, USHORT maxDifference, UINT minSupport)
+    {
+        HRESULT hr = CheckFilterArguments(region, width, height, pSource, sourcePitch, pDestination, destinationPitch);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        if (minSupport > 8)
+        {
+            return E_INVALIDARG;
+        }
+
+        const __m128i maxDifferences = _mm_set1_epi16(static_cast<short>(maxDifference));
+        const __m128i minSupports = _mm_set1_epi16(static_cast<short>(minSupport));
+        const UINT firstColumn = static_cast<UINT>(region.left);
+        const UINT columnEnd = static_cast<UINT>(region.right);
+
+        for (UINT y = static_cast<UINT>(region.top); y < static_cast<UINT>(region.bottom); ++y)
+        {
+            USHORT* pOut = reinterpret_cast<USHORT*>(pDestination + y * destinationPitch);
+            UINT stepEnd = GetStepEnd(firstColumn, columnEnd, width, y, height, NEIGHBOR_RADIUS);
+            UINT x = firstColumn;
+
+            for (; x < NEIGHBOR_RADIUS && x < columnEnd; ++x)
+            {
+                pOut[x] = RemoveSpecklePixel(width, height, pSource, sourcePitch, x, y, maxDifference, minSupport);
+            }
+
+            for (; x < stepEnd; x += PIXELS_PER_STEP)
+            {
+                RemoveSpeckleStep(pSource, sourcePitch, pOut, x, y, maxDifferences, minSupports);
+            }
+
+            for (; x < columnEnd; ++x)
+            {
+                pOut[x] = RemoveSpecklePixel(width, height, pSource, sourcePitch, x, y, maxDifference, minSupport);
+            }
+        }
+
+        return S_OK;
+    }
+
+    /// <summary>
+    /// Draws a synthetic scene for measuring the filters: a floor and a wall, a player in front
+    /// of the wall, depth noise that grows with distance, holes along the player's outline and
+    /// in the wall's shadow, and scattered speckles
+    /// </summary>
+    void RenderScene(UINT width, UINT height, USHORT* pDepth, BYTE* pPlayers)
+    {
+        // Linear congruential generator, so every run measures the same scene
+        UINT seed = 12345;
+
+        for (UINT y = 0; y < height; ++y)
+        {
+            for (UINT x = 0; x < width; ++x)
+            {
+                seed = seed * 1103515245 + 12345;
+                int noise = static_cast<int>((seed >> 16) & 0xFF) - 128;
+
+                // The floor rises towards the sensor along the lower third of the image
+                int depth = 3500;
+                if (y * 3 > height * 2)
+                {
+                    depth = 3500 - static_cast<int>((y * 3 - height * 2) * 2500 / height);
+                }
+
+                // The player is an ellipse in the middle of the image
+                int dx = static_cast<int>(x * 2) - static_cast<int>(width);
+                int dy = static_cast<int>(y * 2) - static_cast<int>(height);
+                LONGLONG ellipse = static_cast<LONGLONG>(dx) * dx * 16 + static_cast<LONGLONG>(dy) * dy * 4;
+                LONGLONG radius = static_cast<LONGLONG>(width) * width * 2;
+                BYTE player = 0;
+                if (ellipse < radius)
+                {
+                    depth = 1800;
+                    player = 1;
+                }
+
+                // Noise grows with the square of the depth, as with structured light
+                depth += noise * depth / 4000 * depth / 4000 / 8;
+
+                if (ellipse >= radius && ellipse < radius + radius / 8)
+                {
+                    depth = 0;
+                }
+                else if (x * 8 < width && y * 4 < height)
+                {
+                    depth = 0xFFFF;
+                }
+                else if (0 == (seed >> 8) % 97)
+                {
+                    depth = 500 + static_cast<int>((seed >> 4) % 3000);
+                }
+
+                pDepth[y * width + x] = static_cast<USHORT>(depth);
+                pPlayers[y * width + x] = player;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Smooths depths with a 5x5 joint bilateral filter. Each neighbor is weighted by a
+/// binomial kernel of its distance and by how much closer than the range width its depth
+/// is to the pixel's, and only counts if it has the pixel's player index, so depths are
+/// never mixed across a depth edge or a player's outline. Invalid pixels stay as they are.
+/// </summary>
+/// <param name="firstRow">first row to filter</param>
+/// <param name="rowCount">number of rows to filter</param>
+/// <param name="width">width of the whole image in pixels</param>
+/// <param name="height">height of the whole image in pixels</param>
+/// <param name="pSource">depths of the whole image</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pPlayers">player indices of the whole image, or NULL to ignore players</param>
+/// <param name="playersPitch">bytes between the starts of player index rows</param>
+/// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="rangeWidth">depth difference in millimeters at which a neighbor stops counting, from 1 to MAX_BILATERAL_RANGE_WIDTH</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::FilterDepthBilateralRows(UINT firstRow, UINT rowCount, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+    const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch, USHORT rangeWidth)
+{
+    RECT region;
+    HRESULT hr = GetRowRegion(firstRow, rowCount, width, height, &region);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return FilterBilateral(region, width, height, pSource, sourcePitch, pPlayers, playersPitch, pDestination, destinationPitch, rangeWidth);
+}
+
+/// <summary>
+/// Fills each invalid pixel with the farthest of its 8 neighbors when enough of them are
+/// valid. Taking the farthest keeps foreground objects from growing into their shadows.
+/// Valid pixels stay as they are.
+/// </summary>
+/// <param name="firstRow">first row to filter</param>
+/// <param name="rowCount">number of rows to filter</param>
+/// <param name="width">width of the whole image in pixels</param>
+/// <param name="height">height of the whole image in pixels</param>
+/// <param name="pSource">depths of the whole image</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="minValidNeighbors">valid neighbors an invalid pixel needs to be filled, from 1 to 8</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::FillDepthHoleRows(UINT firstRow, UINT rowCount, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+    BYTE* pDestination, INT destinationPitch, UINT minValidNeighbors)
+{
+    RECT region;
+    HRESULT hr = GetRowRegion(firstRow, rowCount, width, height, &region);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return FillHoles(region, width, height, pSource, sourcePitch, pDestination, destinationPitch, minValidNeighbors);
+}
+
+/// <summary>
+/// Invalidates speckles: valid pixels with too few of their 8 neighbors valid and within a
+/// depth difference of them. Such pixels are noise or flying pixels along depth edges.
+/// Other pixels stay as they are.
+/// </summary>
+/// <param name="firstRow">first row to filter</param>
+/// <param name="rowCount">number of rows to filter</param>
+/// <param name="width">width of the whole image in pixels</param>
+/// <param name="height">height of the whole image in pixels</param>
+/// <param name="pSource">depths of the whole image</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <param name="maxDifference">largest depth difference in millimeters of a supporting neighbor</param>
+/// <param name="minSupport">supporting neighbors a pixel needs to be kept, from 0 to 8</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::RemoveDepthSpeckleRows(UINT firstRow, UINT rowCount, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+    BYTE* pDestination, INT destinationPitch, USHORT maxDifference, UINT minSupport)
+{
+    RECT region;
+    HRESULT hr = GetRowRegion(firstRow, rowCount, width, height, &region);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return RemoveSpeckles(region, width, height, pSource, sourcePitch, pDestination, destinationPitch, maxDifference, minSupport);
+}
+
+/// <summary>
+/// Applies a depth plane filter with its default settings
+/// </summary>
+/// <param name="filter">filter to apply</param>
+/// <param name="firstRow">first row to filter</param>
+/// <param name="rowCount">number of rows to filter</param>
+/// <param name="width">width of the whole image in pixels</param>
+/// <param name="height">height of the whole image in pixels</param>
+/// <param name="pSource">depths of the whole image</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pPlayers">player indices of the whole image, or NULL to ignore players</param>
+/// <param name="playersPitch">bytes between the starts of player index rows</param>
+/// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the filter is unknown, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::FilterDepthRows(DepthPlaneFilter filter, UINT firstRow, UINT rowCount, UINT width, UINT height,
+    const BYTE* pSource, INT sourcePitch, const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch)
+{
+    RECT region;
+    HRESULT hr = GetRowRegion(firstRow, rowCount, width, height, &region);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return FilterDepthRegion(filter, region, width, height, pSource, sourcePitch, pPlayers, playersPitch, pDestination, destinationPitch);
+}
+
+/// <summary>
+/// Applies a depth plane filter with its default settings to a region of an image, leaving the
+/// rest of the destination as it is. The filter still reads the neighbors of the region's
+/// pixels from outside it.
+/// </summary>
+/// <param name="filter">filter to apply</param>
+/// <param name="region">pixels to filter, within the image</param>
+/// <param name="width">width of the whole image in pixels</param>
+/// <param name="height">height of the whole image in pixels</param>
+/// <param name="pSource">depths of the whole image</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pPlayers">player indices of the whole image, or NULL to ignore players</param>
+/// <param name="playersPitch">bytes between the starts of player index rows</param>
+/// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+/// <param name="destinationPitch">bytes between the starts of destination rows</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the filter is unknown or the region is not within the image, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::FilterDepthRegion(DepthPlaneFilter filter, const RECT& region, UINT width, UINT height,
+    const BYTE* pSource, INT sourcePitch, const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch)
+{
+    switch (filter)
+    {
+    case DEPTH_PLANE_FILTER_BILATERAL:
+        return FilterBilateral(region, width, height, pSource, sourcePitch, pPlayers, playersPitch,
+            pDestination, destinationPitch, DEFAULT_BILATERAL_RANGE_WIDTH);
+
+    case DEPTH_PLANE_FILTER_FILL_HOLES:
+        return FillHoles(region, width, height, pSource, sourcePitch, pDestination, destinationPitch,
+            DEFAULT_MIN_VALID_NEIGHBORS);
+
+    case DEPTH_PLANE_FILTER_REMOVE_SPECKLES:
+        return RemoveSpeckles(region, width, height, pSource, sourcePitch, pDestination, destinationPitch,
+            DEFAULT_SPECKLE_MAX_DIFFERENCE, DEFAULT_SPECKLE_MIN_SUPPORT);
+
+    default:
+        return E_INVALIDARG;
+    }
+}
+
+/// <summary>
+/// Gets the name of a depth plane filter
+/// </summary>
+/// <param name="filter">filter to name</param>
+/// <returns>name of the filter</returns>
+LPCWSTR Microsoft::KinectBridge::GetDepthPlaneFilterName(DepthPlaneFilter filter)
+{
+    if (filter < 0 || filter >= DEPTH_PLANE_FILTER_COUNT)
+    {
+        return L"unknown";
+    }
+
+    return FILTER_NAMES[filter];
+}
+
+/// <summary>
+/// Measures what a depth plane filter costs per pixel on a synthetic scene of the given
+/// resolution, with a floor, a wall, a player in front of it, noise, holes and speckles.
+/// The filter runs on the calling thread.
+/// </summary>
+/// <param name="filter">filter to measure</param>
+/// <param name="resolution">resolution of the scene</param>
+/// <param name="frameCount">number of times to filter the scene</param>
+/// <param name="pNanosecondsPerPixel">pointer in which to return the mean cost of a pixel in nanoseconds</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the filter or resolution is not valid, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::MeasureDepthFilterCost(DepthPlaneFilter filter, NUI_IMAGE_RESOLUTION resolution, UINT frameCount, double* pNanosecondsPerPixel)
+{
+    if (!pNanosecondsPerPixel)
+    {
+        return E_POINTER;
+    }
+
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+    if (0 == width || 0 == height || 0 == frameCount || filter < 0 || filter >= DEPTH_PLANE_FILTER_COUNT)
+    {
+        return E_INVALIDARG;
+    }
+
+    UINT pixelCount = width * height;
+    std::vector<USHORT> source(pixelCount);
+    std::vector<USHORT> destination(pixelCount);
+    std::vector<BYTE> players(pixelCount);
+    RenderScene(width, height, &source[0], &players[0]);
+
+    INT depthPitch = static_cast<INT>(width * sizeof(USHORT));
+    INT playersPitch = static_cast<INT>(width);
+    const BYTE* pSource = reinterpret_cast<const BYTE*>(&source[0]);
+    BYTE* pDestination = reinterpret_cast<BYTE*>(&destination[0]);
+
+    // Filter once before timing so the planes are in the cache, as they are after splitting a frame
+    HRESULT hr = FilterDepthRows(filter, 0, height, width, height, pSource, depthPitch, &players[0], playersPitch, pDestination, depthPitch);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    for (UINT i = 0; i < frameCount; ++i)
+    {
+        FilterDepthRows(filter, 0, height, width, height, pSource, depthPitch, &players[0], playersPitch, pDestination, depthPitch);
+    }
+
+    QueryPerformanceCounter(&end);
+
+    *pNanosecondsPerPixel = 1000000000.0 * (end.QuadPart - start.QuadPart) / frequency.QuadPart / frameCount / pixelCount;
+    return S_OK;
+}
+
+/// <summary>
+/// Writes what each depth plane filter costs per pixel at each depth resolution to the debugger output
+/// </summary>
+/// <param name="frameCount">number of times to filter the scene of each resolution</param>
+void Microsoft::KinectBridge::ReportDepthFilterCosts(UINT frameCount)
+{
+    for (int filter = 0; filter < DEPTH_PLANE_FILTER_COUNT; ++filter)
+    {
+        for (UINT i = 0; i < ARRAYSIZE(REPORTED_RESOLUTIONS); ++i)
+        {
+            double nanosecondsPerPixel;
+            if (FAILED(MeasureDepthFilterCost(static_cast<DepthPlaneFilter>(filter), REPORTED_RESOLUTIONS[i], frameCount, &nanosecondsPerPixel)))
+            {
+                continue;
+            }
+
+            DWORD width, height;
+            NuiImageResolutionToSize(REPORTED_RESOLUTIONS[i], width, height);
+
+            WCHAR line[256];
+            StringCchPrintf(line, _countof(line), L"KinectBridge depth filter %s %ux%u: n=%u cost=%.2f nanoseconds per pixel\n",
+                GetDepthPlaneFilterName(static_cast<DepthPlaneFilter>(filter)), width, height, frameCount, nanosecondsPerPixel);
+            OutputDebugString(line);
+        }
+    }
+}
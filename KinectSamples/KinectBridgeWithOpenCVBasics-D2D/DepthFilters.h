@@ -0,0 +1,190 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthFilters.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        // Filters on planes of depths in millimeters. A depth of 0 or above MAX_FILTER_DEPTH, such
+        // as 65535, is invalid: it never contributes to another pixel. The source and destination
+        // planes must not overlap, since each pixel reads its neighbors. Rows are filtered eight
+        // pixels per SSE2 step, and pixels near the image border one at a time with the same
+        // arithmetic, treating neighbors outside the image as invalid. The filters take a range
+        // of rows of the whole image, so bands of one image can be filtered in parallel.
+
+        // Largest depth the sensor reports, in millimeters, as it fits in the 13 bits above the player index
+        const USHORT MAX_FILTER_DEPTH = 0xFFFF >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+
+        // Standard deviation of the sensor's depth at one millimeter, which grows with the square of
+        // the depth as the disparity is quantized: about 11 millimeters at 2 meters
+        const float DEPTH_NOISE_COEFFICIENT = 2.85e-6f;
+
+        // Smallest variance of a depth in square millimeters, so that pixels whose depth holds
+        // steady still follow slow changes and are not flagged for single steps
+        const float MIN_DEPTH_VARIANCE = 1.0f;
+
+        /// <summary>
+        /// Gets the variance of the sensor's depth at a depth
+        /// </summary>
+        /// <param name="depth">depth in millimeters</param>
+        /// <returns>variance in square millimeters, at least MIN_DEPTH_VARIANCE</returns>
+        inline float GetSensorVariance(float depth)
+        {
+            float deviation = DEPTH_NOISE_COEFFICIENT * depth * depth;
+            float variance = deviation * deviation;
+            return variance > MIN_DEPTH_VARIANCE ? variance : MIN_DEPTH_VARIANCE;
+        }
+
+        // Largest range width the bilateral filter takes, in millimeters
+        const USHORT MAX_BILATERAL_RANGE_WIDTH = 255;
+
+        /// <summary>
+        /// Depth plane filters, as FilterDepthRows applies them with their default settings
+        /// </summary>
+        enum DepthPlaneFilter
+        {
+            // FilterDepthBilateralRows with DEFAULT_BILATERAL_RANGE_WIDTH
+            DEPTH_PLANE_FILTER_BILATERAL,
+
+            // FillDepthHoleRows with DEFAULT_MIN_VALID_NEIGHBORS
+            DEPTH_PLANE_FILTER_FILL_HOLES,
+
+            // RemoveDepthSpeckleRows with DEFAULT_SPECKLE_MAX_DIFFERENCE and DEFAULT_SPECKLE_MIN_SUPPORT
+            DEPTH_PLANE_FILTER_REMOVE_SPECKLES,
+
+            DEPTH_PLANE_FILTER_COUNT
+        };
+
+        // Default settings of the filters
+        const USHORT DEFAULT_BILATERAL_RANGE_WIDTH = 60;
+        const UINT DEFAULT_MIN_VALID_NEIGHBORS = 3;
+        const USHORT DEFAULT_SPECKLE_MAX_DIFFERENCE = 50;
+        const UINT DEFAULT_SPECKLE_MIN_SUPPORT = 2;
+
+        /// <summary>
+        /// Smooths depths with a 5x5 joint bilateral filter. Each neighbor is weighted by a
+        /// binomial kernel of its distance and by how much closer than the range width its depth
+        /// is to the pixel's, and only counts if it has the pixel's player index, so depths are
+        /// never mixed across a depth edge or a player's outline. Invalid pixels stay as they are.
+        /// </summary>
+        /// <param name="firstRow">first row to filter</param>
+        /// <param name="rowCount">number of rows to filter</param>
+        /// <param name="width">width of the whole image in pixels</param>
+        /// <param name="height">height of the whole image in pixels</param>
+        /// <param name="pSource">depths of the whole image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pPlayers">player indices of the whole image, or NULL to ignore players</param>
+        /// <param name="playersPitch">bytes between the starts of player index rows</param>
+        /// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <param name="rangeWidth">depth difference in millimeters at which a neighbor stops counting, from 1 to MAX_BILATERAL_RANGE_WIDTH</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        HRESULT FilterDepthBilateralRows(UINT firstRow, UINT rowCount, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+            const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch, USHORT rangeWidth);
+
+        /// <summary>
+        /// Fills each invalid pixel with the farthest of its 8 neighbors when enough of them are
+        /// valid. Taking the farthest keeps foreground objects from growing into their shadows.
+        /// Valid pixels stay as they are.
+        /// </summary>
+        /// <param name="firstRow">first row to filter</param>
+        /// <param name="rowCount">number of rows to filter</param>
+        /// <param name="width">width of the whole image in pixels</param>
+        /// <param name="height">height of the whole image in pixels</param>
+        /// <param name="pSource">depths of the whole image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <param name="minValidNeighbors">valid neighbors an invalid pixel needs to be filled, from 1 to 8</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        HRESULT FillDepthHoleRows(UINT firstRow, UINT rowCount, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+            BYTE* pDestination, INT destinationPitch, UINT minValidNeighbors);
+
+        /// <summary>
+        /// Invalidates speckles: valid pixels with too few of their 8 neighbors valid and within a
+        /// depth difference of them. Such pixels are noise or flying pixels along depth edges.
+        /// Other pixels stay as they are.
+        /// </summary>
+        /// <param name="firstRow">first row to filter</param>
+        /// <param name="rowCount">number of rows to filter</param>
+        /// <param name="width">width of the whole image in pixels</param>
+        /// <param name="height">height of the whole image in pixels</param>
+        /// <param name="pSource">depths of the whole image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <param name="maxDifference">largest depth difference in millimeters of a supporting neighbor</param>
+        /// <param name="minSupport">supporting neighbors a pixel needs to be kept, from 0 to 8</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        HRESULT RemoveDepthSpeckleRows(UINT firstRow, UINT rowCount, UINT width, UINT height, const BYTE* pSource, INT sourcePitch,
+            BYTE* pDestination, INT destinationPitch, USHORT maxDifference, UINT minSupport);
+
+        /// <summary>
+        /// Applies a depth plane filter with its default settings
+        /// </summary>
+        /// <param name="filter">filter to apply</param>
+        /// <param name="firstRow">first row to filter</param>
+        /// <param name="rowCount">number of rows to filter</param>
+        /// <param name="width">width of the whole image in pixels</param>
+        /// <param name="height">height of the whole image in pixels</param>
+        /// <param name="pSource">depths of the whole image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pPlayers">player indices of the whole image, or NULL to ignore players</param>
+        /// <param name="playersPitch">bytes between the starts of player index rows</param>
+        /// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if the filter is unknown, an error code otherwise</returns>
+        HRESULT FilterDepthRows(DepthPlaneFilter filter, UINT firstRow, UINT rowCount, UINT width, UINT height,
+            const BYTE* pSource, INT sourcePitch, const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch);
+
+        /// <summary>
+        /// Applies a depth plane filter with its default settings to a region of an image, leaving the
+        /// rest of the destination as it is. The filter still reads the neighbors of the region's
+        /// pixels from outside it.
+        /// </summary>
+        /// <param name="filter">filter to apply</param>
+        /// <param name="region">pixels to filter, within the image</param>
+        /// <param name="width">width of the whole image in pixels</param>
+        /// <param name="height">height of the whole image in pixels</param>
+        /// <param name="pSource">depths of the whole image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pPlayers">player indices of the whole image, or NULL to ignore players</param>
+        /// <param name="playersPitch">bytes between the starts of player index rows</param>
+        /// <param name="pDestination">buffer of the whole image in which to return the depths</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if the filter is unknown or the region is not within the image, an error code otherwise</returns>
+        HRESULT FilterDepthRegion(DepthPlaneFilter filter, const RECT& region, UINT width, UINT height,
+            const BYTE* pSource, INT sourcePitch, const BYTE* pPlayers, INT playersPitch, BYTE* pDestination, INT destinationPitch);
+
+        /// <summary>
+        /// Gets the name of a depth plane filter
+        /// </summary>
+        /// <param name="filter">filter to name</param>
+        /// <returns>name of the filter</returns>
+        LPCWSTR GetDepthPlaneFilterName(DepthPlaneFilter filter);
+
+        /// <summary>
+        /// Measures what a depth plane filter costs per pixel on a synthetic scene of the given
+        /// resolution, with a floor, a wall, a player in front of it, noise, holes and speckles.
+        /// The filter runs on the calling thread.
+        /// </summary>
+        /// <param name="filter">filter to measure</param>
+        /// <param name="resolution">resolution of the scene</param>
+        /// <param name="frameCount">number of times to filter the scene</param>
+        /// <param name="pNanosecondsPerPixel">pointer in which to return the mean cost of a pixel in nanoseconds</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if the filter or resolution is not valid, an error code otherwise</returns>
+        HRESULT MeasureDepthFilterCost(DepthPlaneFilter filter, NUI_IMAGE_RESOLUTION resolution, UINT frameCount, double* pNanosecondsPerPixel);
+
+        /// <summary>
+        /// Writes what each depth plane filter costs per pixel at each depth resolution to the debugger output
+        /// </summary>
+        /// <param name="frameCount">number of times to filter the scene of each resolution</param>
+        void ReportDepthFilterCosts(UINT frameCount);
+    }
+}
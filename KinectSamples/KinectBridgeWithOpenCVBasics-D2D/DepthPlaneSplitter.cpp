@@ -0,0 +1,178 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthPlaneSplitter.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "DepthPlaneSplitter.h"
+#include <emmintrin.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pixels split per SSE2 step
+    const UINT PIXELS_PER_STEP = 16;
+
+    // Steps the 8-bit player counters can take before they have to be emptied
+    const UINT STEPS_PER_FLUSH = 255;
+
+    /// <summary>
+    /// Splits packed depth pixels one at a time
+    /// </summary>
+    template <bool CountPlayers>
+    void SplitScalar(const USHORT* pSource, USHORT* pDepth, BYTE* pPlayers, UINT pixelCount, UINT* pPlayerCounts)
+    {
+        for (UINT i = 0; i < pixelCount; ++i)
+        {
+            USHORT playerIndex = NuiDepthPixelToPlayerIndex(pSource[i]);
+            pDepth[i] = NuiDepthPixelToDepth(pSource[i]);
+            pPlayers[i] = static_cast<BYTE>(playerIndex);
+
+            if (CountPlayers)
+            {
+                ++pPlayerCounts[playerIndex];
+            }
+        }
+    }
+
+    /// <summary>
+    /// Splits packed depth pixels sixteen at a time. Player indices are counted in one
+    /// byte per lane for each index but 0, which is what is left over.
+    /// </summary>
+    template <bool CountPlayers>
+    void SplitRow(const USHORT* pSource, USHORT* pDepth, BYTE* pPlayers, UINT pixelCount, UINT* pPlayerCounts)
+    {
+        const __m128i playerMask = _mm_set1_epi16(NUI_IMAGE_PLAYER_INDEX_MASK);
+        const __m128i zero = _mm_setzero_si128();
+
+        UINT stepCount = pixelCount / PIXELS_PER_STEP;
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(pSource);
+        __m128i* pDepthOut = reinterpret_cast<__m128i*>(pDepth);
+        __m128i* pPlayersOut = reinterpret_cast<__m128i*>(pPlayers);
+
+        for (UINT first = 0; first < stepCount; first += STEPS_PER_FLUSH)
+        {
+            __m128i counters[PLAYER_INDEX_COUNT];
+            for (UINT player = 1; player < PLAYER_INDEX_COUNT; ++player)
+            {
+                counters[player] = zero;
+            }
+
+            UINT last = min(stepCount, first + STEPS_PER_FLUSH);
+            for (UINT i = first; i < last; ++i, pIn += 2, pDepthOut += 2, ++pPlayersOut)
+            {
+                __m128i low = _mm_loadu_si128(pIn + 0);
+                __m128i high = _mm_loadu_si128(pIn + 1);
+
+                _mm_storeu_si128(pDepthOut + 0, _mm_srli_epi16(low, NUI_IMAGE_PLAYER_INDEX_SHIFT));
+                _mm_storeu_si128(pDepthOut + 1, _mm_srli_epi16(high, NUI_IMAGE_PLAYER_INDEX_SHIFT));
+
+                // Player indices are at most 7, so narrowing with saturation never clamps
+                __m128i players = _mm_packus_epi16(_mm_and_si128(low, playerMask), _mm_and_si128(high, playerMask));
+                _mm_storeu_si128(pPlayersOut, players);
+
+                if (CountPlayers)
+                {
+                    // A matching lane compares as -1, so subtracting the comparison counts it
+                    for (UINT player = 1; player < PLAYER_INDEX_COUNT; ++player)
+                    {
+                        __m128i match = _mm_cmpeq_epi8(players, _mm_set1_epi8(static_cast<char>(player)));
+                        counters[player] = _mm_sub_epi8(counters[player], match);
+                    }
+                }
+            }
+
+            if (CountPlayers)
+            {
+                // Sum the byte lanes of each counter into its two 64-bit halves
+                UINT playerPixels = 0;
+                for (UINT player = 1; player < PLAYER_INDEX_COUNT; ++player)
+                {
+                    __m128i sums = _mm_sad_epu8(counters[player], zero);
+                    UINT count = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+                    pPlayerCounts[player] += count;
+                    playerPixels += count;
+                }
+
+                pPlayerCounts[0] += (last - first) * PIXELS_PER_STEP - playerPixels;
+            }
+        }
+
+        UINT done = stepCount * PIXELS_PER_STEP;
+        SplitScalar<CountPlayers>(pSource + done, pDepth + done, pPlayers + done, pixelCount - done, pPlayerCounts);
+    }
+}
+
+/// <summary>
+/// Splits a row of packed depth pixels into depths in millimeters and player indices.
+/// Sixteen pixels are split per SSE2 step, and the remainder one at a time.
+/// </summary>
+/// <param name="pSource">packed depth pixels to split</param>
+/// <param name="pDepth">buffer in which to return the depths</param>
+/// <param name="pPlayers">buffer in which to return the player indices</param>
+/// <param name="pixelCount">number of pixels in the row</param>
+/// <param name="pPlayerCounts">PLAYER_INDEX_COUNT counters the number of pixels of each player index is added to, or NULL</param>
+void Microsoft::KinectBridge::SplitDepthRow(const USHORT* pSource, USHORT* pDepth, BYTE* pPlayers, UINT pixelCount, UINT* pPlayerCounts)
+{
+    if (pPlayerCounts)
+    {
+        SplitRow<true>(pSource, pDepth, pPlayers, pixelCount, pPlayerCounts);
+    }
+    else
+    {
+        SplitRow<false>(pSource, pDepth, pPlayers, pixelCount, NULL);
+    }
+}
+
+/// <summary>
+/// Splits a packed depth image into a plane of depths in millimeters and a plane of
+/// player indices, reading each pixel once. When no image has padding between rows
+/// the whole image is split as a single row.
+/// </summary>
+/// <param name="pSource">packed depth pixels to split</param>
+/// <param name="sourcePitch">bytes between the starts of source rows</param>
+/// <param name="pDepth">buffer in which to return the depths</param>
+/// <param name="depthPitch">bytes between the starts of depth rows</param>
+/// <param name="pPlayers">buffer in which to return the player indices</param>
+/// <param name="playersPitch">bytes between the starts of player index rows</param>
+/// <param name="width">width of the image in pixels</param>
+/// <param name="height">height of the image in pixels</param>
+/// <param name="pPlayerCounts">PLAYER_INDEX_COUNT entries in which to return the number of pixels of each player index, or NULL</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT Microsoft::KinectBridge::SplitDepthImage(const BYTE* pSource, INT sourcePitch, BYTE* pDepth, INT depthPitch, BYTE* pPlayers, INT playersPitch,
+    UINT width, UINT height, UINT* pPlayerCounts)
+{
+    if (!pSource || !pDepth || !pPlayers)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the rows would overlap
+    INT depthRowSize = static_cast<INT>(width * sizeof(USHORT));
+    INT playersRowSize = static_cast<INT>(width * sizeof(BYTE));
+    if (sourcePitch < depthRowSize || depthPitch < depthRowSize || playersPitch < playersRowSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (pPlayerCounts)
+    {
+        ZeroMemory(pPlayerCounts, PLAYER_INDEX_COUNT * sizeof(UINT));
+    }
+
+    // Treat an image without padding as one long row
+    if (sourcePitch == depthRowSize && depthPitch == depthRowSize && playersPitch == playersRowSize)
+    {
+        width *= height;
+        height = 1;
+    }
+
+    for (UINT y = 0; y < height; ++y)
+    {
+        SplitDepthRow(reinterpret_cast<const USHORT*>(pSource + y * sourcePitch), reinterpret_cast<USHORT*>(pDepth + y * depthPitch),
+            pPlayers + y * playersPitch, width, pPlayerCounts);
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// <copyright file="DepthPlaneSplitter.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        // Number of distinct player indices a packed depth pixel can hold, including 0 for no player
+        const UINT PLAYER_INDEX_COUNT = NUI_IMAGE_PLAYER_INDEX_MASK + 1;
+
+        /// <summary>
+        /// Splits a row of packed depth pixels into depths in millimeters and player indices.
+        /// Sixteen pixels are split per SSE2 step, and the remainder one at a time.
+        /// </summary>
+        /// <param name="pSource">packed depth pixels to split</param>
+        /// <param name="pDepth">buffer in which to return the depths</param>
+        /// <param name="pPlayers">buffer in which to return the player indices</param>
+        /// <param name="pixelCount">number of pixels in the row</param>
+        /// <param name="pPlayerCounts">PLAYER_INDEX_COUNT counters the number of pixels of each player index is added to, or NULL</param>
+        void SplitDepthRow(const USHORT* pSource, USHORT* pDepth, BYTE* pPlayers, UINT pixelCount, UINT* pPlayerCounts);
+
+        /// <summary>
+        /// Splits a packed depth image into a plane of depths in millimeters and a plane of
+        /// player indices, reading each pixel once. When no image has padding between rows
+        /// the whole image is split as a single row.
+        /// </summary>
+        /// <param name="pSource">packed depth pixels to split</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDepth">buffer in which to return the depths</param>
+        /// <param name="depthPitch">bytes between the starts of depth rows</param>
+        /// <param name="pPlayers">buffer in which to return the player indices</param>
+        /// <param name="playersPitch">bytes between the starts of player index rows</param>
+        /// <param name="width">width of the image in pixels</param>
+        /// <param name="height">height of the image in pixels</param>
+        /// <param name="pPlayerCounts">PLAYER_INDEX_COUNT entries in which to return the number of pixels of each player index, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        HRESULT SplitDepthImage(const BYTE* pSource, INT sourcePitch, BYTE* pDepth, INT depthPitch, BYTE* pPlayers, INT playersPitch,
+            UINT width, UINT height, UINT* pPlayerCounts);
+    }
+}
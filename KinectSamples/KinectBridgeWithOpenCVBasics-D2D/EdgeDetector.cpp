@@ -0,0 +1,435 @@
+//-----------------------------------------------------------------------------
+// <copyright file="EdgeDetector.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "EdgeDetector.h"
+#include "PixelKernels.h"
+#include "PerformanceCounter.h"
+#include <strsafe.h>
+#include <cmath>
+#include <cstdlib>
+
+using namespace cv;
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Fixed point shift of the gradient direction test, and tan(22.5 degrees) in that fixed point
+    const int DIRECTION_SHIFT = 15;
+    const int TAN_22_5 = static_cast<int>(0.4142135623730950488016887242097 * (1 << DIRECTION_SHIFT) + 0.5);
+
+    // Weights of the gray conversion, shared with ConvertColorRow
+    typedef PixelKernel<BgrxPixelFormat, Gray8PixelFormat> GrayKernel;
+
+    /// <summary>
+    /// Reflects an index into [0, count) without repeating the border, as OpenCV's BORDER_REFLECT_101
+    /// </summary>
+    inline int Reflect(int index, int count)
+    {
+        if (count == 1)
+        {
+            return 0;
+        }
+
+        if (index < 0)
+        {
+            return -index;
+        }
+
+        return index >= count ? 2 * count - 2 - index : index;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="lowThreshold">gradient below which pixels are never edges</param>
+/// <param name="highThreshold">gradient above which pixels are always edges</param>
+EdgeDetector::EdgeDetector(double lowThreshold, double highThreshold) :
+    m_lowThreshold(0),
+    m_highThreshold(0),
+    m_allocationCount(0),
+    m_frameCount(0),
+    m_totalTicks(0)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_ticksPerSecond = frequency.QuadPart;
+
+    SetThresholds(lowThreshold, highThreshold);
+}
+
+/// <summary>
+/// Sets the hysteresis thresholds on the L1 gradient of the blurred gray image
+/// </summary>
+/// <param name="lowThreshold">gradient below which pixels are never edges</param>
+/// <param name="highThreshold">gradient above which pixels are always edges</param>
+/// <returns>S_OK if successful, E_INVALIDARG unless 0 &lt;= lowThreshold &lt;= highThreshold</returns>
+HRESULT EdgeDetector::SetThresholds(double lowThreshold, double highThreshold)
+{
+    if (lowThreshold < 0.0 || lowThreshold > highThreshold)
+    {
+        return E_INVALIDARG;
+    }
+
+    // The largest L1 gradient of 8-bit pixels is 2040, so larger thresholds all mean "never"
+    m_lowThreshold = static_cast<int>(floor(min(lowThreshold, 4096.0)));
+    m_highThreshold = static_cast<int>(floor(min(highThreshold, 4096.0)));
+
+    return S_OK;
+}
+
+/// <summary>
+/// Finds the edges of an image and draws them into another one, which may be the same
+/// </summary>
+/// <param name="source">image to find the edges of, of type CV_8UC4 or CV_8UC1</param>
+/// <param name="sourceFormat">layout of the source pixels: COLOR_IMAGE_FORMAT_BGRX, COLOR_IMAGE_FORMAT_RGBA or COLOR_IMAGE_FORMAT_GRAY</param>
+/// <param name="pEdgeImage">pointer in which to return the edges, of type CV_8UC4 and the size of the source</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the source does not match its format, an error code otherwise</returns>
+HRESULT EdgeDetector::Detect(const Mat& source, ColorImageFormat sourceFormat, Mat* pEdgeImage)
+{
+    if (!pEdgeImage)
+    {
+        return E_POINTER;
+    }
+
+    bool isGray = (sourceFormat == COLOR_IMAGE_FORMAT_GRAY);
+    bool isFourChannel = (sourceFormat == COLOR_IMAGE_FORMAT_BGRX || sourceFormat == COLOR_IMAGE_FORMAT_RGBA);
+    if (source.empty() || (isGray && source.type() != CV_8UC1) || (isFourChannel && source.type() != CV_8UC4) ||
+        (!isGray && !isFourChannel))
+    {
+        return E_INVALIDARG;
+    }
+
+    LONGLONG startTicks = GetTicks();
+
+    PrepareBuffers(source.cols, source.rows);
+
+    // A gray source is read where it is; it is only written to after the edges are traced
+    if (isGray)
+    {
+        BlurGray(source);
+    }
+    else
+    {
+        ComputeGray(source, sourceFormat);
+        BlurGray(m_gray);
+    }
+
+    ComputeGradients();
+    TraceEdges();
+
+    if (pEdgeImage->size() != source.size() || pEdgeImage->type() != CV_8UC4)
+    {
+        pEdgeImage->create(source.size(), CV_8UC4);
+        ++m_allocationCount;
+    }
+
+    WriteEdgeImage(pEdgeImage);
+
+    m_totalTicks += GetTicks() - startTicks;
+    ++m_frameCount;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the frame count, allocations per frame and mean time per frame to the debugger output
+/// </summary>
+/// <param name="detectorName">name of the detector to write before the figures</param>
+void EdgeDetector::Report(LPCWSTR detectorName) const
+{
+    if (0 == m_frameCount)
+    {
+        return;
+    }
+
+    WCHAR line[256];
+    StringCchPrintf(line, _countof(line), L"KinectBridge edge detector %s: n=%I64d allocations=%I64d (%.3f per frame) mean=%.1f microseconds\n",
+        detectorName, m_frameCount, m_allocationCount, static_cast<double>(m_allocationCount) / m_frameCount,
+        1000000.0 * m_totalTicks / m_ticksPerSecond / m_frameCount);
+    OutputDebugString(line);
+}
+
+/// <summary>
+/// Sizes the planes for a resolution, if they are not already
+/// </summary>
+/// <param name="width">width of the images in pixels</param>
+/// <param name="height">height of the images in pixels</param>
+void EdgeDetector::PrepareBuffers(int width, int height)
+{
+    if (m_blurred.cols == width && m_blurred.rows == height)
+    {
+        return;
+    }
+
+    m_gray.create(height, width, CV_8UC1);
+    m_blurred.create(height, width, CV_8UC1);
+    m_gradientX.create(height, width, CV_16SC1);
+    m_gradientY.create(height, width, CV_16SC1);
+    m_columnSums.assign(width + 2, 0);
+    m_magnitudes.assign(3 * (width + 2), 0);
+    m_edgeMap.assign((width + 2) * (height + 2), 1);
+    m_edgeStack.assign(width * height, NULL);
+
+    m_allocationCount += 8;
+}
+
+/// <summary>
+/// Fills the gray plane from a 4 channel source
+/// </summary>
+/// <param name="source">source image</param>
+/// <param name="sourceFormat">layout of the source pixels</param>
+void EdgeDetector::ComputeGray(const Mat& source, ColorImageFormat sourceFormat)
+{
+    for (int y = 0; y < source.rows; ++y)
+    {
+        const BYTE* pSource = source.ptr<BYTE>(y);
+        BYTE* pGray = m_gray.ptr<BYTE>(y);
+
+        if (sourceFormat == COLOR_IMAGE_FORMAT_BGRX)
+        {
+            ConvertColorRow(pSource, pGray, source.cols, COLOR_IMAGE_FORMAT_GRAY);
+            continue;
+        }
+
+        // Red first, so the red and blue weights trade places
+        const UINT32* pPixels = reinterpret_cast<const UINT32*>(pSource);
+        for (int x = 0; x < source.cols; ++x)
+        {
+            UINT32 pixel = pPixels[x];
+            UINT luma = GrayKernel::RED_WEIGHT * (pixel & 0xFF) + GrayKernel::GREEN_WEIGHT * ((pixel >> 8) & 0xFF) +
+                GrayKernel::BLUE_WEIGHT * ((pixel >> 16) & 0xFF);
+            pGray[x] = static_cast<BYTE>((luma + 128) >> 8);
+        }
+    }
+}
+
+/// <summary>
+/// Fills the blurred plane with the 3x3 mean of the gray image, reflecting it at the borders
+/// </summary>
+/// <param name="gray">gray image</param>
+void EdgeDetector::BlurGray(const Mat& gray)
+{
+    const int width = gray.cols;
+    const int height = gray.rows;
+    USHORT* pSums = &m_columnSums[1];
+
+    for (int y = 0; y < height; ++y)
+    {
+        const BYTE* pAbove = gray.ptr<BYTE>(Reflect(y - 1, height));
+        const BYTE* pRow = gray.ptr<BYTE>(y);
+        const BYTE* pBelow = gray.ptr<BYTE>(Reflect(y + 1, height));
+
+        for (int x = 0; x < width; ++x)
+        {
+            pSums[x] = static_cast<USHORT>(pAbove[x] + pRow[x] + pBelow[x]);
+        }
+
+        pSums[-1] = pSums[Reflect(-1, width)];
+        pSums[width] = pSums[Reflect(width, width)];
+
+        // Nine is odd, so a sum is never halfway between two means and this rounds as OpenCV does
+        BYTE* pBlurred = m_blurred.ptr<BYTE>(y);
+        for (int x = 0; x < width; ++x)
+        {
+            pBlurred[x] = static_cast<BYTE>((pSums[x - 1] + pSums[x] + pSums[x + 1] + 4) / 9);
+        }
+    }
+}
+
+/// <summary>
+/// Fills the gradient planes with the 3x3 Sobel derivatives of the blurred plane,
+/// replicating it at the borders
+/// </summary>
+void EdgeDetector::ComputeGradients()
+{
+    const int width = m_blurred.cols;
+    const int height = m_blurred.rows;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const BYTE* pAbove = m_blurred.ptr<BYTE>(max(y - 1, 0));
+        const BYTE* pRow = m_blurred.ptr<BYTE>(y);
+        const BYTE* pBelow = m_blurred.ptr<BYTE>(min(y + 1, height - 1));
+        short* pGradientX = m_gradientX.ptr<short>(y);
+        short* pGradientY = m_gradientY.ptr<short>(y);
+        USHORT* pSums = &m_columnSums[1];
+
+        // The kernels are separable: smooth down the columns for x and differentiate them for y
+        for (int x = 0; x < width; ++x)
+        {
+            pSums[x] = static_cast<USHORT>(pAbove[x] + 2 * pRow[x] + pBelow[x]);
+            pGradientY[x] = static_cast<short>(pBelow[x] - pAbove[x]);
+        }
+
+        pSums[-1] = pSums[0];
+        pSums[width] = pSums[width - 1];
+
+        // Then differentiate along the rows for x and smooth them for y, the latter in place
+        int previousDifference = pGradientY[0];
+        for (int x = 0; x < width; ++x)
+        {
+            int difference = pGradientY[x];
+            int nextDifference = x + 1 < width ? pGradientY[x + 1] : difference;
+
+            pGradientX[x] = static_cast<short>(pSums[x + 1] - pSums[x - 1]);
+            pGradientY[x] = static_cast<short>(previousDifference + 2 * difference + nextDifference);
+            previousDifference = difference;
+        }
+    }
+}
+
+/// <summary>
+/// Fills the edge map by non-maximum suppression and hysteresis of the gradients
+/// </summary>
+void EdgeDetector::TraceEdges()
+{
+    const int width = m_blurred.cols;
+    const int height = m_blurred.rows;
+    const int mapStep = width + 2;
+    const int magnitudeStep = width + 2;
+
+    // Rows of magnitudes rotate through the three slots, the one above the image being all zero
+    int* pPrevious = &m_magnitudes[1];
+    int* pCurrent = pPrevious + magnitudeStep;
+    int* pNext = pCurrent + magnitudeStep;
+    memset(&m_magnitudes[0], 0, m_magnitudes.size() * sizeof(int));
+
+    BYTE* pMap = &m_edgeMap[0];
+    memset(pMap, 1, mapStep);
+    memset(pMap + mapStep * (height + 1), 1, mapStep);
+
+    BYTE** ppStackTop = &m_edgeStack[0];
+
+    // Magnitudes of row y are computed before row y - 1 is suppressed, since that needs its
+    // neighbors above and below
+    for (int y = 0; y <= height; ++y)
+    {
+        if (y < height)
+        {
+            const short* pGradientX = m_gradientX.ptr<short>(y);
+            const short* pGradientY = m_gradientY.ptr<short>(y);
+            for (int x = 0; x < width; ++x)
+            {
+                pNext[x] = abs(pGradientX[x]) + abs(pGradientY[x]);
+            }
+        }
+        else
+        {
+            memset(pNext - 1, 0, magnitudeStep * sizeof(int));
+        }
+
+        if (y > 0)
+        {
+            BYTE* pMapRow = pMap + mapStep * y + 1;
+            pMapRow[-1] = 1;
+            pMapRow[width] = 1;
+
+            const short* pGradientX = m_gradientX.ptr<short>(y - 1);
+            const short* pGradientY = m_gradientY.ptr<short>(y - 1);
+            bool isPreviousEdge = false;
+
+            for (int x = 0; x < width; ++x)
+            {
+                int magnitude = pCurrent[x];
+                bool isMaximum = false;
+
+                if (magnitude > m_lowThreshold)
+                {
+                    int gradientX = pGradientX[x];
+                    int gradientY = pGradientY[x];
+                    int absoluteX = abs(gradientX);
+                    int scaledY = abs(gradientY) << DIRECTION_SHIFT;
+                    int tan22X = absoluteX * TAN_22_5;
+
+                    if (scaledY < tan22X)
+                    {
+                        // Mostly horizontal gradient
+                        isMaximum = magnitude > pCurrent[x - 1] && magnitude >= pCurrent[x + 1];
+                    }
+                    else
+                    {
+                        int tan67X = tan22X + (absoluteX << (DIRECTION_SHIFT + 1));
+                        if (scaledY > tan67X)
+                        {
+                            // Mostly vertical gradient
+                            isMaximum = magnitude > pPrevious[x] && magnitude >= pNext[x];
+                        }
+                        else
+                        {
+                            // Diagonal gradient
+                            int side = (gradientX ^ gradientY) < 0 ? -1 : 1;
+                            isMaximum = magnitude > pPrevious[x - side] && magnitude > pNext[x + side];
+                        }
+                    }
+                }
+
+                if (!isMaximum)
+                {
+                    pMapRow[x] = 1;
+                    isPreviousEdge = false;
+                }
+                else if (!isPreviousEdge && magnitude > m_highThreshold && pMapRow[x - mapStep] != 2)
+                {
+                    pMapRow[x] = 2;
+                    *ppStackTop++ = pMapRow + x;
+                    isPreviousEdge = true;
+                }
+                else
+                {
+                    pMapRow[x] = 0;
+                }
+            }
+        }
+
+        int* pOldest = pPrevious;
+        pPrevious = pCurrent;
+        pCurrent = pNext;
+        pNext = pOldest;
+    }
+
+    // Grow the edges into the possible edges they touch
+    while (ppStackTop > &m_edgeStack[0])
+    {
+        BYTE* pEdge = *--ppStackTop;
+        BYTE* pNeighbors[8] =
+        {
+            pEdge - mapStep - 1, pEdge - mapStep, pEdge - mapStep + 1,
+            pEdge - 1, pEdge + 1,
+            pEdge + mapStep - 1, pEdge + mapStep, pEdge + mapStep + 1
+        };
+
+        for (int i = 0; i < 8; ++i)
+        {
+            if (0 == *pNeighbors[i])
+            {
+                *pNeighbors[i] = 2;
+                *ppStackTop++ = pNeighbors[i];
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Writes the edge map as white on black pixels with an opaque alpha
+/// </summary>
+/// <param name="pEdgeImage">pointer to the image to write, already of the right size and type</param>
+void EdgeDetector::WriteEdgeImage(Mat* pEdgeImage) const
+{
+    const int width = m_blurred.cols;
+    const int mapStep = width + 2;
+
+    for (int y = 0; y < m_blurred.rows; ++y)
+    {
+        const BYTE* pMapRow = &m_edgeMap[mapStep * (y + 1) + 1];
+        UINT32* pPixels = pEdgeImage->ptr<UINT32>(y);
+
+        for (int x = 0; x < width; ++x)
+        {
+            pPixels[x] = pMapRow[x] == 2 ? 0xFFFFFFFF : 0xFF000000;
+        }
+    }
+}
@@ -0,0 +1,143 @@
+//-----------------------------------------------------------------------------
+// <copyright file="EdgeDetector.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include "ColorConversion.h"
+
+// Suppress warnings that come from compiling OpenCV code since we have no control over it
+#pragma warning(push)
+#pragma warning(disable : 6294 6031)
+#include <opencv2/core/core.hpp>
+#pragma warning(pop)
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Canny edge detection that draws the edges as an opaque white on black image. The gray,
+        /// blurred and gradient planes are kept from frame to frame and only reallocated when the
+        /// resolution changes, so frames of the same size allocate nothing. The gray plane is
+        /// computed straight from the source pixels, or skipped when the source is already gray,
+        /// and the output image is written once, at the end. Not safe to use from several threads at once.
+        /// </summary>
+        class EdgeDetector
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            /// <param name="lowThreshold">gradient below which pixels are never edges</param>
+            /// <param name="highThreshold">gradient above which pixels are always edges</param>
+            EdgeDetector(double lowThreshold, double highThreshold);
+
+            /// <summary>
+            /// Sets the hysteresis thresholds on the L1 gradient of the blurred gray image
+            /// </summary>
+            /// <param name="lowThreshold">gradient below which pixels are never edges</param>
+            /// <param name="highThreshold">gradient above which pixels are always edges</param>
+            /// <returns>S_OK if successful, E_INVALIDARG unless 0 &lt;= lowThreshold &lt;= highThreshold</returns>
+            HRESULT SetThresholds(double lowThreshold, double highThreshold);
+
+            /// <summary>
+            /// Finds the edges of an image and draws them into another one, which may be the same
+            /// </summary>
+            /// <param name="source">image to find the edges of, of type CV_8UC4 or CV_8UC1</param>
+            /// <param name="sourceFormat">layout of the source pixels: COLOR_IMAGE_FORMAT_BGRX, COLOR_IMAGE_FORMAT_RGBA or COLOR_IMAGE_FORMAT_GRAY</param>
+            /// <param name="pEdgeImage">pointer in which to return the edges, of type CV_8UC4 and the size of the source</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the source does not match its format, an error code otherwise</returns>
+            HRESULT Detect(const cv::Mat& source, ColorImageFormat sourceFormat, cv::Mat* pEdgeImage);
+
+            /// <summary>
+            /// Gets the number of buffers allocated so far, including those of the images edges were drawn into
+            /// </summary>
+            /// <returns>number of allocations</returns>
+            LONGLONG GetAllocationCount() const { return m_allocationCount; }
+
+            /// <summary>
+            /// Gets the number of images edges were found in
+            /// </summary>
+            /// <returns>number of images</returns>
+            LONGLONG GetFrameCount() const { return m_frameCount; }
+
+            /// <summary>
+            /// Writes the frame count, allocations per frame and mean time per frame to the debugger output
+            /// </summary>
+            /// <param name="detectorName">name of the detector to write before the figures</param>
+            void Report(LPCWSTR detectorName) const;
+
+        private:
+            // Functions:
+            /// <summary>
+            /// Sizes the planes for a resolution, if they are not already
+            /// </summary>
+            /// <param name="width">width of the images in pixels</param>
+            /// <param name="height">height of the images in pixels</param>
+            void PrepareBuffers(int width, int height);
+
+            /// <summary>
+            /// Fills the gray plane from a 4 channel source
+            /// </summary>
+            /// <param name="source">source image</param>
+            /// <param name="sourceFormat">layout of the source pixels</param>
+            void ComputeGray(const cv::Mat& source, ColorImageFormat sourceFormat);
+
+            /// <summary>
+            /// Fills the blurred plane with the 3x3 mean of the gray image, reflecting it at the borders
+            /// </summary>
+            /// <param name="gray">gray image</param>
+            void BlurGray(const cv::Mat& gray);
+
+            /// <summary>
+            /// Fills the gradient planes with the 3x3 Sobel derivatives of the blurred plane,
+            /// replicating it at the borders
+            /// </summary>
+            void ComputeGradients();
+
+            /// <summary>
+            /// Fills the edge map by non-maximum suppression and hysteresis of the gradients
+            /// </summary>
+            void TraceEdges();
+
+            /// <summary>
+            /// Writes the edge map as white on black pixels with an opaque alpha
+            /// </summary>
+            /// <param name="pEdgeImage">pointer to the image to write, already of the right size and type</param>
+            void WriteEdgeImage(cv::Mat* pEdgeImage) const;
+
+            // Variables:
+            // Hysteresis thresholds, rounded down as the gradients are integers
+            int m_lowThreshold;
+            int m_highThreshold;
+
+            // Gray image, its blur and the blur's derivatives along x and y
+            cv::Mat m_gray;
+            cv::Mat m_blurred;
+            cv::Mat m_gradientX;
+            cv::Mat m_gradientY;
+
+            // Sums of three gray rows for each column, with a reflected column on each side
+            std::vector<USHORT> m_columnSums;
+
+            // Gradient magnitudes of the previous, current and next rows, with a zero on each side
+            std::vector<int> m_magnitudes;
+
+            // Edge map with a border of one pixel: 0 for possible edges, 1 for non-edges, 2 for edges
+            std::vector<BYTE> m_edgeMap;
+
+            // Edges whose neighbors are yet to be traced; each pixel is pushed at most once
+            std::vector<BYTE*> m_edgeStack;
+
+            // Figures for Report
+            LONGLONG m_allocationCount;
+            LONGLONG m_frameCount;
+            LONGLONG m_totalTicks;
+            LONGLONG m_ticksPerSecond;
+        };
+    }
+}
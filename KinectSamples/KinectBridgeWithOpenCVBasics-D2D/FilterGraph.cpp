@@ -0,0 +1,787 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FilterGraph.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FilterGraph.h"
+#include "PerformanceCounter.h"
+#include <strsafe.h>
+#include <wchar.h>
+
+// Suppress warnings that come from compiling OpenCV code since we have no control over it
+#pragma warning(push)
+#pragma warning(disable : 6294 6031)
+#include <opencv2/imgproc/imgproc.hpp>
+#pragma warning(pop)
+
+using namespace cv;
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Names filters are added by, in FilterType order
+    LPCWSTR g_filterNames[FILTER_TYPE_COUNT] =
+    {
+        L"Gray",
+        L"Color",
+        L"GaussianBlur",
+        L"BoxBlur",
+        L"Dilate",
+        L"Erode",
+        L"CannyEdge",
+        L"Scale",
+        L"Threshold",
+        L"Invert",
+        L"Overlay"
+    };
+
+    /// <summary>
+    /// Gets whether a parameter is a whole number in a range
+    /// </summary>
+    inline bool IsWholeNumber(double value, double minimum)
+    {
+        return value >= minimum && value == static_cast<int>(value);
+    }
+}
+
+/// <summary>
+/// Constructor. Starts with no nodes, so the graph leaves images unchanged.
+/// </summary>
+/// <param name="colorFormat">channel order of the images the graph is applied to: COLOR_IMAGE_FORMAT_BGRX or COLOR_IMAGE_FORMAT_RGBA</param>
+FilterGraph::FilterGraph(ColorImageFormat colorFormat) :
+    m_colorFormat(colorFormat),
+    m_plannedType(-1),
+    m_isPlanStale(true),
+    m_isOutputCopied(false)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_ticksPerSecond = frequency.QuadPart;
+}
+
+/// <summary>
+/// Removes all nodes
+/// </summary>
+void FilterGraph::Clear()
+{
+    m_nodes.clear();
+    m_passes.clear();
+    m_nodePasses.clear();
+    m_buffers.clear();
+    m_isPlanStale = true;
+}
+
+/// <summary>
+/// Adds a node running a filter with one input
+/// </summary>
+/// <param name="type">filter to run, any but FILTER_TYPE_OVERLAY</param>
+/// <param name="input">node whose output the filter reads, or SOURCE_NODE</param>
+/// <param name="parameter0">first parameter of the filter</param>
+/// <param name="parameter1">second parameter of the filter</param>
+/// <param name="pNode">pointer in which to return the index of the node, or NULL</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the input or a parameter is not valid</returns>
+HRESULT FilterGraph::AddNode(FilterType type, int input, double parameter0, double parameter1, int* pNode)
+{
+    if (input < SOURCE_NODE || input >= static_cast<int>(m_nodes.size()))
+    {
+        return E_INVALIDARG;
+    }
+
+    bool isValid = true;
+    switch (type)
+    {
+    case FILTER_TYPE_GAUSSIAN_BLUR:
+        isValid = IsWholeNumber(parameter0, 1.0) && static_cast<int>(parameter0) % 2 == 1 && parameter1 >= 0.0;
+        break;
+
+    case FILTER_TYPE_BOX_BLUR:
+        isValid = IsWholeNumber(parameter0, 1.0);
+        break;
+
+    case FILTER_TYPE_DILATE:
+    case FILTER_TYPE_ERODE:
+        isValid = IsWholeNumber(parameter0, 0.0);
+        break;
+
+    case FILTER_TYPE_CANNY_EDGE:
+        isValid = parameter0 >= 0.0 && parameter0 <= parameter1;
+        break;
+
+    case FILTER_TYPE_GRAY:
+    case FILTER_TYPE_COLOR:
+    case FILTER_TYPE_SCALE:
+    case FILTER_TYPE_THRESHOLD:
+    case FILTER_TYPE_INVERT:
+        break;
+
+    default:
+        // Overlays are added with AddOverlayNode
+        isValid = false;
+        break;
+    }
+
+    if (!isValid)
+    {
+        return E_INVALIDARG;
+    }
+
+    Node node;
+    node.type = type;
+    node.inputs[0] = input;
+    node.inputs[1] = SOURCE_NODE;
+    node.parameters[0] = parameter0;
+    node.parameters[1] = parameter1;
+
+    m_nodes.push_back(node);
+    m_isPlanStale = true;
+
+    if (pNode)
+    {
+        *pNode = static_cast<int>(m_nodes.size()) - 1;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Adds a node running a filter given by its name
+/// </summary>
+/// <param name="filterName">name of the filter to run, as GetFilterName gives</param>
+/// <param name="input">node whose output the filter reads, or SOURCE_NODE</param>
+/// <param name="parameter0">first parameter of the filter</param>
+/// <param name="parameter1">second parameter of the filter</param>
+/// <param name="pNode">pointer in which to return the index of the node, or NULL</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the name, input or a parameter is not valid</returns>
+HRESULT FilterGraph::AddNode(LPCWSTR filterName, int input, double parameter0, double parameter1, int* pNode)
+{
+    if (!filterName)
+    {
+        return E_POINTER;
+    }
+
+    for (int i = 0; i < FILTER_TYPE_COUNT; ++i)
+    {
+        if (0 == _wcsicmp(filterName, g_filterNames[i]))
+        {
+            return AddNode(static_cast<FilterType>(i), input, parameter0, parameter1, pNode);
+        }
+    }
+
+    return E_INVALIDARG;
+}
+
+/// <summary>
+/// Adds a node drawing one image over another
+/// </summary>
+/// <param name="baseInput">node whose output is drawn over, or SOURCE_NODE</param>
+/// <param name="overlayInput">node whose output is drawn, or SOURCE_NODE</param>
+/// <param name="opacity">opacity from 0 to 1 of the drawn pixels</param>
+/// <param name="pNode">pointer in which to return the index of the node, or NULL</param>
+/// <returns>S_OK if successful, E_INVALIDARG if an input or the opacity is not valid</returns>
+HRESULT FilterGraph::AddOverlayNode(int baseInput, int overlayInput, double opacity, int* pNode)
+{
+    int nodeCount = static_cast<int>(m_nodes.size());
+    if (baseInput < SOURCE_NODE || baseInput >= nodeCount || overlayInput < SOURCE_NODE || overlayInput >= nodeCount ||
+        opacity < 0.0 || opacity > 1.0)
+    {
+        return E_INVALIDARG;
+    }
+
+    Node node;
+    node.type = FILTER_TYPE_OVERLAY;
+    node.inputs[0] = baseInput;
+    node.inputs[1] = overlayInput;
+    node.parameters[0] = opacity;
+    node.parameters[1] = 0.0;
+
+    m_nodes.push_back(node);
+    m_isPlanStale = true;
+
+    if (pNode)
+    {
+        *pNode = nodeCount;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Runs the graph on an image, replacing it with the graph's output
+/// </summary>
+/// <param name="pImage">pointer to the image to filter</param>
+/// <returns>S_OK if successful, E_INVALIDARG if a filter cannot take the image it is given, an error code otherwise</returns>
+HRESULT FilterGraph::Apply(Mat* pImage)
+{
+    if (!pImage)
+    {
+        return E_POINTER;
+    }
+
+    if (pImage->empty())
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_nodes.empty())
+    {
+        return S_OK;
+    }
+
+    if (m_isPlanStale || pImage->size() != m_plannedSize || pImage->type() != m_plannedType)
+    {
+        HRESULT hr = Plan(pImage->size(), pImage->type());
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    for (size_t i = 0; i < m_passes.size(); ++i)
+    {
+        LONGLONG startTicks = GetTicks();
+        RunPass(m_passes[i], pImage);
+
+        m_passes[i].totalTicks += GetTicks() - startTicks;
+        ++m_passes[i].runCount;
+    }
+
+    if (m_isOutputCopied)
+    {
+        m_buffers[m_passes.back().outputBuffer].copyTo(*pImage);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the cost of a node since the graph was last planned
+/// </summary>
+/// <param name="node">index of the node</param>
+/// <param name="pCost">pointer in which to return the cost</param>
+/// <returns>S_OK if successful, E_INVALIDARG if there is no such node</returns>
+HRESULT FilterGraph::GetNodeCost(UINT node, FilterNodeCost* pCost) const
+{
+    if (!pCost)
+    {
+        return E_POINTER;
+    }
+
+    if (node >= m_nodes.size())
+    {
+        return E_INVALIDARG;
+    }
+
+    pCost->type = m_nodes[node].type;
+    pCost->isUsed = false;
+    pCost->passNodeCount = 0;
+    pCost->runCount = 0;
+    pCost->meanMicros = 0.0;
+
+    // Nothing ran since the nodes last changed
+    if (m_isPlanStale || node >= m_nodePasses.size() || m_nodePasses[node] < 0)
+    {
+        return S_OK;
+    }
+
+    const Pass& pass = m_passes[m_nodePasses[node]];
+    pCost->isUsed = true;
+    pCost->passNodeCount = static_cast<UINT>(pass.nodes.size());
+    pCost->runCount = pass.runCount;
+    if (pass.runCount > 0)
+    {
+        pCost->meanMicros = 1000000.0 * pass.totalTicks / m_ticksPerSecond / pass.runCount;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the cost of every node to the debugger output
+/// </summary>
+/// <param name="graphName">name of the graph to write before the costs</param>
+void FilterGraph::Report(LPCWSTR graphName) const
+{
+    WCHAR line[256];
+    StringCchPrintf(line, _countof(line), L"KinectBridge filter graph %s (microseconds):\n", graphName);
+    OutputDebugString(line);
+
+    for (UINT i = 0; i < m_nodes.size(); ++i)
+    {
+        FilterNodeCost cost;
+        GetNodeCost(i, &cost);
+
+        if (!cost.isUsed)
+        {
+            StringCchPrintf(line, _countof(line), L"  #%-3u %-14s not run\n", i, GetFilterName(cost.type));
+        }
+        else if (cost.passNodeCount > 1)
+        {
+            StringCchPrintf(line, _countof(line), L"  #%-3u %-14s n=%I64d mean=%.1f, in one pass with %u nodes\n",
+                i, GetFilterName(cost.type), cost.runCount, cost.meanMicros, cost.passNodeCount);
+        }
+        else
+        {
+            StringCchPrintf(line, _countof(line), L"  #%-3u %-14s n=%I64d mean=%.1f\n",
+                i, GetFilterName(cost.type), cost.runCount, cost.meanMicros);
+        }
+
+        OutputDebugString(line);
+    }
+}
+
+/// <summary>
+/// Gets the name a filter is added by
+/// </summary>
+/// <param name="type">filter to name</param>
+/// <returns>name of the filter</returns>
+LPCWSTR FilterGraph::GetFilterName(FilterType type)
+{
+    if (type < 0 || type >= FILTER_TYPE_COUNT)
+    {
+        return L"";
+    }
+
+    return g_filterNames[type];
+}
+
+/// <summary>
+/// Gets whether a filter changes each value on its own
+/// </summary>
+/// <param name="type">filter</param>
+/// <returns>true for pointwise filters with one input</returns>
+bool FilterGraph::IsPointwise(FilterType type)
+{
+    return type == FILTER_TYPE_SCALE || type == FILTER_TYPE_THRESHOLD || type == FILTER_TYPE_INVERT;
+}
+
+/// <summary>
+/// Gets whether a filter may write over the buffer it reads
+/// </summary>
+/// <param name="type">filter</param>
+/// <returns>true if the filter can run in place</returns>
+bool FilterGraph::CanRunInPlace(FilterType type)
+{
+    switch (type)
+    {
+    case FILTER_TYPE_GAUSSIAN_BLUR:
+    case FILTER_TYPE_BOX_BLUR:
+    case FILTER_TYPE_DILATE:
+    case FILTER_TYPE_ERODE:
+    case FILTER_TYPE_SCALE:
+    case FILTER_TYPE_THRESHOLD:
+    case FILTER_TYPE_INVERT:
+    case FILTER_TYPE_OVERLAY:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Gets the Mat type a node gives for an input type
+/// </summary>
+/// <param name="node">node</param>
+/// <param name="inputType">Mat type of the node's first input</param>
+/// <returns>Mat type of the output, or -1 if the filter cannot take the input</returns>
+int FilterGraph::GetOutputType(const Node& node, int inputType) const
+{
+    int depth = CV_MAT_DEPTH(inputType);
+    int channels = CV_MAT_CN(inputType);
+
+    switch (node.type)
+    {
+    case FILTER_TYPE_GRAY:
+        return (channels == 3 || channels == 4) ? CV_MAKETYPE(depth, 1) : -1;
+
+    case FILTER_TYPE_COLOR:
+        return channels == 1 ? CV_MAKETYPE(depth, 4) : -1;
+
+    case FILTER_TYPE_CANNY_EDGE:
+        return inputType == CV_8UC1 ? CV_8UC1 : -1;
+
+    case FILTER_TYPE_THRESHOLD:
+        return (depth == CV_8U || depth == CV_32F) ? inputType : -1;
+
+    case FILTER_TYPE_INVERT:
+        return (depth == CV_8U || depth == CV_16U) ? inputType : -1;
+
+    case FILTER_TYPE_OVERLAY:
+        return depth == CV_8U ? inputType : -1;
+
+    default:
+        return inputType;
+    }
+}
+
+/// <summary>
+/// Plans the passes and buffers for images of a size and type
+/// </summary>
+/// <param name="size">size of the images</param>
+/// <param name="type">Mat type of the images</param>
+/// <returns>S_OK if successful, E_INVALIDARG if a filter cannot take the image it is given</returns>
+HRESULT FilterGraph::Plan(Size size, int type)
+{
+    const int nodeCount = static_cast<int>(m_nodes.size());
+    const int outputNode = nodeCount - 1;
+
+    m_passes.clear();
+    m_nodePasses.assign(nodeCount, -1);
+    m_buffers.clear();
+    m_isOutputCopied = false;
+
+    // Find the nodes the output depends on. Inputs always come before the node reading them,
+    // so one sweep back from the output finds them all.
+    std::vector<bool> isUsed(nodeCount, false);
+    isUsed[outputNode] = true;
+    for (int i = outputNode; i >= 0; --i)
+    {
+        if (isUsed[i])
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                if (m_nodes[i].inputs[k] != SOURCE_NODE)
+                {
+                    isUsed[m_nodes[i].inputs[k]] = true;
+                }
+            }
+        }
+    }
+
+    // Work out the type of every output, and count the reads of every output and of the source
+    std::vector<int> types(nodeCount, -1);
+    std::vector<int> readCounts(nodeCount, 0);
+    int sourceReadCount = 0;
+
+    for (int i = 0; i < nodeCount; ++i)
+    {
+        if (!isUsed[i])
+        {
+            continue;
+        }
+
+        const Node& node = m_nodes[i];
+        int inputCount = node.type == FILTER_TYPE_OVERLAY ? 2 : 1;
+        int inputTypes[2];
+
+        for (int k = 0; k < inputCount; ++k)
+        {
+            int input = node.inputs[k];
+            if (input == SOURCE_NODE)
+            {
+                inputTypes[k] = type;
+                ++sourceReadCount;
+            }
+            else
+            {
+                inputTypes[k] = types[input];
+                ++readCounts[input];
+            }
+        }
+
+        types[i] = GetOutputType(node, inputTypes[0]);
+        if (types[i] < 0 || (inputCount == 2 && inputTypes[1] != inputTypes[0]))
+        {
+            m_isPlanStale = true;
+            return E_INVALIDARG;
+        }
+    }
+
+    // The output is read by the caller
+    ++readCounts[outputNode];
+
+    // Group the nodes into passes, fusing a pointwise node on 8-bit values into the pass of
+    // its input when that is also pointwise and nothing else reads it
+    for (int i = 0; i < nodeCount; ++i)
+    {
+        if (!isUsed[i])
+        {
+            continue;
+        }
+
+        const Node& node = m_nodes[i];
+        int input = node.inputs[0];
+
+        if (IsPointwise(node.type) && CV_MAT_DEPTH(types[i]) == CV_8U &&
+            input != SOURCE_NODE && IsPointwise(m_nodes[input].type) && readCounts[input] == 1)
+        {
+            m_nodePasses[i] = m_nodePasses[input];
+            m_passes[m_nodePasses[i]].nodes.push_back(i);
+        }
+        else
+        {
+            Pass pass;
+            pass.nodes.push_back(i);
+            pass.inputBuffers[0] = SOURCE_BUFFER;
+            pass.inputBuffers[1] = -1;
+            pass.outputBuffer = SOURCE_BUFFER;
+            pass.runCount = 0;
+            pass.totalTicks = 0;
+
+            m_nodePasses[i] = static_cast<int>(m_passes.size());
+            m_passes.push_back(pass);
+        }
+    }
+
+    // Give every pass an output buffer by running through the passes in order and tracking
+    // how many reads are left of the value each buffer holds. The pass giving the graph's
+    // output always comes last, since every other pass feeds it.
+    std::vector<int> nodeBuffers(nodeCount, SOURCE_BUFFER);
+    std::vector<int> bufferTypes(1, type);
+    std::vector<int> bufferReadCounts(1, sourceReadCount);
+
+    for (size_t p = 0; p < m_passes.size(); ++p)
+    {
+        Pass& pass = m_passes[p];
+        const Node& first = m_nodes[pass.nodes.front()];
+        int lastNode = pass.nodes.back();
+        bool isLast = (p + 1 == m_passes.size());
+
+        int inputBuffer = first.inputs[0] == SOURCE_NODE ? SOURCE_BUFFER : nodeBuffers[first.inputs[0]];
+        int secondInputBuffer = -1;
+        if (first.type == FILTER_TYPE_OVERLAY)
+        {
+            secondInputBuffer = first.inputs[1] == SOURCE_NODE ? SOURCE_BUFFER : nodeBuffers[first.inputs[1]];
+        }
+
+        int outputBuffer = -1;
+        if (CanRunInPlace(first.type) && bufferReadCounts[inputBuffer] == 1 && secondInputBuffer != inputBuffer)
+        {
+            // Nothing reads the input after this pass, so write over it
+            outputBuffer = inputBuffer;
+        }
+        else if (bufferReadCounts[SOURCE_BUFFER] == 0 && (isLast || types[lastNode] == type))
+        {
+            // The caller's image is no longer read, so use it
+            outputBuffer = SOURCE_BUFFER;
+        }
+        else
+        {
+            for (size_t b = 1; b < bufferTypes.size(); ++b)
+            {
+                if (bufferReadCounts[b] == 0 && bufferTypes[b] == types[lastNode])
+                {
+                    outputBuffer = static_cast<int>(b);
+                    break;
+                }
+            }
+
+            if (outputBuffer < 0)
+            {
+                outputBuffer = static_cast<int>(bufferTypes.size());
+                bufferTypes.push_back(types[lastNode]);
+                bufferReadCounts.push_back(0);
+            }
+        }
+
+        --bufferReadCounts[inputBuffer];
+        if (secondInputBuffer >= 0)
+        {
+            --bufferReadCounts[secondInputBuffer];
+        }
+
+        bufferReadCounts[outputBuffer] = readCounts[lastNode];
+        nodeBuffers[lastNode] = outputBuffer;
+
+        pass.inputBuffers[0] = inputBuffer;
+        pass.inputBuffers[1] = secondInputBuffer;
+        pass.outputBuffer = outputBuffer;
+
+        if (isLast && outputBuffer != SOURCE_BUFFER)
+        {
+            m_isOutputCopied = true;
+        }
+
+        // Fold the pointwise nodes of the pass into one table
+        if (IsPointwise(first.type) && CV_MAT_DEPTH(types[lastNode]) == CV_8U)
+        {
+            pass.table.create(1, 256, CV_8U);
+            uchar* pTable = pass.table.ptr<uchar>();
+            for (int v = 0; v < 256; ++v)
+            {
+                pTable[v] = static_cast<uchar>(v);
+            }
+
+            for (size_t k = 0; k < pass.nodes.size(); ++k)
+            {
+                ApplyToTable(m_nodes[pass.nodes[k]], pTable);
+            }
+        }
+    }
+
+    // Allocate the scratch buffers once for every image of this size and type
+    m_buffers.resize(bufferTypes.size());
+    for (size_t b = 1; b < bufferTypes.size(); ++b)
+    {
+        m_buffers[b].create(size, bufferTypes[b]);
+    }
+
+    m_plannedSize = size;
+    m_plannedType = type;
+    m_isPlanStale = false;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Runs one pass
+/// </summary>
+/// <param name="pass">pass to run</param>
+/// <param name="pSource">image given to Apply</param>
+void FilterGraph::RunPass(const Pass& pass, Mat* pSource)
+{
+    Mat& input = pass.inputBuffers[0] == SOURCE_BUFFER ? *pSource : m_buffers[pass.inputBuffers[0]];
+    Mat& output = pass.outputBuffer == SOURCE_BUFFER ? *pSource : m_buffers[pass.outputBuffer];
+
+    if (!pass.table.empty())
+    {
+        LUT(input, pass.table, output);
+        return;
+    }
+
+    Mat noInput;
+    const Mat& secondInput = pass.inputBuffers[1] < 0 ? noInput :
+        (pass.inputBuffers[1] == SOURCE_BUFFER ? *pSource : m_buffers[pass.inputBuffers[1]]);
+
+    RunNode(m_nodes[pass.nodes.front()], input, secondInput, output);
+
+    // Pointwise nodes on other than 8-bit values are not fused, so this only runs for 8-bit
+    // passes without a table, which have a single node
+    for (size_t k = 1; k < pass.nodes.size(); ++k)
+    {
+        RunNode(m_nodes[pass.nodes[k]], output, noInput, output);
+    }
+}
+
+/// <summary>
+/// Runs one node
+/// </summary>
+/// <param name="node">node to run</param>
+/// <param name="input">image the node reads</param>
+/// <param name="secondInput">second image the node reads, if it overlays</param>
+/// <param name="output">image in which to return the output</param>
+void FilterGraph::RunNode(const Node& node, const Mat& input, const Mat& secondInput, Mat& output) const
+{
+    switch (node.type)
+    {
+    case FILTER_TYPE_GRAY:
+        if (m_colorFormat == COLOR_IMAGE_FORMAT_RGBA)
+        {
+            cvtColor(input, output, input.channels() == 4 ? CV_RGBA2GRAY : CV_RGB2GRAY);
+        }
+        else
+        {
+            cvtColor(input, output, input.channels() == 4 ? CV_BGRA2GRAY : CV_BGR2GRAY);
+        }
+        break;
+
+    case FILTER_TYPE_COLOR:
+        cvtColor(input, output, CV_GRAY2RGBA);
+        break;
+
+    case FILTER_TYPE_GAUSSIAN_BLUR:
+        {
+            int kernelSize = static_cast<int>(node.parameters[0]);
+            GaussianBlur(input, output, Size(kernelSize, kernelSize), node.parameters[1]);
+        }
+        break;
+
+    case FILTER_TYPE_BOX_BLUR:
+        {
+            int kernelSize = static_cast<int>(node.parameters[0]);
+            blur(input, output, Size(kernelSize, kernelSize));
+        }
+        break;
+
+    case FILTER_TYPE_DILATE:
+        dilate(input, output, Mat(), Point(-1, -1), max(1, static_cast<int>(node.parameters[0])));
+        break;
+
+    case FILTER_TYPE_ERODE:
+        erode(input, output, Mat(), Point(-1, -1), max(1, static_cast<int>(node.parameters[0])));
+        break;
+
+    case FILTER_TYPE_CANNY_EDGE:
+        Canny(input, output, node.parameters[0], node.parameters[1]);
+        break;
+
+    case FILTER_TYPE_SCALE:
+        input.convertTo(output, -1, node.parameters[0], node.parameters[1]);
+        break;
+
+    case FILTER_TYPE_THRESHOLD:
+        threshold(input, output, node.parameters[0], node.parameters[1], THRESH_BINARY);
+        break;
+
+    case FILTER_TYPE_INVERT:
+        bitwise_not(input, output);
+        break;
+
+    case FILTER_TYPE_OVERLAY:
+        {
+            if (output.data != input.data)
+            {
+                input.copyTo(output);
+            }
+
+            // Blend in 8-bit fixed point, testing only the color channels so that an opaque
+            // alpha channel does not make every pixel count as drawn
+            const int alpha = static_cast<int>(node.parameters[0] * 256.0 + 0.5);
+            const int channels = output.channels();
+            const int colorChannels = min(channels, 3);
+
+            for (int y = 0; y < output.rows; ++y)
+            {
+                const uchar* pOverlay = secondInput.ptr<uchar>(y);
+                uchar* pOutput = output.ptr<uchar>(y);
+
+                for (int x = 0; x < output.cols; ++x, pOverlay += channels, pOutput += channels)
+                {
+                    bool isDrawn = false;
+                    for (int c = 0; c < colorChannels; ++c)
+                    {
+                        isDrawn |= pOverlay[c] != 0;
+                    }
+
+                    if (isDrawn)
+                    {
+                        for (int c = 0; c < channels; ++c)
+                        {
+                            pOutput[c] = static_cast<uchar>(pOutput[c] + (((pOverlay[c] - pOutput[c]) * alpha) >> 8));
+                        }
+                    }
+                }
+            }
+        }
+        break;
+    }
+}
+
+/// <summary>
+/// Fills the table of a pointwise node for 8-bit values
+/// </summary>
+/// <param name="node">pointwise node</param>
+/// <param name="pTable">256 entries to pass through the node</param>
+void FilterGraph::ApplyToTable(const Node& node, uchar* pTable)
+{
+    for (int v = 0; v < 256; ++v)
+    {
+        int value = pTable[v];
+
+        switch (node.type)
+        {
+        case FILTER_TYPE_SCALE:
+            pTable[v] = saturate_cast<uchar>(value * node.parameters[0] + node.parameters[1]);
+            break;
+
+        case FILTER_TYPE_THRESHOLD:
+            pTable[v] = value > node.parameters[0] ? saturate_cast<uchar>(node.parameters[1]) : 0;
+            break;
+
+        case FILTER_TYPE_INVERT:
+            pTable[v] = static_cast<uchar>(255 - value);
+            break;
+        }
+    }
+}
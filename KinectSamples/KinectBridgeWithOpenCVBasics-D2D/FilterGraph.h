@@ -0,0 +1,303 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FilterGraph.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include "ColorConversion.h"
+
+// Suppress warnings that come from compiling OpenCV code since we have no control over it
+#pragma warning(push)
+#pragma warning(disable : 6294 6031)
+#include <opencv2/core/core.hpp>
+#pragma warning(pop)
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Filters a graph is built from. Pointwise filters change each value on its own, so
+        /// runs of them are fused into a single pass.
+        /// </summary>
+        enum FilterType
+        {
+            // "Gray": 3 or 4 channels, in the graph's channel order, to one channel of gray
+            FILTER_TYPE_GRAY,
+
+            // "Color": one channel of gray to 4 channels
+            FILTER_TYPE_COLOR,
+
+            // "GaussianBlur": kernel size (odd), sigma (0 derives it from the kernel size)
+            FILTER_TYPE_GAUSSIAN_BLUR,
+
+            // "BoxBlur": kernel size
+            FILTER_TYPE_BOX_BLUR,
+
+            // "Dilate" and "Erode" with a 3x3 square: iterations (0 runs one)
+            FILTER_TYPE_DILATE,
+            FILTER_TYPE_ERODE,
+
+            // "CannyEdge" of a one channel 8-bit image: low threshold, high threshold
+            FILTER_TYPE_CANNY_EDGE,
+
+            // "Scale", pointwise: gain, offset. The result is saturated.
+            FILTER_TYPE_SCALE,
+
+            // "Threshold", pointwise: threshold, value given to values above it. Other values become 0.
+            FILTER_TYPE_THRESHOLD,
+
+            // "Invert", pointwise: largest value minus the value
+            FILTER_TYPE_INVERT,
+
+            // "Overlay", two inputs: opacity from 0 to 1 with which pixels of the second input
+            // that are not black are drawn over the first
+            FILTER_TYPE_OVERLAY,
+
+            FILTER_TYPE_COUNT
+        };
+
+        /// <summary>
+        /// Cost of a node of a filter graph
+        /// </summary>
+        struct FilterNodeCost
+        {
+            // Filter the node runs
+            FilterType type;
+
+            // Whether the node runs at all; nodes the output does not depend on are skipped
+            bool isUsed;
+
+            // Nodes that run in the same pass as this one, 1 unless pointwise nodes were fused
+            UINT passNodeCount;
+
+            // Number of times the pass ran, and its mean duration in microseconds
+            LONGLONG runCount;
+            double meanMicros;
+        };
+
+        /// <summary>
+        /// Directed acyclic graph of filters applied to a stream's images. Every node takes
+        /// the graph's input image or the output of earlier nodes, so nodes are added in an
+        /// order in which they can run, and the last node added gives the graph's output.
+        /// The first time a graph is applied to images of a size and type, it plans how to run:
+        /// nodes the output does not depend on are dropped, chains of pointwise nodes on 8-bit
+        /// images are fused into one table lookup pass, and each pass is given a scratch buffer
+        /// that is reused once nothing reads it any more, or the input's own buffer when the
+        /// filter can run in place. Later images of the same size and type run without
+        /// reallocating any buffer the graph owns. Each pass is timed.
+        /// A graph is not safe to use from several threads at once.
+        /// </summary>
+        class FilterGraph
+        {
+        public:
+            // Constants:
+            // Input of a node that reads the graph's input image
+            static const int SOURCE_NODE = -1;
+
+            // Functions:
+            /// <summary>
+            /// Constructor. Starts with no nodes, so the graph leaves images unchanged.
+            /// </summary>
+            /// <param name="colorFormat">channel order of the images the graph is applied to: COLOR_IMAGE_FORMAT_BGRX or COLOR_IMAGE_FORMAT_RGBA</param>
+            explicit FilterGraph(ColorImageFormat colorFormat);
+
+            /// <summary>
+            /// Removes all nodes
+            /// </summary>
+            void Clear();
+
+            /// <summary>
+            /// Gets whether the graph has no nodes
+            /// </summary>
+            /// <returns>true if the graph leaves images unchanged</returns>
+            bool IsEmpty() const { return m_nodes.empty(); }
+
+            /// <summary>
+            /// Adds a node running a filter with one input
+            /// </summary>
+            /// <param name="type">filter to run, any but FILTER_TYPE_OVERLAY</param>
+            /// <param name="input">node whose output the filter reads, or SOURCE_NODE</param>
+            /// <param name="parameter0">first parameter of the filter</param>
+            /// <param name="parameter1">second parameter of the filter</param>
+            /// <param name="pNode">pointer in which to return the index of the node, or NULL</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the input or a parameter is not valid</returns>
+            HRESULT AddNode(FilterType type, int input, double parameter0 = 0.0, double parameter1 = 0.0, int* pNode = NULL);
+
+            /// <summary>
+            /// Adds a node running a filter given by its name
+            /// </summary>
+            /// <param name="filterName">name of the filter to run, as GetFilterName gives</param>
+            /// <param name="input">node whose output the filter reads, or SOURCE_NODE</param>
+            /// <param name="parameter0">first parameter of the filter</param>
+            /// <param name="parameter1">second parameter of the filter</param>
+            /// <param name="pNode">pointer in which to return the index of the node, or NULL</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the name, input or a parameter is not valid</returns>
+            HRESULT AddNode(LPCWSTR filterName, int input, double parameter0 = 0.0, double parameter1 = 0.0, int* pNode = NULL);
+
+            /// <summary>
+            /// Adds a node drawing one image over another
+            /// </summary>
+            /// <param name="baseInput">node whose output is drawn over, or SOURCE_NODE</param>
+            /// <param name="overlayInput">node whose output is drawn, or SOURCE_NODE</param>
+            /// <param name="opacity">opacity from 0 to 1 of the drawn pixels</param>
+            /// <param name="pNode">pointer in which to return the index of the node, or NULL</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if an input or the opacity is not valid</returns>
+            HRESULT AddOverlayNode(int baseInput, int overlayInput, double opacity, int* pNode = NULL);
+
+            /// <summary>
+            /// Runs the graph on an image, replacing it with the graph's output
+            /// </summary>
+            /// <param name="pImage">pointer to the image to filter</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if a filter cannot take the image it is given, an error code otherwise</returns>
+            HRESULT Apply(cv::Mat* pImage);
+
+            /// <summary>
+            /// Gets the number of nodes
+            /// </summary>
+            /// <returns>number of nodes</returns>
+            UINT GetNodeCount() const { return static_cast<UINT>(m_nodes.size()); }
+
+            /// <summary>
+            /// Gets the cost of a node since the graph was last planned
+            /// </summary>
+            /// <param name="node">index of the node</param>
+            /// <param name="pCost">pointer in which to return the cost</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if there is no such node</returns>
+            HRESULT GetNodeCost(UINT node, FilterNodeCost* pCost) const;
+
+            /// <summary>
+            /// Writes the cost of every node to the debugger output
+            /// </summary>
+            /// <param name="graphName">name of the graph to write before the costs</param>
+            void Report(LPCWSTR graphName) const;
+
+            /// <summary>
+            /// Gets the name a filter is added by
+            /// </summary>
+            /// <param name="type">filter to name</param>
+            /// <returns>name of the filter</returns>
+            static LPCWSTR GetFilterName(FilterType type);
+
+        private:
+            // Constants:
+            // Buffer index standing for the image given to Apply
+            static const int SOURCE_BUFFER = 0;
+
+            /// <summary>
+            /// Node as it was added
+            /// </summary>
+            struct Node
+            {
+                FilterType type;
+                int inputs[2];
+                double parameters[2];
+            };
+
+            /// <summary>
+            /// Pass over the image running one node, or a chain of fused pointwise nodes
+            /// </summary>
+            struct Pass
+            {
+                // Nodes run, in order; the last one gives the pass's output
+                std::vector<int> nodes;
+
+                // Buffers read and written, one input buffer unless the pass overlays
+                int inputBuffers[2];
+                int outputBuffer;
+
+                // Table all nodes are fused into, for passes of pointwise nodes over 8-bit images
+                cv::Mat table;
+
+                // Time spent running the pass
+                LONGLONG runCount;
+                LONGLONG totalTicks;
+            };
+
+            // Graphs are not copied, since their buffers would be shared
+            FilterGraph(const FilterGraph&);
+            FilterGraph& operator=(const FilterGraph&);
+
+            // Functions:
+            /// <summary>
+            /// Gets whether a filter changes each value on its own
+            /// </summary>
+            /// <param name="type">filter</param>
+            /// <returns>true for pointwise filters with one input</returns>
+            static bool IsPointwise(FilterType type);
+
+            /// <summary>
+            /// Gets whether a filter may write over the buffer it reads
+            /// </summary>
+            /// <param name="type">filter</param>
+            /// <returns>true if the filter can run in place</returns>
+            static bool CanRunInPlace(FilterType type);
+
+            /// <summary>
+            /// Gets the Mat type a node gives for an input type
+            /// </summary>
+            /// <param name="node">node</param>
+            /// <param name="inputType">Mat type of the node's first input</param>
+            /// <returns>Mat type of the output, or -1 if the filter cannot take the input</returns>
+            int GetOutputType(const Node& node, int inputType) const;
+
+            /// <summary>
+            /// Plans the passes and buffers for images of a size and type
+            /// </summary>
+            /// <param name="size">size of the images</param>
+            /// <param name="type">Mat type of the images</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if a filter cannot take the image it is given</returns>
+            HRESULT Plan(cv::Size size, int type);
+
+            /// <summary>
+            /// Runs one pass
+            /// </summary>
+            /// <param name="pass">pass to run</param>
+            /// <param name="pSource">image given to Apply</param>
+            void RunPass(const Pass& pass, cv::Mat* pSource);
+
+            /// <summary>
+            /// Runs one node
+            /// </summary>
+            /// <param name="node">node to run</param>
+            /// <param name="input">image the node reads</param>
+            /// <param name="secondInput">second image the node reads, if it overlays</param>
+            /// <param name="output">image in which to return the output</param>
+            void RunNode(const Node& node, const cv::Mat& input, const cv::Mat& secondInput, cv::Mat& output) const;
+
+            /// <summary>
+            /// Fills the table of a pointwise node for 8-bit values
+            /// </summary>
+            /// <param name="node">pointwise node</param>
+            /// <param name="pTable">256 entries to pass through the node</param>
+            static void ApplyToTable(const Node& node, uchar* pTable);
+
+            // Variables:
+            // Channel order of the images, which decides how gray weighs each channel
+            ColorImageFormat m_colorFormat;
+
+            // Nodes in the order they were added
+            std::vector<Node> m_nodes;
+
+            // Size and type the plan is for, and whether the nodes changed since it was made
+            cv::Size m_plannedSize;
+            int m_plannedType;
+            bool m_isPlanStale;
+
+            // Passes in the order they run, and the pass running each node or -1 if it is skipped
+            std::vector<Pass> m_passes;
+            std::vector<int> m_nodePasses;
+
+            // Scratch buffers, the first one standing for the image given to Apply
+            std::vector<cv::Mat> m_buffers;
+
+            // Whether the output ends up in a scratch buffer and is copied to the image given to Apply
+            bool m_isOutputCopied;
+
+            // Performance counter ticks per second
+            LONGLONG m_ticksPerSecond;
+        };
+    }
+}
@@ -0,0 +1,358 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameBufferPool.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FrameBufferPool.h"
+#include <malloc.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pool shared by all capture and conversion paths
+    FrameBufferPool g_sharedPool;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameBufferPool::FrameBufferPool() :
+    m_largePageSize(0),
+    m_allocationCount(0),
+    m_largePageCount(0),
+    m_outstandingCount(0),
+    m_highWaterCount(0),
+    m_outstandingBytes(0),
+    m_highWaterBytes(0),
+    m_reservedBytes(0)
+{
+    for (int i = 0; i < SIZE_CLASS_COUNT; ++i)
+    {
+        InitializeSListHead(&m_freeLists[i]);
+    }
+}
+
+/// <summary>
+/// Destructor. Frees the pooled blocks; blocks still handed out are leaked.
+/// </summary>
+FrameBufferPool::~FrameBufferPool()
+{
+    Trim();
+}
+
+/// <summary>
+/// Gets the pool shared by all capture and conversion paths
+/// </summary>
+/// <returns>shared pool</returns>
+FrameBufferPool* FrameBufferPool::GetSharedPool()
+{
+    return &g_sharedPool;
+}
+
+/// <summary>
+/// Backs blocks of at least the large page size with large pages from now on. The
+/// process must hold the lock pages in memory privilege.
+/// </summary>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameBufferPool::EnableLargePages()
+{
+    SIZE_T largePageSize = GetLargePageMinimum();
+    if (0 == largePageSize)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    // The privilege is held by the account but disabled in the token until asked for
+    HANDLE hToken;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    HRESULT hr = S_OK;
+    if (!LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) ||
+        !AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (ERROR_NOT_ALL_ASSIGNED == GetLastError())
+    {
+        // AdjustTokenPrivileges succeeds even when the account lacks the privilege
+        hr = HRESULT_FROM_WIN32(ERROR_PRIVILEGE_NOT_HELD);
+    }
+
+    CloseHandle(hToken);
+
+    if (SUCCEEDED(hr))
+    {
+        m_largePageSize = largePageSize;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Allocates a block
+/// </summary>
+/// <param name="size">number of bytes needed</param>
+/// <param name="ppBlock">pointer in which to return the 64-byte aligned block</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameBufferPool::Allocate(SIZE_T size, BYTE** ppBlock)
+{
+    // Fail if pointer is invalid
+    if (!ppBlock)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if size is invalid
+    if (size > MAX_BLOCK_SIZE)
+    {
+        return E_INVALIDARG;
+    }
+
+    int sizeClass = GetSizeClass(size);
+    BlockHeader* pHeader = reinterpret_cast<BlockHeader*>(InterlockedPopEntrySList(&m_freeLists[sizeClass]));
+    if (!pHeader)
+    {
+        pHeader = CreateBlock(sizeClass);
+        if (!pHeader)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    RaiseHighWater(&m_highWaterCount, InterlockedIncrement64(&m_outstandingCount));
+    RaiseHighWater(&m_highWaterBytes, InterlockedExchangeAdd64(&m_outstandingBytes, pHeader->capacity) + pHeader->capacity);
+
+    *ppBlock = reinterpret_cast<BYTE*>(pHeader + 1);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Returns a block to the pool
+/// </summary>
+/// <param name="pBlock">block returned by Allocate, or NULL</param>
+void FrameBufferPool::Free(BYTE* pBlock)
+{
+    if (!pBlock)
+    {
+        return;
+    }
+
+    BlockHeader* pHeader = reinterpret_cast<BlockHeader*>(pBlock) - 1;
+
+    InterlockedExchangeAdd64(&m_outstandingBytes, -static_cast<LONGLONG>(pHeader->capacity));
+    InterlockedExchangeAdd64(&m_outstandingCount, -1);
+
+    InterlockedPushEntrySList(&m_freeLists[pHeader->sizeClass], &pHeader->entry);
+}
+
+/// <summary>
+/// Adds free blocks to the pool ahead of time, so that the first frames do not allocate
+/// </summary>
+/// <param name="size">number of bytes each block must hold</param>
+/// <param name="count">number of blocks to add</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameBufferPool::Reserve(SIZE_T size, DWORD count)
+{
+    // Fail if size is invalid
+    if (size > MAX_BLOCK_SIZE)
+    {
+        return E_INVALIDARG;
+    }
+
+    int sizeClass = GetSizeClass(size);
+    for (DWORD i = 0; i < count; ++i)
+    {
+        BlockHeader* pHeader = CreateBlock(sizeClass);
+        if (!pHeader)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        InterlockedPushEntrySList(&m_freeLists[sizeClass], &pHeader->entry);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Frees all blocks that are not handed out
+/// </summary>
+void FrameBufferPool::Trim()
+{
+    for (int i = 0; i < SIZE_CLASS_COUNT; ++i)
+    {
+        PSLIST_ENTRY pEntry = InterlockedFlushSList(&m_freeLists[i]);
+        while (pEntry)
+        {
+            PSLIST_ENTRY pNext = pEntry->Next;
+            DestroyBlock(reinterpret_cast<BlockHeader*>(pEntry));
+            pEntry = pNext;
+        }
+    }
+}
+
+/// <summary>
+/// Gets the pool's counters
+/// </summary>
+/// <param name="pStatistics">pointer in which to return the counters</param>
+void FrameBufferPool::GetStatistics(FrameBufferPoolStatistics* pStatistics) const
+{
+    pStatistics->allocationCount = m_allocationCount;
+    pStatistics->largePageCount = m_largePageCount;
+    pStatistics->outstandingCount = static_cast<LONG>(m_outstandingCount);
+    pStatistics->highWaterCount = static_cast<LONG>(m_highWaterCount);
+    pStatistics->outstandingBytes = m_outstandingBytes;
+    pStatistics->highWaterBytes = m_highWaterBytes;
+    pStatistics->reservedBytes = m_reservedBytes;
+}
+
+/// <summary>
+/// Gets the number of bytes a block can hold, which may exceed the size it was allocated with
+/// </summary>
+/// <param name="pBlock">block returned by Allocate</param>
+/// <returns>capacity of the block in bytes</returns>
+SIZE_T FrameBufferPool::GetBlockCapacity(const BYTE* pBlock)
+{
+    return (reinterpret_cast<const BlockHeader*>(pBlock) - 1)->capacity;
+}
+
+/// <summary>
+/// Gets the size class that holds a number of bytes
+/// </summary>
+/// <param name="size">number of bytes, at most MAX_BLOCK_SIZE</param>
+/// <returns>index of the smallest size class that fits</returns>
+int FrameBufferPool::GetSizeClass(SIZE_T size)
+{
+    if (size <= MIN_BLOCK_SIZE)
+    {
+        return 0;
+    }
+
+    // Find the doubling the size falls in, then which quarter of it
+    SIZE_T last = size - 1;
+    int log2 = 0;
+    while ((last >> (log2 + 1)) != 0)
+    {
+        ++log2;
+    }
+
+    int quarter = static_cast<int>(last >> (log2 - 2)) & (CLASSES_PER_DOUBLING - 1);
+
+    return 1 + (log2 - MIN_BLOCK_SIZE_LOG2) * CLASSES_PER_DOUBLING + quarter;
+}
+
+/// <summary>
+/// Gets the number of bytes the blocks of a size class hold
+/// </summary>
+/// <param name="sizeClass">index of the size class</param>
+/// <returns>capacity in bytes</returns>
+SIZE_T FrameBufferPool::GetClassCapacity(int sizeClass)
+{
+    if (0 == sizeClass)
+    {
+        return MIN_BLOCK_SIZE;
+    }
+
+    int log2 = MIN_BLOCK_SIZE_LOG2 + (sizeClass - 1) / CLASSES_PER_DOUBLING;
+    int quarter = (sizeClass - 1) % CLASSES_PER_DOUBLING;
+
+    return static_cast<SIZE_T>(CLASSES_PER_DOUBLING + quarter + 1) << (log2 - 2);
+}
+
+/// <summary>
+/// Obtains a new block of a size class from the operating system
+/// </summary>
+/// <param name="sizeClass">index of the size class</param>
+/// <returns>header of the new block, or NULL if out of memory</returns>
+FrameBufferPool::BlockHeader* FrameBufferPool::CreateBlock(int sizeClass)
+{
+    SIZE_T capacity = GetClassCapacity(sizeClass);
+    SIZE_T allocationSize = sizeof(BlockHeader) + capacity;
+
+    void* pMemory = NULL;
+    bool isLargePage = false;
+
+    // Large pages save TLB misses when a frame is walked row by row. Fall back to
+    // ordinary pages once physical memory is too fragmented to provide them.
+    if (m_largePageSize != 0 && allocationSize >= m_largePageSize)
+    {
+        SIZE_T largeSize = (allocationSize + m_largePageSize - 1) & ~(m_largePageSize - 1);
+        pMemory = VirtualAlloc(NULL, largeSize, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (pMemory)
+        {
+            allocationSize = largeSize;
+            isLargePage = true;
+        }
+    }
+
+    if (!pMemory)
+    {
+        pMemory = _aligned_malloc(allocationSize, BLOCK_ALIGNMENT);
+        if (!pMemory)
+        {
+            return NULL;
+        }
+    }
+
+    BlockHeader* pHeader = static_cast<BlockHeader*>(pMemory);
+    pHeader->entry.Next = NULL;
+    pHeader->sizeClass = sizeClass;
+    pHeader->capacity = capacity;
+    pHeader->allocationSize = allocationSize;
+    pHeader->isLargePage = isLargePage;
+
+    InterlockedIncrement(&m_allocationCount);
+    if (isLargePage)
+    {
+        InterlockedIncrement(&m_largePageCount);
+    }
+    InterlockedExchangeAdd64(&m_reservedBytes, allocationSize);
+
+    return pHeader;
+}
+
+/// <summary>
+/// Gives a block back to the operating system
+/// </summary>
+/// <param name="pHeader">header of the block</param>
+void FrameBufferPool::DestroyBlock(BlockHeader* pHeader)
+{
+    InterlockedExchangeAdd64(&m_reservedBytes, -static_cast<LONGLONG>(pHeader->allocationSize));
+    if (pHeader->isLargePage)
+    {
+        VirtualFree(pHeader, 0, MEM_RELEASE);
+    }
+    else
+    {
+        _aligned_free(pHeader);
+    }
+}
+
+/// <summary>
+/// Raises a high-water mark to a value if the value exceeds it
+/// </summary>
+/// <param name="pHighWater">high-water mark to raise</param>
+/// <param name="value">value reached</param>
+void FrameBufferPool::RaiseHighWater(volatile LONGLONG* pHighWater, LONGLONG value)
+{
+    LONGLONG highWater = *pHighWater;
+    while (value > highWater)
+    {
+        LONGLONG previous = InterlockedCompareExchange64(pHighWater, value, highWater);
+        if (previous == highWater)
+        {
+            break;
+        }
+        highWater = previous;
+    }
+}
@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameBufferPool.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Counters describing the memory held by a FrameBufferPool
+        /// </summary>
+        struct FrameBufferPoolStatistics
+        {
+            // Blocks obtained from the operating system since the pool was created, and how many
+            // of those use large pages. Stops growing once capture reaches a steady state.
+            LONG allocationCount;
+            LONG largePageCount;
+
+            // Blocks currently handed out, and the most handed out at once
+            LONG outstandingCount;
+            LONG highWaterCount;
+
+            // Bytes currently handed out, and the most handed out at once
+            LONGLONG outstandingBytes;
+            LONGLONG highWaterBytes;
+
+            // Bytes held by the pool, whether handed out or free
+            LONGLONG reservedBytes;
+        };
+
+        /// <summary>
+        /// Pool of 64-byte aligned frame buffers. Requests are rounded up to a size class and
+        /// freed blocks are kept on a lock-free list per class, so once every class in use has
+        /// enough blocks, allocating and freeing frame buffers never touches the heap. Blocks
+        /// may be allocated and freed from any thread.
+        /// </summary>
+        class FrameBufferPool
+        {
+        public:
+            // Constants:
+            // Alignment of every block, one cache line
+            static const SIZE_T BLOCK_ALIGNMENT = 64;
+
+            // Smallest and largest block sizes
+            static const int MIN_BLOCK_SIZE_LOG2 = 12;
+            static const SIZE_T MIN_BLOCK_SIZE = 1 << MIN_BLOCK_SIZE_LOG2;
+            static const SIZE_T MAX_BLOCK_SIZE = 256 * 1024 * 1024;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            FrameBufferPool();
+
+            /// <summary>
+            /// Destructor. Frees the pooled blocks; blocks still handed out are leaked.
+            /// </summary>
+            ~FrameBufferPool();
+
+            /// <summary>
+            /// Gets the pool shared by all capture and conversion paths
+            /// </summary>
+            /// <returns>shared pool</returns>
+            static FrameBufferPool* GetSharedPool();
+
+            /// <summary>
+            /// Backs blocks of at least the large page size with large pages from now on. The
+            /// process must hold the lock pages in memory privilege.
+            /// </summary>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT EnableLargePages();
+
+            /// <summary>
+            /// Allocates a block
+            /// </summary>
+            /// <param name="size">number of bytes needed</param>
+            /// <param name="ppBlock">pointer in which to return the 64-byte aligned block</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Allocate(SIZE_T size, BYTE** ppBlock);
+
+            /// <summary>
+            /// Returns a block to the pool
+            /// </summary>
+            /// <param name="pBlock">block returned by Allocate, or NULL</param>
+            void Free(BYTE* pBlock);
+
+            /// <summary>
+            /// Adds free blocks to the pool ahead of time, so that the first frames do not allocate
+            /// </summary>
+            /// <param name="size">number of bytes each block must hold</param>
+            /// <param name="count">number of blocks to add</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Reserve(SIZE_T size, DWORD count);
+
+            /// <summary>
+            /// Frees all blocks that are not handed out
+            /// </summary>
+            void Trim();
+
+            /// <summary>
+            /// Gets the pool's counters
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            void GetStatistics(FrameBufferPoolStatistics* pStatistics) const;
+
+            /// <summary>
+            /// Gets the number of bytes a block can hold, which may exceed the size it was allocated with
+            /// </summary>
+            /// <param name="pBlock">block returned by Allocate</param>
+            /// <returns>capacity of the block in bytes</returns>
+            static SIZE_T GetBlockCapacity(const BYTE* pBlock);
+
+        private:
+            // Constants:
+            // Each doubling of size is split into this many size classes
+            static const int CLASSES_PER_DOUBLING = 4;
+
+            // Number of size classes between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE
+            static const int SIZE_CLASS_COUNT = 1 + 16 * CLASSES_PER_DOUBLING;
+
+            /// <summary>
+            /// Bookkeeping stored in front of every block. Occupies one alignment unit so that the
+            /// block after it stays aligned.
+            /// </summary>
+            struct DECLSPEC_ALIGN(64) BlockHeader
+            {
+                // Link in the free list while the block is in the pool
+                SLIST_ENTRY entry;
+
+                // Size class and capacity of the block
+                int sizeClass;
+                SIZE_T capacity;
+
+                // Number of bytes obtained from the operating system, and whether they are large pages
+                SIZE_T allocationSize;
+                bool isLargePage;
+            };
+
+            // Pools are not copied, since they own memory
+            FrameBufferPool(const FrameBufferPool&);
+            FrameBufferPool& operator=(const FrameBufferPool&);
+
+            // Functions:
+            /// <summary>
+            /// Gets the size class that holds a number of bytes
+            /// </summary>
+            /// <param name="size">number of bytes, at most MAX_BLOCK_SIZE</param>
+            /// <returns>index of the smallest size class that fits</returns>
+            static int GetSizeClass(SIZE_T size);
+
+            /// <summary>
+            /// Gets the number of bytes the blocks of a size class hold
+            /// </summary>
+            /// <param name="sizeClass">index of the size class</param>
+            /// <returns>capacity in bytes</returns>
+            static SIZE_T GetClassCapacity(int sizeClass);
+
+            /// <summary>
+            /// Obtains a new block of a size class from the operating system
+            /// </summary>
+            /// <param name="sizeClass">index of the size class</param>
+            /// <returns>header of the new block, or NULL if out of memory</returns>
+            BlockHeader* CreateBlock(int sizeClass);
+
+            /// <summary>
+            /// Gives a block back to the operating system
+            /// </summary>
+            /// <param name="pHeader">header of the block</param>
+            void DestroyBlock(BlockHeader* pHeader);
+
+            /// <summary>
+            /// Raises a high-water mark to a value if the value exceeds it
+            /// </summary>
+            /// <param name="pHighWater">high-water mark to raise</param>
+            /// <param name="value">value reached</param>
+            static void RaiseHighWater(volatile LONGLONG* pHighWater, LONGLONG value);
+
+            // Variables:
+            // Free blocks of each size class
+            SLIST_HEADER m_freeLists[SIZE_CLASS_COUNT];
+
+            // Large page size if large pages are enabled, 0 otherwise
+            SIZE_T m_largePageSize;
+
+            // Counters
+            volatile LONG m_allocationCount;
+            volatile LONG m_largePageCount;
+            volatile LONGLONG m_outstandingCount;
+            volatile LONGLONG m_highWaterCount;
+            volatile LONGLONG m_outstandingBytes;
+            volatile LONGLONG m_highWaterBytes;
+            volatile LONGLONG m_reservedBytes;
+        };
+    }
+}
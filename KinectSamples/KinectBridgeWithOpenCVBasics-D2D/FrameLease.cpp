@@ -0,0 +1,455 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameLease.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FrameLease.h"
+
+using namespace Microsoft::KinectBridge;
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="pStream">stream that owns the lease</param>
+FrameLease::FrameLease(FrameLeaseStream* pStream) :
+    m_pStream(pStream),
+    m_refCount(0),
+    m_hStreamHandle(NULL),
+    m_isZeroCopy(false),
+    m_pBits(NULL),
+    m_pitch(0),
+    m_size(0),
+    m_timeStamp(0),
+    m_frameNumber(0),
+    m_pCopyBuffer(NULL),
+    m_copyBufferSize(0)
+{
+    ZeroMemory(&m_image, sizeof(m_image));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameLease::~FrameLease()
+{
+    FrameBufferPool::GetSharedPool()->Free(m_pCopyBuffer);
+}
+
+/// <summary>
+/// Copies frame data into the lease's pooled buffer
+/// </summary>
+/// <param name="pData">pointer to the frame data</param>
+/// <param name="size">number of bytes to copy</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameLease::CopyFrom(const BYTE* pData, INT size)
+{
+    // Only trade the buffer for a bigger one if it is too small
+    if (size > m_copyBufferSize)
+    {
+        FrameBufferPool* pPool = FrameBufferPool::GetSharedPool();
+        pPool->Free(m_pCopyBuffer);
+        m_pCopyBuffer = NULL;
+        m_copyBufferSize = 0;
+
+        HRESULT hr = pPool->Allocate(size, &m_pCopyBuffer);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        m_copyBufferSize = static_cast<INT>(FrameBufferPool::GetBlockCapacity(m_pCopyBuffer));
+    }
+    memcpy_s(m_pCopyBuffer, m_copyBufferSize, pData, size);
+
+    m_isZeroCopy = false;
+    m_pBits = m_pCopyBuffer;
+    m_size = size;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Adds a reference to the lease
+/// </summary>
+/// <returns>new reference count</returns>
+ULONG FrameLease::AddRef()
+{
+    return InterlockedIncrement(&m_refCount);
+}
+
+/// <summary>
+/// Releases a reference to the lease, returning the frame to its stream when
+/// the last reference goes away
+/// </summary>
+/// <returns>new reference count</returns>
+ULONG FrameLease::Release()
+{
+    LONG refCount = InterlockedDecrement(&m_refCount);
+    if (refCount == 0)
+    {
+        m_pStream->ReturnLease(this);
+    }
+
+    return refCount;
+}
+
+/// <summary>
+/// Gets a pointer to the frame data
+/// </summary>
+/// <returns>pointer to the first byte of the frame</returns>
+BYTE* FrameLease::GetBits() const
+{
+    return m_pBits;
+}
+
+/// <summary>
+/// Gets the number of bytes in each row of the frame
+/// </summary>
+/// <returns>row pitch in bytes</returns>
+INT FrameLease::GetPitch() const
+{
+    return m_pitch;
+}
+
+/// <summary>
+/// Gets the total number of bytes in the frame
+/// </summary>
+/// <returns>frame size in bytes</returns>
+INT FrameLease::GetSize() const
+{
+    return m_size;
+}
+
+/// <summary>
+/// Gets the time stamp the sensor assigned to the frame
+/// </summary>
+/// <returns>time stamp in milliseconds</returns>
+LONGLONG FrameLease::GetTimeStamp() const
+{
+    return m_timeStamp;
+}
+
+/// <summary>
+/// Gets the frame number the sensor assigned to the frame
+/// </summary>
+/// <returns>frame number</returns>
+DWORD FrameLease::GetFrameNumber() const
+{
+    return m_frameNumber;
+}
+
+/// <summary>
+/// Returns whether the lease references the sensor's own frame buffer
+/// </summary>
+/// <returns>true if the frame was not copied, false otherwise</returns>
+bool FrameLease::IsZeroCopy() const
+{
+    return m_isZeroCopy;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameLeaseStream::FrameLeaseStream() :
+    m_pFrameSource(NULL),
+    m_hStreamHandle(NULL),
+    m_frameBufferCount(0),
+    m_sourceHoldCount(0),
+    m_outstandingLeaseCount(0),
+    m_heldFrameCount(0),
+    m_copiedLeaseCount(0)
+{
+    InitializeCriticalSection(&m_lock);
+    InitializeConditionVariable(&m_sourceReleased);
+}
+
+/// <summary>
+/// Destructor. All leases must have been released before the stream is destroyed.
+/// </summary>
+FrameLeaseStream::~FrameLeaseStream()
+{
+    for (std::vector<FrameLease*>::iterator it = m_freeLeases.begin(); it != m_freeLeases.end(); ++it)
+    {
+        delete *it;
+    }
+
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Binds the stream to an opened image stream of a frame source
+/// </summary>
+/// <param name="pFrameSource">frame source that owns the image stream</param>
+/// <param name="hStreamHandle">handle of the opened image stream</param>
+/// <param name="frameBufferCount">number of frames the source buffers for the stream</param>
+void FrameLeaseStream::Attach(IFrameSource* pFrameSource, HANDLE hStreamHandle, DWORD frameBufferCount)
+{
+    EnterCriticalSection(&m_lock);
+
+    // Let leases being acquired from the current source finish with it first
+    while (m_sourceHoldCount > 0)
+    {
+        SleepConditionVariableCS(&m_sourceReleased, &m_lock, INFINITE);
+    }
+
+    m_pFrameSource = pFrameSource;
+    m_hStreamHandle = hStreamHandle;
+    m_frameBufferCount = frameBufferCount;
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Unbinds the stream from its frame source, waiting for leases being acquired from it.
+/// Leases released afterwards no longer touch the source.
+/// </summary>
+void FrameLeaseStream::Detach()
+{
+    Attach(NULL, NULL, 0);
+}
+
+/// <summary>
+/// Gets the next frame of the stream as a lease. The lease keeps the sensor's frame locked
+/// unless that would hold more frames than the sensor buffers for the stream, in which case
+/// the frame is copied into a pooled buffer and handed back to the sensor immediately.
+/// </summary>
+/// <param name="waitMillis">number of milliseconds to wait</param>
+/// <param name="ppLease">pointer in which to return the lease, with one reference held</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameLeaseStream::AcquireLease(DWORD waitMillis, FrameLease** ppLease)
+{
+    // Fail if pointer is invalid
+    if (!ppLease)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if stream is not attached to a frame source, otherwise keep it attached until we are done
+    IFrameSource* pFrameSource;
+    HANDLE hStreamHandle;
+    DWORD frameBufferCount;
+    HRESULT hr = AcquireSource(&pFrameSource, &hStreamHandle, &frameBufferCount);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Get next image stream frame with its data locked
+    FrameSourceImage image;
+
+    hr = pFrameSource->AcquireImageFrame(
+        hStreamHandle,
+        waitMillis,
+        &image);
+    if (FAILED(hr))
+    {
+        ReleaseSource();
+        return hr;
+    }
+
+    NUI_LOCKED_RECT& lockedRect = image.lockedRect;
+
+    // Check if image is valid
+    if (lockedRect.Pitch == 0)
+    {
+        pFrameSource->ReleaseImageFrame(hStreamHandle, &image);
+        ReleaseSource();
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    FrameLease* pLease = PopFreeLease();
+    pLease->m_hStreamHandle = hStreamHandle;
+    pLease->m_image = image;
+    pLease->m_pitch = lockedRect.Pitch;
+    pLease->m_size = lockedRect.size;
+    pLease->m_timeStamp = image.imageFrame.liTimeStamp.QuadPart;
+    pLease->m_frameNumber = image.imageFrame.dwFrameNumber;
+
+    // Keep the source's frame if it still has a buffer to spare for us
+    if (static_cast<DWORD>(InterlockedIncrement(&m_heldFrameCount)) <= frameBufferCount)
+    {
+        pLease->m_isZeroCopy = true;
+        pLease->m_pBits = lockedRect.pBits;
+    }
+    else
+    {
+        InterlockedDecrement(&m_heldFrameCount);
+        InterlockedIncrement(&m_copiedLeaseCount);
+
+        hr = pLease->CopyFrom(lockedRect.pBits, lockedRect.size);
+
+        // Hand the frame straight back to the source
+        pFrameSource->ReleaseImageFrame(hStreamHandle, &image);
+
+        if (FAILED(hr))
+        {
+            ReleaseSource();
+            PushFreeLease(pLease);
+            return hr;
+        }
+    }
+
+    ReleaseSource();
+
+    InterlockedIncrement(&m_outstandingLeaseCount);
+    pLease->AddRef();
+    *ppLease = pLease;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Copies frame data that did not come from a sensor image stream, such as a
+/// skeleton frame, into a pooled lease
+/// </summary>
+/// <param name="pData">pointer to the frame data</param>
+/// <param name="size">number of bytes in the frame</param>
+/// <param name="pitch">number of bytes in each row of the frame</param>
+/// <param name="timeStamp">time stamp of the frame in milliseconds</param>
+/// <param name="frameNumber">frame number of the frame</param>
+/// <param name="ppLease">pointer in which to return the lease, with one reference held</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameLeaseStream::CreateCopyLease(const void* pData, INT size, INT pitch, LONGLONG timeStamp, DWORD frameNumber, FrameLease** ppLease)
+{
+    // Fail if pointer is invalid
+    if (!pData || !ppLease)
+    {
+        return E_POINTER;
+    }
+
+    FrameLease* pLease = PopFreeLease();
+    HRESULT hr = pLease->CopyFrom(static_cast<const BYTE*>(pData), size);
+    if (FAILED(hr))
+    {
+        PushFreeLease(pLease);
+        return hr;
+    }
+
+    pLease->m_pitch = pitch;
+    pLease->m_timeStamp = timeStamp;
+    pLease->m_frameNumber = frameNumber;
+
+    InterlockedIncrement(&m_outstandingLeaseCount);
+    pLease->AddRef();
+    *ppLease = pLease;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the number of leases that have not been released yet
+/// </summary>
+/// <returns>number of outstanding leases</returns>
+LONG FrameLeaseStream::GetOutstandingLeaseCount() const
+{
+    return m_outstandingLeaseCount;
+}
+
+/// <summary>
+/// Gets the number of leases that had to fall back to a pooled copy
+/// </summary>
+/// <returns>number of copied leases</returns>
+LONG FrameLeaseStream::GetCopiedLeaseCount() const
+{
+    return m_copiedLeaseCount;
+}
+
+/// <summary>
+/// Takes a lease from the free list, creating one if the list is empty
+/// </summary>
+/// <returns>pointer to an unused lease</returns>
+FrameLease* FrameLeaseStream::PopFreeLease()
+{
+    FrameLease* pLease = NULL;
+
+    EnterCriticalSection(&m_lock);
+    if (!m_freeLeases.empty())
+    {
+        pLease = m_freeLeases.back();
+        m_freeLeases.pop_back();
+    }
+    LeaveCriticalSection(&m_lock);
+
+    if (!pLease)
+    {
+        pLease = new FrameLease(this);
+    }
+
+    return pLease;
+}
+
+/// <summary>
+/// Gets the bound frame source and holds it, so it is not unbound until ReleaseSource
+/// </summary>
+/// <param name="ppFrameSource">pointer in which to return the frame source</param>
+/// <param name="phStreamHandle">pointer in which to return the handle of the image stream</param>
+/// <param name="pFrameBufferCount">pointer in which to return the number of frames the source buffers</param>
+/// <returns>S_OK if successful, E_NUI_DEVICE_NOT_READY if the stream is not bound</returns>
+HRESULT FrameLeaseStream::AcquireSource(IFrameSource** ppFrameSource, HANDLE* phStreamHandle, DWORD* pFrameBufferCount)
+{
+    HRESULT hr = E_NUI_DEVICE_NOT_READY;
+
+    EnterCriticalSection(&m_lock);
+    if (m_pFrameSource)
+    {
+        *ppFrameSource = m_pFrameSource;
+        *phStreamHandle = m_hStreamHandle;
+        *pFrameBufferCount = m_frameBufferCount;
+        ++m_sourceHoldCount;
+        hr = S_OK;
+    }
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/// <summary>
+/// Releases the hold AcquireSource took on the frame source
+/// </summary>
+void FrameLeaseStream::ReleaseSource()
+{
+    EnterCriticalSection(&m_lock);
+    if (0 == --m_sourceHoldCount)
+    {
+        WakeAllConditionVariable(&m_sourceReleased);
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Returns a lease whose last reference was released
+/// </summary>
+/// <param name="pLease">lease to return</param>
+void FrameLeaseStream::ReturnLease(FrameLease* pLease)
+{
+    EnterCriticalSection(&m_lock);
+
+    // Give the source its frame back, unless the source has already been shut down
+    if (pLease->m_isZeroCopy)
+    {
+        if (m_pFrameSource)
+        {
+            m_pFrameSource->ReleaseImageFrame(pLease->m_hStreamHandle, &pLease->m_image);
+        }
+
+        pLease->m_isZeroCopy = false;
+        InterlockedDecrement(&m_heldFrameCount);
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    PushFreeLease(pLease);
+    InterlockedDecrement(&m_outstandingLeaseCount);
+}
+
+/// <summary>
+/// Puts an unused lease on the free list
+/// </summary>
+/// <param name="pLease">lease to put back</param>
+void FrameLeaseStream::PushFreeLease(FrameLease* pLease)
+{
+    pLease->m_pBits = NULL;
+
+    EnterCriticalSection(&m_lock);
+    m_freeLeases.push_back(pLease);
+    LeaveCriticalSection(&m_lock);
+}
@@ -0,0 +1,245 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameLease.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include <vector>
+#include "FrameSource.h"
+#include "FrameBufferPool.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        class FrameLeaseStream;
+
+        /// <summary>
+        /// Reference counted view of a single image stream frame. A lease either keeps the
+        /// locked sensor texture alive until it is released (zero-copy), or owns a pooled
+        /// copy of the frame when the stream has no spare sensor buffers left.
+        /// </summary>
+        class FrameLease
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Adds a reference to the lease
+            /// </summary>
+            /// <returns>new reference count</returns>
+            ULONG AddRef();
+
+            /// <summary>
+            /// Releases a reference to the lease, returning the frame to its stream when
+            /// the last reference goes away
+            /// </summary>
+            /// <returns>new reference count</returns>
+            ULONG Release();
+
+            /// <summary>
+            /// Gets a pointer to the frame data
+            /// </summary>
+            /// <returns>pointer to the first byte of the frame</returns>
+            BYTE* GetBits() const;
+
+            /// <summary>
+            /// Gets the number of bytes in each row of the frame
+            /// </summary>
+            /// <returns>row pitch in bytes</returns>
+            INT GetPitch() const;
+
+            /// <summary>
+            /// Gets the total number of bytes in the frame
+            /// </summary>
+            /// <returns>frame size in bytes</returns>
+            INT GetSize() const;
+
+            /// <summary>
+            /// Gets the time stamp the sensor assigned to the frame
+            /// </summary>
+            /// <returns>time stamp in milliseconds</returns>
+            LONGLONG GetTimeStamp() const;
+
+            /// <summary>
+            /// Gets the frame number the sensor assigned to the frame
+            /// </summary>
+            /// <returns>frame number</returns>
+            DWORD GetFrameNumber() const;
+
+            /// <summary>
+            /// Returns whether the lease references the sensor's own frame buffer
+            /// </summary>
+            /// <returns>true if the frame was not copied, false otherwise</returns>
+            bool IsZeroCopy() const;
+
+        private:
+            friend class FrameLeaseStream;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            /// <param name="pStream">stream that owns the lease</param>
+            FrameLease(FrameLeaseStream* pStream);
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~FrameLease();
+
+            /// <summary>
+            /// Copies frame data into the lease's pooled buffer
+            /// </summary>
+            /// <param name="pData">pointer to the frame data</param>
+            /// <param name="size">number of bytes to copy</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT CopyFrom(const BYTE* pData, INT size);
+
+            // Variables:
+            // Owning stream and reference count
+            FrameLeaseStream* m_pStream;
+            volatile LONG m_refCount;
+
+            // Source frame held while the lease is zero-copy
+            HANDLE m_hStreamHandle;
+            FrameSourceImage m_image;
+            bool m_isZeroCopy;
+
+            // Frame data, either the locked texture or m_pCopyBuffer
+            BYTE* m_pBits;
+            INT m_pitch;
+            INT m_size;
+            LONGLONG m_timeStamp;
+            DWORD m_frameNumber;
+
+            // Copy buffer from the shared FrameBufferPool, kept across reuses of this lease
+            BYTE* m_pCopyBuffer;
+            INT m_copyBufferSize;
+        };
+
+        /// <summary>
+        /// Hands out FrameLeases for one sensor image stream and recycles them when they are
+        /// released. Leases stay zero-copy as long as the number of outstanding leases fits in
+        /// the stream's frame buffer count.
+        /// </summary>
+        class FrameLeaseStream
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            FrameLeaseStream();
+
+            /// <summary>
+            /// Destructor. All leases must have been released before the stream is destroyed.
+            /// </summary>
+            ~FrameLeaseStream();
+
+            /// <summary>
+            /// Binds the stream to an opened image stream of a frame source
+            /// </summary>
+            /// <param name="pFrameSource">frame source that owns the image stream</param>
+            /// <param name="hStreamHandle">handle of the opened image stream</param>
+            /// <param name="frameBufferCount">number of frames the source buffers for the stream</param>
+            void Attach(IFrameSource* pFrameSource, HANDLE hStreamHandle, DWORD frameBufferCount);
+
+            /// <summary>
+            /// Unbinds the stream from its frame source, waiting for leases being acquired from it.
+            /// Leases released afterwards no longer touch the source.
+            /// </summary>
+            void Detach();
+
+            /// <summary>
+            /// Gets the next frame of the stream as a lease
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="ppLease">pointer in which to return the lease, with one reference held</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AcquireLease(DWORD waitMillis, FrameLease** ppLease);
+
+            /// <summary>
+            /// Copies frame data that did not come from a sensor image stream, such as a
+            /// skeleton frame, into a pooled lease
+            /// </summary>
+            /// <param name="pData">pointer to the frame data</param>
+            /// <param name="size">number of bytes in the frame</param>
+            /// <param name="pitch">number of bytes in each row of the frame</param>
+            /// <param name="timeStamp">time stamp of the frame in milliseconds</param>
+            /// <param name="frameNumber">frame number of the frame</param>
+            /// <param name="ppLease">pointer in which to return the lease, with one reference held</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT CreateCopyLease(const void* pData, INT size, INT pitch, LONGLONG timeStamp, DWORD frameNumber, FrameLease** ppLease);
+
+            /// <summary>
+            /// Gets the number of leases that have not been released yet
+            /// </summary>
+            /// <returns>number of outstanding leases</returns>
+            LONG GetOutstandingLeaseCount() const;
+
+            /// <summary>
+            /// Gets the number of leases that had to fall back to a pooled copy
+            /// </summary>
+            /// <returns>number of copied leases</returns>
+            LONG GetCopiedLeaseCount() const;
+
+        private:
+            friend class FrameLease;
+
+            // Functions:
+            /// <summary>
+            /// Takes a lease from the free list, creating one if the list is empty
+            /// </summary>
+            /// <returns>pointer to an unused lease</returns>
+            FrameLease* PopFreeLease();
+
+            /// <summary>
+            /// Gets the bound frame source and holds it, so it is not unbound until ReleaseSource
+            /// </summary>
+            /// <param name="ppFrameSource">pointer in which to return the frame source</param>
+            /// <param name="phStreamHandle">pointer in which to return the handle of the image stream</param>
+            /// <param name="pFrameBufferCount">pointer in which to return the number of frames the source buffers</param>
+            /// <returns>S_OK if successful, E_NUI_DEVICE_NOT_READY if the stream is not bound</returns>
+            HRESULT AcquireSource(IFrameSource** ppFrameSource, HANDLE* phStreamHandle, DWORD* pFrameBufferCount);
+
+            /// <summary>
+            /// Releases the hold AcquireSource took on the frame source
+            /// </summary>
+            void ReleaseSource();
+
+            /// <summary>
+            /// Puts an unused lease on the free list
+            /// </summary>
+            /// <param name="pLease">lease to put back</param>
+            void PushFreeLease(FrameLease* pLease);
+
+            /// <summary>
+            /// Returns a lease whose last reference was released
+            /// </summary>
+            /// <param name="pLease">lease to return</param>
+            void ReturnLease(FrameLease* pLease);
+
+            // Variables:
+            // Source image stream
+            IFrameSource* m_pFrameSource;
+            HANDLE m_hStreamHandle;
+            DWORD m_frameBufferCount;
+
+            // Holds AcquireSource has taken on the source, guarded by m_lock. Attach waits on
+            // m_sourceReleased until there are none before rebinding the stream.
+            int m_sourceHoldCount;
+            CONDITION_VARIABLE m_sourceReleased;
+
+            // Lease accounting. m_heldFrameCount only counts zero-copy leases.
+            volatile LONG m_outstandingLeaseCount;
+            volatile LONG m_heldFrameCount;
+            volatile LONG m_copiedLeaseCount;
+
+            // Unused leases, guarded by m_lock
+            std::vector<FrameLease*> m_freeLeases;
+            CRITICAL_SECTION m_lock;
+        };
+    }
+}
@@ -5,14 +5,29 @@
 //-----------------------------------------------------------------------------
 
 #include "FrameRateTracker.h"
+#include <math.h>
 
 // Functions:
 /// <summary>
 /// Constructor
 /// </summary>
-FrameRateTracker::FrameRateTracker(): m_frameCount(0), m_previousFrameCount(0), m_fps(0)
+FrameRateTracker::FrameRateTracker()
 {
-    m_previousClock = clock();
+    InitializeCriticalSection(&m_lock);
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_ticksPerSecond = frequency.QuadPart;
+
+    Reset();
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameRateTracker::~FrameRateTracker()
+{
+    DeleteCriticalSection(&m_lock);
 }
 
 /// <summary>
@@ -20,25 +35,140 @@ FrameRateTracker::FrameRateTracker(): m_frameCount(0), m_previousFrameCount(0),
 /// about how long it took to render the current frame.
 /// </summary>
 void FrameRateTracker::Tick() {
-    m_frameCount++;
+    RecordFrame(false, 0);
+}
+
+/// <summary>
+/// Call once per frame to update the frame rate tracker's internal history, counting
+/// frames skipped in the sensor's numbering as dropped.
+/// </summary>
+/// <param name="frameNumber">frame number the sensor assigned to the frame</param>
+void FrameRateTracker::Tick(DWORD frameNumber) {
+    RecordFrame(true, frameNumber);
+}
 
-    // Calculate how long it took to render the current frame
-    clock_t currentClock = clock();
-    clock_t milliseconds = (currentClock - m_previousClock) / (CLOCKS_PER_SEC / 1000);
+/// <summary>
+/// Forgets all frames seen so far, for example because the stream was reopened
+/// </summary>
+void FrameRateTracker::Reset()
+{
+    EnterCriticalSection(&m_lock);
+
+    m_lastFrameTicks = 0;
+    m_intervalCount = 0;
+    m_nextInterval = 0;
+    m_hasFrameNumber = false;
+    m_lastFrameNumber = 0;
+    m_frameCount = 0;
+    m_droppedFrameCount = 0;
+
+    LeaveCriticalSection(&m_lock);
+}
 
-    // Update the frame rate every 1 second
-    if (milliseconds >= 1000)
+/// <summary>
+/// Get the current frame rate
+/// </summary>
+/// <returns>The frame rate averaged over the window</returns>
+double FrameRateTracker::CurrentFPS() const {
+    FrameTimingStatistics statistics;
+    GetStatistics(&statistics);
+    return statistics.meanFps;
+}
+
+/// <summary>
+/// Gets the frame pacing over the window
+/// </summary>
+/// <param name="pStatistics">pointer in which to return the frame pacing</param>
+void FrameRateTracker::GetStatistics(FrameTimingStatistics* pStatistics) const
+{
+    ZeroMemory(pStatistics, sizeof(*pStatistics));
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    EnterCriticalSection(&m_lock);
+
+    pStatistics->frameCount = m_frameCount;
+    pStatistics->droppedFrameCount = m_droppedFrameCount;
+
+    if (m_intervalCount > 0)
     {
-        m_fps = (UINT)((double)(m_frameCount - m_previousFrameCount) * 1000 / milliseconds);
-        m_previousClock = currentClock;
-        m_previousFrameCount = m_frameCount;
+        const double millisPerTick = 1000.0 / m_ticksPerSecond;
+
+        LONGLONG totalTicks = 0;
+        LONGLONG worstTicks = 0;
+        for (int i = 0; i < m_intervalCount; ++i)
+        {
+            totalTicks += m_intervals[i];
+            if (m_intervals[i] > worstTicks)
+            {
+                worstTicks = m_intervals[i];
+            }
+        }
+
+        double meanMillis = totalTicks * millisPerTick / m_intervalCount;
+
+        double variance = 0.0;
+        for (int i = 0; i < m_intervalCount; ++i)
+        {
+            double deviation = m_intervals[i] * millisPerTick - meanMillis;
+            variance += deviation * deviation;
+        }
+
+        // A stream that stopped delivering shows up as a growing gap rather than a frozen rate
+        LONGLONG latestTicks = m_intervals[(m_nextInterval + WINDOW_SIZE - 1) % WINDOW_SIZE];
+        LONGLONG openTicks = now.QuadPart - m_lastFrameTicks;
+        if (openTicks > latestTicks)
+        {
+            latestTicks = openTicks;
+        }
+        if (openTicks > worstTicks)
+        {
+            worstTicks = openTicks;
+        }
+
+        pStatistics->meanFps = (meanMillis > 0.0) ? 1000.0 / meanMillis : 0.0;
+        pStatistics->instantaneousFps = (latestTicks > 0) ? m_ticksPerSecond / static_cast<double>(latestTicks) : 0.0;
+        pStatistics->jitterMillis = sqrt(variance / m_intervalCount);
+        pStatistics->worstGapMillis = worstTicks * millisPerTick;
     }
+
+    LeaveCriticalSection(&m_lock);
 }
 
 /// <summary>
-/// Get the current frame rate
+/// Records the arrival of a frame
 /// </summary>
-/// <returns>The current frame rate</returns>
-const int FrameRateTracker::CurrentFPS() {
-    return m_fps;
+/// <param name="hasFrameNumber">true if frameNumber is valid</param>
+/// <param name="frameNumber">frame number the sensor assigned to the frame</param>
+void FrameRateTracker::RecordFrame(bool hasFrameNumber, DWORD frameNumber)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    EnterCriticalSection(&m_lock);
+
+    if (m_frameCount > 0)
+    {
+        m_intervals[m_nextInterval] = now.QuadPart - m_lastFrameTicks;
+        m_nextInterval = (m_nextInterval + 1) % WINDOW_SIZE;
+        if (m_intervalCount < WINDOW_SIZE)
+        {
+            ++m_intervalCount;
+        }
+    }
+
+    // Frame numbers that were skipped belong to frames that never reached us. A number that
+    // goes backwards means the stream restarted its numbering, which drops nothing.
+    if (hasFrameNumber && m_hasFrameNumber && frameNumber > m_lastFrameNumber)
+    {
+        m_droppedFrameCount += static_cast<LONG>(frameNumber - m_lastFrameNumber - 1);
+    }
+
+    m_hasFrameNumber = hasFrameNumber;
+    m_lastFrameNumber = frameNumber;
+    m_lastFrameTicks = now.QuadPart;
+    ++m_frameCount;
+
+    LeaveCriticalSection(&m_lock);
 }
@@ -6,10 +6,28 @@
 
 #pragma once
 
-#include <ctime>
-#include <algorithm>
 #include <windows.h>
 
+/// <summary>
+/// Frame pacing of a stream over the tracker's window
+/// </summary>
+struct FrameTimingStatistics
+{
+    // Frames per second averaged over the window, and implied by the latest interval
+    double meanFps;
+    double instantaneousFps;
+
+    // Standard deviation of the intervals between frames, in milliseconds
+    double jitterMillis;
+
+    // Longest interval between frames in the window, including the time since the last frame
+    double worstGapMillis;
+
+    // Frames seen, and frames the sensor numbered but that never arrived, since the last reset
+    LONG frameCount;
+    LONG droppedFrameCount;
+};
+
 class FrameRateTracker {
 public:
     // Functions:
@@ -19,27 +37,71 @@ public:
     FrameRateTracker();
 
     /// <summary>
-    /// Call once per frame to update the frame rate
+    /// Destructor
+    /// </summary>
+    ~FrameRateTracker();
+
+    /// <summary>
+    /// Call once per frame to update the frame timing
     /// </summary>
     void Tick();
 
+    /// <summary>
+    /// Call once per frame to update the frame timing, counting frames skipped in the sensor's numbering as dropped
+    /// </summary>
+    /// <param name="frameNumber">frame number the sensor assigned to the frame</param>
+    void Tick(DWORD frameNumber);
+
+    /// <summary>
+    /// Forgets all frames seen so far, for example because the stream was reopened
+    /// </summary>
+    void Reset();
+
     /// <summary>
     /// Get the current frame rate
     /// </summary>
-    /// <returns>The current frame rate</returns>
-    const int CurrentFPS();
+    /// <returns>The frame rate averaged over the window</returns>
+    double CurrentFPS() const;
+
+    /// <summary>
+    /// Gets the frame pacing over the window
+    /// </summary>
+    /// <param name="pStatistics">pointer in which to return the frame pacing</param>
+    void GetStatistics(FrameTimingStatistics* pStatistics) const;
 
 private:
+    // Constants:
+    // Number of inter-frame intervals kept, 3 seconds at 30 FPS
+    static const int WINDOW_SIZE = 90;
+
+    // Functions:
+    /// <summary>
+    /// Records the arrival of a frame
+    /// </summary>
+    /// <param name="hasFrameNumber">true if frameNumber is valid</param>
+    /// <param name="frameNumber">frame number the sensor assigned to the frame</param>
+    void RecordFrame(bool hasFrameNumber, DWORD frameNumber);
+
     // Variables
-    // The clock tick from the last time the fps was calculated
-    clock_t m_previousClock;
+    // Guards the window, since frames are ticked and statistics read on different threads
+    mutable CRITICAL_SECTION m_lock;
+
+    // Performance counter frequency
+    LONGLONG m_ticksPerSecond;
+
+    // Performance counter value when the last frame arrived
+    LONGLONG m_lastFrameTicks;
 
-    // The current frame count
-    DWORD m_frameCount;
+    // Most recent inter-frame intervals in performance counter ticks, oldest at m_nextInterval once full
+    LONGLONG m_intervals[WINDOW_SIZE];
+    int m_intervalCount;
+    int m_nextInterval;
 
-    // The previous frame count
-    DWORD m_previousFrameCount;
+    // Frame number of the last frame, if the caller supplies them
+    bool m_hasFrameNumber;
+    DWORD m_lastFrameNumber;
 
-    // The current frame rate
-    int m_fps;
-};
\ No newline at end of file
+    // Counters since the last reset
+    LONG m_frameCount;
+    LONG m_droppedFrameCount;
+};
@@ -0,0 +1,174 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameRecorder.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FrameRecorder.h"
+
+using namespace Microsoft::KinectBridge;
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameRecorder::FrameRecorder() :
+    m_hFile(INVALID_HANDLE_VALUE)
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameRecorder::~FrameRecorder()
+{
+    Close();
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Creates a recording, replacing any existing file
+/// </summary>
+/// <param name="fileName">path of the recording</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameRecorder::Open(LPCWSTR fileName)
+{
+    // Fail if pointer is invalid
+    if (!fileName)
+    {
+        return E_POINTER;
+    }
+
+    Close();
+
+    HANDLE hFile = CreateFileW(fileName, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    FrameRecordingHeader header;
+    header.magic = FRAME_RECORDING_MAGIC;
+    header.version = FRAME_RECORDING_VERSION;
+
+    DWORD bytesWritten = 0;
+    if (!WriteFile(hFile, &header, sizeof(header), &bytesWritten, NULL))
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(hFile);
+        return hr;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_hFile = hFile;
+    LeaveCriticalSection(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Finishes the recording
+/// </summary>
+void FrameRecorder::Close()
+{
+    EnterCriticalSection(&m_lock);
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Returns whether a recording is open
+/// </summary>
+/// <returns>true if frames are being recorded, false otherwise</returns>
+bool FrameRecorder::IsOpen() const
+{
+    return INVALID_HANDLE_VALUE != m_hFile;
+}
+
+/// <summary>
+/// Appends an image frame to the recording
+/// </summary>
+/// <param name="stream">stream the frame belongs to</param>
+/// <param name="imageType">image type of the stream</param>
+/// <param name="resolution">resolution of the stream</param>
+/// <param name="pLease">frame to record</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameRecorder::WriteImageFrame(FrameStream stream, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, const FrameLease* pLease)
+{
+    // Fail if pointer is invalid
+    if (!pLease)
+    {
+        return E_POINTER;
+    }
+
+    FrameRecordHeader header;
+    header.stream = stream;
+    header.imageType = imageType;
+    header.resolution = resolution;
+    header.frameNumber = pLease->GetFrameNumber();
+    header.timeStamp = pLease->GetTimeStamp();
+    header.pitch = pLease->GetPitch();
+    header.size = pLease->GetSize();
+
+    return WriteRecord(header, pLease->GetBits());
+}
+
+/// <summary>
+/// Appends a skeleton frame to the recording
+/// </summary>
+/// <param name="pSkeletonFrame">skeleton frame to record</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameRecorder::WriteSkeletonFrame(const NUI_SKELETON_FRAME* pSkeletonFrame)
+{
+    // Fail if pointer is invalid
+    if (!pSkeletonFrame)
+    {
+        return E_POINTER;
+    }
+
+    FrameRecordHeader header;
+    header.stream = FRAME_STREAM_SKELETON;
+    header.imageType = NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX;
+    header.resolution = NUI_IMAGE_RESOLUTION_INVALID;
+    header.frameNumber = pSkeletonFrame->dwFrameNumber;
+    header.timeStamp = pSkeletonFrame->liTimeStamp.QuadPart;
+    header.pitch = sizeof(NUI_SKELETON_FRAME);
+    header.size = sizeof(NUI_SKELETON_FRAME);
+
+    return WriteRecord(header, pSkeletonFrame);
+}
+
+/// <summary>
+/// Appends a record header and its frame data to the recording
+/// </summary>
+/// <param name="header">header of the record</param>
+/// <param name="pData">pointer to header.size bytes of frame data</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameRecorder::WriteRecord(const FrameRecordHeader& header, const void* pData)
+{
+    HRESULT hr = S_OK;
+
+    EnterCriticalSection(&m_lock);
+
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        hr = E_HANDLE;
+    }
+    else
+    {
+        DWORD bytesWritten = 0;
+        if (!WriteFile(m_hFile, &header, sizeof(header), &bytesWritten, NULL) ||
+            !WriteFile(m_hFile, pData, header.size, &bytesWritten, NULL))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
@@ -0,0 +1,126 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameRecorder.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include "FrameSource.h"
+#include "FrameLease.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Header at the start of a frame recording
+        /// </summary>
+        struct FrameRecordingHeader
+        {
+            // FRAME_RECORDING_MAGIC
+            DWORD magic;
+
+            // FRAME_RECORDING_VERSION of the writer
+            DWORD version;
+        };
+
+        /// <summary>
+        /// Header in front of each recorded frame. The frame data follows immediately.
+        /// </summary>
+        struct FrameRecordHeader
+        {
+            // FrameStream the frame belongs to
+            DWORD stream;
+
+            // Image type and resolution of image frames, unused for skeleton frames
+            NUI_IMAGE_TYPE imageType;
+            NUI_IMAGE_RESOLUTION resolution;
+
+            // Frame number and time stamp in milliseconds, as assigned by the sensor
+            DWORD frameNumber;
+            LONGLONG timeStamp;
+
+            // Number of bytes in each row and in the whole frame
+            INT pitch;
+            INT size;
+        };
+
+        /// <summary>
+        /// Writes frames to a recording that ReplayFrameSource can play back
+        /// </summary>
+        class FrameRecorder
+        {
+        public:
+            // Constants:
+            // "KBRF" in little-endian byte order
+            static const DWORD FRAME_RECORDING_MAGIC = 0x4652424B;
+
+            // Current recording format
+            static const DWORD FRAME_RECORDING_VERSION = 1;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            FrameRecorder();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~FrameRecorder();
+
+            /// <summary>
+            /// Creates a recording, replacing any existing file
+            /// </summary>
+            /// <param name="fileName">path of the recording</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Open(LPCWSTR fileName);
+
+            /// <summary>
+            /// Finishes the recording
+            /// </summary>
+            void Close();
+
+            /// <summary>
+            /// Returns whether a recording is open
+            /// </summary>
+            /// <returns>true if frames are being recorded, false otherwise</returns>
+            bool IsOpen() const;
+
+            /// <summary>
+            /// Appends an image frame to the recording
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="imageType">image type of the stream</param>
+            /// <param name="resolution">resolution of the stream</param>
+            /// <param name="pLease">frame to record</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT WriteImageFrame(FrameStream stream, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, const FrameLease* pLease);
+
+            /// <summary>
+            /// Appends a skeleton frame to the recording
+            /// </summary>
+            /// <param name="pSkeletonFrame">skeleton frame to record</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT WriteSkeletonFrame(const NUI_SKELETON_FRAME* pSkeletonFrame);
+
+        private:
+            // Functions:
+            /// <summary>
+            /// Appends a record header and its frame data to the recording
+            /// </summary>
+            /// <param name="header">header of the record</param>
+            /// <param name="pData">pointer to header.size bytes of frame data</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT WriteRecord(const FrameRecordHeader& header, const void* pData);
+
+            // Variables:
+            // Recording file
+            HANDLE m_hFile;
+
+            // Serializes writes from the acquisition threads
+            CRITICAL_SECTION m_lock;
+        };
+    }
+}
@@ -0,0 +1,314 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameRing.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FrameRing.h"
+#include <algorithm>
+
+using namespace Microsoft::KinectBridge;
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameRing::FrameRing() :
+    m_ppSlots(NULL),
+    m_depth(0),
+    m_policy(FRAME_RING_POLICY_DROP_OLDEST),
+    m_blockMillis(INFINITE),
+    m_writeIndex(0),
+    m_writeSlot(0),
+    m_readIndex(0),
+    m_readSlot(0),
+    m_pushedCount(0),
+    m_overrunCount(0),
+    m_skippedCount(0),
+    m_blockedCount(0)
+{
+    m_hFrameReadyEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    m_hSlotFreedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Initialize(DEFAULT_DEPTH, FRAME_RING_POLICY_DROP_OLDEST);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameRing::~FrameRing()
+{
+    Clear();
+    delete [] m_ppSlots;
+
+    CloseHandle(m_hFrameReadyEvent);
+    CloseHandle(m_hSlotFreedEvent);
+}
+
+/// <summary>
+/// Sets the ring depth and full-ring policy, releasing any unread frames. Must not be
+/// called while the producer or consumer are using the ring.
+/// </summary>
+/// <param name="depth">number of slots in the ring</param>
+/// <param name="policy">what the producer does when the ring is full</param>
+/// <param name="blockMillis">number of milliseconds the producer waits for a free slot under FRAME_RING_POLICY_BLOCK</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameRing::Initialize(DWORD depth, FrameRingPolicy policy, DWORD blockMillis /* = INFINITE */)
+{
+    // Fail if depth is out of range
+    if (depth < 1 || depth > MAXIMUM_DEPTH)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Release frames stored with the old depth
+    if (m_ppSlots)
+    {
+        Clear();
+    }
+
+    // Only reallocate memory if the depth has changed
+    if (depth != m_depth)
+    {
+        delete [] m_ppSlots;
+        m_ppSlots = new FrameLease*[depth];
+        m_depth = depth;
+    }
+
+    for (DWORD i = 0; i < m_depth; ++i)
+    {
+        m_ppSlots[i] = NULL;
+    }
+
+    m_policy = policy;
+    m_blockMillis = blockMillis;
+    m_writeIndex = 0;
+    m_writeSlot = 0;
+    m_readIndex = 0;
+    m_readSlot = 0;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Pushes a frame into the ring. Called only from the producer thread.
+/// </summary>
+/// <param name="pLease">frame to push; the ring takes over the caller's reference</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameRing::Push(FrameLease* pLease)
+{
+    // Fail if pointer is invalid
+    if (!pLease)
+    {
+        return E_POINTER;
+    }
+
+    DWORD writeSlot = m_writeSlot;
+
+    // Wait for the consumer to empty the slot if we are not allowed to overwrite it
+    if (FRAME_RING_POLICY_BLOCK == m_policy && m_ppSlots[writeSlot])
+    {
+        InterlockedIncrement(&m_blockedCount);
+
+        while (m_ppSlots[writeSlot])
+        {
+            if (WAIT_TIMEOUT == WaitForSingleObject(m_hSlotFreedEvent, m_blockMillis))
+            {
+                // Give up on the new frame rather than stall the producer forever
+                InterlockedIncrement(&m_overrunCount);
+                pLease->Release();
+                return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+            }
+        }
+    }
+
+    // Store the frame, then publish it by advancing the write index
+    FrameLease* pOverwritten = ExchangeSlot(writeSlot, pLease);
+    m_writeSlot = AdvanceSlot(writeSlot, 1);
+    InterlockedIncrement(&m_writeIndex);
+    InterlockedIncrement(&m_pushedCount);
+    SetEvent(m_hFrameReadyEvent);
+
+    // The consumer never saw the frame we overwrote
+    if (pOverwritten)
+    {
+        InterlockedIncrement(&m_overrunCount);
+        pOverwritten->Release();
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Pops the newest unread frame, releasing any older unread frames. Called only from the consumer thread.
+/// </summary>
+/// <param name="ppLease">pointer in which to return the frame, which the caller must release</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no unread frame</returns>
+HRESULT FrameRing::PopLatest(FrameLease** ppLease)
+{
+    // Fail if pointer is invalid
+    if (!ppLease)
+    {
+        return E_POINTER;
+    }
+
+    LONG writeIndex = m_writeIndex;
+    if (writeIndex == m_readIndex)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    // Slots older than one lap behind the producer have already been overwritten
+    LONG firstIndex = m_readIndex;
+    if (writeIndex - firstIndex > static_cast<LONG>(m_depth))
+    {
+        firstIndex = writeIndex - static_cast<LONG>(m_depth);
+    }
+
+    // Empty every unread slot, keeping the newest frame. The producer may refill a slot while
+    // we walk the ring, so compare time stamps rather than trusting the slot order.
+    FrameLease* pLatest = NULL;
+    for (LONG index = writeIndex - 1; index - firstIndex >= 0; --index)
+    {
+        FrameLease* pLease = ExchangeSlot(AdvanceSlot(m_readSlot, index - m_readIndex), NULL);
+        if (!pLease)
+        {
+            continue;
+        }
+
+        if (!pLatest)
+        {
+            pLatest = pLease;
+        }
+        else
+        {
+            if (pLease->GetTimeStamp() > pLatest->GetTimeStamp())
+            {
+                std::swap(pLease, pLatest);
+            }
+
+            InterlockedIncrement(&m_skippedCount);
+            pLease->Release();
+        }
+    }
+
+    m_readSlot = AdvanceSlot(m_readSlot, writeIndex - m_readIndex);
+    m_readIndex = writeIndex;
+    SetEvent(m_hSlotFreedEvent);
+
+    if (!pLatest)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    *ppLease = pLatest;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Pops the oldest unread frame. Called only from the consumer thread.
+/// </summary>
+/// <param name="ppLease">pointer in which to return the frame, which the caller must release</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no unread frame</returns>
+HRESULT FrameRing::PopOldest(FrameLease** ppLease)
+{
+    // Fail if pointer is invalid
+    if (!ppLease)
+    {
+        return E_POINTER;
+    }
+
+    // Slots older than one lap behind the producer have already been overwritten
+    LONG writeIndex = m_writeIndex;
+    if (writeIndex - m_readIndex > static_cast<LONG>(m_depth))
+    {
+        LONG firstIndex = writeIndex - static_cast<LONG>(m_depth);
+        m_readSlot = AdvanceSlot(m_readSlot, firstIndex - m_readIndex);
+        m_readIndex = firstIndex;
+    }
+
+    while (m_readIndex != writeIndex)
+    {
+        FrameLease* pLease = ExchangeSlot(m_readSlot, NULL);
+        m_readSlot = AdvanceSlot(m_readSlot, 1);
+        ++m_readIndex;
+
+        if (pLease)
+        {
+            SetEvent(m_hSlotFreedEvent);
+            *ppLease = pLease;
+            return S_OK;
+        }
+    }
+
+    return E_NUI_FRAME_NO_DATA;
+}
+
+/// <summary>
+/// Releases all unread frames. Called only from the consumer thread.
+/// </summary>
+void FrameRing::Clear()
+{
+    for (DWORD i = 0; i < m_depth; ++i)
+    {
+        FrameLease* pLease = ExchangeSlot(i, NULL);
+        if (pLease)
+        {
+            pLease->Release();
+        }
+    }
+
+    LONG writeIndex = m_writeIndex;
+    m_readSlot = AdvanceSlot(m_readSlot, writeIndex - m_readIndex);
+    m_readIndex = writeIndex;
+    SetEvent(m_hSlotFreedEvent);
+}
+
+/// <summary>
+/// Gets the event that is signalled each time a frame is pushed
+/// </summary>
+/// <returns>handle to an auto-reset event</returns>
+HANDLE FrameRing::GetFrameReadyHandle() const
+{
+    return m_hFrameReadyEvent;
+}
+
+/// <summary>
+/// Gets the ring's counters
+/// </summary>
+/// <param name="pStatistics">pointer in which to return the counters</param>
+void FrameRing::GetStatistics(FrameRingStatistics* pStatistics) const
+{
+    pStatistics->pushedCount = m_pushedCount;
+    pStatistics->overrunCount = m_overrunCount;
+    pStatistics->skippedCount = m_skippedCount;
+    pStatistics->blockedCount = m_blockedCount;
+}
+
+/// <summary>
+/// Moves a slot position forward around the ring
+/// </summary>
+/// <param name="slot">slot position, from 0 to the depth of the ring</param>
+/// <param name="count">number of slots to move forward, at least 0</param>
+/// <returns>slot position, from 0 to the depth of the ring</returns>
+DWORD FrameRing::AdvanceSlot(DWORD slot, LONG count) const
+{
+    slot += static_cast<DWORD>(count) % m_depth;
+    if (slot >= m_depth)
+    {
+        slot -= m_depth;
+    }
+
+    return slot;
+}
+
+/// <summary>
+/// Atomically replaces the frame in a slot
+/// </summary>
+/// <param name="slot">slot position, from 0 to the depth of the ring</param>
+/// <param name="pLease">frame to store, or NULL to empty the slot</param>
+/// <returns>frame previously stored in the slot</returns>
+FrameLease* FrameRing::ExchangeSlot(DWORD slot, FrameLease* pLease)
+{
+    PVOID volatile* pSlot = reinterpret_cast<PVOID volatile*>(&m_ppSlots[slot]);
+    return reinterpret_cast<FrameLease*>(InterlockedExchangePointer(pSlot, pLease));
+}
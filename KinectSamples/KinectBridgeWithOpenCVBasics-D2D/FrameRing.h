@@ -0,0 +1,166 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameRing.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include "FrameLease.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// What the producer does when it finds the ring full
+        /// </summary>
+        enum FrameRingPolicy
+        {
+            // Overwrite the oldest unread frame
+            FRAME_RING_POLICY_DROP_OLDEST,
+
+            // Wait for the consumer to free a slot
+            FRAME_RING_POLICY_BLOCK
+        };
+
+        /// <summary>
+        /// Counters describing how frames moved through a FrameRing
+        /// </summary>
+        struct FrameRingStatistics
+        {
+            // Frames written by the producer
+            LONG pushedCount;
+
+            // Frames discarded before the consumer saw them, because the ring was full
+            LONG overrunCount;
+
+            // Frames the consumer passed over to get to a newer frame
+            LONG skippedCount;
+
+            // Number of times the producer had to wait for a free slot
+            LONG blockedCount;
+        };
+
+        /// <summary>
+        /// Lock-free single-producer/single-consumer ring of frame leases. The producer thread
+        /// pushes leases as frames arrive and the consumer thread pops the freshest or oldest
+        /// unread frame, so neither thread ever waits on a lock held by the other.
+        /// </summary>
+        class FrameRing
+        {
+        public:
+            // Constants:
+            // Default number of slots in the ring
+            static const DWORD DEFAULT_DEPTH = 3;
+
+            // Maximum number of slots in the ring
+            static const DWORD MAXIMUM_DEPTH = 64;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            FrameRing();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~FrameRing();
+
+            /// <summary>
+            /// Sets the ring depth and full-ring policy, releasing any unread frames. Must not be
+            /// called while the producer or consumer are using the ring.
+            /// </summary>
+            /// <param name="depth">number of slots in the ring</param>
+            /// <param name="policy">what the producer does when the ring is full</param>
+            /// <param name="blockMillis">number of milliseconds the producer waits for a free slot under FRAME_RING_POLICY_BLOCK</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Initialize(DWORD depth, FrameRingPolicy policy, DWORD blockMillis = INFINITE);
+
+            /// <summary>
+            /// Pushes a frame into the ring. Called only from the producer thread.
+            /// </summary>
+            /// <param name="pLease">frame to push; the ring takes over the caller's reference</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Push(FrameLease* pLease);
+
+            /// <summary>
+            /// Pops the newest unread frame, releasing any older unread frames. Called only from the consumer thread.
+            /// </summary>
+            /// <param name="ppLease">pointer in which to return the frame, which the caller must release</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no unread frame</returns>
+            HRESULT PopLatest(FrameLease** ppLease);
+
+            /// <summary>
+            /// Pops the oldest unread frame. Called only from the consumer thread.
+            /// </summary>
+            /// <param name="ppLease">pointer in which to return the frame, which the caller must release</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no unread frame</returns>
+            HRESULT PopOldest(FrameLease** ppLease);
+
+            /// <summary>
+            /// Releases all unread frames. Called only from the consumer thread.
+            /// </summary>
+            void Clear();
+
+            /// <summary>
+            /// Gets the event that is signalled each time a frame is pushed
+            /// </summary>
+            /// <returns>handle to an auto-reset event</returns>
+            HANDLE GetFrameReadyHandle() const;
+
+            /// <summary>
+            /// Gets the ring's counters
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            void GetStatistics(FrameRingStatistics* pStatistics) const;
+
+        private:
+            // Functions:
+            /// <summary>
+            /// Moves a slot position forward around the ring
+            /// </summary>
+            /// <param name="slot">slot position, from 0 to the depth of the ring</param>
+            /// <param name="count">number of slots to move forward, at least 0</param>
+            /// <returns>slot position, from 0 to the depth of the ring</returns>
+            DWORD AdvanceSlot(DWORD slot, LONG count) const;
+
+            /// <summary>
+            /// Atomically replaces the frame in a slot
+            /// </summary>
+            /// <param name="slot">slot position, from 0 to the depth of the ring</param>
+            /// <param name="pLease">frame to store, or NULL to empty the slot</param>
+            /// <returns>frame previously stored in the slot</returns>
+            FrameLease* ExchangeSlot(DWORD slot, FrameLease* pLease);
+
+            // Variables:
+            // Slots, each holding one reference to its frame or NULL
+            FrameLease* volatile* m_ppSlots;
+            DWORD m_depth;
+            FrameRingPolicy m_policy;
+            DWORD m_blockMillis;
+
+            // Number of frames pushed so far, only advanced by the producer, and the position of
+            // the slot it writes next, only touched by the producer
+            volatile LONG m_writeIndex;
+            DWORD m_writeSlot;
+
+            // Number of frames read or passed over so far, and the position of the slot it reads
+            // next, only touched by the consumer. The indices are only ever compared with each
+            // other, so they may wrap around; the slot positions always stay below m_depth.
+            LONG m_readIndex;
+            DWORD m_readSlot;
+
+            // Counters
+            volatile LONG m_pushedCount;
+            volatile LONG m_overrunCount;
+            volatile LONG m_skippedCount;
+            volatile LONG m_blockedCount;
+
+            // Events signalled when a frame is pushed and when the consumer frees slots
+            HANDLE m_hFrameReadyEvent;
+            HANDLE m_hSlotFreedEvent;
+        };
+    }
+}
@@ -0,0 +1,148 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FrameSource.h"
+
+using namespace Microsoft::KinectBridge;
+
+/// <summary>
+/// Constructor
+/// </summary>
+NuiFrameSource::NuiFrameSource() : m_pNuiSensor(NULL)
+{
+}
+
+/// <summary>
+/// Sets the sensor to pull frames from. Must be called before Initialize.
+/// </summary>
+/// <param name="pNuiSensor">sensor to use</param>
+void NuiFrameSource::SetSensor(INuiSensor* pNuiSensor)
+{
+    m_pNuiSensor = pNuiSensor;
+}
+
+/// <summary>
+/// Starts the source
+/// </summary>
+/// <param name="nuiInitFlags">NUI_INITIALIZE_FLAG_* values selecting the streams to use</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::Initialize(DWORD nuiInitFlags)
+{
+    // Fail if there is no sensor
+    if (!m_pNuiSensor)
+    {
+        return E_POINTER;
+    }
+
+    return m_pNuiSensor->NuiInitialize(nuiInitFlags);
+}
+
+/// <summary>
+/// Stops the source
+/// </summary>
+void NuiFrameSource::Shutdown()
+{
+    if (m_pNuiSensor)
+    {
+        m_pNuiSensor->NuiShutdown();
+    }
+}
+
+/// <summary>
+/// Returns a string identifying the device or recording behind the source
+/// </summary>
+/// <returns>connection id of the source</returns>
+BSTR NuiFrameSource::GetConnectionId() const
+{
+    return m_pNuiSensor->NuiDeviceConnectionId();
+}
+
+/// <summary>
+/// Opens, or reopens, an image stream
+/// </summary>
+/// <param name="imageType">type of image stream to open</param>
+/// <param name="resolution">resolution of image stream</param>
+/// <param name="flags">image frame flags</param>
+/// <param name="frameBufferCount">number of frames to buffer</param>
+/// <param name="hNextFrameEvent">event to signal when a frame is available</param>
+/// <param name="phStreamHandle">pointer in which to return the stream handle</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::OpenImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, DWORD flags,
+    DWORD frameBufferCount, HANDLE hNextFrameEvent, HANDLE* phStreamHandle)
+{
+    return m_pNuiSensor->NuiImageStreamOpen(
+        imageType,
+        resolution,
+        flags,
+        frameBufferCount,
+        hNextFrameEvent,
+        phStreamHandle);
+}
+
+/// <summary>
+/// Sets the image frame flags of an opened image stream
+/// </summary>
+/// <param name="hStreamHandle">stream handle</param>
+/// <param name="flags">image frame flags</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::SetImageStreamFlags(HANDLE hStreamHandle, DWORD flags)
+{
+    return m_pNuiSensor->NuiImageStreamSetImageFrameFlags(hStreamHandle, flags);
+}
+
+/// <summary>
+/// Enables skeleton tracking
+/// </summary>
+/// <param name="hNextFrameEvent">event to signal when a skeleton frame is available</param>
+/// <param name="flags">skeleton tracking flags</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::EnableSkeletonTracking(HANDLE hNextFrameEvent, DWORD flags)
+{
+    return m_pNuiSensor->NuiSkeletonTrackingEnable(hNextFrameEvent, flags);
+}
+
+/// <summary>
+/// Gets the next frame of an image stream and locks its data
+/// </summary>
+/// <param name="hStreamHandle">stream handle</param>
+/// <param name="waitMillis">number of milliseconds to wait</param>
+/// <param name="pImage">pointer in which to return the frame</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::AcquireImageFrame(HANDLE hStreamHandle, DWORD waitMillis, FrameSourceImage* pImage)
+{
+    HRESULT hr = m_pNuiSensor->NuiImageStreamGetNextFrame(hStreamHandle, waitMillis, &pImage->imageFrame);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Lock frame texture to allow access to its data
+    return pImage->imageFrame.pFrameTexture->LockRect(0, &pImage->lockedRect, NULL, 0);
+}
+
+/// <summary>
+/// Unlocks and releases a frame returned by AcquireImageFrame
+/// </summary>
+/// <param name="hStreamHandle">stream handle the frame came from</param>
+/// <param name="pImage">frame to release</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::ReleaseImageFrame(HANDLE hStreamHandle, FrameSourceImage* pImage)
+{
+    pImage->imageFrame.pFrameTexture->UnlockRect(0);
+
+    return m_pNuiSensor->NuiImageStreamReleaseFrame(hStreamHandle, &pImage->imageFrame);
+}
+
+/// <summary>
+/// Gets the next skeleton frame
+/// </summary>
+/// <param name="waitMillis">number of milliseconds to wait</param>
+/// <param name="pSkeletonFrame">pointer in which to return the skeleton frame</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT NuiFrameSource::GetNextSkeletonFrame(DWORD waitMillis, NUI_SKELETON_FRAME* pSkeletonFrame)
+{
+    return m_pNuiSensor->NuiSkeletonGetNextFrame(waitMillis, pSkeletonFrame);
+}
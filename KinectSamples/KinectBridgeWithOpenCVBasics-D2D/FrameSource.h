@@ -0,0 +1,216 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Streams a frame source produces
+        /// </summary>
+        enum FrameStream
+        {
+            FRAME_STREAM_COLOR,
+            FRAME_STREAM_DEPTH,
+            FRAME_STREAM_SKELETON,
+            FRAME_STREAM_COUNT
+        };
+
+        /// <summary>
+        /// Image stream frame handed out by a frame source, together with its locked data
+        /// </summary>
+        struct FrameSourceImage
+        {
+            NUI_IMAGE_FRAME imageFrame;
+            NUI_LOCKED_RECT lockedRect;
+        };
+
+        /// <summary>
+        /// Backend that KinectHelper pulls its frames from. The calls mirror the subset of
+        /// INuiSensor that KinectHelper uses, and frames come back in the same NUI layouts,
+        /// so everything downstream of the helper behaves the same whichever source is used.
+        /// </summary>
+        class IFrameSource
+        {
+        public:
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            virtual ~IFrameSource() {}
+
+            /// <summary>
+            /// Starts the source
+            /// </summary>
+            /// <param name="nuiInitFlags">NUI_INITIALIZE_FLAG_* values selecting the streams to use</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT Initialize(DWORD nuiInitFlags) = 0;
+
+            /// <summary>
+            /// Stops the source
+            /// </summary>
+            virtual void Shutdown() = 0;
+
+            /// <summary>
+            /// Returns a string identifying the device or recording behind the source
+            /// </summary>
+            /// <returns>connection id of the source</returns>
+            virtual BSTR GetConnectionId() const = 0;
+
+            /// <summary>
+            /// Opens, or reopens, an image stream
+            /// </summary>
+            /// <param name="imageType">type of image stream to open</param>
+            /// <param name="resolution">resolution of image stream</param>
+            /// <param name="flags">image frame flags</param>
+            /// <param name="frameBufferCount">number of frames to buffer</param>
+            /// <param name="hNextFrameEvent">event to signal when a frame is available</param>
+            /// <param name="phStreamHandle">pointer in which to return the stream handle</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT OpenImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, DWORD flags,
+                DWORD frameBufferCount, HANDLE hNextFrameEvent, HANDLE* phStreamHandle) = 0;
+
+            /// <summary>
+            /// Sets the image frame flags of an opened image stream
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="flags">image frame flags</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT SetImageStreamFlags(HANDLE hStreamHandle, DWORD flags) = 0;
+
+            /// <summary>
+            /// Enables skeleton tracking
+            /// </summary>
+            /// <param name="hNextFrameEvent">event to signal when a skeleton frame is available</param>
+            /// <param name="flags">skeleton tracking flags</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT EnableSkeletonTracking(HANDLE hNextFrameEvent, DWORD flags) = 0;
+
+            /// <summary>
+            /// Gets the next frame of an image stream and locks its data
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pImage">pointer in which to return the frame</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT AcquireImageFrame(HANDLE hStreamHandle, DWORD waitMillis, FrameSourceImage* pImage) = 0;
+
+            /// <summary>
+            /// Unlocks and releases a frame returned by AcquireImageFrame
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle the frame came from</param>
+            /// <param name="pImage">frame to release</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT ReleaseImageFrame(HANDLE hStreamHandle, FrameSourceImage* pImage) = 0;
+
+            /// <summary>
+            /// Gets the next skeleton frame
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pSkeletonFrame">pointer in which to return the skeleton frame</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT GetNextSkeletonFrame(DWORD waitMillis, NUI_SKELETON_FRAME* pSkeletonFrame) = 0;
+        };
+
+        /// <summary>
+        /// Frame source backed by a Kinect sensor
+        /// </summary>
+        class NuiFrameSource : public IFrameSource
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            NuiFrameSource();
+
+            /// <summary>
+            /// Sets the sensor to pull frames from. Must be called before Initialize.
+            /// </summary>
+            /// <param name="pNuiSensor">sensor to use</param>
+            void SetSensor(INuiSensor* pNuiSensor);
+
+            /// <summary>
+            /// Starts the source
+            /// </summary>
+            /// <param name="nuiInitFlags">NUI_INITIALIZE_FLAG_* values selecting the streams to use</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Initialize(DWORD nuiInitFlags) override;
+
+            /// <summary>
+            /// Stops the source
+            /// </summary>
+            void Shutdown() override;
+
+            /// <summary>
+            /// Returns a string identifying the device or recording behind the source
+            /// </summary>
+            /// <returns>connection id of the source</returns>
+            BSTR GetConnectionId() const override;
+
+            /// <summary>
+            /// Opens, or reopens, an image stream
+            /// </summary>
+            /// <param name="imageType">type of image stream to open</param>
+            /// <param name="resolution">resolution of image stream</param>
+            /// <param name="flags">image frame flags</param>
+            /// <param name="frameBufferCount">number of frames to buffer</param>
+            /// <param name="hNextFrameEvent">event to signal when a frame is available</param>
+            /// <param name="phStreamHandle">pointer in which to return the stream handle</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT OpenImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, DWORD flags,
+                DWORD frameBufferCount, HANDLE hNextFrameEvent, HANDLE* phStreamHandle) override;
+
+            /// <summary>
+            /// Sets the image frame flags of an opened image stream
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="flags">image frame flags</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetImageStreamFlags(HANDLE hStreamHandle, DWORD flags) override;
+
+            /// <summary>
+            /// Enables skeleton tracking
+            /// </summary>
+            /// <param name="hNextFrameEvent">event to signal when a skeleton frame is available</param>
+            /// <param name="flags">skeleton tracking flags</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT EnableSkeletonTracking(HANDLE hNextFrameEvent, DWORD flags) override;
+
+            /// <summary>
+            /// Gets the next frame of an image stream and locks its data
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pImage">pointer in which to return the frame</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AcquireImageFrame(HANDLE hStreamHandle, DWORD waitMillis, FrameSourceImage* pImage) override;
+
+            /// <summary>
+            /// Unlocks and releases a frame returned by AcquireImageFrame
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle the frame came from</param>
+            /// <param name="pImage">frame to release</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ReleaseImageFrame(HANDLE hStreamHandle, FrameSourceImage* pImage) override;
+
+            /// <summary>
+            /// Gets the next skeleton frame
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pSkeletonFrame">pointer in which to return the skeleton frame</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetNextSkeletonFrame(DWORD waitMillis, NUI_SKELETON_FRAME* pSkeletonFrame) override;
+
+        private:
+            // Variables:
+            // Pointer to Kinect sensor
+            INuiSensor* m_pNuiSensor;
+        };
+    }
+}
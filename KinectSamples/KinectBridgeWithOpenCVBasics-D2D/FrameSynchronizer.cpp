@@ -0,0 +1,406 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameSynchronizer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "FrameSynchronizer.h"
+
+using namespace Microsoft::KinectBridge;
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameSet::FrameSet()
+{
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        m_pLeases[i] = NULL;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameSet::~FrameSet()
+{
+    Clear();
+}
+
+/// <summary>
+/// Releases the frames of the set
+/// </summary>
+void FrameSet::Clear()
+{
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        if (m_pLeases[i])
+        {
+            m_pLeases[i]->Release();
+            m_pLeases[i] = NULL;
+        }
+    }
+}
+
+/// <summary>
+/// Gets the frame of a stream
+/// </summary>
+/// <param name="stream">stream of the frame</param>
+/// <returns>frame of the stream, or NULL if the set has none. The set keeps its reference.</returns>
+FrameLease* FrameSet::GetLease(FrameStream stream) const
+{
+    return m_pLeases[stream];
+}
+
+/// <summary>
+/// Gets the time stamp of the newest frame in the set
+/// </summary>
+/// <returns>time stamp in milliseconds</returns>
+LONGLONG FrameSet::GetTimeStamp() const
+{
+    LONGLONG timeStamp = 0;
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        if (m_pLeases[i] && m_pLeases[i]->GetTimeStamp() > timeStamp)
+        {
+            timeStamp = m_pLeases[i]->GetTimeStamp();
+        }
+    }
+
+    return timeStamp;
+}
+
+/// <summary>
+/// Gets the largest time stamp difference between frames of the set
+/// </summary>
+/// <returns>skew in milliseconds</returns>
+LONGLONG FrameSet::GetSkew() const
+{
+    bool isEmpty = true;
+    LONGLONG oldest = 0, newest = 0;
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        if (m_pLeases[i])
+        {
+            LONGLONG timeStamp = m_pLeases[i]->GetTimeStamp();
+            if (isEmpty || timeStamp < oldest)
+            {
+                oldest = timeStamp;
+            }
+            if (isEmpty || timeStamp > newest)
+            {
+                newest = timeStamp;
+            }
+            isEmpty = false;
+        }
+    }
+
+    return newest - oldest;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+FrameSynchronizer::FrameSynchronizer() :
+    m_mode(FRAME_SYNC_MODE_LATEST_COMPLETE),
+    m_tolerance(DEFAULT_TOLERANCE_MILLIS),
+    m_queueDepth(DEFAULT_QUEUE_DEPTH),
+    m_setCount(0),
+    m_lastSkew(0)
+{
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        m_droppedCounts[i] = 0;
+    }
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+FrameSynchronizer::~FrameSynchronizer()
+{
+    Clear();
+}
+
+/// <summary>
+/// Sets how frames are matched, releasing any queued frames
+/// </summary>
+/// <param name="mode">which complete sets are emitted</param>
+/// <param name="toleranceMillis">largest time stamp difference within a set, in milliseconds</param>
+/// <param name="queueDepth">number of unmatched frames kept per stream</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameSynchronizer::Initialize(FrameSyncMode mode, DWORD toleranceMillis, DWORD queueDepth /* = DEFAULT_QUEUE_DEPTH */)
+{
+    // Fail if queue depth is invalid
+    if (queueDepth < 1)
+    {
+        return E_INVALIDARG;
+    }
+
+    Clear();
+
+    m_mode = mode;
+    m_tolerance = toleranceMillis;
+    m_queueDepth = queueDepth;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Queues a frame for matching
+/// </summary>
+/// <param name="stream">stream the frame belongs to</param>
+/// <param name="pLease">frame to queue; the synchronizer takes over the caller's reference</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT FrameSynchronizer::AddFrame(FrameStream stream, FrameLease* pLease)
+{
+    // Fail if pointer is invalid
+    if (!pLease)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if stream is invalid
+    if (stream < 0 || stream >= FRAME_STREAM_COUNT)
+    {
+        pLease->Release();
+        return E_INVALIDARG;
+    }
+
+    std::deque<FrameLease*>& queue = m_queues[stream];
+    queue.push_back(pLease);
+
+    // Frames that waited this long for a partner are not going to get one
+    while (queue.size() > m_queueDepth)
+    {
+        DropOldest(stream);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Takes the next complete set out of the queued frames
+/// </summary>
+/// <param name="streamMask">bit (1 &lt;&lt; FrameStream) set for every stream a set must contain</param>
+/// <param name="pFrameSet">set in which to return the frames; its previous frames are released</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no complete set is queued</returns>
+HRESULT FrameSynchronizer::GetFrameSet(DWORD streamMask, FrameSet* pFrameSet)
+{
+    // Fail if pointer is invalid
+    if (!pFrameSet)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if no stream is asked for
+    if (0 == (streamMask & ((1 << FRAME_STREAM_COUNT) - 1)))
+    {
+        return E_INVALIDARG;
+    }
+
+    pFrameSet->Clear();
+
+    size_t indices[FRAME_STREAM_COUNT];
+    bool isFound = (FRAME_SYNC_MODE_STRICT_LOCKSTEP == m_mode) ?
+        FindOldestComplete(streamMask, indices) :
+        FindLatestComplete(streamMask, indices);
+    if (!isFound)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        if (streamMask & (1 << i))
+        {
+            // Frames older than the one picked can no longer be part of a set
+            for (size_t k = 0; k < indices[i]; ++k)
+            {
+                DropOldest(i);
+            }
+
+            pFrameSet->m_pLeases[i] = m_queues[i].front();
+            m_queues[i].pop_front();
+        }
+    }
+
+    ++m_setCount;
+    m_lastSkew = pFrameSet->GetSkew();
+
+    return S_OK;
+}
+
+/// <summary>
+/// Releases all queued frames
+/// </summary>
+void FrameSynchronizer::Clear()
+{
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        std::deque<FrameLease*>& queue = m_queues[i];
+        for (std::deque<FrameLease*>::iterator it = queue.begin(); it != queue.end(); ++it)
+        {
+            (*it)->Release();
+        }
+        queue.clear();
+    }
+}
+
+/// <summary>
+/// Gets the synchronizer's counters
+/// </summary>
+/// <param name="pStatistics">pointer in which to return the counters</param>
+void FrameSynchronizer::GetStatistics(FrameSyncStatistics* pStatistics) const
+{
+    pStatistics->setCount = m_setCount;
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        pStatistics->droppedCounts[i] = m_droppedCounts[i];
+    }
+    pStatistics->lastSkew = m_lastSkew;
+}
+
+/// <summary>
+/// Finds the newest complete set
+/// </summary>
+/// <param name="streamMask">streams a set must contain</param>
+/// <param name="indices">array in which to return the queue index of each stream's frame</param>
+/// <returns>true if a complete set was found, false otherwise</returns>
+bool FrameSynchronizer::FindLatestComplete(DWORD streamMask, size_t* indices) const
+{
+    // Every set holds exactly one frame of the first required stream, so walking that
+    // stream from its newest frame finds the newest set
+    int anchor = 0;
+    while (!(streamMask & (1 << anchor)))
+    {
+        ++anchor;
+    }
+
+    const std::deque<FrameLease*>& anchorQueue = m_queues[anchor];
+    for (size_t k = anchorQueue.size(); k-- > 0; )
+    {
+        const LONGLONG anchorTimeStamp = anchorQueue[k]->GetTimeStamp();
+        LONGLONG oldest = anchorTimeStamp, newest = anchorTimeStamp;
+        indices[anchor] = k;
+
+        bool isComplete = true;
+        for (int i = anchor + 1; i < FRAME_STREAM_COUNT && isComplete; ++i)
+        {
+            if (!(streamMask & (1 << i)))
+            {
+                continue;
+            }
+
+            // Pair the anchor with the stream's nearest frame
+            const std::deque<FrameLease*>& queue = m_queues[i];
+            LONGLONG bestDistance = -1;
+            for (size_t j = 0; j < queue.size(); ++j)
+            {
+                LONGLONG distance = queue[j]->GetTimeStamp() - anchorTimeStamp;
+                if (distance < 0)
+                {
+                    distance = -distance;
+                }
+
+                if (bestDistance < 0 || distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    indices[i] = j;
+                }
+            }
+
+            if (bestDistance < 0 || bestDistance > m_tolerance)
+            {
+                isComplete = false;
+                break;
+            }
+
+            LONGLONG timeStamp = queue[indices[i]]->GetTimeStamp();
+            if (timeStamp < oldest)
+            {
+                oldest = timeStamp;
+            }
+            if (timeStamp > newest)
+            {
+                newest = timeStamp;
+            }
+        }
+
+        // Each frame may be near the anchor while two of them are still too far apart
+        if (isComplete && newest - oldest <= m_tolerance)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Finds the oldest complete set, dropping frames that can no longer be part of one
+/// </summary>
+/// <param name="streamMask">streams a set must contain</param>
+/// <param name="indices">array in which to return the queue index of each stream's frame</param>
+/// <returns>true if a complete set was found, false otherwise</returns>
+bool FrameSynchronizer::FindOldestComplete(DWORD streamMask, size_t* indices)
+{
+    for (;;)
+    {
+        // Frames arrive in order, so nothing older than the newest front frame minus the
+        // tolerance will ever be matched
+        bool isFirst = true;
+        LONGLONG newestFront = 0;
+        for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+        {
+            if (streamMask & (1 << i))
+            {
+                if (m_queues[i].empty())
+                {
+                    return false;
+                }
+
+                LONGLONG timeStamp = m_queues[i].front()->GetTimeStamp();
+                if (isFirst || timeStamp > newestFront)
+                {
+                    newestFront = timeStamp;
+                }
+                isFirst = false;
+            }
+        }
+
+        bool isDropped = false;
+        for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+        {
+            if (streamMask & (1 << i))
+            {
+                while (!m_queues[i].empty() && m_queues[i].front()->GetTimeStamp() < newestFront - m_tolerance)
+                {
+                    DropOldest(i);
+                    isDropped = true;
+                }
+            }
+        }
+
+        // All front frames are within the tolerance of the newest one
+        if (!isDropped)
+        {
+            for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+            {
+                indices[i] = 0;
+            }
+            return true;
+        }
+    }
+}
+
+/// <summary>
+/// Releases the oldest queued frame of a stream, counting it as dropped
+/// </summary>
+/// <param name="stream">stream to drop from</param>
+void FrameSynchronizer::DropOldest(int stream)
+{
+    m_queues[stream].front()->Release();
+    m_queues[stream].pop_front();
+    ++m_droppedCounts[stream];
+}
@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+// <copyright file="FrameSynchronizer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include <deque>
+#include "FrameLease.h"
+#include "FrameSource.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// How the synchronizer picks the frames it bundles
+        /// </summary>
+        enum FrameSyncMode
+        {
+            // Emit the newest complete set, dropping anything older
+            FRAME_SYNC_MODE_LATEST_COMPLETE,
+
+            // Emit every complete set in capture order, dropping only frames that have no partner
+            FRAME_SYNC_MODE_STRICT_LOCKSTEP
+        };
+
+        /// <summary>
+        /// Counters describing how the synchronizer bundled frames
+        /// </summary>
+        struct FrameSyncStatistics
+        {
+            // Frame sets emitted
+            LONG setCount;
+
+            // Frames of each stream discarded without becoming part of a set
+            LONG droppedCounts[FRAME_STREAM_COUNT];
+
+            // Largest time stamp difference within the last emitted set, in milliseconds
+            LONGLONG lastSkew;
+        };
+
+        /// <summary>
+        /// Frames of several streams captured at the same instant. Holds one reference to each
+        /// of its frames and releases them when cleared or destroyed.
+        /// </summary>
+        class FrameSet
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            FrameSet();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~FrameSet();
+
+            /// <summary>
+            /// Releases the frames of the set
+            /// </summary>
+            void Clear();
+
+            /// <summary>
+            /// Gets the frame of a stream
+            /// </summary>
+            /// <param name="stream">stream of the frame</param>
+            /// <returns>frame of the stream, or NULL if the set has none. The set keeps its reference.</returns>
+            FrameLease* GetLease(FrameStream stream) const;
+
+            /// <summary>
+            /// Gets the time stamp of the newest frame in the set
+            /// </summary>
+            /// <returns>time stamp in milliseconds</returns>
+            LONGLONG GetTimeStamp() const;
+
+            /// <summary>
+            /// Gets the largest time stamp difference between frames of the set
+            /// </summary>
+            /// <returns>skew in milliseconds</returns>
+            LONGLONG GetSkew() const;
+
+        private:
+            friend class FrameSynchronizer;
+
+            // Sets are not copied, since they own references
+            FrameSet(const FrameSet&);
+            FrameSet& operator=(const FrameSet&);
+
+            // Variables:
+            FrameLease* m_pLeases[FRAME_STREAM_COUNT];
+        };
+
+        /// <summary>
+        /// Bundles color, depth and skeleton frames whose NUI time stamps lie within a tolerance
+        /// of each other, so that consumers never combine frames from different instants.
+        /// Used only from the consumer thread.
+        /// </summary>
+        class FrameSynchronizer
+        {
+        public:
+            // Constants:
+            // Default largest time stamp difference within a set, in milliseconds. Color and
+            // depth are not captured in lockstep, so at 30 FPS their time stamps drift apart by
+            // up to half a frame.
+            static const DWORD DEFAULT_TOLERANCE_MILLIS = 20;
+
+            // Default number of unmatched frames kept per stream
+            static const DWORD DEFAULT_QUEUE_DEPTH = 8;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            FrameSynchronizer();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~FrameSynchronizer();
+
+            /// <summary>
+            /// Sets how frames are matched, releasing any queued frames
+            /// </summary>
+            /// <param name="mode">which complete sets are emitted</param>
+            /// <param name="toleranceMillis">largest time stamp difference within a set, in milliseconds</param>
+            /// <param name="queueDepth">number of unmatched frames kept per stream</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Initialize(FrameSyncMode mode, DWORD toleranceMillis, DWORD queueDepth = DEFAULT_QUEUE_DEPTH);
+
+            /// <summary>
+            /// Queues a frame for matching
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="pLease">frame to queue; the synchronizer takes over the caller's reference</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AddFrame(FrameStream stream, FrameLease* pLease);
+
+            /// <summary>
+            /// Takes the next complete set out of the queued frames
+            /// </summary>
+            /// <param name="streamMask">bit (1 &lt;&lt; FrameStream) set for every stream a set must contain</param>
+            /// <param name="pFrameSet">set in which to return the frames; its previous frames are released</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no complete set is queued</returns>
+            HRESULT GetFrameSet(DWORD streamMask, FrameSet* pFrameSet);
+
+            /// <summary>
+            /// Releases all queued frames
+            /// </summary>
+            void Clear();
+
+            /// <summary>
+            /// Gets the synchronizer's counters
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            void GetStatistics(FrameSyncStatistics* pStatistics) const;
+
+        private:
+            // Functions:
+            /// <summary>
+            /// Finds the newest complete set
+            /// </summary>
+            /// <param name="streamMask">streams a set must contain</param>
+            /// <param name="indices">array in which to return the queue index of each stream's frame</param>
+            /// <returns>true if a complete set was found, false otherwise</returns>
+            bool FindLatestComplete(DWORD streamMask, size_t* indices) const;
+
+            /// <summary>
+            /// Finds the oldest complete set, dropping frames that can no longer be part of one
+            /// </summary>
+            /// <param name="streamMask">streams a set must contain</param>
+            /// <param name="indices">array in which to return the queue index of each stream's frame</param>
+            /// <returns>true if a complete set was found, false otherwise</returns>
+            bool FindOldestComplete(DWORD streamMask, size_t* indices);
+
+            /// <summary>
+            /// Releases the oldest queued frame of a stream, counting it as dropped
+            /// </summary>
+            /// <param name="stream">stream to drop from</param>
+            void DropOldest(int stream);
+
+            // Variables:
+            FrameSyncMode m_mode;
+            LONGLONG m_tolerance;
+            DWORD m_queueDepth;
+
+            // Unmatched frames of each stream, oldest first
+            std::deque<FrameLease*> m_queues[FRAME_STREAM_COUNT];
+
+            // Counters
+            LONG m_setCount;
+            LONG m_droppedCounts[FRAME_STREAM_COUNT];
+            LONGLONG m_lastSkew;
+        };
+    }
+}
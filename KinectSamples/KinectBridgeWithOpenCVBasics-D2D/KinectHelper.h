@@ -11,9 +11,34 @@
 #include <stdlib.h>
 #include <algorithm>
 #include <iterator>
+#include "FrameLease.h"
+#include "FrameRing.h"
+#include "FrameSynchronizer.h"
+#include "FrameSource.h"
+#include "FrameRecorder.h"
+#include "SkeletonSmoother.h"
+#include "DepthColorizer.h"
+#include "WorkerPool.h"
+#include "PipelineProfiler.h"
 
 namespace Microsoft {
     namespace KinectBridge {
+        /// <summary>
+        /// Function run for each frame produced on a subscribed stream, before the frame is queued
+        /// for consumption
+        /// </summary>
+        /// <param name="stream">stream the frame belongs to</param>
+        /// <param name="pLease">lease on the frame, only valid during the call unless the function adds a reference</param>
+        /// <param name="pContext">context given when subscribing</param>
+        typedef void (CALLBACK *FrameCallback)(FrameStream stream, FrameLease* pLease, void* pContext);
+
+        /// <summary>
+        /// Function run for each frame set the dispatcher consumes, while the helper's images and
+        /// skeleton frame hold the set
+        /// </summary>
+        /// <param name="pContext">context given when subscribing</param>
+        typedef void (CALLBACK *FrameSetCallback)(void* pContext);
+
         template <typename Image>
         class KinectHelper
         {
@@ -22,6 +47,12 @@ namespace Microsoft {
             static const NUI_IMAGE_RESOLUTION COLOR_DEFAULT_RESOLUTION = NUI_IMAGE_RESOLUTION_640x480;
             static const NUI_IMAGE_RESOLUTION DEPTH_DEFAULT_RESOLUTION = NUI_IMAGE_RESOLUTION_320x240;
 
+            // Default number of frames the sensor buffers for each image stream
+            static const DWORD FRAME_BUFFER_COUNT = 2;
+
+            // Largest number of frame and frame set subscriptions
+            static const int MAXIMUM_SUBSCRIPTION_COUNT = 16;
+
         public:
             // Functions:
             /// <summary>
@@ -45,14 +76,16 @@ namespace Microsoft {
             HRESULT SetNuiInitFlags(bool useColor, bool useDepth, bool useSkeleton, bool usePlayerIndex = true);
 
             /// <summary>
-            /// Sets the color stream resolution
+            /// Sets the color stream resolution, releasing the color frames of the old resolution. Called
+            /// from the consumer thread; while dispatching, must not be called from a frame callback.
             /// </summary>
             /// <param name="res">resolution to use</param>
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT SetColorFrameResolution(NUI_IMAGE_RESOLUTION resolution);
 
             /// <summary>
-            /// Sets the depth stream resolution
+            /// Sets the depth stream resolution, releasing the depth frames of the old resolution. Called
+            /// from the consumer thread; while dispatching, must not be called from a frame callback.
             /// </summary>
             /// <param name="res">resolution to use</param>
             /// <returns>S_OK if successful, an error code otherwise</returns>
@@ -74,6 +107,52 @@ namespace Microsoft {
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT SetSkeletonTrackingFlag(DWORD flag, bool value);
 
+            /// <summary>
+            /// Sets the profile skeleton joints are smoothed with. May be called while frames are produced.
+            /// </summary>
+            /// <param name="profile">smoothing profile to use</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetSkeletonSmoothingProfile(SkeletonSmoothingProfile profile);
+
+            /// <summary>
+            /// Sets custom parameters skeleton joints are smoothed with. May be called while frames are produced.
+            /// </summary>
+            /// <param name="parameters">smoothing parameters to use</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetSkeletonSmoothingParameters(const NUI_TRANSFORM_SMOOTH_PARAMETERS& parameters);
+
+            /// <summary>
+            /// Sets the palette ARGB depth images are drawn with. May be called while frames are produced.
+            /// </summary>
+            /// <param name="palette">palette to use</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetDepthPalette(DepthPalette palette);
+
+            /// <summary>
+            /// Sets the depths the palette of ARGB depth images is stretched over. May be called while frames are produced.
+            /// </summary>
+            /// <param name="nearDepth">nearest depth in millimeters</param>
+            /// <param name="farDepth">farthest depth in millimeters</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetDepthColorRange(USHORT nearDepth, USHORT farDepth);
+
+            /// <summary>
+            /// Sets the number of frames the sensor buffers for each image stream. This is also the
+            /// number of frame leases per stream that can be outstanding before leases fall back to copies.
+            /// </summary>
+            /// <param name="frameBufferCount">number of frames to buffer</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetFrameBufferCount(DWORD frameBufferCount);
+
+            /// <summary>
+            /// Sets the depth and full-ring policy of the color, depth and skeleton frame rings
+            /// </summary>
+            /// <param name="depth">number of frames each ring holds</param>
+            /// <param name="policy">what the acquisition thread does when a ring is full</param>
+            /// <param name="blockMillis">number of milliseconds to wait for a free slot under FRAME_RING_POLICY_BLOCK</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetFrameRingPolicy(DWORD depth, FrameRingPolicy policy, DWORD blockMillis = INFINITE);
+
             /// <summary>
             /// Initializes the Kinect with the given sensor. The depth stream and color stream,
             /// if they are opened, will be set to the default resolutions defined in COLOR_DEFAULT_RESOLUTION
@@ -83,6 +162,20 @@ namespace Microsoft {
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT Initialize(INuiSensor* pNuiSensor);
 
+            /// <summary>
+            /// Initializes the Kinect with the given frame source, such as a synthetic or replay
+            /// source. The streams are opened exactly as they are for a sensor.
+            /// </summary>
+            /// <param name="pFrameSource">frame source to initialize, which must outlive the helper's use of it</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Initialize(IFrameSource* pFrameSource);
+
+            /// <summary>
+            /// Sets a recorder that every produced frame is written to, or NULL to stop recording
+            /// </summary>
+            /// <param name="pFrameRecorder">opened recorder, which must outlive the helper's use of it</param>
+            void SetFrameRecorder(FrameRecorder* pFrameRecorder);
+
             /// <summary>
             /// Uninitializes the Kinect
             /// </summary>
@@ -121,6 +214,121 @@ namespace Microsoft {
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT UpdateSkeletonFrame(DWORD waitMillis = 0);
 
+            /// <summary>
+            /// Gets the next color frame from the sensor and pushes it into the color frame ring.
+            /// Called from the acquisition thread.
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ProduceColorFrame(DWORD waitMillis = 0);
+
+            /// <summary>
+            /// Gets the next depth frame from the sensor and pushes it into the depth frame ring.
+            /// Called from the acquisition thread.
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ProduceDepthFrame(DWORD waitMillis = 0);
+
+            /// <summary>
+            /// Gets the next skeleton frame from the sensor, smooths it and pushes it into the
+            /// skeleton frame ring. Called from the acquisition thread.
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ProduceSkeletonFrame(DWORD waitMillis = 0);
+
+            /// <summary>
+            /// Makes the newest color frame in the color frame ring the internal color image.
+            /// Called from the consumer thread.
+            /// </summary>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no new frame has arrived, an error code otherwise</returns>
+            HRESULT ConsumeColorFrame();
+
+            /// <summary>
+            /// Makes the newest depth frame in the depth frame ring the internal depth image.
+            /// Called from the consumer thread.
+            /// </summary>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no new frame has arrived, an error code otherwise</returns>
+            HRESULT ConsumeDepthFrame();
+
+            /// <summary>
+            /// Makes the newest skeleton frame in the skeleton frame ring the internal skeleton frame.
+            /// Called from the consumer thread.
+            /// </summary>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no new frame has arrived, an error code otherwise</returns>
+            HRESULT ConsumeSkeletonFrame();
+
+            /// <summary>
+            /// Sets how ConsumeFrameSet matches frames of the enabled streams, releasing any frames
+            /// waiting to be matched
+            /// </summary>
+            /// <param name="mode">whether to emit the newest complete set or every complete set in order</param>
+            /// <param name="toleranceMillis">largest time stamp difference within a set, in milliseconds</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetFrameSyncPolicy(FrameSyncMode mode, DWORD toleranceMillis = FrameSynchronizer::DEFAULT_TOLERANCE_MILLIS);
+
+            /// <summary>
+            /// Makes a set of color, depth and skeleton frames captured at the same instant the
+            /// internal images and skeleton frame, for every enabled stream at once. Called from the
+            /// consumer thread instead of the per-stream Consume functions.
+            /// </summary>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no complete set has arrived, an error code otherwise</returns>
+            HRESULT ConsumeFrameSet();
+
+            /// <summary>
+            /// Runs a callback for every frame produced on a stream. While dispatching, the callback
+            /// runs on a worker thread as soon as the frame is signalled. Must not be called from a
+            /// subscription callback.
+            /// </summary>
+            /// <param name="stream">stream to receive frames of</param>
+            /// <param name="callback">function to run</param>
+            /// <param name="pContext">context to pass to the function</param>
+            /// <param name="pCookie">pointer in which to return the cookie to unsubscribe with, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SubscribeFrames(FrameStream stream, FrameCallback callback, void* pContext, DWORD* pCookie);
+
+            /// <summary>
+            /// Runs a callback for every frame set consumed while dispatching. Must not be called
+            /// from a subscription callback.
+            /// </summary>
+            /// <param name="callback">function to run</param>
+            /// <param name="pContext">context to pass to the function</param>
+            /// <param name="pCookie">pointer in which to return the cookie to unsubscribe with, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SubscribeFrameSets(FrameSetCallback callback, void* pContext, DWORD* pCookie);
+
+            /// <summary>
+            /// Removes a subscription. Once this returns its callback is not running and will not
+            /// run again. Must not be called from a subscription callback.
+            /// </summary>
+            /// <param name="cookie">cookie returned when subscribing</param>
+            void Unsubscribe(DWORD cookie);
+
+            /// <summary>
+            /// Starts delivering frames to subscribers from a worker pool. Frames are produced as
+            /// soon as the source signals them and frame sets consumed as soon as they complete, so
+            /// no thread polls for them. While dispatching, the helper is the only producer and
+            /// consumer of its frame rings. Dispatch stops on UnInitialize and resumes on the next
+            /// Initialize. Image conversions are also split into row bands across the pool's threads.
+            /// </summary>
+            /// <param name="pWorkerPool">started pool to run the work on, which must outlive the dispatch</param>
+            /// <param name="priority">priority of the work</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT StartDispatch(WorkerPool* pWorkerPool, WorkPriority priority);
+
+            /// <summary>
+            /// Stops delivering frames from the worker pool. Must not be called from a subscription callback.
+            /// </summary>
+            void StopDispatch();
+
+            /// <summary>
+            /// Changes the priority of the dispatch work
+            /// </summary>
+            /// <param name="priority">new priority</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetDispatchPriority(WorkPriority priority);
+
             /// <summary>
             /// Gets the color stream resolution
             /// </summary>
@@ -158,6 +366,55 @@ namespace Microsoft {
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT GetSkeletonHandle(HANDLE* phSkeletonEvent) const;
 
+            /// <summary>
+            /// Gets the event signalled when a color frame is pushed into the color frame ring
+            /// </summary>
+            /// <param name="phColorReadyEvent">pointer in which to return the handle</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetColorFrameReadyHandle(HANDLE* phColorReadyEvent) const;
+
+            /// <summary>
+            /// Gets the event signalled when a depth frame is pushed into the depth frame ring
+            /// </summary>
+            /// <param name="phDepthReadyEvent">pointer in which to return the handle</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthFrameReadyHandle(HANDLE* phDepthReadyEvent) const;
+
+            /// <summary>
+            /// Gets the event signalled when a skeleton frame is pushed into the skeleton frame ring
+            /// </summary>
+            /// <param name="phSkeletonReadyEvent">pointer in which to return the handle</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetSkeletonFrameReadyHandle(HANDLE* phSkeletonReadyEvent) const;
+
+            /// <summary>
+            /// Gets the counters of the color frame ring
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetColorRingStatistics(FrameRingStatistics* pStatistics) const;
+
+            /// <summary>
+            /// Gets the counters of the depth frame ring
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthRingStatistics(FrameRingStatistics* pStatistics) const;
+
+            /// <summary>
+            /// Gets the counters of the skeleton frame ring
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetSkeletonRingStatistics(FrameRingStatistics* pStatistics) const;
+
+            /// <summary>
+            /// Gets the counters of the frame set synchronizer
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetFrameSyncStatistics(FrameSyncStatistics* pStatistics) const;
+
             /// <summary>
             /// Gets the color image
             /// </summary>
@@ -186,6 +443,40 @@ namespace Microsoft {
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT GetDepthImageAsArgb(Image* pDepthArgbImage) const;
 
+            /// <summary>
+            /// Gets a lease on the current color frame. The frame stays valid until the lease is
+            /// released, even after the next call to UpdateColorFrame.
+            /// </summary>
+            /// <param name="ppLease">pointer in which to return the lease, which the caller must release</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetColorFrameLease(FrameLease** ppLease) const;
+
+            /// <summary>
+            /// Gets a lease on the current depth frame. The frame stays valid until the lease is
+            /// released, even after the next call to UpdateDepthFrame.
+            /// </summary>
+            /// <param name="ppLease">pointer in which to return the lease, which the caller must release</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthFrameLease(FrameLease** ppLease) const;
+
+            /// <summary>
+            /// Gets a color image that references the leased frame data without copying it.
+            /// The image is only valid while the lease is held.
+            /// </summary>
+            /// <param name="pLease">lease on the color frame</param>
+            /// <param name="pColorImage">pointer in which to return the image</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetColorImageView(const FrameLease* pLease, Image* pColorImage) const;
+
+            /// <summary>
+            /// Gets a depth image that references the leased frame data without copying it.
+            /// The image is only valid while the lease is held.
+            /// </summary>
+            /// <param name="pLease">lease on the depth frame</param>
+            /// <param name="pDepthImage">pointer in which to return the image</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthImageView(const FrameLease* pLease, Image* pDepthImage) const;
+
         protected:
             // Functions:
             /// <summary>
@@ -217,6 +508,22 @@ namespace Microsoft {
             /// <returns>S_OK if image matches given width and height, an error code otherwise</returns>
             virtual HRESULT VerifySize(const Image* pImage, NUI_IMAGE_RESOLUTION resolution) const = 0;
 
+            /// <summary>
+            /// Wraps leased Kinect color frame data in an Image without copying it
+            /// </summary>
+            /// <param name="pLease">lease on the color frame</param>
+            /// <param name="pImage">pointer in which to return the image</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT GetColorView(const FrameLease* pLease, Image* pImage) const = 0;
+
+            /// <summary>
+            /// Wraps leased Kinect depth frame data in an Image without copying it
+            /// </summary>
+            /// <param name="pLease">lease on the depth frame</param>
+            /// <param name="pImage">pointer in which to return the image</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            virtual HRESULT GetDepthView(const FrameLease* pLease, Image* pImage) const = 0;
+
             /// <summary>
             /// Convert a 13-bit depth value into a set of RGB values
             /// </summary>
@@ -227,7 +534,17 @@ namespace Microsoft {
             /// <returns>S_OK if successful, an error code otherwise</returns>
             HRESULT DepthShortToRgb(USHORT depth, UINT8* pRedPixel, UINT8* pGreenPixel, UINT8* pBluePixel) const;
 
-            // Image stream data
+            /// <summary>
+            /// Runs a conversion over bands of rows, spread across the dispatch pool's threads
+            /// while dispatching and on the calling thread otherwise
+            /// </summary>
+            /// <param name="rowCount">number of rows</param>
+            /// <param name="bytesPerRow">bytes read and written per row</param>
+            /// <param name="callback">function to run on each band</param>
+            /// <param name="pContext">context to pass to the function</param>
+            void RunRowBands(UINT rowCount, SIZE_T bytesPerRow, RowBandCallback callback, void* pContext) const;
+
+            // Image stream data, pointing into the current frame leases
             BYTE* m_pColorBuffer;
             INT m_colorBufferSize;
             INT m_colorBufferPitch;
@@ -239,13 +556,133 @@ namespace Microsoft {
             NUI_IMAGE_RESOLUTION m_colorResolution;
             NUI_IMAGE_RESOLUTION m_depthResolution;
 
+            // Turns depth pixels into colors for GetDepthImageAsArgb
+            DepthColorizer m_depthColorizer;
+
         private:
+            /// <summary>
+            /// Callback registered with SubscribeFrames or SubscribeFrameSets
+            /// </summary>
+            struct FrameSubscription
+            {
+                DWORD cookie;
+
+                // Stream the callback receives frames of, or FRAME_STREAM_COUNT for frame sets
+                FrameStream stream;
+
+                FrameCallback frameCallback;
+                FrameSetCallback frameSetCallback;
+                void* pContext;
+            };
+
             // Functions:
+            /// <summary>
+            /// Makes a color frame the internal color image, releasing the previous one
+            /// </summary>
+            /// <param name="pLease">frame to use; the helper takes over the caller's reference</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the frame is too small for the color resolution</returns>
+            HRESULT SetColorLease(FrameLease* pLease);
+
+            /// <summary>
+            /// Makes a depth frame the internal depth image, releasing the previous one
+            /// </summary>
+            /// <param name="pLease">frame to use; the helper takes over the caller's reference</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the frame is too small for the depth resolution</returns>
+            HRESULT SetDepthLease(FrameLease* pLease);
+
+            /// <summary>
+            /// Releases the unread color frames, the frames waiting to be matched into sets and the
+            /// internal color image. Called from the consumer thread while the acquisition dispatcher is stopped.
+            /// </summary>
+            void ReleaseColorFrames();
+
+            /// <summary>
+            /// Releases the unread depth frames, the frames waiting to be matched into sets and the
+            /// internal depth image. Called from the consumer thread while the acquisition dispatcher is stopped.
+            /// </summary>
+            void ReleaseDepthFrames();
+
+            /// <summary>
+            /// Copies a skeleton frame into the internal skeleton frame and releases it
+            /// </summary>
+            /// <param name="pLease">frame to use; the helper takes over the caller's reference</param>
+            void SetSkeletonLease(FrameLease* pLease);
+
+            /// <summary>
+            /// Adds a subscription, pausing the dispatcher while the list changes
+            /// </summary>
+            /// <param name="subscription">subscription to add, whose cookie is assigned here</param>
+            /// <param name="pCookie">pointer in which to return the cookie, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AddSubscription(FrameSubscription subscription, DWORD* pCookie);
+
+            /// <summary>
+            /// Runs the callbacks subscribed to a stream on a produced frame
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="pLease">lease on the frame</param>
+            void NotifyFrameSubscribers(FrameStream stream, FrameLease* pLease);
+
+            /// <summary>
+            /// Registers the wait on the source's frame events if dispatching and initialized
+            /// </summary>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT StartAcquisitionDispatch();
+
+            /// <summary>
+            /// Unregisters the wait on the source's frame events, waiting for a running callback to return
+            /// </summary>
+            void StopAcquisitionDispatch();
+
+            /// <summary>
+            /// Registers the wait on the frame ready events of the rings if dispatching and initialized
+            /// </summary>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT StartFrameSetDispatch();
+
+            /// <summary>
+            /// Unregisters the wait on the frame ready events of the rings, waiting for a running callback to return
+            /// </summary>
+            void StopFrameSetDispatch();
+
+            /// <summary>
+            /// Produces the frame whose event was signalled. Runs on a worker thread.
+            /// </summary>
+            /// <param name="pContext">pointer to the helper</param>
+            /// <param name="handleIndex">index of the signalled frame event</param>
+            static void CALLBACK DispatchAcquisition(void* pContext, DWORD handleIndex);
+
+            /// <summary>
+            /// Consumes the frame sets that have completed and runs the frame set callbacks on
+            /// each. Runs on a worker thread.
+            /// </summary>
+            /// <param name="pContext">pointer to the helper</param>
+            /// <param name="handleIndex">index of the signalled frame ready event</param>
+            static void CALLBACK DispatchFrameSets(void* pContext, DWORD handleIndex);
+
             // Variables:
             // Image stream handles
             HANDLE m_hColorStreamHandle;
             HANDLE m_hDepthStreamHandle;
 
+            // Number of frames the sensor buffers for each image stream
+            DWORD m_frameBufferCount;
+
+            // Frame leases for each image stream and the current frames
+            FrameLeaseStream m_colorLeaseStream;
+            FrameLeaseStream m_depthLeaseStream;
+            FrameLeaseStream m_skeletonLeaseStream;
+            FrameLease* m_pColorLease;
+            FrameLease* m_pDepthLease;
+
+            // Frames handed from the acquisition thread to the consumer thread
+            FrameRing m_colorRing;
+            FrameRing m_depthRing;
+            FrameRing m_skeletonRing;
+
+            // Bundles frames of the enabled streams by time stamp
+            FrameSynchronizer m_frameSynchronizer;
+
             // Frame event handles
             // These are handles to events created using the CreateEvent Win32 API
             HANDLE m_hNextColorFrameEvent;
@@ -268,9 +705,34 @@ namespace Microsoft {
             // Internal skeleton frame
             NUI_SKELETON_FRAME m_skeletonFrame;
 
-            // Pointer to Kinect sensor
-            INuiSensor* m_pNuiSensor;
+            // Filters the joints of produced skeleton frames
+            SkeletonSmoother m_skeletonSmoother;
+
+            // Source frames are pulled from, NULL while uninitialized
+            IFrameSource* m_pFrameSource;
+
+            // Source used when initialized with a sensor
+            NuiFrameSource m_nuiFrameSource;
+
+            // Recorder produced frames are written to
+            FrameRecorder* m_pFrameRecorder;
+
+            // Subscribed callbacks, and the cookie the next one gets. Only changed while the
+            // dispatcher is paused, so the dispatch callbacks read them without a lock.
+            FrameSubscription m_subscriptions[MAXIMUM_SUBSCRIPTION_COUNT];
+            int m_subscriptionCount;
+            DWORD m_nextSubscriptionCookie;
+
+            // Pool frames are dispatched from, NULL while not dispatching
+            WorkerPool* m_pWorkerPool;
+            WorkPriority m_dispatchPriority;
+
+            // Waits on the source's frame events and on the frame ready events of the rings
+            WorkerPool::WaitRegistration* m_pAcquisitionWait;
+            WorkerPool::WaitRegistration* m_pFrameSetWait;
 
+            // Stream each handle of the acquisition wait belongs to
+            FrameStream m_acquisitionStreams[FRAME_STREAM_COUNT];
         };
 
         /// <summary>
@@ -278,14 +740,6 @@ namespace Microsoft {
         /// </summary>
         template <typename Image>
         KinectHelper<Image>::KinectHelper() :
-            m_hColorStreamHandle(NULL),
-            m_hDepthStreamHandle(NULL),
-            m_hNextColorFrameEvent(NULL),
-            m_hNextDepthFrameEvent(NULL),
-            m_hNextSkeletonFrameEvent(NULL),
-            m_depthFlags(0),
-            m_skeletonFlags(NUI_SKELETON_TRACKING_FLAG_ENABLE_IN_NEAR_RANGE),
-            m_pNuiSensor(NULL),
             m_pColorBuffer(NULL),
             m_colorBufferSize(0),
             m_colorBufferPitch(0),
@@ -293,8 +747,28 @@ namespace Microsoft {
             m_depthBufferSize(0),
             m_depthBufferPitch(0),
             m_colorResolution(COLOR_DEFAULT_RESOLUTION),
-            m_depthResolution(DEPTH_DEFAULT_RESOLUTION)
+            m_depthResolution(DEPTH_DEFAULT_RESOLUTION),
+            m_hColorStreamHandle(NULL),
+            m_hDepthStreamHandle(NULL),
+            m_frameBufferCount(FRAME_BUFFER_COUNT),
+            m_pColorLease(NULL),
+            m_pDepthLease(NULL),
+            m_hNextColorFrameEvent(NULL),
+            m_hNextDepthFrameEvent(NULL),
+            m_hNextSkeletonFrameEvent(NULL),
+            m_depthFlags(0),
+            m_skeletonFlags(NUI_SKELETON_TRACKING_FLAG_ENABLE_IN_NEAR_RANGE),
+            m_pFrameSource(NULL),
+            m_pFrameRecorder(NULL),
+            m_subscriptionCount(0),
+            m_nextSubscriptionCookie(1),
+            m_pWorkerPool(NULL),
+            m_dispatchPriority(WORK_PRIORITY_NORMAL),
+            m_pAcquisitionWait(NULL),
+            m_pFrameSetWait(NULL)
         {
+            ZeroMemory(&m_skeletonFrame, sizeof(m_skeletonFrame));
+
             // Default to all streams enabled
             SetNuiInitFlags(true, true, true);
         }
@@ -305,6 +779,7 @@ namespace Microsoft {
         template <typename Image>
         KinectHelper<Image>::~KinectHelper()
         {
+            StopDispatch();
             UnInitialize();
         }
 
@@ -320,7 +795,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::SetNuiInitFlags(bool useColor, bool useDepth, bool useSkeleton, bool usePlayerIndex /* = true */)
         {
             // Fail if Kinect is already initialized
-            if (m_pNuiSensor) 
+            if (m_pFrameSource) 
             {
                 return E_NUI_ALREADY_INITIALIZED;
             }
@@ -366,7 +841,8 @@ namespace Microsoft {
         }
 
         /// <summary>
-        /// Sets the color stream resolution
+        /// Sets the color stream resolution, releasing the color frames of the old resolution. Called
+        /// from the consumer thread; while dispatching, must not be called from a frame callback.
         /// </summary>
         /// <param name="res">resolution to use</param>
         /// <returns>S_OK if successful, an error code otherwise</returns>
@@ -394,22 +870,36 @@ namespace Microsoft {
             HRESULT hr = S_OK;
 
             // If color stream is already opened, update its resolution
-            if (m_pNuiSensor)
+            if (m_pFrameSource)
             {
-                hr = m_pNuiSensor->NuiImageStreamOpen(
+                // Keep the dispatcher from pulling frames while the stream is reopened
+                StopAcquisitionDispatch();
+
+                // Frames of the old resolution are smaller than the conversions now expect
+                ReleaseColorFrames();
+
+                hr = m_pFrameSource->OpenImageStream(
                     NUI_IMAGE_TYPE_COLOR,
                     resolution,
                     0,
-                    2,
+                    m_frameBufferCount,
                     m_hNextColorFrameEvent,
                     &m_hColorStreamHandle);
+                m_colorLeaseStream.Attach(m_pFrameSource, m_hColorStreamHandle, m_frameBufferCount);
+
+                HRESULT hrDispatch = StartAcquisitionDispatch();
+                if (SUCCEEDED(hr))
+                {
+                    hr = hrDispatch;
+                }
             }
 
             return hr;
         }
 
         /// <summary>
-        /// Sets the depth stream resolution
+        /// Sets the depth stream resolution, releasing the depth frames of the old resolution. Called
+        /// from the consumer thread; while dispatching, must not be called from a frame callback.
         /// </summary>
         /// <param name="res">resolution to use</param>
         /// <returns>S_OK if successful, an error code otherwise</returns>
@@ -437,15 +927,28 @@ namespace Microsoft {
             HRESULT hr = S_OK;
 
             // If depth stream is already open, update its resolution
-            if (m_pNuiSensor)
+            if (m_pFrameSource)
             {
-                hr = m_pNuiSensor->NuiImageStreamOpen(
+                // Keep the dispatcher from pulling frames while the stream is reopened
+                StopAcquisitionDispatch();
+
+                // Frames of the old resolution are smaller than the conversions now expect
+                ReleaseDepthFrames();
+
+                hr = m_pFrameSource->OpenImageStream(
                     m_isUsingPlayerIndex ? NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX : NUI_IMAGE_TYPE_DEPTH,
                     resolution,
                     m_depthFlags,
-                    2,
+                    m_frameBufferCount,
                     m_hNextDepthFrameEvent,
                     &m_hDepthStreamHandle);
+                m_depthLeaseStream.Attach(m_pFrameSource, m_hDepthStreamHandle, m_frameBufferCount);
+
+                HRESULT hrDispatch = StartAcquisitionDispatch();
+                if (SUCCEEDED(hr))
+                {
+                    hr = hrDispatch;
+                }
             }
 
             return hr;
@@ -480,9 +983,9 @@ namespace Microsoft {
             // Apply new flags to depth stream
             if (newFlags != m_depthFlags) 
             {
-                if (m_pNuiSensor)
+                if (m_pFrameSource)
                 {
-                    HRESULT hr = m_pNuiSensor->NuiImageStreamSetImageFrameFlags(m_hDepthStreamHandle, newFlags);
+                    HRESULT hr = m_pFrameSource->SetImageStreamFlags(m_hDepthStreamHandle, newFlags);
 
                     if (FAILED(hr))
                     {
@@ -525,9 +1028,9 @@ namespace Microsoft {
             // Apply new flags to skeleton tracking
             if (newFlags != m_skeletonFlags) 
             {
-                if (m_pNuiSensor)
+                if (m_pFrameSource)
                 {
-                    HRESULT hr = m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonFrameEvent, newFlags);
+                    HRESULT hr = m_pFrameSource->EnableSkeletonTracking(m_hNextSkeletonFrameEvent, newFlags);
 
                     if (FAILED(hr))
                     {
@@ -542,33 +1045,159 @@ namespace Microsoft {
         }
 
         /// <summary>
-        /// Initializes the Kinect with the given sensor. The depth stream and color stream,
-        /// if they are opened, will be set to the default resolutions defined in COLOR_DEFAULT_RESOLUTION
-        //  and DEPTH_DEFAULT_RESOLUTION.
+        /// Sets the profile skeleton joints are smoothed with. May be called while frames are produced.
         /// </summary>
-        /// <param name="pNuiSensor">sensor to initialize</param>
+        /// <param name="profile">smoothing profile to use</param>
         /// <returns>S_OK if successful, an error code otherwise</returns>
         template <typename Image>
-        HRESULT KinectHelper<Image>::Initialize(INuiSensor* pNuiSensor)
+        HRESULT KinectHelper<Image>::SetSkeletonSmoothingProfile(SkeletonSmoothingProfile profile)
         {
-            HRESULT hr;
-
-            // If there is no sensor, initialize one
-            if (!m_pNuiSensor)
-            {
-                if (!pNuiSensor)
-                {
-                    return E_POINTER;
-                }
-                m_pNuiSensor = pNuiSensor;
+            return m_skeletonSmoother.SetProfile(profile);
+        }
 
-                hr = m_pNuiSensor->NuiInitialize(m_nuiInitFlags);
-                if (FAILED(hr))
-                {
-                    return hr;
-                }
+        /// <summary>
+        /// Sets custom parameters skeleton joints are smoothed with. May be called while frames are produced.
+        /// </summary>
+        /// <param name="parameters">smoothing parameters to use</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetSkeletonSmoothingParameters(const NUI_TRANSFORM_SMOOTH_PARAMETERS& parameters)
+        {
+            return m_skeletonSmoother.SetParameters(parameters);
+        }
 
-            }
+        /// <summary>
+        /// Sets the palette ARGB depth images are drawn with. May be called while frames are produced.
+        /// </summary>
+        /// <param name="palette">palette to use</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetDepthPalette(DepthPalette palette)
+        {
+            return m_depthColorizer.SetPalette(palette);
+        }
+
+        /// <summary>
+        /// Sets the depths the palette of ARGB depth images is stretched over. May be called while frames are produced.
+        /// </summary>
+        /// <param name="nearDepth">nearest depth in millimeters</param>
+        /// <param name="farDepth">farthest depth in millimeters</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetDepthColorRange(USHORT nearDepth, USHORT farDepth)
+        {
+            return m_depthColorizer.SetDepthRange(nearDepth, farDepth);
+        }
+
+        /// <summary>
+        /// Sets the number of frames the sensor buffers for each image stream. This is also the
+        /// number of frame leases per stream that can be outstanding before leases fall back to copies.
+        /// </summary>
+        /// <param name="frameBufferCount">number of frames to buffer</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetFrameBufferCount(DWORD frameBufferCount)
+        {
+            // Fail if Kinect is already initialized
+            if (m_pFrameSource) 
+            {
+                return E_NUI_ALREADY_INITIALIZED;
+            }
+
+            // Fail if buffer count is out of range
+            if (frameBufferCount < 1 || frameBufferCount > NUI_IMAGE_STREAM_FRAME_LIMIT_MAXIMUM) 
+            {
+                return E_INVALIDARG;
+            }
+
+            m_frameBufferCount = frameBufferCount;
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Sets the depth and full-ring policy of the color, depth and skeleton frame rings
+        /// </summary>
+        /// <param name="depth">number of frames each ring holds</param>
+        /// <param name="policy">what the acquisition thread does when a ring is full</param>
+        /// <param name="blockMillis">number of milliseconds to wait for a free slot under FRAME_RING_POLICY_BLOCK</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetFrameRingPolicy(DWORD depth, FrameRingPolicy policy, DWORD blockMillis /* = INFINITE */)
+        {
+            // Fail if Kinect is already initialized
+            if (m_pFrameSource) 
+            {
+                return E_NUI_ALREADY_INITIALIZED;
+            }
+
+            HRESULT hr = m_colorRing.Initialize(depth, policy, blockMillis);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            hr = m_depthRing.Initialize(depth, policy, blockMillis);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            return m_skeletonRing.Initialize(depth, policy, blockMillis);
+        }
+
+        /// <summary>
+        /// Initializes the Kinect with the given sensor. The depth stream and color stream,
+        /// if they are opened, will be set to the default resolutions defined in COLOR_DEFAULT_RESOLUTION
+        //  and DEPTH_DEFAULT_RESOLUTION.
+        /// </summary>
+        /// <param name="pNuiSensor">sensor to initialize</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::Initialize(INuiSensor* pNuiSensor)
+        {
+            // Fail if pointer is invalid
+            if (!m_pFrameSource && !pNuiSensor)
+            {
+                return E_POINTER;
+            }
+
+            // Only swap sensors while no source is in use
+            if (!m_pFrameSource)
+            {
+                m_nuiFrameSource.SetSensor(pNuiSensor);
+            }
+
+            return Initialize(&m_nuiFrameSource);
+        }
+
+        /// <summary>
+        /// Initializes the Kinect with the given frame source, such as a synthetic or replay
+        /// source. The streams are opened exactly as they are for a sensor.
+        /// </summary>
+        /// <param name="pFrameSource">frame source to initialize, which must outlive the helper's use of it</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::Initialize(IFrameSource* pFrameSource)
+        {
+            HRESULT hr;
+
+            // If there is no source, initialize one
+            if (!m_pFrameSource)
+            {
+                if (!pFrameSource)
+                {
+                    return E_POINTER;
+                }
+                m_pFrameSource = pFrameSource;
+
+                hr = m_pFrameSource->Initialize(m_nuiInitFlags);
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
+
+            }
 
             // Create events based on usage settings
             if (m_isUsingColor) 
@@ -601,59 +1230,114 @@ namespace Microsoft {
             // Open image stream
             if (m_isUsingColor) 
             {
-                hr = m_pNuiSensor->NuiImageStreamOpen(
+                hr = m_pFrameSource->OpenImageStream(
                     NUI_IMAGE_TYPE_COLOR,
                     m_colorResolution,
                     0,
-                    2,
+                    m_frameBufferCount,
                     m_hNextColorFrameEvent,
                     &m_hColorStreamHandle);
                 if (FAILED(hr))
                 {
                     return hr;
                 }
+
+                m_colorLeaseStream.Attach(m_pFrameSource, m_hColorStreamHandle, m_frameBufferCount);
             }
 
             // Open depth stream
             if (m_isUsingDepth) 
             {
-                hr = m_pNuiSensor->NuiImageStreamOpen(
+                hr = m_pFrameSource->OpenImageStream(
                     m_isUsingPlayerIndex ? NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX : NUI_IMAGE_TYPE_DEPTH,
                     m_depthResolution,
                     m_depthFlags,
-                    2,
+                    m_frameBufferCount,
                     m_hNextDepthFrameEvent,
                     &m_hDepthStreamHandle);
                 if (FAILED(hr))
                 {
                     return hr;
                 }
+
+                m_depthLeaseStream.Attach(m_pFrameSource, m_hDepthStreamHandle, m_frameBufferCount);
             }
 
             // Enable skeleton tracking
             if (m_isUsingSkeleton)
             {
-                hr = m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonFrameEvent, m_skeletonFlags);
+                m_skeletonSmoother.Reset();
+
+                hr = m_pFrameSource->EnableSkeletonTracking(m_hNextSkeletonFrameEvent, m_skeletonFlags);
                 if (FAILED(hr))
                 {
                     return hr;
                 }
             }
 
+            // Deliver frames from the worker pool if dispatch was started
+            hr = StartAcquisitionDispatch();
+            if (SUCCEEDED(hr))
+            {
+                hr = StartFrameSetDispatch();
+            }
+
             return hr;
         }
 
+        /// <summary>
+        /// Sets a recorder that every produced frame is written to, or NULL to stop recording
+        /// </summary>
+        /// <param name="pFrameRecorder">opened recorder, which must outlive the helper's use of it</param>
+        template <typename Image>
+        void KinectHelper<Image>::SetFrameRecorder(FrameRecorder* pFrameRecorder)
+        {
+            m_pFrameRecorder = pFrameRecorder;
+        }
+
         /// <summary>
         /// Uninitializes the Kinect
         /// </summary>
         template <typename Image>
         void KinectHelper<Image>::UnInitialize()
         {
+            // Stop the dispatcher before the events it waits on are closed
+            StopFrameSetDispatch();
+            StopAcquisitionDispatch();
+
+            // Release unread and current frames and stop leases from touching the sensor
+            m_colorRing.Clear();
+            m_depthRing.Clear();
+            m_skeletonRing.Clear();
+            m_frameSynchronizer.Clear();
+
+            if (m_pColorLease)
+            {
+                m_pColorLease->Release();
+                m_pColorLease = NULL;
+            }
+
+            if (m_pDepthLease)
+            {
+                m_pDepthLease->Release();
+                m_pDepthLease = NULL;
+            }
+
+            m_pColorBuffer = NULL;
+            m_colorBufferSize = 0;
+            m_colorBufferPitch = 0;
+            m_pDepthBuffer = NULL;
+            m_depthBufferSize = 0;
+            m_depthBufferPitch = 0;
+
+            m_colorLeaseStream.Detach();
+            m_depthLeaseStream.Detach();
+
             // Close Kinect
-            if (m_pNuiSensor)
+            if (m_pFrameSource)
             {
-                m_pNuiSensor->NuiShutdown();
-                m_pNuiSensor = NULL;
+                m_pFrameSource->Shutdown();
+                m_pFrameSource = NULL;
             }
 
             // Close handles for created events
@@ -683,7 +1367,7 @@ namespace Microsoft {
         template <typename Image>
         bool KinectHelper<Image>::IsInitialized() const
         {
-            return m_pNuiSensor != NULL;
+            return m_pFrameSource != NULL;
         }
 
         /// <summary>
@@ -693,7 +1377,7 @@ namespace Microsoft {
         template <typename Image>
         BSTR KinectHelper<Image>::GetKinectDeviceConnectionId() const
         {
-            return m_pNuiSensor->NuiDeviceConnectionId();
+            return m_pFrameSource->GetConnectionId();
         }
 
         /// <summary>
@@ -703,9 +1387,75 @@ namespace Microsoft {
         /// <returns>S_OK if successful, an error code otherwise</returns>
         template <typename Image>
         HRESULT KinectHelper<Image>::UpdateColorFrame(DWORD waitMillis /* = 0 */)
+        {
+            HRESULT hr = ProduceColorFrame(waitMillis);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Keep the previous frame if the new one had no data
+            hr = ConsumeColorFrame();
+            if (E_NUI_FRAME_NO_DATA == hr)
+            {
+                return S_OK;
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Updates the internal depth image
+        /// </summary>
+        /// <param name="waitMillis">number of milliseconds to wait</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::UpdateDepthFrame(DWORD waitMillis /* = 0 */)
+        {
+            HRESULT hr = ProduceDepthFrame(waitMillis);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Keep the previous frame if the new one had no data
+            hr = ConsumeDepthFrame();
+            if (E_NUI_FRAME_NO_DATA == hr)
+            {
+                return S_OK;
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Updates the internal skeleton frame
+        /// </summary>
+        /// <param name="waitMillis">number of milliseconds to wait</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::UpdateSkeletonFrame(DWORD waitMillis /* = 0 */)
+        {
+            HRESULT hr = ProduceSkeletonFrame(waitMillis);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            return ConsumeSkeletonFrame();
+        }
+
+        /// <summary>
+        /// Gets the next color frame from the sensor and pushes it into the color frame ring.
+        /// Called from the acquisition thread.
+        /// </summary>
+        /// <param name="waitMillis">number of milliseconds to wait</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::ProduceColorFrame(DWORD waitMillis /* = 0 */)
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor)
+            if (!m_pFrameSource)
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -716,150 +1466,797 @@ namespace Microsoft {
                 return E_NUI_STREAM_NOT_ENABLED;
             }
 
-            // Get next image stream frame
-            NUI_IMAGE_FRAME imageFrame;
+            // Lease next image stream frame
+            FrameLease* pLease = NULL;
+            HRESULT hr = m_colorLeaseStream.AcquireLease(waitMillis, &pLease);
+            if (FAILED(hr))
+            {
+                // A frame without data is dropped, not an error
+                return (E_NUI_FRAME_NO_DATA == hr) ? S_FALSE : hr;
+            }
+
+            // A failed write only loses the recording, so keep the live stream going
+            if (m_pFrameRecorder)
+            {
+                m_pFrameRecorder->WriteImageFrame(FRAME_STREAM_COLOR, NUI_IMAGE_TYPE_COLOR, m_colorResolution, pLease);
+            }
+
+            NotifyFrameSubscribers(FRAME_STREAM_COLOR, pLease);
+
+            return m_colorRing.Push(pLease);
+        }
+
+        /// <summary>
+        /// Makes the newest color frame in the color frame ring the internal color image.
+        /// Called from the consumer thread.
+        /// </summary>
+        /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no new frame has arrived, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::ConsumeColorFrame()
+        {
+            // Fail if color stream is not enabled
+            if (!m_isUsingColor)
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
 
-            HRESULT hr = m_pNuiSensor->NuiImageStreamGetNextFrame(
-                m_hColorStreamHandle,
-                waitMillis,
-                &imageFrame);
+            FrameLease* pLease = NULL;
+            HRESULT hr = m_colorRing.PopLatest(&pLease);
             if (FAILED(hr))
             {
                 return hr;
             }
 
-            // Lock frame texture to allow for copy
-            INuiFrameTexture* pTexture = imageFrame.pFrameTexture;
-            NUI_LOCKED_RECT lockedRect;
-            pTexture->LockRect(0, &lockedRect, NULL, 0);
+            return SetColorLease(pLease);
+        }
 
-            // Check if image is valid
-            if (lockedRect.Pitch != 0)
+        /// <summary>
+        /// Gets the next depth frame from the sensor and pushes it into the depth frame ring.
+        /// Called from the acquisition thread.
+        /// </summary>
+        /// <param name="waitMillis">number of milliseconds to wait</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::ProduceDepthFrame(DWORD waitMillis /* = 0 */)
+        {
+            // Fail if Kinect is not initialized
+            if (!m_pFrameSource)
             {
-                // Copy image information into buffer so it doesn't get overwritten later
-                BYTE* pBuffer = lockedRect.pBits;
-                INT size =  lockedRect.size;
-                INT pitch = lockedRect.Pitch;
+                return E_NUI_DEVICE_NOT_READY;
+            }
 
-                // Only reallocate memory if the buffer size has changed
-                if (size != m_colorBufferSize)
-                {
-                    delete [] m_pColorBuffer;
-                    m_pColorBuffer = new BYTE[size];
-                    m_colorBufferSize = size;
-                }
-                memcpy_s(m_pColorBuffer, size, pBuffer, size);
+            // Fail if depth stream is not enabled
+            if (!m_isUsingDepth)
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
 
+            // Lease next image stream frame
+            FrameLease* pLease = NULL;
+            HRESULT hr = m_depthLeaseStream.AcquireLease(waitMillis, &pLease);
+            if (FAILED(hr))
+            {
+                // A frame without data is dropped, not an error
+                return (E_NUI_FRAME_NO_DATA == hr) ? S_FALSE : hr;
+            }
 
-                m_colorBufferPitch = pitch;
+            // A failed write only loses the recording, so keep the live stream going
+            if (m_pFrameRecorder)
+            {
+                m_pFrameRecorder->WriteImageFrame(FRAME_STREAM_DEPTH, m_isUsingPlayerIndex ? NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX : NUI_IMAGE_TYPE_DEPTH, m_depthResolution, pLease);
             }
 
-            // Unlock texture
-            pTexture->UnlockRect(0);
+            NotifyFrameSubscribers(FRAME_STREAM_DEPTH, pLease);
+
+            return m_depthRing.Push(pLease);
+        }
+
+        /// <summary>
+        /// Makes the newest depth frame in the depth frame ring the internal depth image.
+        /// Called from the consumer thread.
+        /// </summary>
+        /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no new frame has arrived, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::ConsumeDepthFrame()
+        {
+            // Fail if depth stream is not enabled
+            if (!m_isUsingDepth)
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
 
-            // Release image stream frame
-            hr = m_pNuiSensor->NuiImageStreamReleaseFrame(m_hColorStreamHandle, &imageFrame);
+            FrameLease* pLease = NULL;
+            HRESULT hr = m_depthRing.PopLatest(&pLease);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
 
-            return hr;
+            return SetDepthLease(pLease);
         }
 
         /// <summary>
-        /// Updates the internal depth image
+        /// Gets the next skeleton frame from the sensor, smooths it and pushes it into the
+        /// skeleton frame ring. Called from the acquisition thread.
         /// </summary>
         /// <param name="waitMillis">number of milliseconds to wait</param>
         /// <returns>S_OK if successful, an error code otherwise</returns>
         template <typename Image>
-        HRESULT KinectHelper<Image>::UpdateDepthFrame(DWORD waitMillis /* = 0 */)
+        HRESULT KinectHelper<Image>::ProduceSkeletonFrame(DWORD waitMillis /* = 0 */)
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor)
+            if (!m_pFrameSource)
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
 
-            // Fail if depth stream is not enabled
-            if (!m_isUsingDepth)
+            // Fail if skeleton tracking is not enabled
+            if (!m_isUsingSkeleton)
             {
                 return E_NUI_STREAM_NOT_ENABLED;
             }
 
-            // Get next image stream frame
-            NUI_IMAGE_FRAME imageFrame;
+            // Get next skeleton frame
+            NUI_SKELETON_FRAME skeletonFrame;
+            HRESULT hr = m_pFrameSource->GetNextSkeletonFrame(waitMillis, &skeletonFrame);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Record raw joints, so that replays are smoothed with whatever profile is in use then
+            if (m_pFrameRecorder)
+            {
+                m_pFrameRecorder->WriteSkeletonFrame(&skeletonFrame);
+            }
 
-            HRESULT hr = m_pNuiSensor->NuiImageStreamGetNextFrame(
-                m_hDepthStreamHandle,
-                waitMillis,
-                &imageFrame);
+            m_skeletonSmoother.Smooth(&skeletonFrame);
+
+            // Skeleton frames are small, so they always travel through the ring as copies
+            FrameLease* pLease = NULL;
+            hr = m_skeletonLeaseStream.CreateCopyLease(&skeletonFrame, sizeof(skeletonFrame), sizeof(skeletonFrame),
+                skeletonFrame.liTimeStamp.QuadPart, skeletonFrame.dwFrameNumber, &pLease);
             if (FAILED(hr))
             {
-                return hr;
+                return hr;
+            }
+
+            NotifyFrameSubscribers(FRAME_STREAM_SKELETON, pLease);
+
+            return m_skeletonRing.Push(pLease);
+        }
+
+        /// <summary>
+        /// Makes the newest skeleton frame in the skeleton frame ring the internal skeleton frame.
+        /// Called from the consumer thread.
+        /// </summary>
+        /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no new frame has arrived, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::ConsumeSkeletonFrame()
+        {
+            // Fail if skeleton tracking is not enabled
+            if (!m_isUsingSkeleton)
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            FrameLease* pLease = NULL;
+            HRESULT hr = m_skeletonRing.PopLatest(&pLease);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            SetSkeletonLease(pLease);
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Sets how ConsumeFrameSet matches frames of the enabled streams, releasing any frames
+        /// waiting to be matched
+        /// </summary>
+        /// <param name="mode">whether to emit the newest complete set or every complete set in order</param>
+        /// <param name="toleranceMillis">largest time stamp difference within a set, in milliseconds</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetFrameSyncPolicy(FrameSyncMode mode, DWORD toleranceMillis /* = FrameSynchronizer::DEFAULT_TOLERANCE_MILLIS */)
+        {
+            return m_frameSynchronizer.Initialize(mode, toleranceMillis);
+        }
+
+        /// <summary>
+        /// Makes a set of color, depth and skeleton frames captured at the same instant the
+        /// internal images and skeleton frame, for every enabled stream at once. Called from the
+        /// consumer thread instead of the per-stream Consume functions.
+        /// </summary>
+        /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no complete set has arrived, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::ConsumeFrameSet()
+        {
+            // Fail if Kinect is not initialized
+            if (!m_pFrameSource)
+            {
+                return E_NUI_DEVICE_NOT_READY;
+            }
+
+            // Hand every frame that has arrived to the synchronizer, in capture order
+            DWORD streamMask = 0;
+            FrameRing* rings[FRAME_STREAM_COUNT] = {&m_colorRing, &m_depthRing, &m_skeletonRing};
+            const bool isUsing[FRAME_STREAM_COUNT] = {m_isUsingColor, m_isUsingDepth, m_isUsingSkeleton};
+
+            for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+            {
+                if (!isUsing[i])
+                {
+                    continue;
+                }
+
+                streamMask |= 1 << i;
+
+                FrameLease* pLease = NULL;
+                while (SUCCEEDED(rings[i]->PopOldest(&pLease)))
+                {
+                    m_frameSynchronizer.AddFrame(static_cast<FrameStream>(i), pLease);
+                }
+            }
+
+            // Fail if no stream is enabled
+            if (!streamMask)
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            FrameSet frameSet;
+            HRESULT hr = m_frameSynchronizer.GetFrameSet(streamMask, &frameSet);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Take over the set's references, so the frames outlive the set
+            FrameLease* pColorLease = frameSet.GetLease(FRAME_STREAM_COLOR);
+            if (pColorLease)
+            {
+                pColorLease->AddRef();
+                hr = SetColorLease(pColorLease);
+            }
+
+            FrameLease* pDepthLease = frameSet.GetLease(FRAME_STREAM_DEPTH);
+            if (pDepthLease && SUCCEEDED(hr))
+            {
+                pDepthLease->AddRef();
+                hr = SetDepthLease(pDepthLease);
+            }
+
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            FrameLease* pSkeletonLease = frameSet.GetLease(FRAME_STREAM_SKELETON);
+            if (pSkeletonLease)
+            {
+                pSkeletonLease->AddRef();
+                SetSkeletonLease(pSkeletonLease);
+            }
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Runs a callback for every frame produced on a stream. While dispatching, the callback
+        /// runs on a worker thread as soon as the frame is signalled. Must not be called from a
+        /// subscription callback.
+        /// </summary>
+        /// <param name="stream">stream to receive frames of</param>
+        /// <param name="callback">function to run</param>
+        /// <param name="pContext">context to pass to the function</param>
+        /// <param name="pCookie">pointer in which to return the cookie to unsubscribe with, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SubscribeFrames(FrameStream stream, FrameCallback callback, void* pContext, DWORD* pCookie)
+        {
+            if (stream < 0 || stream >= FRAME_STREAM_COUNT)
+            {
+                return E_INVALIDARG;
+            }
+
+            if (!callback)
+            {
+                return E_POINTER;
+            }
+
+            FrameSubscription subscription;
+            ZeroMemory(&subscription, sizeof(subscription));
+            subscription.stream = stream;
+            subscription.frameCallback = callback;
+            subscription.pContext = pContext;
+
+            return AddSubscription(subscription, pCookie);
+        }
+
+        /// <summary>
+        /// Runs a callback for every frame set consumed while dispatching. Must not be called
+        /// from a subscription callback.
+        /// </summary>
+        /// <param name="callback">function to run</param>
+        /// <param name="pContext">context to pass to the function</param>
+        /// <param name="pCookie">pointer in which to return the cookie to unsubscribe with, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SubscribeFrameSets(FrameSetCallback callback, void* pContext, DWORD* pCookie)
+        {
+            if (!callback)
+            {
+                return E_POINTER;
+            }
+
+            FrameSubscription subscription;
+            ZeroMemory(&subscription, sizeof(subscription));
+            subscription.stream = FRAME_STREAM_COUNT;
+            subscription.frameSetCallback = callback;
+            subscription.pContext = pContext;
+
+            return AddSubscription(subscription, pCookie);
+        }
+
+        /// <summary>
+        /// Removes a subscription. Once this returns its callback is not running and will not
+        /// run again. Must not be called from a subscription callback.
+        /// </summary>
+        /// <param name="cookie">cookie returned when subscribing</param>
+        template <typename Image>
+        void KinectHelper<Image>::Unsubscribe(DWORD cookie)
+        {
+            // Pause the dispatcher, which waits for running callbacks to return
+            StopFrameSetDispatch();
+            StopAcquisitionDispatch();
+
+            for (int i = 0; i < m_subscriptionCount; ++i)
+            {
+                if (m_subscriptions[i].cookie == cookie)
+                {
+                    // Keep the remaining subscriptions in the order they were made
+                    for (int j = i + 1; j < m_subscriptionCount; ++j)
+                    {
+                        m_subscriptions[j - 1] = m_subscriptions[j];
+                    }
+
+                    --m_subscriptionCount;
+                    break;
+                }
+            }
+
+            StartAcquisitionDispatch();
+            StartFrameSetDispatch();
+        }
+
+        /// <summary>
+        /// Starts delivering frames to subscribers from a worker pool. Frames are produced as
+        /// soon as the source signals them and frame sets consumed as soon as they complete, so
+        /// no thread polls for them. While dispatching, the helper is the only producer and
+        /// consumer of its frame rings. Dispatch stops on UnInitialize and resumes on the next
+        /// Initialize. Image conversions are also split into row bands across the pool's threads.
+        /// </summary>
+        /// <param name="pWorkerPool">started pool to run the work on, which must outlive the dispatch</param>
+        /// <param name="priority">priority of the work</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::StartDispatch(WorkerPool* pWorkerPool, WorkPriority priority)
+        {
+            if (!pWorkerPool)
+            {
+                return E_POINTER;
+            }
+
+            if (priority < 0 || priority >= WORK_PRIORITY_COUNT)
+            {
+                return E_INVALIDARG;
+            }
+
+            // Fail if already dispatching
+            if (m_pWorkerPool)
+            {
+                return E_NUI_ALREADY_INITIALIZED;
+            }
+
+            m_pWorkerPool = pWorkerPool;
+            m_dispatchPriority = priority;
+
+            HRESULT hr = StartAcquisitionDispatch();
+            if (SUCCEEDED(hr))
+            {
+                hr = StartFrameSetDispatch();
+            }
+
+            if (FAILED(hr))
+            {
+                StopDispatch();
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Stops delivering frames from the worker pool. Must not be called from a subscription callback.
+        /// </summary>
+        template <typename Image>
+        void KinectHelper<Image>::StopDispatch()
+        {
+            StopFrameSetDispatch();
+            StopAcquisitionDispatch();
+
+            m_pWorkerPool = NULL;
+        }
+
+        /// <summary>
+        /// Changes the priority of the dispatch work
+        /// </summary>
+        /// <param name="priority">new priority</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetDispatchPriority(WorkPriority priority)
+        {
+            if (priority < 0 || priority >= WORK_PRIORITY_COUNT)
+            {
+                return E_INVALIDARG;
+            }
+
+            m_dispatchPriority = priority;
+
+            if (m_pWorkerPool)
+            {
+                m_pWorkerPool->SetWaitPriority(m_pAcquisitionWait, priority);
+                m_pWorkerPool->SetWaitPriority(m_pFrameSetWait, priority);
+            }
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Adds a subscription, pausing the dispatcher while the list changes
+        /// </summary>
+        /// <param name="subscription">subscription to add, whose cookie is assigned here</param>
+        /// <param name="pCookie">pointer in which to return the cookie, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::AddSubscription(FrameSubscription subscription, DWORD* pCookie)
+        {
+            if (m_subscriptionCount >= MAXIMUM_SUBSCRIPTION_COUNT)
+            {
+                return E_OUTOFMEMORY;
+            }
+
+            // Pause the dispatcher, so that no callback reads the list while it changes
+            StopFrameSetDispatch();
+            StopAcquisitionDispatch();
+
+            subscription.cookie = m_nextSubscriptionCookie++;
+            m_subscriptions[m_subscriptionCount++] = subscription;
+
+            HRESULT hr = StartAcquisitionDispatch();
+            if (SUCCEEDED(hr))
+            {
+                hr = StartFrameSetDispatch();
+            }
+
+            if (pCookie)
+            {
+                *pCookie = subscription.cookie;
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Runs the callbacks subscribed to a stream on a produced frame
+        /// </summary>
+        /// <param name="stream">stream the frame belongs to</param>
+        /// <param name="pLease">lease on the frame</param>
+        template <typename Image>
+        void KinectHelper<Image>::NotifyFrameSubscribers(FrameStream stream, FrameLease* pLease)
+        {
+            for (int i = 0; i < m_subscriptionCount; ++i)
+            {
+                const FrameSubscription& subscription = m_subscriptions[i];
+                if (subscription.stream == stream)
+                {
+                    subscription.frameCallback(stream, pLease, subscription.pContext);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Registers the wait on the source's frame events if dispatching and initialized
+        /// </summary>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::StartAcquisitionDispatch()
+        {
+            if (!m_pWorkerPool || !m_pFrameSource || m_pAcquisitionWait)
+            {
+                return S_OK;
+            }
+
+            HANDLE handles[FRAME_STREAM_COUNT];
+            DWORD handleCount = 0;
+
+            const HANDLE events[FRAME_STREAM_COUNT] = {m_hNextColorFrameEvent, m_hNextDepthFrameEvent, m_hNextSkeletonFrameEvent};
+            for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+            {
+                // Disabled streams have no event
+                if (events[i] && (events[i] != INVALID_HANDLE_VALUE))
+                {
+                    m_acquisitionStreams[handleCount] = static_cast<FrameStream>(i);
+                    handles[handleCount++] = events[i];
+                }
+            }
+
+            if (0 == handleCount)
+            {
+                return S_OK;
+            }
+
+            return m_pWorkerPool->RegisterWait(handles, handleCount, DispatchAcquisition, this, m_dispatchPriority, &m_pAcquisitionWait);
+        }
+
+        /// <summary>
+        /// Unregisters the wait on the source's frame events, waiting for a running callback to return
+        /// </summary>
+        template <typename Image>
+        void KinectHelper<Image>::StopAcquisitionDispatch()
+        {
+            if (m_pAcquisitionWait)
+            {
+                m_pWorkerPool->UnregisterWait(m_pAcquisitionWait);
+                m_pAcquisitionWait = NULL;
+            }
+        }
+
+        /// <summary>
+        /// Registers the wait on the frame ready events of the rings if dispatching and initialized
+        /// </summary>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::StartFrameSetDispatch()
+        {
+            if (!m_pWorkerPool || !m_pFrameSource || m_pFrameSetWait)
+            {
+                return S_OK;
+            }
+
+            HANDLE handles[FRAME_STREAM_COUNT];
+            DWORD handleCount = 0;
+
+            if (m_isUsingColor)
+            {
+                handles[handleCount++] = m_colorRing.GetFrameReadyHandle();
+            }
+
+            if (m_isUsingDepth)
+            {
+                handles[handleCount++] = m_depthRing.GetFrameReadyHandle();
+            }
+
+            if (m_isUsingSkeleton)
+            {
+                handles[handleCount++] = m_skeletonRing.GetFrameReadyHandle();
+            }
+
+            if (0 == handleCount)
+            {
+                return S_OK;
+            }
+
+            return m_pWorkerPool->RegisterWait(handles, handleCount, DispatchFrameSets, this, m_dispatchPriority, &m_pFrameSetWait);
+        }
+
+        /// <summary>
+        /// Unregisters the wait on the frame ready events of the rings, waiting for a running callback to return
+        /// </summary>
+        template <typename Image>
+        void KinectHelper<Image>::StopFrameSetDispatch()
+        {
+            if (m_pFrameSetWait)
+            {
+                m_pWorkerPool->UnregisterWait(m_pFrameSetWait);
+                m_pFrameSetWait = NULL;
+            }
+        }
+
+        /// <summary>
+        /// Produces the frame whose event was signalled. Runs on a worker thread.
+        /// </summary>
+        /// <param name="pContext">pointer to the helper</param>
+        /// <param name="handleIndex">index of the signalled frame event</param>
+        template <typename Image>
+        void CALLBACK KinectHelper<Image>::DispatchAcquisition(void* pContext, DWORD handleIndex)
+        {
+            KinectHelper* pThis = reinterpret_cast<KinectHelper*>(pContext);
+
+            switch (pThis->m_acquisitionStreams[handleIndex])
+            {
+            case FRAME_STREAM_COLOR:
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_ACQUIRE_COLOR);
+                    pThis->ProduceColorFrame();
+                }
+                break;
+
+            case FRAME_STREAM_DEPTH:
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_ACQUIRE_DEPTH);
+                    pThis->ProduceDepthFrame();
+                }
+                break;
+
+            case FRAME_STREAM_SKELETON:
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_ACQUIRE_SKELETON);
+                    pThis->ProduceSkeletonFrame();
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        /// <summary>
+        /// Consumes the frame sets that have completed and runs the frame set callbacks on
+        /// each. Runs on a worker thread.
+        /// </summary>
+        /// <param name="pContext">pointer to the helper</param>
+        /// <param name="handleIndex">index of the signalled frame ready event</param>
+        template <typename Image>
+        void CALLBACK KinectHelper<Image>::DispatchFrameSets(void* pContext, DWORD handleIndex)
+        {
+            KinectHelper* pThis = reinterpret_cast<KinectHelper*>(pContext);
+
+            // Several sets may have completed since the last signal when every set is kept
+            for (;;)
+            {
+                HRESULT hr;
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_CONSUME_FRAME_SET);
+                    hr = pThis->ConsumeFrameSet();
+                }
+
+                if (FAILED(hr))
+                {
+                    break;
+                }
+
+                for (int i = 0; i < pThis->m_subscriptionCount; ++i)
+                {
+                    const FrameSubscription& subscription = pThis->m_subscriptions[i];
+                    if (FRAME_STREAM_COUNT == subscription.stream)
+                    {
+                        subscription.frameSetCallback(subscription.pContext);
+                    }
+                }
+            }
+        }
+
+
+        /// <summary>
+        /// Makes a color frame the internal color image, releasing the previous one
+        /// </summary>
+        /// <param name="pLease">frame to use; the helper takes over the caller's reference</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if the frame is too small for the color resolution</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetColorLease(FrameLease* pLease)
+        {
+            // Refuse a frame of another resolution, which the conversions would read past the end of
+            DWORD width, height;
+            NuiImageResolutionToSize(m_colorResolution, width, height);
+            INT pitch = pLease->GetPitch();
+            if (pitch < static_cast<INT>(width * sizeof(DWORD)) || pLease->GetSize() < pitch * static_cast<INT>(height))
+            {
+                pLease->Release();
+                return E_INVALIDARG;
+            }
+
+            // Hand the previous frame back and point the buffer at the new one
+            if (m_pColorLease)
+            {
+                m_pColorLease->Release();
+            }
+
+            m_pColorLease = pLease;
+            m_pColorBuffer = pLease->GetBits();
+            m_colorBufferSize = pLease->GetSize();
+            m_colorBufferPitch = pitch;
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Makes a depth frame the internal depth image, releasing the previous one
+        /// </summary>
+        /// <param name="pLease">frame to use; the helper takes over the caller's reference</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if the frame is too small for the depth resolution</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::SetDepthLease(FrameLease* pLease)
+        {
+            // Refuse a frame of another resolution, which the conversions would read past the end of
+            DWORD width, height;
+            NuiImageResolutionToSize(m_depthResolution, width, height);
+            INT pitch = pLease->GetPitch();
+            if (pitch < static_cast<INT>(width * sizeof(USHORT)) || pLease->GetSize() < pitch * static_cast<INT>(height))
+            {
+                pLease->Release();
+                return E_INVALIDARG;
             }
 
-            // Lock frame texture to allow for copy
-            INuiFrameTexture* pTexture = imageFrame.pFrameTexture;
-            NUI_LOCKED_RECT lockedRect;
-            pTexture->LockRect(0, &lockedRect, NULL, 0);
-
-            // Check if image is valid
-            if (lockedRect.Pitch != 0)
+            // Hand the previous frame back and point the buffer at the new one
+            if (m_pDepthLease)
             {
-                // Copy image information into buffer
-                BYTE* pBuffer = lockedRect.pBits;
-                INT size =  lockedRect.size;
-                INT pitch = lockedRect.Pitch;
-
-                // Only reallocate memory if the buffer size has changed
-                if (size != m_depthBufferSize)
-                {
-                    delete [] m_pDepthBuffer;
-                    m_pDepthBuffer = new BYTE[size];
-                    m_depthBufferSize = size;
-                }
-                memcpy_s(m_pDepthBuffer, size, pBuffer, size);
-
-                m_depthBufferPitch = pitch;
+                m_pDepthLease->Release();
             }
 
-            // Unlock texture
-            pTexture->UnlockRect(0);
+            m_pDepthLease = pLease;
+            m_pDepthBuffer = pLease->GetBits();
+            m_depthBufferSize = pLease->GetSize();
+            m_depthBufferPitch = pitch;
 
-            // Release image stream frame
-            hr = m_pNuiSensor->NuiImageStreamReleaseFrame(m_hDepthStreamHandle, &imageFrame);
-
-            return hr;
+            return S_OK;
         }
 
         /// <summary>
-        /// Updates the internal skeleton frame
+        /// Releases the unread color frames, the frames waiting to be matched into sets and the
+        /// internal color image. Called from the consumer thread while the acquisition dispatcher is stopped.
         /// </summary>
-        /// <param name="waitMillis">number of milliseconds to wait</param>
-        /// <returns>S_OK if successful, an error code otherwise</returns>
         template <typename Image>
-        HRESULT KinectHelper<Image>::UpdateSkeletonFrame(DWORD waitMillis /* = 0 */)
+        void KinectHelper<Image>::ReleaseColorFrames()
         {
-            // Fail if Kinect is not initialized
-            if (!m_pNuiSensor)
-            {
-                return E_NUI_DEVICE_NOT_READY;
-            }
+            // The synchronizer cannot drop one stream's frames, so sets of the other streams start afresh too
+            m_colorRing.Clear();
+            m_frameSynchronizer.Clear();
 
-            // Fail if skeleton tracking is not enabled
-            if (!m_isUsingSkeleton)
+            if (m_pColorLease)
             {
-                return E_NUI_STREAM_NOT_ENABLED;
+                m_pColorLease->Release();
+                m_pColorLease = NULL;
             }
 
-            // Get next skeleton frame
-            HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(waitMillis, &m_skeletonFrame);
-            if (FAILED(hr))
+            m_pColorBuffer = NULL;
+            m_colorBufferSize = 0;
+            m_colorBufferPitch = 0;
+        }
+
+        /// <summary>
+        /// Releases the unread depth frames, the frames waiting to be matched into sets and the
+        /// internal depth image. Called from the consumer thread while the acquisition dispatcher is stopped.
+        /// </summary>
+        template <typename Image>
+        void KinectHelper<Image>::ReleaseDepthFrames()
+        {
+            // The synchronizer cannot drop one stream's frames, so sets of the other streams start afresh too
+            m_depthRing.Clear();
+            m_frameSynchronizer.Clear();
+
+            if (m_pDepthLease)
             {
-                return hr;
+                m_pDepthLease->Release();
+                m_pDepthLease = NULL;
             }
 
-            // Smooth skeletons
-            hr = m_pNuiSensor->NuiTransformSmooth(&m_skeletonFrame,NULL);
+            m_pDepthBuffer = NULL;
+            m_depthBufferSize = 0;
+            m_depthBufferPitch = 0;
+        }
 
-            return hr;
+        /// <summary>
+        /// Copies a skeleton frame into the internal skeleton frame and releases it
+        /// </summary>
+        /// <param name="pLease">frame to use; the helper takes over the caller's reference</param>
+        template <typename Image>
+        void KinectHelper<Image>::SetSkeletonLease(FrameLease* pLease)
+        {
+            memcpy_s(&m_skeletonFrame, sizeof(m_skeletonFrame), pLease->GetBits(), pLease->GetSize());
+            pLease->Release();
         }
 
         /// <summary>
@@ -911,7 +2308,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetColorHandle(HANDLE* phColorEvent) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -942,7 +2339,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetDepthHandle(HANDLE* phDepthEvent) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -973,7 +2370,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetSkeletonHandle(HANDLE* phSkeletonEvent) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -995,6 +2392,157 @@ namespace Microsoft {
             return S_OK;
         }
 
+        /// <summary>
+        /// Gets the event signalled when a color frame is pushed into the color frame ring
+        /// </summary>
+        /// <param name="phColorReadyEvent">pointer in which to return the handle</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetColorFrameReadyHandle(HANDLE* phColorReadyEvent) const
+        {
+            // Fail if color stream is not enabled
+            if (!m_isUsingColor) 
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            // Fail if pointer is invalid
+            if (!phColorReadyEvent) 
+            {
+                return E_POINTER;
+            }
+
+            *phColorReadyEvent = m_colorRing.GetFrameReadyHandle();
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the event signalled when a depth frame is pushed into the depth frame ring
+        /// </summary>
+        /// <param name="phDepthReadyEvent">pointer in which to return the handle</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetDepthFrameReadyHandle(HANDLE* phDepthReadyEvent) const
+        {
+            // Fail if depth stream is not enabled
+            if (!m_isUsingDepth) 
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            // Fail if pointer is invalid
+            if (!phDepthReadyEvent) 
+            {
+                return E_POINTER;
+            }
+
+            *phDepthReadyEvent = m_depthRing.GetFrameReadyHandle();
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the event signalled when a skeleton frame is pushed into the skeleton frame ring
+        /// </summary>
+        /// <param name="phSkeletonReadyEvent">pointer in which to return the handle</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetSkeletonFrameReadyHandle(HANDLE* phSkeletonReadyEvent) const
+        {
+            // Fail if skeleton tracking is not enabled
+            if (!m_isUsingSkeleton) 
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            // Fail if pointer is invalid
+            if (!phSkeletonReadyEvent) 
+            {
+                return E_POINTER;
+            }
+
+            *phSkeletonReadyEvent = m_skeletonRing.GetFrameReadyHandle();
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the counters of the color frame ring
+        /// </summary>
+        /// <param name="pStatistics">pointer in which to return the counters</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetColorRingStatistics(FrameRingStatistics* pStatistics) const
+        {
+            // Fail if pointer is invalid
+            if (!pStatistics) 
+            {
+                return E_POINTER;
+            }
+
+            m_colorRing.GetStatistics(pStatistics);
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the counters of the depth frame ring
+        /// </summary>
+        /// <param name="pStatistics">pointer in which to return the counters</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetDepthRingStatistics(FrameRingStatistics* pStatistics) const
+        {
+            // Fail if pointer is invalid
+            if (!pStatistics) 
+            {
+                return E_POINTER;
+            }
+
+            m_depthRing.GetStatistics(pStatistics);
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the counters of the skeleton frame ring
+        /// </summary>
+        /// <param name="pStatistics">pointer in which to return the counters</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetSkeletonRingStatistics(FrameRingStatistics* pStatistics) const
+        {
+            // Fail if pointer is invalid
+            if (!pStatistics) 
+            {
+                return E_POINTER;
+            }
+
+            m_skeletonRing.GetStatistics(pStatistics);
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the counters of the frame set synchronizer
+        /// </summary>
+        /// <param name="pStatistics">pointer in which to return the counters</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetFrameSyncStatistics(FrameSyncStatistics* pStatistics) const
+        {
+            // Fail if pointer is invalid
+            if (!pStatistics) 
+            {
+                return E_POINTER;
+            }
+
+            m_frameSynchronizer.GetStatistics(pStatistics);
+
+            return S_OK;
+        }
+
         /// <summary>
         /// Gets the color image
         /// </summary>
@@ -1004,7 +2552,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetColorImage(Image* pColorImage) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -1042,7 +2590,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetDepthImage(Image* pDepthImage) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -1060,7 +2608,7 @@ namespace Microsoft {
             }
 
             // Fail if pDepthImage is not the correct size
-            HRESULT hr = VerifySize(pDepthImage, m_depthWidth, m_depthHeight);
+            HRESULT hr = VerifySize(pDepthImage, m_depthResolution);
             if (FAILED(hr))
             {
                 return hr;
@@ -1080,7 +2628,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetSkeletonFrame(NUI_SKELETON_FRAME* pSkeletonFrame) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -1111,7 +2659,7 @@ namespace Microsoft {
         HRESULT KinectHelper<Image>::GetDepthImageAsArgb(Image* pDepthArgbImage) const
         {
             // Fail if Kinect is not initialized
-            if (!m_pNuiSensor) 
+            if (!m_pFrameSource) 
             {
                 return E_NUI_DEVICE_NOT_READY;
             }
@@ -1141,6 +2689,158 @@ namespace Microsoft {
             return hr;
         }
 
+        /// <summary>
+        /// Gets a lease on the current color frame. The frame stays valid until the lease is
+        /// released, even after the next call to UpdateColorFrame.
+        /// </summary>
+        /// <param name="ppLease">pointer in which to return the lease, which the caller must release</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetColorFrameLease(FrameLease** ppLease) const
+        {
+            // Fail if Kinect is not initialized
+            if (!m_pFrameSource) 
+            {
+                return E_NUI_DEVICE_NOT_READY;
+            }
+
+            // Fail if color stream is not enabled
+            if (!m_isUsingColor) 
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            // Fail if pointer is invalid
+            if (!ppLease) 
+            {
+                return E_POINTER;
+            }
+
+            // Fail if no frame has been received yet
+            if (!m_pColorLease)
+            {
+                return E_NUI_FRAME_NO_DATA;
+            }
+
+            m_pColorLease->AddRef();
+            *ppLease = m_pColorLease;
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets a lease on the current depth frame. The frame stays valid until the lease is
+        /// released, even after the next call to UpdateDepthFrame.
+        /// </summary>
+        /// <param name="ppLease">pointer in which to return the lease, which the caller must release</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetDepthFrameLease(FrameLease** ppLease) const
+        {
+            // Fail if Kinect is not initialized
+            if (!m_pFrameSource) 
+            {
+                return E_NUI_DEVICE_NOT_READY;
+            }
+
+            // Fail if depth stream is not enabled
+            if (!m_isUsingDepth) 
+            {
+                return E_NUI_STREAM_NOT_ENABLED;
+            }
+
+            // Fail if pointer is invalid
+            if (!ppLease) 
+            {
+                return E_POINTER;
+            }
+
+            // Fail if no frame has been received yet
+            if (!m_pDepthLease)
+            {
+                return E_NUI_FRAME_NO_DATA;
+            }
+
+            m_pDepthLease->AddRef();
+            *ppLease = m_pDepthLease;
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets a color image that references the leased frame data without copying it.
+        /// The image is only valid while the lease is held.
+        /// </summary>
+        /// <param name="pLease">lease on the color frame</param>
+        /// <param name="pColorImage">pointer in which to return the image</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetColorImageView(const FrameLease* pLease, Image* pColorImage) const
+        {
+            // Fail if pointer is invalid
+            if (!pLease || !pColorImage) 
+            {
+                return E_POINTER;
+            }
+
+            HRESULT hr = GetColorView(pLease, pColorImage);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Fail if the frame was captured at a different resolution
+            return VerifySize(pColorImage, m_colorResolution);
+        }
+
+        /// <summary>
+        /// Gets a depth image that references the leased frame data without copying it.
+        /// The image is only valid while the lease is held.
+        /// </summary>
+        /// <param name="pLease">lease on the depth frame</param>
+        /// <param name="pDepthImage">pointer in which to return the image</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Image>
+        HRESULT KinectHelper<Image>::GetDepthImageView(const FrameLease* pLease, Image* pDepthImage) const
+        {
+            // Fail if pointer is invalid
+            if (!pLease || !pDepthImage) 
+            {
+                return E_POINTER;
+            }
+
+            HRESULT hr = GetDepthView(pLease, pDepthImage);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Fail if the frame was captured at a different resolution
+            return VerifySize(pDepthImage, m_depthResolution);
+        }
+
+        /// <summary>
+        /// Runs a conversion over bands of rows, spread across the dispatch pool's threads
+        /// while dispatching and on the calling thread otherwise
+        /// </summary>
+        /// <param name="rowCount">number of rows</param>
+        /// <param name="bytesPerRow">bytes read and written per row</param>
+        /// <param name="callback">function to run on each band</param>
+        /// <param name="pContext">context to pass to the function</param>
+        template <typename Image>
+        void KinectHelper<Image>::RunRowBands(UINT rowCount, SIZE_T bytesPerRow, RowBandCallback callback, void* pContext) const
+        {
+            WorkerPool* pWorkerPool = m_pWorkerPool;
+            if (pWorkerPool)
+            {
+                pWorkerPool->ParallelForRowBands(rowCount, bytesPerRow, callback, pContext, m_dispatchPriority);
+            }
+            else
+            {
+                callback(pContext, 0, rowCount);
+            }
+        }
+
         /// <summary>
         /// Convert a 13-bit depth value into a set of RGB values
         /// </summary>
@@ -0,0 +1,814 @@
+//-----------------------------------------------------------------------------
+// <copyright file="KinectSensorManager.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include <strsafe.h>
+#include "FrameLease.h"
+#include "FrameSource.h"
+#include "WorkerPool.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Counters describing one sensor of a KinectSensorManager
+        /// </summary>
+        struct KinectSensorStatistics
+        {
+            // Whether a sensor or frame source is attached, and the priority of its work
+            bool isConnected;
+            WorkPriority priority;
+
+            // Frames pulled from the sensor per stream, and frame sets handed to the consumer
+            LONG colorFrameCount;
+            LONG depthFrameCount;
+            LONG skeletonFrameCount;
+            LONG frameSetCount;
+
+            // Frames discarded from the frame rings before they were consumed
+            LONG droppedFrameCount;
+        };
+
+        /// <summary>
+        /// Counters summed over all sensors of a KinectSensorManager
+        /// </summary>
+        struct KinectSensorManagerStatistics
+        {
+            // Sensors and frame sources attached
+            LONG sensorCount;
+
+            // Sums of the per-sensor counters
+            LONG colorFrameCount;
+            LONG depthFrameCount;
+            LONG skeletonFrameCount;
+            LONG frameSetCount;
+            LONG droppedFrameCount;
+
+            // Counters of the shared worker pool
+            WorkerPoolStatistics workerPool;
+        };
+
+        /// <summary>
+        /// Function run on a worker thread each time a sensor's frame set has been consumed
+        /// </summary>
+        /// <param name="sensorIndex">index of the sensor, whose helper holds the frame set</param>
+        /// <param name="pContext">context given to SetFrameSetCallback</param>
+        typedef void (CALLBACK *SensorFrameSetCallback)(int sensorIndex, void* pContext);
+
+        /// <summary>
+        /// Owns a KinectHelper per attached sensor and has all of them dispatch their frames from
+        /// one shared worker pool instead of threads per sensor. A sensor's frames are acquired by
+        /// one worker at a time and its frame sets consumed by one worker at a time, so each frame
+        /// ring keeps a single producer and a single consumer, while different sensors, and
+        /// acquisition and consumption of the same sensor, run in parallel. Sensors of a higher
+        /// priority are served first when more work is ready than there are workers. Sensors are
+        /// attached and detached as they are plugged in and out, through OnSensorStatusChanged.
+        /// </summary>
+        template <typename Helper>
+        class KinectSensorManager
+        {
+        public:
+            // Constants:
+            // Largest number of sensors managed at once
+            static const int MAXIMUM_SENSOR_COUNT = 8;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            KinectSensorManager();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~KinectSensorManager();
+
+            /// <summary>
+            /// Starts the shared worker pool
+            /// </summary>
+            /// <param name="threadCount">number of worker threads, or 0 for one per processor</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Start(DWORD threadCount = 0);
+
+            /// <summary>
+            /// Detaches every sensor and stops the shared worker pool
+            /// </summary>
+            void Stop();
+
+            /// <summary>
+            /// Sets the function run each time a sensor's frame set has been consumed. Set it before
+            /// attaching sensors.
+            /// </summary>
+            /// <param name="callback">function to run, or NULL to only consume frame sets</param>
+            /// <param name="pContext">context to pass to the function</param>
+            void SetFrameSetCallback(SensorFrameSetCallback callback, void* pContext);
+
+            /// <summary>
+            /// Gets the helper of a sensor slot. Helpers can be configured before a sensor is attached to them.
+            /// </summary>
+            /// <param name="sensorIndex">index of the sensor</param>
+            /// <returns>helper of the sensor, or NULL if the index is out of range</returns>
+            Helper* GetHelper(int sensorIndex);
+
+            /// <summary>
+            /// Returns whether a sensor or frame source is attached to a sensor slot
+            /// </summary>
+            /// <param name="sensorIndex">index of the sensor</param>
+            /// <returns>true if attached, false otherwise</returns>
+            bool IsSensorConnected(int sensorIndex) const;
+
+            /// <summary>
+            /// Attaches every sensor that is plugged in and can be initialized
+            /// </summary>
+            /// <param name="priority">priority of the sensors' work</param>
+            /// <param name="pConnectedCount">pointer in which to return the number of sensors attached, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ConnectAllSensors(WorkPriority priority, int* pConnectedCount);
+
+            /// <summary>
+            /// Initializes a sensor and attaches it to a free sensor slot
+            /// </summary>
+            /// <param name="pNuiSensor">sensor, whose reference the manager takes over even if attaching fails</param>
+            /// <param name="priority">priority of the sensor's work</param>
+            /// <param name="pSensorIndex">pointer in which to return the index of the sensor, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AddSensor(INuiSensor* pNuiSensor, WorkPriority priority, int* pSensorIndex);
+
+            /// <summary>
+            /// Initializes a frame source, such as a synthetic or replay source, and attaches it to a free sensor slot
+            /// </summary>
+            /// <param name="pFrameSource">frame source, which must outlive its attachment</param>
+            /// <param name="priority">priority of the source's work</param>
+            /// <param name="pSensorIndex">pointer in which to return the index of the sensor, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AddFrameSource(IFrameSource* pFrameSource, WorkPriority priority, int* pSensorIndex);
+
+            /// <summary>
+            /// Stops a sensor's work, uninitializes its helper and releases the sensor
+            /// </summary>
+            /// <param name="sensorIndex">index of the sensor</param>
+            void RemoveSensor(int sensorIndex);
+
+            /// <summary>
+            /// Changes the priority of a sensor's work
+            /// </summary>
+            /// <param name="sensorIndex">index of the sensor</param>
+            /// <param name="priority">new priority</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetSensorPriority(int sensorIndex, WorkPriority priority);
+
+            /// <summary>
+            /// Attaches or detaches a sensor that was plugged in or out. Call from the NuiStatusProc
+            /// registered with NuiSetDeviceStatusCallback.
+            /// </summary>
+            /// <param name="hrStatus">status reported for the sensor</param>
+            /// <param name="instanceName">instance name of the sensor</param>
+            /// <returns>index of the sensor attached or detached, or -1 if none was</returns>
+            int OnSensorStatusChanged(HRESULT hrStatus, const OLECHAR* instanceName);
+
+            /// <summary>
+            /// Gets the counters of a sensor
+            /// </summary>
+            /// <param name="sensorIndex">index of the sensor</param>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetSensorStatistics(int sensorIndex, KinectSensorStatistics* pStatistics) const;
+
+            /// <summary>
+            /// Gets the counters summed over all sensors
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            void GetStatistics(KinectSensorManagerStatistics* pStatistics) const;
+
+        private:
+            // Constants:
+            // Longest connection id kept for recognizing a sensor that is plugged back in
+            static const int MAXIMUM_CONNECTION_ID_LENGTH = 256;
+
+            /// <summary>
+            /// A sensor and everything the manager keeps for it
+            /// </summary>
+            struct SensorSlot
+            {
+                // Manager the slot belongs to, and its index there
+                KinectSensorManager* pManager;
+                int index;
+
+                Helper helper;
+
+                // Sensor reference owned by the slot, NULL for frame sources
+                INuiSensor* pNuiSensor;
+
+                // Whether a sensor or frame source is attached
+                bool isConnected;
+
+                // Connection id of the last sensor attached, so that it gets its slot back when plugged in again
+                WCHAR connectionId[MAXIMUM_CONNECTION_ID_LENGTH];
+
+                WorkPriority priority;
+
+                // Counters
+                volatile LONG colorFrameCount;
+                volatile LONG depthFrameCount;
+                volatile LONG skeletonFrameCount;
+                volatile LONG frameSetCount;
+            };
+
+            // Managers are not copied, since slots refer to the instance
+            KinectSensorManager(const KinectSensorManager&);
+            KinectSensorManager& operator=(const KinectSensorManager&);
+
+            // Functions:
+            /// <summary>
+            /// Initializes the helper of a free slot with a sensor or frame source and starts its work.
+            /// Called with m_lock held.
+            /// </summary>
+            /// <param name="pNuiSensor">sensor to attach, or NULL</param>
+            /// <param name="pFrameSource">frame source to attach if pNuiSensor is NULL</param>
+            /// <param name="priority">priority of the work</param>
+            /// <param name="pSensorIndex">pointer in which to return the index of the sensor, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ConnectSlot(INuiSensor* pNuiSensor, IFrameSource* pFrameSource, WorkPriority priority, int* pSensorIndex);
+
+            /// <summary>
+            /// Stops the work of a slot and uninitializes its helper. Called with m_lock held.
+            /// </summary>
+            /// <param name="slot">slot to detach</param>
+            void DisconnectSlot(SensorSlot& slot);
+
+            /// <summary>
+            /// Counts a frame produced by a sensor. Runs on a worker thread.
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="pLease">lease on the frame</param>
+            /// <param name="pContext">slot of the sensor</param>
+            static void CALLBACK CountFrame(FrameStream stream, FrameLease* pLease, void* pContext);
+
+            /// <summary>
+            /// Counts a frame set consumed by a sensor's helper and hands it to the frame set
+            /// callback. Runs on a worker thread.
+            /// </summary>
+            /// <param name="pContext">slot of the sensor</param>
+            static void CALLBACK OnFrameSet(void* pContext);
+
+            // Variables:
+            // Guards attaching and detaching sensors
+            mutable CRITICAL_SECTION m_lock;
+
+            // Runs the work of all sensors
+            mutable WorkerPool m_workerPool;
+
+            SensorSlot m_slots[MAXIMUM_SENSOR_COUNT];
+
+            // Function run after each frame set is consumed
+            SensorFrameSetCallback m_frameSetCallback;
+            void* m_pFrameSetContext;
+        };
+
+        /// <summary>
+        /// Constructor
+        /// </summary>
+        template <typename Helper>
+        KinectSensorManager<Helper>::KinectSensorManager() :
+            m_frameSetCallback(NULL),
+            m_pFrameSetContext(NULL)
+        {
+            InitializeCriticalSection(&m_lock);
+
+            for (int i = 0; i < MAXIMUM_SENSOR_COUNT; ++i)
+            {
+                SensorSlot& slot = m_slots[i];
+                slot.pManager = this;
+                slot.index = i;
+                slot.pNuiSensor = NULL;
+                slot.isConnected = false;
+                slot.connectionId[0] = L'\0';
+                slot.priority = WORK_PRIORITY_NORMAL;
+                slot.colorFrameCount = 0;
+                slot.depthFrameCount = 0;
+                slot.skeletonFrameCount = 0;
+                slot.frameSetCount = 0;
+
+                // Subscriptions outlive sensors, so they are made once
+                slot.helper.SubscribeFrames(FRAME_STREAM_COLOR, CountFrame, &slot, NULL);
+                slot.helper.SubscribeFrames(FRAME_STREAM_DEPTH, CountFrame, &slot, NULL);
+                slot.helper.SubscribeFrames(FRAME_STREAM_SKELETON, CountFrame, &slot, NULL);
+                slot.helper.SubscribeFrameSets(OnFrameSet, &slot, NULL);
+            }
+        }
+
+        /// <summary>
+        /// Destructor
+        /// </summary>
+        template <typename Helper>
+        KinectSensorManager<Helper>::~KinectSensorManager()
+        {
+            Stop();
+            DeleteCriticalSection(&m_lock);
+        }
+
+        /// <summary>
+        /// Starts the shared worker pool
+        /// </summary>
+        /// <param name="threadCount">number of worker threads, or 0 for one per processor</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::Start(DWORD threadCount /* = 0 */)
+        {
+            HRESULT hr = m_workerPool.Start(threadCount);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Helpers dispatch whenever a sensor is attached to them
+            for (int i = 0; i < MAXIMUM_SENSOR_COUNT && SUCCEEDED(hr); ++i)
+            {
+                hr = m_slots[i].helper.StartDispatch(&m_workerPool, m_slots[i].priority);
+            }
+
+            if (FAILED(hr))
+            {
+                Stop();
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Detaches every sensor and stops the shared worker pool
+        /// </summary>
+        template <typename Helper>
+        void KinectSensorManager<Helper>::Stop()
+        {
+            for (int i = 0; i < MAXIMUM_SENSOR_COUNT; ++i)
+            {
+                RemoveSensor(i);
+                m_slots[i].helper.StopDispatch();
+            }
+
+            m_workerPool.Stop();
+        }
+
+        /// <summary>
+        /// Sets the function run each time a sensor's frame set has been consumed. Set it before
+        /// attaching sensors.
+        /// </summary>
+        /// <param name="callback">function to run, or NULL to only consume frame sets</param>
+        /// <param name="pContext">context to pass to the function</param>
+        template <typename Helper>
+        void KinectSensorManager<Helper>::SetFrameSetCallback(SensorFrameSetCallback callback, void* pContext)
+        {
+            m_frameSetCallback = callback;
+            m_pFrameSetContext = pContext;
+        }
+
+        /// <summary>
+        /// Gets the helper of a sensor slot. Helpers can be configured before a sensor is attached to them.
+        /// </summary>
+        /// <param name="sensorIndex">index of the sensor</param>
+        /// <returns>helper of the sensor, or NULL if the index is out of range</returns>
+        template <typename Helper>
+        Helper* KinectSensorManager<Helper>::GetHelper(int sensorIndex)
+        {
+            if (sensorIndex < 0 || sensorIndex >= MAXIMUM_SENSOR_COUNT)
+            {
+                return NULL;
+            }
+
+            return &m_slots[sensorIndex].helper;
+        }
+
+        /// <summary>
+        /// Returns whether a sensor or frame source is attached to a sensor slot
+        /// </summary>
+        /// <param name="sensorIndex">index of the sensor</param>
+        /// <returns>true if attached, false otherwise</returns>
+        template <typename Helper>
+        bool KinectSensorManager<Helper>::IsSensorConnected(int sensorIndex) const
+        {
+            if (sensorIndex < 0 || sensorIndex >= MAXIMUM_SENSOR_COUNT)
+            {
+                return false;
+            }
+
+            return m_slots[sensorIndex].isConnected;
+        }
+
+        /// <summary>
+        /// Attaches every sensor that is plugged in and can be initialized
+        /// </summary>
+        /// <param name="priority">priority of the sensors' work</param>
+        /// <param name="pConnectedCount">pointer in which to return the number of sensors attached, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::ConnectAllSensors(WorkPriority priority, int* pConnectedCount)
+        {
+            int sensorCount = 0;
+            HRESULT hr = NuiGetSensorCount(&sensorCount);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            // Sensors that are in use by another application fail to initialize and are skipped
+            int connectedCount = 0;
+            for (int i = 0; i < sensorCount; ++i)
+            {
+                INuiSensor* pNuiSensor = NULL;
+                if (SUCCEEDED(NuiCreateSensorByIndex(i, &pNuiSensor)) && SUCCEEDED(AddSensor(pNuiSensor, priority, NULL)))
+                {
+                    ++connectedCount;
+                }
+            }
+
+            if (pConnectedCount)
+            {
+                *pConnectedCount = connectedCount;
+            }
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Initializes a sensor and attaches it to a free sensor slot
+        /// </summary>
+        /// <param name="pNuiSensor">sensor, whose reference the manager takes over even if attaching fails</param>
+        /// <param name="priority">priority of the sensor's work</param>
+        /// <param name="pSensorIndex">pointer in which to return the index of the sensor, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::AddSensor(INuiSensor* pNuiSensor, WorkPriority priority, int* pSensorIndex)
+        {
+            if (!pNuiSensor)
+            {
+                return E_POINTER;
+            }
+
+            EnterCriticalSection(&m_lock);
+            HRESULT hr = ConnectSlot(pNuiSensor, NULL, priority, pSensorIndex);
+            LeaveCriticalSection(&m_lock);
+
+            if (FAILED(hr))
+            {
+                pNuiSensor->Release();
+            }
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Initializes a frame source, such as a synthetic or replay source, and attaches it to a free sensor slot
+        /// </summary>
+        /// <param name="pFrameSource">frame source, which must outlive its attachment</param>
+        /// <param name="priority">priority of the source's work</param>
+        /// <param name="pSensorIndex">pointer in which to return the index of the sensor, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::AddFrameSource(IFrameSource* pFrameSource, WorkPriority priority, int* pSensorIndex)
+        {
+            if (!pFrameSource)
+            {
+                return E_POINTER;
+            }
+
+            EnterCriticalSection(&m_lock);
+            HRESULT hr = ConnectSlot(NULL, pFrameSource, priority, pSensorIndex);
+            LeaveCriticalSection(&m_lock);
+
+            return hr;
+        }
+
+        /// <summary>
+        /// Stops a sensor's work, uninitializes its helper and releases the sensor
+        /// </summary>
+        /// <param name="sensorIndex">index of the sensor</param>
+        template <typename Helper>
+        void KinectSensorManager<Helper>::RemoveSensor(int sensorIndex)
+        {
+            if (sensorIndex < 0 || sensorIndex >= MAXIMUM_SENSOR_COUNT)
+            {
+                return;
+            }
+
+            EnterCriticalSection(&m_lock);
+            DisconnectSlot(m_slots[sensorIndex]);
+            LeaveCriticalSection(&m_lock);
+        }
+
+        /// <summary>
+        /// Changes the priority of a sensor's work
+        /// </summary>
+        /// <param name="sensorIndex">index of the sensor</param>
+        /// <param name="priority">new priority</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::SetSensorPriority(int sensorIndex, WorkPriority priority)
+        {
+            if (sensorIndex < 0 || sensorIndex >= MAXIMUM_SENSOR_COUNT || priority < 0 || priority >= WORK_PRIORITY_COUNT)
+            {
+                return E_INVALIDARG;
+            }
+
+            EnterCriticalSection(&m_lock);
+
+            SensorSlot& slot = m_slots[sensorIndex];
+            slot.priority = priority;
+            slot.helper.SetDispatchPriority(priority);
+
+            LeaveCriticalSection(&m_lock);
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Attaches or detaches a sensor that was plugged in or out. Call from the NuiStatusProc
+        /// registered with NuiSetDeviceStatusCallback.
+        /// </summary>
+        /// <param name="hrStatus">status reported for the sensor</param>
+        /// <param name="instanceName">instance name of the sensor</param>
+        /// <returns>index of the sensor attached or detached, or -1 if none was</returns>
+        template <typename Helper>
+        int KinectSensorManager<Helper>::OnSensorStatusChanged(HRESULT hrStatus, const OLECHAR* instanceName)
+        {
+            if (!instanceName)
+            {
+                return -1;
+            }
+
+            int sensorIndex = -1;
+
+            EnterCriticalSection(&m_lock);
+
+            // Find the slot the sensor is attached to or was last attached to
+            int knownIndex = -1;
+            for (int i = 0; i < MAXIMUM_SENSOR_COUNT && knownIndex < 0; ++i)
+            {
+                if (0 == lstrcmp(m_slots[i].connectionId, instanceName))
+                {
+                    knownIndex = i;
+                }
+            }
+
+            if (FAILED(hrStatus))
+            {
+                // Unplugged, or otherwise unusable
+                if (knownIndex >= 0 && m_slots[knownIndex].isConnected)
+                {
+                    DisconnectSlot(m_slots[knownIndex]);
+                    sensorIndex = knownIndex;
+                }
+            }
+            else if (S_OK == hrStatus && (knownIndex < 0 || !m_slots[knownIndex].isConnected))
+            {
+                // Plugged in and ready. Other success codes report a sensor that is still starting up.
+                WorkPriority priority = (knownIndex >= 0) ? m_slots[knownIndex].priority : WORK_PRIORITY_NORMAL;
+
+                INuiSensor* pNuiSensor = NULL;
+                if (SUCCEEDED(NuiCreateSensorById(instanceName, &pNuiSensor)))
+                {
+                    if (FAILED(ConnectSlot(pNuiSensor, NULL, priority, &sensorIndex)))
+                    {
+                        pNuiSensor->Release();
+                        sensorIndex = -1;
+                    }
+                }
+            }
+
+            LeaveCriticalSection(&m_lock);
+
+            return sensorIndex;
+        }
+
+        /// <summary>
+        /// Gets the counters of a sensor
+        /// </summary>
+        /// <param name="sensorIndex">index of the sensor</param>
+        /// <param name="pStatistics">pointer in which to return the counters</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::GetSensorStatistics(int sensorIndex, KinectSensorStatistics* pStatistics) const
+        {
+            if (sensorIndex < 0 || sensorIndex >= MAXIMUM_SENSOR_COUNT)
+            {
+                return E_INVALIDARG;
+            }
+
+            if (!pStatistics)
+            {
+                return E_POINTER;
+            }
+
+            const SensorSlot& slot = m_slots[sensorIndex];
+
+            ZeroMemory(pStatistics, sizeof(*pStatistics));
+            pStatistics->isConnected = slot.isConnected;
+            pStatistics->priority = slot.priority;
+            pStatistics->colorFrameCount = slot.colorFrameCount;
+            pStatistics->depthFrameCount = slot.depthFrameCount;
+            pStatistics->skeletonFrameCount = slot.skeletonFrameCount;
+            pStatistics->frameSetCount = slot.frameSetCount;
+
+            FrameRingStatistics ringStatistics;
+            if (SUCCEEDED(slot.helper.GetColorRingStatistics(&ringStatistics)))
+            {
+                pStatistics->droppedFrameCount += ringStatistics.overrunCount;
+            }
+            if (SUCCEEDED(slot.helper.GetDepthRingStatistics(&ringStatistics)))
+            {
+                pStatistics->droppedFrameCount += ringStatistics.overrunCount;
+            }
+            if (SUCCEEDED(slot.helper.GetSkeletonRingStatistics(&ringStatistics)))
+            {
+                pStatistics->droppedFrameCount += ringStatistics.overrunCount;
+            }
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Gets the counters summed over all sensors
+        /// </summary>
+        /// <param name="pStatistics">pointer in which to return the counters</param>
+        template <typename Helper>
+        void KinectSensorManager<Helper>::GetStatistics(KinectSensorManagerStatistics* pStatistics) const
+        {
+            ZeroMemory(pStatistics, sizeof(*pStatistics));
+
+            for (int i = 0; i < MAXIMUM_SENSOR_COUNT; ++i)
+            {
+                KinectSensorStatistics sensorStatistics;
+                GetSensorStatistics(i, &sensorStatistics);
+
+                if (sensorStatistics.isConnected)
+                {
+                    ++pStatistics->sensorCount;
+                }
+
+                pStatistics->colorFrameCount += sensorStatistics.colorFrameCount;
+                pStatistics->depthFrameCount += sensorStatistics.depthFrameCount;
+                pStatistics->skeletonFrameCount += sensorStatistics.skeletonFrameCount;
+                pStatistics->frameSetCount += sensorStatistics.frameSetCount;
+                pStatistics->droppedFrameCount += sensorStatistics.droppedFrameCount;
+            }
+
+            m_workerPool.GetStatistics(&pStatistics->workerPool);
+        }
+
+        /// <summary>
+        /// Initializes the helper of a free slot with a sensor or frame source and starts its work.
+        /// Called with m_lock held.
+        /// </summary>
+        /// <param name="pNuiSensor">sensor to attach, or NULL</param>
+        /// <param name="pFrameSource">frame source to attach if pNuiSensor is NULL</param>
+        /// <param name="priority">priority of the work</param>
+        /// <param name="pSensorIndex">pointer in which to return the index of the sensor, or NULL</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Helper>
+        HRESULT KinectSensorManager<Helper>::ConnectSlot(INuiSensor* pNuiSensor, IFrameSource* pFrameSource, WorkPriority priority, int* pSensorIndex)
+        {
+            // A sensor that was attached before gets its old slot back; others take the first
+            // slot that never held a sensor, then any free slot
+            const OLECHAR* connectionId = pNuiSensor ? pNuiSensor->NuiDeviceConnectionId() : pFrameSource->GetConnectionId();
+            int freeIndex = -1;
+            int unusedIndex = -1;
+            int knownIndex = -1;
+            for (int i = 0; i < MAXIMUM_SENSOR_COUNT; ++i)
+            {
+                const SensorSlot& slot = m_slots[i];
+                if (slot.isConnected)
+                {
+                    continue;
+                }
+
+                if (connectionId && 0 == lstrcmp(slot.connectionId, connectionId))
+                {
+                    knownIndex = i;
+                    break;
+                }
+
+                if (freeIndex < 0)
+                {
+                    freeIndex = i;
+                }
+
+                if (unusedIndex < 0 && L'\0' == slot.connectionId[0])
+                {
+                    unusedIndex = i;
+                }
+            }
+
+            int index = (knownIndex >= 0) ? knownIndex : ((unusedIndex >= 0) ? unusedIndex : freeIndex);
+            if (index < 0)
+            {
+                return E_OUTOFMEMORY;
+            }
+
+            SensorSlot& slot = m_slots[index];
+            slot.priority = priority;
+            slot.colorFrameCount = 0;
+            slot.depthFrameCount = 0;
+            slot.skeletonFrameCount = 0;
+            slot.frameSetCount = 0;
+            slot.helper.SetDispatchPriority(priority);
+
+            // Initializing starts the helper's dispatch on the shared pool
+            HRESULT hr = pNuiSensor ? slot.helper.Initialize(pNuiSensor) : slot.helper.Initialize(pFrameSource);
+            if (FAILED(hr))
+            {
+                // The caller still owns the sensor reference
+                slot.helper.UnInitialize();
+                return hr;
+            }
+
+            slot.pNuiSensor = pNuiSensor;
+            slot.isConnected = true;
+            StringCchCopy(slot.connectionId, _countof(slot.connectionId), connectionId ? connectionId : L"");
+
+            if (pSensorIndex)
+            {
+                *pSensorIndex = index;
+            }
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Stops the work of a slot and uninitializes its helper. Called with m_lock held.
+        /// </summary>
+        /// <param name="slot">slot to detach</param>
+        template <typename Helper>
+        void KinectSensorManager<Helper>::DisconnectSlot(SensorSlot& slot)
+        {
+            if (!slot.isConnected)
+            {
+                return;
+            }
+
+            // Uninitializing waits for the helper's running callbacks to return
+            slot.helper.UnInitialize();
+
+            if (slot.pNuiSensor)
+            {
+                slot.pNuiSensor->Release();
+                slot.pNuiSensor = NULL;
+            }
+
+            slot.isConnected = false;
+        }
+
+        /// <summary>
+        /// Counts a frame produced by a sensor. Runs on a worker thread.
+        /// </summary>
+        /// <param name="stream">stream the frame belongs to</param>
+        /// <param name="pLease">lease on the frame</param>
+        /// <param name="pContext">slot of the sensor</param>
+        template <typename Helper>
+        void CALLBACK KinectSensorManager<Helper>::CountFrame(FrameStream stream, FrameLease* pLease, void* pContext)
+        {
+            SensorSlot* pSlot = reinterpret_cast<SensorSlot*>(pContext);
+
+            switch (stream)
+            {
+            case FRAME_STREAM_COLOR:
+                InterlockedIncrement(&pSlot->colorFrameCount);
+                break;
+
+            case FRAME_STREAM_DEPTH:
+                InterlockedIncrement(&pSlot->depthFrameCount);
+                break;
+
+            case FRAME_STREAM_SKELETON:
+                InterlockedIncrement(&pSlot->skeletonFrameCount);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        /// <summary>
+        /// Counts a frame set consumed by a sensor's helper and hands it to the frame set
+        /// callback. Runs on a worker thread.
+        /// </summary>
+        /// <param name="pContext">slot of the sensor</param>
+        template <typename Helper>
+        void CALLBACK KinectSensorManager<Helper>::OnFrameSet(void* pContext)
+        {
+            SensorSlot* pSlot = reinterpret_cast<SensorSlot*>(pContext);
+            KinectSensorManager* pManager = pSlot->pManager;
+
+            InterlockedIncrement(&pSlot->frameSetCount);
+
+            if (pManager->m_frameSetCallback)
+            {
+                pManager->m_frameSetCallback(pSlot->index, pManager->m_pFrameSetContext);
+            }
+        }
+    }
+}
@@ -29,22 +29,25 @@ CMainWindow::CMainWindow() :
     m_hWndMain(NULL),
     m_hWndStatus(NULL),
     m_hStreamInfoFont(NULL),
+    m_pFrameSource(NULL),
+    m_frameHelper(*m_sensorManager.GetHelper(DISPLAYED_SENSOR_INDEX)),
     m_bIsColorPaused(false),
     m_colorResolution(NUI_IMAGE_RESOLUTION_INVALID),
+    m_colorFilterID(IDM_COLOR_FILTER_NOFILTER),
     m_bIsDepthPaused(false),
     m_bIsDepthNearMode(false),
+    m_bIsDepthForegroundOnly(false),
     m_depthResolution(NUI_IMAGE_RESOLUTION_INVALID),
+    m_depthFilterID(IDM_DEPTH_FILTER_NOFILTER),
+    m_processedColorResolution(NUI_IMAGE_RESOLUTION_INVALID),
+    m_processedDepthResolution(NUI_IMAGE_RESOLUTION_INVALID),
     m_bIsSkeletonSeatedMode(false),
     m_bIsSkeletonDrawColor(false),
     m_bIsSkeletonDrawDepth(false),
-    m_depthFilterID(IDM_DEPTH_FILTER_NOFILTER),
-    m_colorFilterID(IDM_COLOR_FILTER_NOFILTER),
     m_pColorBitmapBits(NULL),
     m_hColorBitmap(NULL),
     m_pDepthBitmapBits(NULL),
     m_hDepthBitmap(NULL),
-    m_hProcessStopEvent(NULL),
-    m_hProcessThread(NULL),
     m_hColorResolutionMutex(NULL),
     m_hDepthResolutionMutex(NULL),
     m_hColorBitmapMutex(NULL),
@@ -58,19 +61,10 @@ CMainWindow::CMainWindow() :
 /// </summary>
 CMainWindow::~CMainWindow()
 {
-    if (m_hProcessStopEvent)
-    {
-        // Signal processing thread to stop
-        SetEvent(m_hProcessStopEvent);
+    // Detach the sensors and stop the worker threads before the mutexes they use are closed
+    m_sensorManager.Stop();
 
-        if (m_hProcessThread)
-        {
-            WaitForSingleObject(m_hProcessThread, INFINITE);
-            CloseHandle(m_hProcessThread);
-        }
-
-        CloseHandle(m_hProcessStopEvent);
-    }
+    KINECTBRIDGE_PROFILE_REPORT(0);
 
     // Delete created handles and allocated data
     if (m_hDepthResolutionMutex)
@@ -141,19 +135,39 @@ int CMainWindow::Run(HINSTANCE hInstance, int nCmdShow)
     CreateColorImage();
     CreateDepthImage();
 
-    // Perform Kinect initialization
-    // If Kinect initialization succeeded, start the event processing thread
-    // that will update the screen with depth and color images
-    if (SUCCEEDED(CreateFirstConnected()))
+#ifdef KINECTBRIDGE_ENABLE_PROFILING
+    // Measure the depth plane filters once, at every depth resolution, before any frames arrive
+    Microsoft::KinectBridge::ReportDepthFilterCosts(DEPTH_FILTER_BENCHMARK_FRAME_COUNT);
+#endif
+
+    // Start the worker threads that acquire frames and update the screen with depth and
+    // color images, then perform Kinect initialization, with the frame source given on the
+    // command line if any
+    m_sensorManager.SetFrameSetCallback(&CMainWindow::FrameSetCallback, this);
+
+    HRESULT hr = m_sensorManager.Start();
+    if (SUCCEEDED(hr))
     {
-        // Create window processing thread
-        m_hProcessStopEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
-        m_hProcessThread = CreateThread(NULL, 0, ProcessThread, this, 0, NULL);
+        hr = ParseCommandLine();
+    }
 
-        NuiSetDeviceStatusCallback( &CMainWindow::StatusProc, this );
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateFirstConnected();
+
+        // Kinects plugged in later are attached as they arrive
+        if (!m_pFrameSource)
+        {
+            NuiSetDeviceStatusCallback( &CMainWindow::StatusProc, this );
+        }
     }
-    // If Kinect initialization failed, disable the menus
     else
+    {
+        SetStatusMessage(IDS_ERROR_KINECT_INIT);
+    }
+
+    // If Kinect initialization failed, disable the menus
+    if (FAILED(hr))
     {
         DisableMenus();
     }
@@ -297,6 +311,13 @@ LRESULT CALLBACK CMainWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam, LP
                     CheckMenuItem(hMenu, wmID, m_bIsDepthNearMode ? MF_CHECKED : MF_UNCHECKED);
                 }
                 break;
+            case IDM_DEPTH_FOREGROUND:
+                {
+                    m_bIsDepthForegroundOnly = !m_bIsDepthForegroundOnly;
+                    m_openCVHelper.SetDepthForegroundOnly(m_bIsDepthForegroundOnly);
+                    CheckMenuItem(hMenu, wmID, m_bIsDepthForegroundOnly ? MF_CHECKED : MF_UNCHECKED);
+                }
+                break;
             case IDM_DEPTH_RESOLUTION_320x240:
                 {
                     // Update instance variable for processing thread to see, using mutex for synchronization
@@ -320,6 +341,10 @@ LRESULT CALLBACK CMainWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam, LP
             case IDM_DEPTH_FILTER_DILATE:
             case IDM_DEPTH_FILTER_ERODE:
             case IDM_DEPTH_FILTER_CANNYEDGE:
+            case IDM_DEPTH_FILTER_BILATERAL:
+            case IDM_DEPTH_FILTER_FILLHOLES:
+            case IDM_DEPTH_FILTER_DESPECKLE:
+            case IDM_DEPTH_FILTER_TEMPORAL:
                 {
                     m_depthFilterID = wmID;
                     CheckMenuRadioItem(hMenu, DEPTH_FILTER_FIRST, DEPTH_FILTER_LAST, wmID, MF_BYCOMMAND);
@@ -353,6 +378,16 @@ LRESULT CALLBACK CMainWindow::WndProc(HWND hWnd, UINT message, WPARAM wParam, LP
                     CheckMenuItem(hMenu, wmID, m_bIsSkeletonDrawDepth ? MF_CHECKED : MF_UNCHECKED);
                 }
                 break;
+            case IDM_SKELETON_SMOOTHING_NONE:
+            case IDM_SKELETON_SMOOTHING_DEFAULT:
+            case IDM_SKELETON_SMOOTHING_LOWLATENCY:
+            case IDM_SKELETON_SMOOTHING_SMOOTH:
+                {
+                    // Takes effect from the next skeleton frame the acquisition thread produces
+                    m_frameHelper.SetSkeletonSmoothingProfile(static_cast<SkeletonSmoothingProfile>(wmID - SKELETON_SMOOTHING_FIRST));
+                    CheckMenuRadioItem(hMenu, SKELETON_SMOOTHING_FIRST, SKELETON_SMOOTHING_LAST, wmID, MF_BYCOMMAND);
+                }
+                break;
             default:
                 return DefWindowProc(hWnd, message, wParam, lParam);
             }
@@ -386,218 +421,376 @@ void CALLBACK CMainWindow::StatusProc(HRESULT hrStatus, const OLECHAR* instanceN
 {
     CMainWindow* window = reinterpret_cast<CMainWindow *>(pUserData);
 
-    // Check if the Kinect sensor who's status changed is the one the sample is currently connected to.
-    // Otherwise, we can ignore the status change. This check is done in case there are multiple Kinect sensors
-    // plugged into the machine.
-    // If the status change is not S_OK, then disable the menus.
-    BSTR deviceConnectionId = window->GetKinectDeviceConnectionId();
-
-    int compareResult = lstrcmp(instanceName, deviceConnectionId);
-    if (compareResult == 0 && FAILED(hrStatus))
+    // Attach the Kinect sensor if it was plugged in and detach it if it was unplugged. Only the
+    // displayed sensor affects the menus; the others just stream or stop streaming.
+    // If the displayed sensor's status is not S_OK, then disable the menus.
+    int sensorIndex = window->m_sensorManager.OnSensorStatusChanged(hrStatus, instanceName);
+    if (DISPLAYED_SENSOR_INDEX == sensorIndex)
     {
-        window->DisableMenus();
+        if (FAILED(hrStatus))
+        {
+            window->DisableMenus();
+        }
+        else
+        {
+            window->EnableMenus();
+            window->SetStatusMessage(IDS_STATUS_INITSUCCESS);
+        }
     }
-
 }
 
 /// <summary>
-/// Thread to handle Kinect processing, calls class instance thread processor
+/// Callback run by the sensor manager for each consumed frame set, redirects to the class handler
 /// </summary>
-/// <param name="lpParam">instance pointer</param>
-/// <returns>0</returns>
-DWORD WINAPI CMainWindow::ProcessThread(LPVOID lpParam)
+/// <param name="sensorIndex">index of the sensor the frame set is from</param>
+/// <param name="pContext">instance pointer</param>
+void CALLBACK CMainWindow::FrameSetCallback(int sensorIndex, void* pContext)
 {
-    // Use class instance thread processor
-    CMainWindow* pThis = reinterpret_cast<CMainWindow*>(lpParam);
-    return pThis->ProcessThread();
+    CMainWindow* pThis = reinterpret_cast<CMainWindow*>(pContext);
+    pThis->ProcessFrameSet(sensorIndex);
 }
 
 /// <summary>
-/// Thread to handle Kinect processing
+/// Filters and draws a consumed frame set. Runs on a worker thread of the sensor manager,
+/// which never runs two frame sets of the same sensor at once.
 /// </summary>
-/// <returns>0</returns>
-DWORD WINAPI CMainWindow::ProcessThread()
+/// <param name="sensorIndex">index of the sensor the frame set is from</param>
+void CMainWindow::ProcessFrameSet(int sensorIndex)
 {
-    // Store local copies of resolutions to check for changes
+    // Frame sets of the other sensors are consumed to keep their rings flowing, but not drawn
+    if (DISPLAYED_SENSOR_INDEX != sensorIndex)
+    {
+        return;
+    }
+
+    // Use mutexes to check for updates to the resolutions
+    WaitForSingleObject(m_hColorResolutionMutex, INFINITE);
     NUI_IMAGE_RESOLUTION colorResolution = m_colorResolution;
+    ReleaseMutex(m_hColorResolutionMutex);
+
+    WaitForSingleObject(m_hDepthResolutionMutex, INFINITE);
     NUI_IMAGE_RESOLUTION depthResolution = m_depthResolution;
+    ReleaseMutex(m_hDepthResolutionMutex);
 
-    // Initialize array of events to wait for
-    HANDLE hEvents[4] = {m_hProcessStopEvent, NULL, NULL, NULL};
-    int numEvents;
-    if (m_frameHelper.IsInitialized())
-    {
-        m_frameHelper.GetColorHandle(hEvents + 1);
-        m_frameHelper.GetDepthHandle(hEvents + 2);
-        m_frameHelper.GetSkeletonHandle(hEvents + 3);
-        numEvents = 4;
-    }
-    else
+    // Reopen streams whose resolution changed. The frame set at hand has the old resolution, so it is dropped.
+    if (colorResolution != m_processedColorResolution || depthResolution != m_processedDepthResolution)
     {
-        numEvents = 1;
-    }
+        // Stop painting while the streams are reopened. The helper stops pulling frames itself.
+        WaitForSingleObject(m_hPaintWindowMutex, INFINITE);
 
-    // Main update loop
-    bool continueProcessing = true;
-    while (continueProcessing)
-    {
-        // Use a mutex to check for update to color resolution
-        WaitForSingleObject(m_hColorResolutionMutex, INFINITE);
-        NUI_IMAGE_RESOLUTION newColorResolution = m_colorResolution;
-        ReleaseMutex(m_hColorResolutionMutex);
+        HRESULT hrColor = S_OK;
+        if (colorResolution != m_processedColorResolution)
+        {
+            hrColor = m_frameHelper.SetColorFrameResolution(colorResolution);
+        }
 
-        // Reopen color image stream if necessary
-        if (colorResolution != newColorResolution)
+        HRESULT hrDepth = S_OK;
+        if (depthResolution != m_processedDepthResolution)
         {
-            // Stop painting while we change resolution
-            WaitForSingleObject(m_hPaintWindowMutex, INFINITE);
+            hrDepth = m_frameHelper.SetDepthFrameResolution(depthResolution);
+        }
 
-            colorResolution = newColorResolution;
+        // Start painting again
+        ReleaseMutex(m_hPaintWindowMutex);
 
-            HRESULT hr = m_frameHelper.SetColorFrameResolution(colorResolution);
-            if (FAILED(hr))
-            {
-                SetStatusMessage(IDS_ERROR_KINECT_COLOR);
-            }
+        if (FAILED(hrColor))
+        {
+            SetStatusMessage(IDS_ERROR_KINECT_COLOR);
+        }
 
-            // Start painting again
-            ReleaseMutex(m_hPaintWindowMutex);
+        if (FAILED(hrDepth))
+        {
+            SetStatusMessage(IDS_ERROR_KINECT_DEPTH);
+        }
+
+        // Resize images. The reopened streams start a new frame numbering.
+        if (colorResolution != m_processedColorResolution)
+        {
+            m_processedColorResolution = colorResolution;
 
             ResizeWindow();
             CreateColorImage();
+            m_colorFrameRateTracker.Reset();
         }
 
-        // Use a mutex to check for update to depth resolution
-        WaitForSingleObject(m_hDepthResolutionMutex, INFINITE);
-        NUI_IMAGE_RESOLUTION newDepthResolution = m_depthResolution;
-        ReleaseMutex(m_hDepthResolutionMutex);
-
-        // Reopen depth image stream if necessary
-        if (depthResolution != newDepthResolution)
+        if (depthResolution != m_processedDepthResolution)
         {
-            // Stop painting while we change resolution
-            WaitForSingleObject(m_hPaintWindowMutex, INFINITE);
-
-            depthResolution = newDepthResolution;
-
-            HRESULT hr = m_frameHelper.SetDepthFrameResolution(depthResolution);
-            if (FAILED(hr))
-            {
-                SetStatusMessage(IDS_ERROR_KINECT_DEPTH);
-            }
-
-            // Start painting again
-            ReleaseMutex(m_hPaintWindowMutex);
+            m_processedDepthResolution = depthResolution;
 
             ResizeWindow();
             CreateDepthImage();
+            m_depthFrameRateTracker.Reset();
         }
 
-        // Wait for any event to be signalled
-        int eventId = WaitForMultipleObjects(numEvents, hEvents, FALSE, 100);
+        return;
+    }
 
-        // No events were signalled in time
-        if (WAIT_TIMEOUT == eventId)
-        {
-            continue;
-        }
+    // Draw the frame set, timing the whole of it as one stage
+    {
+        KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_PROCESS_FRAME_SET);
 
-        // Stop event was signalled
-        if (WAIT_OBJECT_0 == eventId)
+        // Get skeleton frame, drawing no skeletons if there is none
+        NUI_SKELETON_FRAME skeletonFrame;
+        ZeroMemory(&skeletonFrame, sizeof(skeletonFrame));
+        if ((m_bIsSkeletonDrawDepth && !m_bIsDepthPaused) || (m_bIsSkeletonDrawColor && !m_bIsColorPaused)) 
         {
-            continueProcessing = false;
-            break;
+            m_frameHelper.GetSkeletonFrame(&skeletonFrame);
         }
 
-        // Update image outputs
-        if (m_frameHelper.IsInitialized()) 
+        // Update color frame
+        if (!m_bIsColorPaused) 
         {
-            // Update skeleton frame
-            NUI_SKELETON_FRAME skeletonFrame;
-            if (((m_bIsSkeletonDrawDepth && !m_bIsDepthPaused) || (m_bIsSkeletonDrawColor && !m_bIsColorPaused))
-                && SUCCEEDED(m_frameHelper.UpdateSkeletonFrame())) 
+            Microsoft::KinectBridge::FrameLease* pColorLease = NULL;
+            if (m_colorFilterID == IDM_COLOR_FILTER_NOFILTER && !m_bIsSkeletonDrawColor
+                && SUCCEEDED(m_frameHelper.GetColorFrameLease(&pColorLease)))
             {
-                m_frameHelper.GetSkeletonFrame(&skeletonFrame);
-            }
+                // Nothing is drawn over the frame, so the bitmap can be updated straight from the sensor's buffer
+                Mat colorView;
+                HRESULT hr;
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_CONVERT);
+                    hr = m_frameHelper.GetColorImageView(pColorLease, &colorView);
+                }
+                if (SUCCEEDED(hr))
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_UPDATE_BITMAP);
+                    WaitForSingleObject(m_hColorBitmapMutex, INFINITE);
+                    UpdateBitmap(&colorView, &m_hColorBitmap, &m_bmiColor);
+                    ReleaseMutex(m_hColorBitmapMutex);
+                }
 
-            // Update color frame
-            if (!m_bIsColorPaused && SUCCEEDED(m_frameHelper.UpdateColorFrame())) 
-            {
-                HRESULT hr = m_frameHelper.GetColorImage(&m_colorMat);
+                pColorLease->Release();
                 if (FAILED(hr))
                 {
-                    continue;
+                    return;
                 }
+            }
+            else
+            {
+                HRESULT hr;
+                if (m_colorFilterID == IDM_COLOR_FILTER_CANNYEDGE && SUCCEEDED(m_frameHelper.GetColorFrameLease(&pColorLease)))
+                {
+                    // Edges are found straight from the sensor's buffer and drawn into the color image in one pass
+                    Mat colorView;
+                    {
+                        KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_CONVERT);
+                        hr = m_frameHelper.GetColorImageView(pColorLease, &colorView);
+                    }
+                    if (SUCCEEDED(hr))
+                    {
+                        KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_FILTER);
+                        hr = m_openCVHelper.DetectColorEdges(colorView, &m_colorMat);
+                    }
 
-                // Apply filter to color stream
-                hr = m_openCVHelper.ApplyColorFilter(&m_colorMat);
-                if (FAILED(hr))
+                    pColorLease->Release();
+                    if (FAILED(hr))
+                    {
+                        return;
+                    }
+                }
+                else
                 {
-                    continue;
+                    {
+                        KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_CONVERT);
+                        hr = m_frameHelper.GetColorImage(&m_colorMat);
+                    }
+                    if (FAILED(hr))
+                    {
+                        return;
+                    }
+
+                    // Apply filter to color stream
+                    {
+                        KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_FILTER);
+                        hr = m_openCVHelper.ApplyColorFilter(&m_colorMat);
+                    }
+                    if (FAILED(hr))
+                    {
+                        return;
+                    }
                 }
 
                 // Draw skeleton onto color stream
                 if (m_bIsSkeletonDrawColor) 
                 {
-                    hr = m_openCVHelper.DrawSkeletonsInColorImage(&m_colorMat, &skeletonFrame, colorResolution, depthResolution);
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_DRAW_SKELETONS);
+                    hr = m_openCVHelper.DrawSkeletonsInColorImage(&m_colorMat, &skeletonFrame, m_processedColorResolution, m_processedDepthResolution);
                     if (FAILED(hr))
                     {
-                        continue;
+                        return;
                     }
                 }
 
                 // Update bitmap for drawing
+                KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_COLOR_UPDATE_BITMAP);
                 WaitForSingleObject(m_hColorBitmapMutex, INFINITE);
                 UpdateBitmap(&m_colorMat, &m_hColorBitmap, &m_bmiColor);
                 ReleaseMutex(m_hColorBitmapMutex);
+            }
 
-                // Notify frame rate tracker that new frame has been rendered
-                m_colorFrameRateTracker.Tick();
+            // Notify frame rate tracker that new frame has been rendered, so it can spot gaps in the frame numbers
+            Microsoft::KinectBridge::FrameLease* pTickLease = NULL;
+            if (SUCCEEDED(m_frameHelper.GetColorFrameLease(&pTickLease)))
+            {
+                m_colorFrameRateTracker.Tick(pTickLease->GetFrameNumber());
+                pTickLease->Release();
             }
+        }
 
-            // Update depth frame
-            if (!m_bIsDepthPaused && SUCCEEDED(m_frameHelper.UpdateDepthFrame())) 
+        // Update depth frame
+        if (!m_bIsDepthPaused) 
+        {
+            HRESULT hr;
+            int depthFilterID = m_depthFilterID;
+            bool isTemporal = (depthFilterID == IDM_DEPTH_FILTER_TEMPORAL);
+            Microsoft::KinectBridge::DepthPlaneFilter planeFilter;
+            bool isPlaneFiltered = isTemporal || OpenCVHelper::GetDepthPlaneFilter(depthFilterID, &planeFilter);
+            bool isForegroundOnly = m_bIsDepthForegroundOnly;
+
+            // The depth plane filters and the background model read the depths in millimeters, where invalid pixels can still be told apart
+            if (isPlaneFiltered || isForegroundOnly)
             {
-                HRESULT hr = m_frameHelper.GetDepthImageAsArgb(&m_depthMat);
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_CONVERT);
+                    hr = m_frameHelper.GetDepthPlanes(&m_depthPlane, &m_playerPlane);
+                }
                 if (FAILED(hr))
                 {
-                    continue;
+                    return;
                 }
+            }
 
-                // Apply filter to depth stream
-                hr = m_openCVHelper.ApplyDepthFilter(&m_depthMat);
+            // The background model learns from every frame while it is on, whichever filter is active
+            if (isForegroundOnly)
+            {
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_BACKGROUND);
+                    hr = m_openCVHelper.FindDepthForeground(m_depthPlane, &m_foregroundRegions, &m_foregroundBoxes, &m_foregroundMask);
+                }
+
+                // Turn only the foreground regions into points, to tell how far away each box is
+                if (SUCCEEDED(hr))
+                {
+                    m_pointsX.create(m_depthPlane.size(), CV_32F);
+                    m_pointsY.create(m_depthPlane.size(), CV_32F);
+                    m_pointsZ.create(m_depthPlane.size(), CV_32F);
+                    m_pointMask.create(m_depthPlane.size(), CV_8U);
+                    hr = m_frameHelper.GetDepthPointCloud(&m_pointsX, &m_pointsY, &m_pointsZ, &m_pointMask, &m_foregroundRegions);
+                }
+
+                // The regions cover whole tiles, so drop the points of background pixels in them
+                if (SUCCEEDED(hr))
+                {
+                    bitwise_and(m_pointMask, m_foregroundMask, m_pointMask);
+                }
                 if (FAILED(hr))
                 {
-                    continue;
+                    return;
                 }
+            }
 
-                // Draw skeleton onto depth stream
-                if (m_bIsSkeletonDrawDepth)
+            if (isPlaneFiltered)
+            {
+                // Filter the depths in millimeters, then colorize them
                 {
-                    hr = m_openCVHelper.DrawSkeletonsInDepthImage(&m_depthMat, &skeletonFrame, depthResolution);
-                    if (FAILED(hr))
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_FILTER);
+                    if (isTemporal)
                     {
-                        continue;
+                        // The temporal filter keeps a history of every pixel, so it always filters the whole frame
+                        hr = m_openCVHelper.ApplyTemporalDepthFilter(m_depthPlane, m_playerPlane, &m_filteredDepthPlane);
                     }
+                    else
+                    {
+                        hr = m_frameHelper.FilterDepthPlane(planeFilter, m_depthPlane, m_playerPlane, &m_filteredDepthPlane,
+                            isForegroundOnly ? &m_foregroundRegions : NULL);
+                    }
+
+                    if (SUCCEEDED(hr))
+                    {
+                        hr = m_frameHelper.ColorizeDepthPlanes(m_filteredDepthPlane, m_playerPlane, &m_depthMat);
+                    }
+                }
+                if (FAILED(hr))
+                {
+                    return;
+                }
+            }
+            else
+            {
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_CONVERT);
+                    hr = m_frameHelper.GetDepthImageAsArgb(&m_depthMat);
+                }
+                if (FAILED(hr))
+                {
+                    return;
                 }
 
-                // Update bitmap for drawing
+                // Apply filter to depth stream
+                {
+                    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_FILTER);
+                    hr = m_openCVHelper.ApplyDepthFilter(&m_depthMat);
+                }
+                if (FAILED(hr))
+                {
+                    return;
+                }
+            }
+
+            // Draw the foreground boxes onto depth stream, labeled with how far away they are
+            if (isForegroundOnly)
+            {
+                KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_BACKGROUND);
+                hr = m_openCVHelper.DrawForegroundBoxes(&m_depthMat, m_foregroundBoxes);
+                if (SUCCEEDED(hr))
+                {
+                    hr = m_openCVHelper.DrawForegroundDistances(&m_depthMat, m_foregroundBoxes, m_pointsZ, m_pointMask);
+                }
+                if (FAILED(hr))
+                {
+                    return;
+                }
+            }
+
+            // Draw skeleton onto depth stream
+            if (m_bIsSkeletonDrawDepth)
+            {
+                KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_DRAW_SKELETONS);
+                hr = m_openCVHelper.DrawSkeletonsInDepthImage(&m_depthMat, &skeletonFrame, m_processedDepthResolution);
+                if (FAILED(hr))
+                {
+                    return;
+                }
+            }
+
+            // Update bitmap for drawing
+            {
+                KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_UPDATE_BITMAP);
                 WaitForSingleObject(m_hDepthBitmapMutex, INFINITE);
                 UpdateBitmap(&m_depthMat, &m_hDepthBitmap, &m_bmiDepth);
                 ReleaseMutex(m_hDepthBitmapMutex);
-
-                // Notify frame rate tracker that new frame has been rendered
-                m_depthFrameRateTracker.Tick();
             }
 
-            // Tell the window to paint the new bitmap
-            WaitForSingleObject(m_hPaintWindowMutex, INFINITE);
-            InvalidateRect(m_hWndMain, NULL, false);
-            ReleaseMutex(m_hPaintWindowMutex);
+            // Notify frame rate tracker that new frame has been rendered, so it can spot gaps in the frame numbers
+            Microsoft::KinectBridge::FrameLease* pTickLease = NULL;
+            if (SUCCEEDED(m_frameHelper.GetDepthFrameLease(&pTickLease)))
+            {
+                m_depthFrameRateTracker.Tick(pTickLease->GetFrameNumber());
+                pTickLease->Release();
+            }
         }
+
+        // Tell the window to paint the new bitmap
+        WaitForSingleObject(m_hPaintWindowMutex, INFINITE);
+        InvalidateRect(m_hWndMain, NULL, false);
+        ReleaseMutex(m_hPaintWindowMutex);
     }
 
-    return 0;
+    // Write stage latencies to the debugger output now and then
+    KINECTBRIDGE_PROFILE_REPORT(PROFILE_REPORT_INTERVAL_MILLIS);
+#ifdef KINECTBRIDGE_ENABLE_PROFILING
+    m_openCVHelper.ReportFilterCosts(PROFILE_REPORT_INTERVAL_MILLIS);
+#endif
 }
 
 /// <summary>
@@ -699,6 +892,8 @@ void CMainWindow::ResizeWindow()
 /// </summary>
 void CMainWindow::PaintWindow()
 {   
+    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_PAINT);
+
     WaitForSingleObject(m_hPaintWindowMutex, INFINITE);
 
     // Determine dimensions of window
@@ -717,7 +912,9 @@ void CMainWindow::PaintWindow()
 
     // Get color stream information text
     WaitForSingleObject(m_hColorResolutionMutex, INFINITE);
-    wstring colorStreamInfoText = GenerateStreamInformation(m_colorResolution, m_colorFilterID, m_colorFrameRateTracker.CurrentFPS());
+    FrameTimingStatistics colorFrameTiming;
+    m_colorFrameRateTracker.GetStatistics(&colorFrameTiming);
+    wstring colorStreamInfoText = GenerateStreamInformation(m_colorResolution, m_colorFilterID, colorFrameTiming);
     ReleaseMutex(m_hColorResolutionMutex);
 
     // Paint color bitmap
@@ -732,7 +929,9 @@ void CMainWindow::PaintWindow()
 
     // Get depth stream information text
     WaitForSingleObject(m_hDepthResolutionMutex, INFINITE);
-    wstring depthStreamInfoText = GenerateStreamInformation(m_depthResolution, m_depthFilterID, m_depthFrameRateTracker.CurrentFPS());
+    FrameTimingStatistics depthFrameTiming;
+    m_depthFrameRateTracker.GetStatistics(&depthFrameTiming);
+    wstring depthStreamInfoText = GenerateStreamInformation(m_depthResolution, m_depthFilterID, depthFrameTiming);
     ReleaseMutex(m_hDepthResolutionMutex);
 
     // Paint depth bitmap
@@ -778,33 +977,54 @@ void CMainWindow::InitSettings(HMENU hMenu)
 {
     // Set default color resolution, checking the appropriate radio buttons
     m_colorResolution = NUI_IMAGE_RESOLUTION_640x480;
+    m_processedColorResolution = m_colorResolution;
     m_frameHelper.SetColorFrameResolution(m_colorResolution);
     CheckMenuRadioItem(hMenu, COLOR_RESOLUTION_FIRST, COLOR_RESOLUTION_LAST, IDM_COLOR_RESOLUTION_640x480, MF_BYCOMMAND);
 
     // Set default depth resolution, checking the appropriate radio buttons
     m_depthResolution = NUI_IMAGE_RESOLUTION_640x480;
+    m_processedDepthResolution = m_depthResolution;
     m_frameHelper.SetDepthFrameResolution(m_depthResolution);
     CheckMenuRadioItem(hMenu, DEPTH_RESOLUTION_FIRST, DEPTH_RESOLUTION_LAST, IDM_DEPTH_RESOLUTION_640x480, MF_BYCOMMAND);
 
     // Check default filter radio buttons
     CheckMenuRadioItem(hMenu, COLOR_FILTER_FIRST, COLOR_FILTER_LAST, IDM_COLOR_FILTER_NOFILTER, MF_BYCOMMAND);
     CheckMenuRadioItem(hMenu, DEPTH_FILTER_FIRST, DEPTH_FILTER_LAST, IDM_DEPTH_FILTER_NOFILTER, MF_BYCOMMAND);
+
+    // Set default skeleton smoothing, checking the appropriate radio button
+    m_frameHelper.SetSkeletonSmoothingProfile(SKELETON_SMOOTHING_PROFILE_DEFAULT);
+    CheckMenuRadioItem(hMenu, SKELETON_SMOOTHING_FIRST, SKELETON_SMOOTHING_LAST, IDM_SKELETON_SMOOTHING_DEFAULT, MF_BYCOMMAND);
 }
 
 /// <summary>
-/// Initializes the first available Kinect found
+/// Attaches the frame source picked on the command line, or every Kinect found, the
+/// first of which is displayed
 /// </summary>
 /// <returns>S_OK if successful, E_FAIL otherwise</returns>
 HRESULT CMainWindow::CreateFirstConnected()
 {
     // If Kinect is already initialized, return
-    if (m_frameHelper.IsInitialized()) 
+    if (m_sensorManager.IsSensorConnected(DISPLAYED_SENSOR_INDEX)) 
     {
         return S_OK;
     }
 
     HRESULT hr;
 
+    // Use the frame source picked on the command line instead of a sensor
+    if (m_pFrameSource)
+    {
+        hr = m_sensorManager.AddFrameSource(m_pFrameSource, WORK_PRIORITY_HIGH, NULL);
+        if (SUCCEEDED(hr))
+        {
+            SetStatusMessage(IDS_STATUS_INITSUCCESS);
+            return S_OK;
+        }
+
+        SetStatusMessage(IDS_ERROR_KINECT_INIT);
+        return hr;
+    }
+
     // Get number of Kinect sensors
     int sensorCount = 0;
     hr = NuiGetSensorCount(&sensorCount);
@@ -820,31 +1040,70 @@ HRESULT CMainWindow::CreateFirstConnected()
         return E_FAIL;
     }
 
-    // Iterate through Kinect sensors until one is successfully initialized
-    for (int i = 0; i < sensorCount; ++i) 
+    // Attach every Kinect sensor that can be initialized. The first one lands in the displayed
+    // slot; the others stream into helpers of their own in the background.
+    int connectedCount = 0;
+    hr = m_sensorManager.ConnectAllSensors(WORK_PRIORITY_LOW, &connectedCount);
+    if (SUCCEEDED(hr) && m_sensorManager.IsSensorConnected(DISPLAYED_SENSOR_INDEX))
     {
-        INuiSensor* sensor = NULL;
-        hr = NuiCreateSensorByIndex(i, &sensor);
-        if (SUCCEEDED(hr))
+        // Serve the displayed sensor before the others
+        m_sensorManager.SetSensorPriority(DISPLAYED_SENSOR_INDEX, WORK_PRIORITY_HIGH);
+
+        // Report success
+        SetStatusMessage(IDS_STATUS_INITSUCCESS);
+        return S_OK;
+    }
+
+    // Report failure
+    SetStatusMessage(IDS_ERROR_KINECT_INIT);
+    return E_FAIL;
+}
+
+/// <summary>
+/// Applies the command line switches: -synthetic plays a generated scene instead of
+/// using a Kinect, -replay &lt;file&gt; plays a recording, -record &lt;file&gt; records
+/// every frame received and -largepages backs frame buffers with large pages
+/// </summary>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT CMainWindow::ParseCommandLine()
+{
+    int argCount = 0;
+    LPWSTR* args = CommandLineToArgvW(GetCommandLineW(), &argCount);
+    if (!args)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    for (int i = 1; i < argCount && SUCCEEDED(hr); ++i)
+    {
+        if (0 == _wcsicmp(args[i], L"-synthetic"))
         {
-            hr = m_frameHelper.Initialize(sensor);
-            if (SUCCEEDED(hr)) 
-            {
-                // Report success
-                SetStatusMessage(IDS_STATUS_INITSUCCESS);
-                return S_OK;
-            }
-            else
+            m_pFrameSource = &m_syntheticFrameSource;
+        }
+        else if (0 == _wcsicmp(args[i], L"-replay") && i + 1 < argCount)
+        {
+            hr = m_replayFrameSource.Open(args[++i]);
+            m_pFrameSource = &m_replayFrameSource;
+        }
+        else if (0 == _wcsicmp(args[i], L"-record") && i + 1 < argCount)
+        {
+            hr = m_frameRecorder.Open(args[++i]);
+            if (SUCCEEDED(hr))
             {
-                // Uninitialize KinectHelper to show that Kinect is not ready
-                m_frameHelper.UnInitialize();
+                m_frameHelper.SetFrameRecorder(&m_frameRecorder);
             }
         }
+        else if (0 == _wcsicmp(args[i], L"-largepages"))
+        {
+            // Without the lock pages in memory privilege the pool keeps using ordinary pages
+            FrameBufferPool::GetSharedPool()->EnableLargePages();
+        }
     }
 
-    // Report failure
-    SetStatusMessage(IDS_ERROR_KINECT_INIT);
-    return E_FAIL;
+    LocalFree(args);
+
+    return hr;
 }
 
 /// <summary>
@@ -888,6 +1147,9 @@ HRESULT CMainWindow::CreateDepthImage()
 
     Size size(width, height);
     m_depthMat.create(size, m_frameHelper.DEPTH_RGB_TYPE);
+    m_depthPlane.create(size, CV_16U);
+    m_playerPlane.create(size, CV_8U);
+    m_filteredDepthPlane.create(size, CV_16U);
 
     // Create the bitmap
     WaitForSingleObject(m_hDepthBitmapMutex, INFINITE);
@@ -1010,10 +1272,20 @@ void CMainWindow::DisableMenus()
         EnableMenuItem(hMenu, i, MF_BYPOSITION | MF_GRAYED);
     }
 
-    // Signal processing thread to stop
-    if (m_hProcessStopEvent)
+    DrawMenuBar(m_hWndMain);
+    InvalidateRect(m_hWndMain, NULL, false);
+}
+
+/// <summary>
+/// Enable the menus at the top of the window
+/// </summary>
+void CMainWindow::EnableMenus()
+{
+    HMENU hMenu = GetMenu(m_hWndMain);
+
+    for (int i = 0; i < GetMenuItemCount(hMenu); ++i)
     {
-        SetEvent(m_hProcessStopEvent);
+        EnableMenuItem(hMenu, i, MF_BYPOSITION | MF_ENABLED);
     }
 
     DrawMenuBar(m_hWndMain);
@@ -1109,6 +1381,22 @@ wstring CMainWindow::FilterIDToString(int filterID)
         text += _TEXT("Canny Edge");
         break;
 
+    case IDM_DEPTH_FILTER_BILATERAL:
+        text += _TEXT("Bilateral");
+        break;
+
+    case IDM_DEPTH_FILTER_FILLHOLES:
+        text += _TEXT("Fill Holes");
+        break;
+
+    case IDM_DEPTH_FILTER_DESPECKLE:
+        text += _TEXT("Remove Speckles");
+        break;
+
+    case IDM_DEPTH_FILTER_TEMPORAL:
+        text += _TEXT("Temporal");
+        break;
+
     default:
         text += _TEXT("Unknown");
         break;
@@ -1118,14 +1406,17 @@ wstring CMainWindow::FilterIDToString(int filterID)
 }
 
 /// <summary>
-/// Converts a given frame rate into a string
+/// Converts the frame pacing of a stream into a string
 /// </summary>
-/// <param name="value">frame rate to convert into string</param>
-wstring CMainWindow::FrameRateToString(double frameRate)
+/// <param name="frameTiming">frame pacing to convert into string</param>
+wstring CMainWindow::FrameTimingToString(const FrameTimingStatistics& frameTiming)
 {
     wostringstream stream;
-    stream << frameRate;
-    return _TEXT("FPS: ") + stream.str();
+    stream << fixed << setprecision(1);
+    stream << _TEXT("FPS: ") << frameTiming.meanFps << _TEXT(" (now ") << frameTiming.instantaneousFps << _TEXT(")");
+    stream << _TEXT("\r\nJitter: ") << frameTiming.jitterMillis << _TEXT(" ms, worst gap: ") << frameTiming.worstGapMillis << _TEXT(" ms");
+    stream << _TEXT("\r\nDropped: ") << frameTiming.droppedFrameCount;
+    return stream.str();
 }
 
 /// <summary>
@@ -1133,22 +1424,12 @@ wstring CMainWindow::FrameRateToString(double frameRate)
 /// </summary>
 /// <param name="resolution">resolution of images coming from stream</param>
 /// <param name="filterID">id of the filter being applied to stream</param>
-/// <param name="frameRate">actual frame rate of stream after filtering is applied</param>
-wstring CMainWindow::GenerateStreamInformation(NUI_IMAGE_RESOLUTION resolution, int filterID, double frameRate)
+/// <param name="frameTiming">actual frame pacing of stream after filtering is applied</param>
+wstring CMainWindow::GenerateStreamInformation(NUI_IMAGE_RESOLUTION resolution, int filterID, const FrameTimingStatistics& frameTiming)
 {
     wstring streamInfoText = NuiImageResolutionToString(resolution);
     streamInfoText += _TEXT("\r\n") + FilterIDToString(filterID);
-    streamInfoText += _TEXT("\r\n") + FrameRateToString(frameRate);
+    streamInfoText += _TEXT("\r\n") + FrameTimingToString(frameTiming);
 
     return streamInfoText;
-}
-
-/// <summary>
-/// Computes framerate based on the interval between two timings taken with clock()
-/// </summary>
-/// <param name="startClock">starting clock value of interval</param>
-/// <param name="endClock">ending clock value of interval</param>
-double CMainWindow::CalculateFrameRate(clock_t startClock, clock_t endClock)
-{
-    return floor(1 / ((endClock - startClock) / static_cast<double>(CLOCKS_PER_SEC) ));
 }
\ No newline at end of file
@@ -12,13 +12,18 @@
 #include <CommCtrl.h>
 #include <string>
 #include <sstream>
+#include <iomanip>
 #include "time.h"
 #include "math.h"
 
 #include <NuiApi.h>
 
 #include "OpenCVHelper.h"
+#include "KinectSensorManager.h"
 #include "FrameRateTracker.h"
+#include "PipelineProfiler.h"
+#include "SyntheticFrameSource.h"
+#include "ReplayFrameSource.h"
 
 class CMainWindow
 {
@@ -35,7 +40,11 @@ class CMainWindow
     static const int COLOR_FILTER_LAST = IDM_COLOR_FILTER_CANNYEDGE;
 
     static const int DEPTH_FILTER_FIRST = IDM_DEPTH_FILTER_NOFILTER;
-    static const int DEPTH_FILTER_LAST = IDM_DEPTH_FILTER_CANNYEDGE;
+    static const int DEPTH_FILTER_LAST = IDM_DEPTH_FILTER_TEMPORAL;
+
+    // First and last menu item identifiers for skeleton smoothing radio buttons, in SkeletonSmoothingProfile order
+    static const int SKELETON_SMOOTHING_FIRST = IDM_SKELETON_SMOOTHING_NONE;
+    static const int SKELETON_SMOOTHING_LAST = IDM_SKELETON_SMOOTHING_SMOOTH;
 
 	// Font size in points of the stream information
 	static const int STREAM_INFO_TEXT_POINT_SIZE = 10;
@@ -44,6 +53,15 @@ class CMainWindow
 	static const int BITMAP_VERTICAL_BORDER_PADDING = 10;
 	static const int MENU_BAR_HORIZONTAL_BORDER_PADDING = 5;
 
+	// Milliseconds between stage latency reports when profiling is compiled in
+	static const DWORD PROFILE_REPORT_INTERVAL_MILLIS = 10000;
+
+	// Times each depth plane filter is run per resolution when measuring their costs at startup
+	static const UINT DEPTH_FILTER_BENCHMARK_FRAME_COUNT = 30;
+
+    // Sensor whose streams are displayed. Other sensors plugged in are streamed at a lower priority.
+    static const int DISPLAYED_SENSOR_INDEX = 0;
+
 public:
     // Functions:
     /// <summary>
@@ -102,17 +120,17 @@ private:
 	static void CALLBACK StatusProc(HRESULT hrStatus, const OLECHAR* instanceName, const OLECHAR* uniqueDeviceName, void * pUserData);
 
     /// <summary>
-    /// Thread to handle Kinect processing, calls class instance thread processor
+    /// Callback run by the sensor manager for each consumed frame set, redirects to the class handler
     /// </summary>
-    /// <param name="lpParam">instance pointer</param>
-    /// <returns>0</returns>
-    static DWORD WINAPI ProcessThread(LPVOID lpParam);
+    /// <param name="sensorIndex">index of the sensor the frame set is from</param>
+    /// <param name="pContext">instance pointer</param>
+    static void CALLBACK FrameSetCallback(int sensorIndex, void* pContext);
 
     /// <summary>
-    /// Thread to handle Kinect processing
+    /// Filters and draws a consumed frame set. Runs on a worker thread of the sensor manager.
     /// </summary>
-    /// <returns>0</returns>
-    DWORD WINAPI ProcessThread();
+    /// <param name="sensorIndex">index of the sensor the frame set is from</param>
+    void ProcessFrameSet(int sensorIndex);
 
     /// <summary>
     /// Creates the main and status bar windows
@@ -138,11 +156,20 @@ private:
     void InitSettings(HMENU hMenu);
 
     /// <summary>
-    /// Initializes the first available Kinect found
+    /// Attaches the frame source picked on the command line, or every Kinect found, the
+    /// first of which is displayed
     /// </summary>
     /// <returns>S_OK if successful, E_FAIL otherwise</returns>
     HRESULT CreateFirstConnected();
 
+    /// <summary>
+    /// Applies the command line switches: -synthetic plays a generated scene instead of
+    /// using a Kinect, -replay &lt;file&gt; plays a recording, -record &lt;file&gt; records
+    /// every frame received and -largepages backs frame buffers with large pages
+    /// </summary>
+    /// <returns>S_OK if successful, an error code otherwise</returns>
+    HRESULT ParseCommandLine();
+
     /// <summary>
     /// Initializes the color bitmap and OpenCV matrix
     /// </summary>
@@ -196,6 +223,11 @@ private:
 	/// </summary>
 	void DisableMenus();
 
+	/// <summary>
+	/// Enable the menus at the top of the window
+	/// </summary>
+	void EnableMenus();
+
 	/// <summary>
     /// Creates a font handle for the font used in the stream information text
     /// </summary>
@@ -214,25 +246,18 @@ private:
 	std::wstring FilterIDToString(int filterID);
 
 	/// <summary>
-    /// Converts a given frame rate into a string
+    /// Converts the frame pacing of a stream into a string
     /// </summary>
-    /// <param name="value">frame rate to convert into string</param>
-	std::wstring FrameRateToString(double frameRate);
+    /// <param name="frameTiming">frame pacing to convert into string</param>
+	std::wstring FrameTimingToString(const FrameTimingStatistics& frameTiming);
 
 	/// <summary>
     /// Generates a string containing stream information from the given parameters
     /// </summary>
     /// <param name="resolution">resolution of images coming from stream</param>
 	/// <param name="filterID">id of the filter being applied to stream</param>
-	/// <param name="frameRate">actual frame rate of stream after filtering is applied</param>
-	std::wstring GenerateStreamInformation(NUI_IMAGE_RESOLUTION resolution, int filterID, double frameRate);
-
-	/// <summary>
-    /// Computes framerate based on the interval between two timings taken with clock()
-    /// </summary>
-    /// <param name="startClock">starting clock value of interval</param>
-	/// <param name="endClock">ending clock value of interval</param>
-	double CalculateFrameRate(clock_t startClock, clock_t endClock);
+	/// <param name="frameTiming">actual frame pacing of stream after filtering is applied</param>
+	std::wstring GenerateStreamInformation(NUI_IMAGE_RESOLUTION resolution, int filterID, const FrameTimingStatistics& frameTiming);
 
     // Variables:
     // Program information
@@ -242,8 +267,17 @@ private:
     HWND m_hWndStatus;                          // Status bar
 	HFONT m_hStreamInfoFont;					// Font for the stream info text
 
+    // Frame sources picked on the command line, which must outlive the frame helper
+    Microsoft::KinectBridge::SyntheticFrameSource m_syntheticFrameSource;
+    Microsoft::KinectBridge::ReplayFrameSource m_replayFrameSource;
+    Microsoft::KinectBridge::IFrameSource* m_pFrameSource;
+    Microsoft::KinectBridge::FrameRecorder m_frameRecorder;
+
+    // Sensors, and the helper of the displayed sensor
+    Microsoft::KinectBridge::KinectSensorManager<Microsoft::KinectBridge::OpenCVFrameHelper> m_sensorManager;
+    Microsoft::KinectBridge::OpenCVFrameHelper& m_frameHelper;
+
     // Helpers
-    Microsoft::KinectBridge::OpenCVFrameHelper m_frameHelper;
     OpenCVHelper m_openCVHelper;
 
     // App settings
@@ -253,9 +287,14 @@ private:
 
     bool m_bIsDepthPaused;
     bool m_bIsDepthNearMode;
+    bool m_bIsDepthForegroundOnly;
     NUI_IMAGE_RESOLUTION m_depthResolution;
 	int m_depthFilterID;
 
+    // Resolutions the displayed sensor's streams were last opened with, only used by ProcessFrameSet
+    NUI_IMAGE_RESOLUTION m_processedColorResolution;
+    NUI_IMAGE_RESOLUTION m_processedDepthResolution;
+
     bool m_bIsSkeletonSeatedMode;
     bool m_bIsSkeletonDrawColor;
     bool m_bIsSkeletonDrawDepth;
@@ -268,6 +307,22 @@ private:
 	Mat m_colorMat;
 	Mat m_depthMat;
 
+	// Depths in millimeters and player indices the depth plane and temporal filters read, and the filtered depths
+	Mat m_depthPlane;
+	Mat m_playerPlane;
+	Mat m_filteredDepthPlane;
+
+	// Regions of the depth foreground the depth plane filters are restricted to, the boxes drawn around it and its pixels
+	std::vector<Rect> m_foregroundRegions;
+	std::vector<Rect> m_foregroundBoxes;
+	Mat m_foregroundMask;
+
+	// Points of the depth foreground in skeleton space, in meters, and the mask of the valid foreground points
+	Mat m_pointsX;
+	Mat m_pointsY;
+	Mat m_pointsZ;
+	Mat m_pointMask;
+
     // Bitmaps
     BITMAPINFO m_bmiColor;
     void* m_pColorBitmapBits;
@@ -277,10 +332,6 @@ private:
     void* m_pDepthBitmapBits;
     HBITMAP m_hDepthBitmap;
 
-    // Window processing thread handles
-    HANDLE m_hProcessStopEvent;
-    HANDLE m_hProcessThread;
-
 	// Mutexes that control access to m_colorResolution and m_depthResolution
     HANDLE m_hColorResolutionMutex;
     HANDLE m_hDepthResolutionMutex;
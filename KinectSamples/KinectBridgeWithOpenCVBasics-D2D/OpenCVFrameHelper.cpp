@@ -8,6 +8,230 @@
 
 using namespace Microsoft::KinectBridge;
 
+namespace
+{
+    // What a band of rows needs to know about the image it converts
+    struct ImageBands
+    {
+        const BYTE* pSource;
+        INT sourcePitch;
+        BYTE* pDestination;
+        INT destinationPitch;
+        UINT width;
+
+        // First failure any band ran into, S_OK if none did
+        volatile LONG result;
+    };
+
+    struct ColorImageBands : ImageBands
+    {
+        ColorImageFormat format;
+    };
+
+    struct DepthImageBands : ImageBands
+    {
+        NUI_IMAGE_RESOLUTION resolution;
+        OpenCVFrameHelper::DepthRowsConverter converter;
+    };
+
+    struct ColorizedDepthBands : ImageBands
+    {
+        const DepthColorizer* pColorizer;
+    };
+
+    struct PointCloudBands : ImageBands
+    {
+        const PointCloudGenerator* pGenerator;
+        NUI_IMAGE_RESOLUTION resolution;
+        FLOAT* pX;
+        FLOAT* pY;
+        FLOAT* pZ;
+        BYTE* pValid;
+
+        // Regions to convert, or NULL to convert every row
+        const std::vector<Rect>* pRegions;
+    };
+
+    struct FilteredDepthBands : ImageBands
+    {
+        DepthPlaneFilter filter;
+        UINT height;
+        const BYTE* pPlayers;
+        INT playersPitch;
+
+        // Regions to filter, or NULL to filter every row
+        const std::vector<Rect>* pRegions;
+    };
+
+    struct ColorizedDepthPlaneBands : ImageBands
+    {
+        const DepthColorizer* pColorizer;
+        const BYTE* pPlayers;
+        INT playersPitch;
+    };
+
+    struct DepthPlaneBands : ImageBands
+    {
+        BYTE* pPlayers;
+        INT playersPitch;
+
+        // Pixels of each player index over all bands, or NULL if they are not counted
+        volatile LONG* pPlayerCounts;
+    };
+
+    /// <summary>
+    /// Keeps the first failure of any band
+    /// </summary>
+    /// <param name="pBands">bands the failing band belongs to</param>
+    /// <param name="hr">result of the band</param>
+    inline void RecordBandResult(ImageBands* pBands, HRESULT hr)
+    {
+        if (FAILED(hr))
+        {
+            InterlockedCompareExchange(&pBands->result, hr, S_OK);
+        }
+    }
+
+    /// <summary>
+    /// Gets the part of a region within a band of rows
+    /// </summary>
+    /// <param name="region">region to clip</param>
+    /// <param name="firstRow">first row of the band</param>
+    /// <param name="rowCount">number of rows in the band</param>
+    /// <param name="pBandRegion">pointer in which to return the part of the region within the band</param>
+    /// <returns>true if the region has rows within the band, false otherwise</returns>
+    inline bool GetBandRegion(const Rect& region, UINT firstRow, UINT rowCount, RECT* pBandRegion)
+    {
+        pBandRegion->left = region.x;
+        pBandRegion->top = max(region.y, static_cast<int>(firstRow));
+        pBandRegion->right = region.x + region.width;
+        pBandRegion->bottom = min(region.y + region.height, static_cast<int>(firstRow + rowCount));
+        return pBandRegion->top < pBandRegion->bottom;
+    }
+
+    /// <summary>
+    /// Converts a band of color rows
+    /// </summary>
+    void CALLBACK ConvertColorBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        ColorImageBands* pBands = static_cast<ColorImageBands*>(pContext);
+        RecordBandResult(pBands, ConvertColorImage(
+            pBands->pSource + firstRow * pBands->sourcePitch, pBands->sourcePitch,
+            pBands->pDestination + firstRow * pBands->destinationPitch, pBands->destinationPitch,
+            pBands->width, rowCount, pBands->format));
+    }
+
+    /// <summary>
+    /// Converts a band of depth rows
+    /// </summary>
+    void CALLBACK ConvertDepthBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        DepthImageBands* pBands = static_cast<DepthImageBands*>(pContext);
+        RecordBandResult(pBands, pBands->converter(pBands->resolution, firstRow, rowCount,
+            pBands->pSource, pBands->sourcePitch, pBands->pDestination, pBands->destinationPitch));
+    }
+
+    /// <summary>
+    /// Colorizes a band of depth rows
+    /// </summary>
+    void CALLBACK ColorizeDepthBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        ColorizedDepthBands* pBands = static_cast<ColorizedDepthBands*>(pContext);
+        RecordBandResult(pBands, pBands->pColorizer->ColorizeLocked(
+            pBands->pSource + firstRow * pBands->sourcePitch, pBands->sourcePitch,
+            pBands->pDestination + firstRow * pBands->destinationPitch, pBands->destinationPitch,
+            pBands->width, rowCount));
+    }
+
+    /// <summary>
+    /// Filters a band of depth plane rows, or the parts of the regions within it. Each band
+    /// reads the whole source plane, as the filters read rows above and below the band.
+    /// </summary>
+    void CALLBACK FilterDepthBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        FilteredDepthBands* pBands = static_cast<FilteredDepthBands*>(pContext);
+        if (!pBands->pRegions)
+        {
+            RecordBandResult(pBands, FilterDepthRows(pBands->filter, firstRow, rowCount, pBands->width, pBands->height,
+                pBands->pSource, pBands->sourcePitch, pBands->pPlayers, pBands->playersPitch,
+                pBands->pDestination, pBands->destinationPitch));
+            return;
+        }
+
+        RECT bandRegion;
+        for (size_t i = 0; i < pBands->pRegions->size(); ++i)
+        {
+            if (GetBandRegion((*pBands->pRegions)[i], firstRow, rowCount, &bandRegion))
+            {
+                RecordBandResult(pBands, FilterDepthRegion(pBands->filter, bandRegion, pBands->width, pBands->height,
+                    pBands->pSource, pBands->sourcePitch, pBands->pPlayers, pBands->playersPitch,
+                    pBands->pDestination, pBands->destinationPitch));
+            }
+        }
+    }
+
+    /// <summary>
+    /// Colorizes a band of depth and player plane rows
+    /// </summary>
+    void CALLBACK ColorizeDepthPlaneBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        ColorizedDepthPlaneBands* pBands = static_cast<ColorizedDepthPlaneBands*>(pContext);
+        RecordBandResult(pBands, pBands->pColorizer->ColorizePlanesLocked(
+            pBands->pSource + firstRow * pBands->sourcePitch, pBands->sourcePitch,
+            pBands->pPlayers + firstRow * pBands->playersPitch, pBands->playersPitch,
+            pBands->pDestination + firstRow * pBands->destinationPitch, pBands->destinationPitch,
+            pBands->width, rowCount));
+    }
+
+    /// <summary>
+    /// Turns a band of depth rows, or the parts of the regions within it, into points
+    /// </summary>
+    void CALLBACK GeneratePointBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        PointCloudBands* pBands = static_cast<PointCloudBands*>(pContext);
+        if (!pBands->pRegions)
+        {
+            RecordBandResult(pBands, pBands->pGenerator->GeneratePointRows(pBands->resolution, firstRow, rowCount,
+                pBands->pSource, pBands->sourcePitch, pBands->pX, pBands->pY, pBands->pZ, pBands->pValid));
+            return;
+        }
+
+        RECT bandRegion;
+        for (size_t i = 0; i < pBands->pRegions->size(); ++i)
+        {
+            if (GetBandRegion((*pBands->pRegions)[i], firstRow, rowCount, &bandRegion))
+            {
+                RecordBandResult(pBands, pBands->pGenerator->GeneratePointRegion(pBands->resolution, bandRegion,
+                    pBands->pSource, pBands->sourcePitch, pBands->pX, pBands->pY, pBands->pZ, pBands->pValid));
+            }
+        }
+    }
+
+    /// <summary>
+    /// Splits a band of depth rows into depth and player planes
+    /// </summary>
+    void CALLBACK SplitDepthBand(void* pContext, UINT firstRow, UINT rowCount)
+    {
+        DepthPlaneBands* pBands = static_cast<DepthPlaneBands*>(pContext);
+        UINT playerCounts[PLAYER_INDEX_COUNT];
+
+        HRESULT hr = SplitDepthImage(pBands->pSource + firstRow * pBands->sourcePitch, pBands->sourcePitch,
+            pBands->pDestination + firstRow * pBands->destinationPitch, pBands->destinationPitch,
+            pBands->pPlayers + firstRow * pBands->playersPitch, pBands->playersPitch,
+            pBands->width, rowCount, pBands->pPlayerCounts ? playerCounts : NULL);
+        RecordBandResult(pBands, hr);
+
+        // Count the band locally and merge once, so bands do not contend per pixel
+        if (SUCCEEDED(hr) && pBands->pPlayerCounts)
+        {
+            for (UINT player = 0; player < PLAYER_INDEX_COUNT; ++player)
+            {
+                InterlockedExchangeAdd(&pBands->pPlayerCounts[player], static_cast<LONG>(playerCounts[player]));
+            }
+        }
+    }
+}
+
 /// <summary>
 /// Converts from Kinect color frame data into a RGB OpenCV image matrix. 
 /// User must pre-allocate space for matrix.
@@ -22,37 +246,336 @@ HRESULT OpenCVFrameHelper::GetColorData(Mat* pImage) const
         return E_NUI_FRAME_NO_DATA;
     }
 
-    DWORD colorHeight, colorWidth;
-    NuiImageResolutionToSize(m_colorResolution, colorWidth, colorHeight);
+    // The Mat has the sensor's pixel layout, so rows are copied as they are
+    return ConvertColorBands(pImage, COLOR_IMAGE_FORMAT_BGRX);
+}
 
-    // Copy image information into Mat
-    for (UINT y = 0; y < colorHeight; ++y)
+/// <summary>
+/// Gets the color image converted into the given pixel format
+/// </summary>
+/// <param name="pColorImage">pointer in which to return the image, of the type GetColorImageType gives</param>
+/// <param name="format">pixel format to convert into</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetColorImage(Mat* pColorImage, ColorImageFormat format) const
+{
+    // Fail if pointer is invalid
+    if (!pColorImage)
     {
-        // Get row pointer for color Mat
-        Vec4b* pColorRow = pImage->ptr<Vec4b>(y);
+        return E_POINTER;
+    }
+
+    // Fail if pColorImage is not the correct type and size for the format
+    if (pColorImage->type() != GetColorImageType(format))
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = VerifySize(pColorImage, m_colorResolution);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Check if image is valid
+    if (m_colorBufferPitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    return ConvertColorBands(pColorImage, format);
+}
+
+/// <summary>
+/// Gets the Mat type that holds a color image in the given pixel format
+/// </summary>
+/// <param name="format">pixel format</param>
+/// <returns>Mat type, or -1 if the format is not valid</returns>
+int OpenCVFrameHelper::GetColorImageType(ColorImageFormat format)
+{
+    switch (format)
+    {
+    case COLOR_IMAGE_FORMAT_BGRX:
+    case COLOR_IMAGE_FORMAT_RGBA:
+        return CV_8UC4;
+    case COLOR_IMAGE_FORMAT_BGR:
+        return CV_8UC3;
+    case COLOR_IMAGE_FORMAT_GRAY:
+        return CV_8UC1;
+    default:
+        return -1;
+    }
+}
+
+/// <summary>
+/// Gets the depth image converted into the given pixel format
+/// </summary>
+/// <param name="pDepthImage">pointer in which to return the image, of the type GetDepthImageType gives</param>
+/// <param name="format">pixel format to convert into</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetDepthImage(Mat* pDepthImage, DepthImageFormat format) const
+{
+    // Fail if pointer is invalid
+    if (!pDepthImage)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if pDepthImage is not the correct type and size for the format
+    if (pDepthImage->type() != GetDepthImageType(format))
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = VerifySize(pDepthImage, m_depthResolution);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Check if image is valid
+    if (m_depthBufferPitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    switch (format)
+    {
+    case DEPTH_IMAGE_FORMAT_MILLIMETERS:
+        return ConvertDepthBands(pDepthImage, &ConvertPixelRows<PackedDepthPixelFormat, DepthPixelFormat>, sizeof(USHORT));
+    case DEPTH_IMAGE_FORMAT_METERS:
+        return ConvertDepthBands(pDepthImage, &ConvertPixelRows<PackedDepthPixelFormat, MetersPixelFormat>, sizeof(FLOAT));
+    case DEPTH_IMAGE_FORMAT_PLAYER_MASK:
+        return ConvertDepthBands(pDepthImage, &ConvertPixelRows<PackedDepthPixelFormat, PlayerMaskPixelFormat>, sizeof(BYTE));
+    default:
+        return GetDepthData(pDepthImage);
+    }
+}
+
+/// <summary>
+/// Gets the Mat type that holds a depth image in the given pixel format
+/// </summary>
+/// <param name="format">pixel format</param>
+/// <returns>Mat type, or -1 if the format is not valid</returns>
+int OpenCVFrameHelper::GetDepthImageType(DepthImageFormat format)
+{
+    switch (format)
+    {
+    case DEPTH_IMAGE_FORMAT_PACKED:
+    case DEPTH_IMAGE_FORMAT_MILLIMETERS:
+        return CV_16U;
+    case DEPTH_IMAGE_FORMAT_METERS:
+        return CV_32F;
+    case DEPTH_IMAGE_FORMAT_PLAYER_MASK:
+        return CV_8U;
+    default:
+        return -1;
+    }
+}
+
+/// <summary>
+/// Splits the depth image into depths in millimeters and player indices, reading each pixel once
+/// </summary>
+/// <param name="pDepthImage">pointer in which to return the depths, of type CV_16U</param>
+/// <param name="pPlayerImage">pointer in which to return the player indices, of type CV_8U</param>
+/// <param name="pPlayerCounts">PLAYER_INDEX_COUNT entries in which to return the number of pixels of each player index, or NULL</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetDepthPlanes(Mat* pDepthImage, Mat* pPlayerImage, UINT* pPlayerCounts) const
+{
+    // Fail if either pointer is invalid
+    if (!pDepthImage || !pPlayerImage)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if either image is not the correct type and size
+    if (pDepthImage->type() != CV_16U || pPlayerImage->type() != CV_8U)
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = VerifySize(pDepthImage, m_depthResolution);
+    if (SUCCEEDED(hr))
+    {
+        hr = VerifySize(pPlayerImage, m_depthResolution);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Check if image is valid
+    if (m_depthBufferPitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    DWORD depthHeight, depthWidth;
+    NuiImageResolutionToSize(m_depthResolution, depthWidth, depthHeight);
+
+    volatile LONG playerCounts[PLAYER_INDEX_COUNT] = { 0 };
+
+    DepthPlaneBands bands;
+    bands.pSource = m_pDepthBuffer;
+    bands.sourcePitch = m_depthBufferPitch;
+    bands.pDestination = pDepthImage->data;
+    bands.destinationPitch = static_cast<INT>(pDepthImage->step);
+    bands.width = depthWidth;
+    bands.result = S_OK;
+    bands.pPlayers = pPlayerImage->data;
+    bands.playersPitch = static_cast<INT>(pPlayerImage->step);
+    bands.pPlayerCounts = pPlayerCounts ? playerCounts : NULL;
+
+    RunRowBands(depthHeight, depthWidth * (sizeof(USHORT) * 2 + sizeof(BYTE)), SplitDepthBand, &bands);
 
-        for (UINT x = 0; x < colorWidth; ++x)
+    if (SUCCEEDED(bands.result) && pPlayerCounts)
+    {
+        for (UINT player = 0; player < PLAYER_INDEX_COUNT; ++player)
         {
-            pColorRow[x] = Vec4b(m_pColorBuffer[y * m_colorBufferPitch + x * 4 + 0],
-                m_pColorBuffer[y * m_colorBufferPitch + x * 4 + 1],
-                m_pColorBuffer[y * m_colorBufferPitch + x * 4 + 2],
-                m_pColorBuffer[y * m_colorBufferPitch + x * 4 + 3]);
+            pPlayerCounts[player] = static_cast<UINT>(playerCounts[player]);
         }
     }
 
-    return S_OK;
+    return bands.result;
 }
 
 /// <summary>
-/// Converts from Kinect depth frame data into a OpenCV matrix
-/// User must pre-allocate space for matrix.
+/// Filters a plane of depths in millimeters, such as GetDepthPlanes returns, in bands of rows.
+/// When given regions, such as the foreground regions of a DepthBackgroundModel, only their
+/// pixels are filtered and the others are copied as they are.
 /// </summary>
-/// <param name="pImage">pointer in which to return the OpenCV matrix</param>
+/// <param name="filter">filter to apply</param>
+/// <param name="depthImage">depths to filter, of type CV_16U</param>
+/// <param name="playerImage">player indices of the depths, of type CV_8U, or an empty Mat to ignore players</param>
+/// <param name="pFilteredImage">pointer in which to return the filtered depths, of type CV_16U and the size of the depths</param>
+/// <param name="pRegions">regions to filter, within the depths, or NULL to filter every pixel</param>
 /// <returns>S_OK if successful, an error code otherwise</returns>
-HRESULT OpenCVFrameHelper::GetDepthData(Mat* pImage) const
+HRESULT OpenCVFrameHelper::FilterDepthPlane(DepthPlaneFilter filter, const Mat& depthImage, const Mat& playerImage, Mat* pFilteredImage,
+    const std::vector<Rect>* pRegions) const
+{
+    // Fail if pointer is invalid
+    if (!pFilteredImage)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the images are not the correct types and sizes, or if the filter would overwrite its own input
+    bool hasPlayers = !playerImage.empty();
+    if (depthImage.type() != CV_16U || pFilteredImage->type() != CV_16U || pFilteredImage->size() != depthImage.size() ||
+        (hasPlayers && (playerImage.type() != CV_8U || playerImage.size() != depthImage.size())) ||
+        pFilteredImage->data == depthImage.data)
+    {
+        return E_INVALIDARG;
+    }
+
+    FilteredDepthBands bands;
+    bands.pSource = depthImage.data;
+    bands.sourcePitch = static_cast<INT>(depthImage.step);
+    bands.pDestination = pFilteredImage->data;
+    bands.destinationPitch = static_cast<INT>(pFilteredImage->step);
+    bands.width = depthImage.cols;
+    bands.result = S_OK;
+    bands.filter = filter;
+    bands.height = depthImage.rows;
+    bands.pPlayers = hasPlayers ? playerImage.data : NULL;
+    bands.playersPitch = hasPlayers ? static_cast<INT>(playerImage.step) : 0;
+    bands.pRegions = pRegions;
+
+    if (pRegions)
+    {
+        depthImage.copyTo(*pFilteredImage);
+    }
+
+    RunRowBands(depthImage.rows, depthImage.cols * (sizeof(USHORT) * 2 + sizeof(BYTE)), FilterDepthBand, &bands);
+
+    return bands.result;
+}
+
+/// <summary>
+/// Colorizes planes of depths in millimeters and player indices the way GetDepthImageAsArgb
+/// colorizes the depth frame
+/// </summary>
+/// <param name="depthImage">depths to colorize, of type CV_16U</param>
+/// <param name="playerImage">player indices of the depths, of type CV_8U</param>
+/// <param name="pDepthArgbImage">pointer in which to return the colors, of type DEPTH_RGB_TYPE and the size of the depths</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::ColorizeDepthPlanes(const Mat& depthImage, const Mat& playerImage, Mat* pDepthArgbImage) const
 {
+    // Fail if pointer is invalid
+    if (!pDepthArgbImage)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the images are not the correct types and sizes
+    if (depthImage.type() != CV_16U || playerImage.type() != CV_8U || playerImage.size() != depthImage.size() ||
+        pDepthArgbImage->type() != DEPTH_RGB_TYPE || pDepthArgbImage->size() != depthImage.size())
+    {
+        return E_INVALIDARG;
+    }
+
+    ColorizedDepthPlaneBands bands;
+    bands.pSource = depthImage.data;
+    bands.sourcePitch = static_cast<INT>(depthImage.step);
+    bands.pDestination = pDepthArgbImage->data;
+    bands.destinationPitch = static_cast<INT>(pDepthArgbImage->step);
+    bands.width = depthImage.cols;
+    bands.result = S_OK;
+    bands.pColorizer = &m_depthColorizer;
+    bands.pPlayers = playerImage.data;
+    bands.playersPitch = static_cast<INT>(playerImage.step);
+
+    // Lock the table once for all the bands, so the whole image is drawn with one palette
+    HRESULT hr = m_depthColorizer.LockTable();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    RunRowBands(depthImage.rows, depthImage.cols * (sizeof(USHORT) + sizeof(BYTE) + sizeof(DWORD)), ColorizeDepthPlaneBand, &bands);
+    m_depthColorizer.UnlockTable();
+
+    return bands.result;
+}
+
+/// <summary>
+/// Converts the depth image into points in skeleton space, in meters. Pixels outside
+/// the point cloud depth range become the origin.
+/// </summary>
+/// <param name="pX">pointer in which to return the X coordinates, a continuous matrix of type CV_32F</param>
+/// <param name="pY">pointer in which to return the Y coordinates, a continuous matrix of type CV_32F</param>
+/// <param name="pZ">pointer in which to return the Z coordinates, a continuous matrix of type CV_32F</param>
+/// <param name="pValidMask">pointer in which to return 255 for valid points and 0 for the others, a continuous matrix of type CV_8U, or NULL</param>
+/// <param name="pRegions">regions to convert, whose left edges are multiples of 4, or NULL to convert every pixel; pixels outside them become the origin and are not valid</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetDepthPointCloud(Mat* pX, Mat* pY, Mat* pZ, Mat* pValidMask, const std::vector<Rect>* pRegions) const
+{
+    KINECTBRIDGE_PROFILE_STAGE(PIPELINE_STAGE_DEPTH_POINT_CLOUD);
+
+    // Fail if any plane is missing or cannot hold the points
+    HRESULT hr = VerifyPointCloudPlane(pX, CV_32F);
+    if (SUCCEEDED(hr))
+    {
+        hr = VerifyPointCloudPlane(pY, CV_32F);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = VerifyPointCloudPlane(pZ, CV_32F);
+    }
+
+    if (SUCCEEDED(hr) && pValidMask)
+    {
+        hr = VerifyPointCloudPlane(pValidMask, CV_8U);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
     // Check if image is valid
-    if (m_colorBufferPitch == 0)
+    if (m_depthBufferPitch == 0)
     {
         return E_NUI_FRAME_NO_DATA;
     }
@@ -60,21 +583,54 @@ HRESULT OpenCVFrameHelper::GetDepthData(Mat* pImage) const
     DWORD depthHeight, depthWidth;
     NuiImageResolutionToSize(m_depthResolution, depthWidth, depthHeight);
 
-    // Copy image information into Mat
-    USHORT* pBufferRun = reinterpret_cast<USHORT*>(m_pDepthBuffer);
+    PointCloudBands bands;
+    bands.pSource = m_pDepthBuffer;
+    bands.sourcePitch = m_depthBufferPitch;
+    bands.pDestination = NULL;
+    bands.destinationPitch = 0;
+    bands.width = depthWidth;
+    bands.result = S_OK;
+    bands.pGenerator = &m_pointCloudGenerator;
+    bands.resolution = m_depthResolution;
+    bands.pX = pX->ptr<FLOAT>();
+    bands.pY = pY->ptr<FLOAT>();
+    bands.pZ = pZ->ptr<FLOAT>();
+    bands.pValid = pValidMask ? pValidMask->ptr<BYTE>() : NULL;
+    bands.pRegions = pRegions;
 
-    for (UINT y = 0; y < depthHeight; ++y)
+    if (pRegions)
     {
-        // Get row pointer for depth Mat
-        USHORT* pDepthRow = pImage->ptr<USHORT>(y);
-
-        for (UINT x = 0; x < depthWidth; ++x)
+        SIZE_T pixelCount = static_cast<SIZE_T>(depthWidth) * depthHeight;
+        ZeroMemory(bands.pX, pixelCount * sizeof(FLOAT));
+        ZeroMemory(bands.pY, pixelCount * sizeof(FLOAT));
+        ZeroMemory(bands.pZ, pixelCount * sizeof(FLOAT));
+        if (bands.pValid)
         {
-            pDepthRow[x] = pBufferRun[y * depthWidth + x];
+            ZeroMemory(bands.pValid, pixelCount);
         }
     }
 
-    return S_OK;
+    RunRowBands(depthHeight, depthWidth * (sizeof(USHORT) + 3 * sizeof(FLOAT) + sizeof(BYTE)), GeneratePointBand, &bands);
+
+    return bands.result;
+}
+
+/// <summary>
+/// Converts from Kinect depth frame data into a OpenCV matrix
+/// User must pre-allocate space for matrix.
+/// </summary>
+/// <param name="pImage">pointer in which to return the OpenCV matrix</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetDepthData(Mat* pImage) const
+{
+    // Check if image is valid
+    if (m_depthBufferPitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    // Copy image information into Mat
+    return ConvertDepthBands(pImage, &ConvertPixelRows<PackedDepthPixelFormat, PackedDepthPixelFormat>, sizeof(USHORT));
 }
 
 /// <summary>
@@ -85,42 +641,91 @@ HRESULT OpenCVFrameHelper::GetDepthData(Mat* pImage) const
 /// <returns>S_OK if successful, an error code otherwise</returns>
 HRESULT OpenCVFrameHelper::GetDepthDataAsArgb(Mat* pImage) const
 {
+    // Check if image is valid
+    if (m_depthBufferPitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
     DWORD depthWidth, depthHeight;
     NuiImageResolutionToSize(m_depthResolution, depthWidth, depthHeight);
 
-    // Get the depth image
-    Mat depthImage;
-    depthImage.create(depthHeight, depthWidth, DEPTH_TYPE);
-    HRESULT hr = GetDepthData(&depthImage);
-    if (!SUCCEEDED(hr)) {
+    // Colorize straight from the sensor's buffer, so each depth pixel is read once and nothing is copied in between
+    ColorizedDepthBands bands;
+    bands.pSource = m_pDepthBuffer;
+    bands.sourcePitch = m_depthBufferPitch;
+    bands.pDestination = pImage->data;
+    bands.destinationPitch = static_cast<INT>(pImage->step);
+    bands.width = depthWidth;
+    bands.result = S_OK;
+    bands.pColorizer = &m_depthColorizer;
+
+    // Lock the table once for all the bands, so the whole image is drawn with one palette
+    HRESULT hr = m_depthColorizer.LockTable();
+    if (FAILED(hr))
+    {
         return hr;
     }
 
-    for (UINT y = 0; y < depthHeight; ++y)
-    {
-        // Get row pointers for Mats
-        const USHORT* pDepthRow = depthImage.ptr<USHORT>(y);
-        Vec4b* pDepthRgbRow = pImage->ptr<Vec4b>(y);
+    RunRowBands(depthHeight, depthWidth * (sizeof(USHORT) + sizeof(DWORD)), ColorizeDepthBand, &bands);
+    m_depthColorizer.UnlockTable();
 
-        for (UINT x = 0; x < depthWidth; ++x)
-        {
-            USHORT raw_depth = pDepthRow[x];
+    return bands.result;
+}
 
-            // If depth value is valid, convert and copy it
-            if (raw_depth != 65535)
-            {
-                UINT8 redPixel, greenPixel, bluePixel;
-                DepthShortToRgb(raw_depth, &redPixel, &greenPixel, &bluePixel);
-                pDepthRgbRow[x] = Vec4b(redPixel, greenPixel, bluePixel, 1);
-            }
-            else
-            {
-                pDepthRgbRow[x] = 0;
-            }
-        }
-    }
+/// <summary>
+/// Converts the color frame into the given pixel format, in bands of rows on the
+/// worker pool while the helper is dispatching
+/// </summary>
+/// <param name="pImage">pointer in which to return the image</param>
+/// <param name="format">pixel format to convert into</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::ConvertColorBands(Mat* pImage, ColorImageFormat format) const
+{
+    DWORD colorHeight, colorWidth;
+    NuiImageResolutionToSize(m_colorResolution, colorWidth, colorHeight);
 
-    return S_OK;
+    ColorImageBands bands;
+    bands.pSource = m_pColorBuffer;
+    bands.sourcePitch = m_colorBufferPitch;
+    bands.pDestination = pImage->data;
+    bands.destinationPitch = static_cast<INT>(pImage->step);
+    bands.width = colorWidth;
+    bands.result = S_OK;
+    bands.format = format;
+
+    SIZE_T bytesPerRow = colorWidth * (GetColorImageBytesPerPixel(COLOR_IMAGE_FORMAT_BGRX) + GetColorImageBytesPerPixel(format));
+    RunRowBands(colorHeight, bytesPerRow, ConvertColorBand, &bands);
+
+    return bands.result;
+}
+
+/// <summary>
+/// Converts the depth frame with the given row converter, in bands of rows on the
+/// worker pool while the helper is dispatching
+/// </summary>
+/// <param name="pImage">pointer in which to return the image</param>
+/// <param name="converter">converts a range of rows into the image's pixel format</param>
+/// <param name="bytesPerPixel">size of a pixel of the image in bytes</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::ConvertDepthBands(Mat* pImage, DepthRowsConverter converter, SIZE_T bytesPerPixel) const
+{
+    DWORD depthHeight, depthWidth;
+    NuiImageResolutionToSize(m_depthResolution, depthWidth, depthHeight);
+
+    DepthImageBands bands;
+    bands.pSource = m_pDepthBuffer;
+    bands.sourcePitch = m_depthBufferPitch;
+    bands.pDestination = pImage->data;
+    bands.destinationPitch = static_cast<INT>(pImage->step);
+    bands.width = depthWidth;
+    bands.result = S_OK;
+    bands.resolution = m_depthResolution;
+    bands.converter = converter;
+
+    RunRowBands(depthHeight, depthWidth * (sizeof(USHORT) + bytesPerPixel), ConvertDepthBand, &bands);
+
+    return bands.result;
 }
 
 /// <summary>
@@ -143,3 +748,66 @@ HRESULT OpenCVFrameHelper::VerifySize(const Mat* pImage, NUI_IMAGE_RESOLUTION re
     return S_OK;
 }
 
+/// <summary>
+/// Verifies a point cloud plane is a continuous matrix of the depth resolution
+/// </summary>
+/// <param name="pPlane">pointer to the plane to verify</param>
+/// <param name="type">Mat type the plane must have</param>
+/// <returns>S_OK if the plane can be written, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::VerifyPointCloudPlane(const Mat* pPlane, int type) const
+{
+    if (!pPlane)
+    {
+        return E_POINTER;
+    }
+
+    // Points are written as whole planes, so rows must follow each other without padding
+    if (pPlane->type() != type || !pPlane->isContinuous())
+    {
+        return E_INVALIDARG;
+    }
+
+    return VerifySize(pPlane, m_depthResolution);
+}
+
+/// <summary>
+/// Wraps leased Kinect color frame data in an OpenCV image matrix header without copying it
+/// </summary>
+/// <param name="pLease">lease on the color frame</param>
+/// <param name="pImage">pointer in which to return the OpenCV image matrix</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetColorView(const FrameLease* pLease, Mat* pImage) const
+{
+    // Check if image is valid
+    INT pitch = pLease->GetPitch();
+    if (pitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    // Point the Mat at the leased rows, using the stride the sensor gave us
+    *pImage = Mat(pLease->GetSize() / pitch, pitch / 4, COLOR_TYPE, pLease->GetBits(), pitch);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Wraps leased Kinect depth frame data in an OpenCV matrix header without copying it
+/// </summary>
+/// <param name="pLease">lease on the depth frame</param>
+/// <param name="pImage">pointer in which to return the OpenCV matrix</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVFrameHelper::GetDepthView(const FrameLease* pLease, Mat* pImage) const
+{
+    // Check if image is valid
+    INT pitch = pLease->GetPitch();
+    if (pitch == 0)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    // Point the Mat at the leased rows, using the stride the sensor gave us
+    *pImage = Mat(pLease->GetSize() / pitch, pitch / sizeof(USHORT), DEPTH_TYPE, pLease->GetBits(), pitch);
+
+    return S_OK;
+}
@@ -6,6 +6,12 @@
 
 #pragma once
 #include "KinectHelper.h"
+#include "ColorConversion.h"
+#include "PixelKernels.h"
+#include "DepthPlaneSplitter.h"
+#include "DepthFilters.h"
+#include "PointCloudGenerator.h"
+#include <vector>
 
 // Suppress warnings that come from compiling OpenCV code since we have no control over it
 #pragma warning(push)
@@ -35,6 +41,97 @@ namespace Microsoft {
             static const int DEPTH_TYPE = CV_16U;
             static const int DEPTH_RGB_TYPE = CV_8UC4;
 
+            // Image getters of the base class, which are hidden by the overloads below
+            using KinectHelper<Mat>::GetColorImage;
+            using KinectHelper<Mat>::GetDepthImage;
+
+            /// <summary>
+            /// Gets the color image converted into the given pixel format
+            /// </summary>
+            /// <param name="pColorImage">pointer in which to return the image, of the type GetColorImageType gives</param>
+            /// <param name="format">pixel format to convert into</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetColorImage(Mat* pColorImage, ColorImageFormat format) const;
+
+            /// <summary>
+            /// Gets the Mat type that holds a color image in the given pixel format
+            /// </summary>
+            /// <param name="format">pixel format</param>
+            /// <returns>Mat type, or -1 if the format is not valid</returns>
+            static int GetColorImageType(ColorImageFormat format);
+
+            /// <summary>
+            /// Gets the depth image converted into the given pixel format
+            /// </summary>
+            /// <param name="pDepthImage">pointer in which to return the image, of the type GetDepthImageType gives</param>
+            /// <param name="format">pixel format to convert into</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthImage(Mat* pDepthImage, DepthImageFormat format) const;
+
+            /// <summary>
+            /// Gets the Mat type that holds a depth image in the given pixel format
+            /// </summary>
+            /// <param name="format">pixel format</param>
+            /// <returns>Mat type, or -1 if the format is not valid</returns>
+            static int GetDepthImageType(DepthImageFormat format);
+
+            /// <summary>
+            /// Splits the depth image into depths in millimeters and player indices, reading each pixel once
+            /// </summary>
+            /// <param name="pDepthImage">pointer in which to return the depths, of type CV_16U</param>
+            /// <param name="pPlayerImage">pointer in which to return the player indices, of type CV_8U</param>
+            /// <param name="pPlayerCounts">PLAYER_INDEX_COUNT entries in which to return the number of pixels of each player index, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthPlanes(Mat* pDepthImage, Mat* pPlayerImage, UINT* pPlayerCounts = NULL) const;
+
+            /// <summary>
+            /// Filters a plane of depths in millimeters, such as GetDepthPlanes returns, in bands of rows.
+            /// When given regions, such as the foreground regions of a DepthBackgroundModel, only their
+            /// pixels are filtered and the others are copied as they are.
+            /// </summary>
+            /// <param name="filter">filter to apply</param>
+            /// <param name="depthImage">depths to filter, of type CV_16U</param>
+            /// <param name="playerImage">player indices of the depths, of type CV_8U, or an empty Mat to ignore players</param>
+            /// <param name="pFilteredImage">pointer in which to return the filtered depths, of type CV_16U and the size of the depths</param>
+            /// <param name="pRegions">regions to filter, within the depths, or NULL to filter every pixel</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT FilterDepthPlane(DepthPlaneFilter filter, const Mat& depthImage, const Mat& playerImage, Mat* pFilteredImage,
+                const std::vector<Rect>* pRegions = NULL) const;
+
+            /// <summary>
+            /// Colorizes planes of depths in millimeters and player indices the way GetDepthImageAsArgb
+            /// colorizes the depth frame
+            /// </summary>
+            /// <param name="depthImage">depths to colorize, of type CV_16U</param>
+            /// <param name="playerImage">player indices of the depths, of type CV_8U</param>
+            /// <param name="pDepthArgbImage">pointer in which to return the colors, of type DEPTH_RGB_TYPE and the size of the depths</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ColorizeDepthPlanes(const Mat& depthImage, const Mat& playerImage, Mat* pDepthArgbImage) const;
+
+            /// <summary>
+            /// Converts the depth image into points in skeleton space, in meters. Pixels outside
+            /// the point cloud depth range become the origin.
+            /// </summary>
+            /// <param name="pX">pointer in which to return the X coordinates, a continuous matrix of type CV_32F</param>
+            /// <param name="pY">pointer in which to return the Y coordinates, a continuous matrix of type CV_32F</param>
+            /// <param name="pZ">pointer in which to return the Z coordinates, a continuous matrix of type CV_32F</param>
+            /// <param name="pValidMask">pointer in which to return 255 for valid points and 0 for the others, a continuous matrix of type CV_8U, or NULL</param>
+            /// <param name="pRegions">regions to convert, whose left edges are multiples of 4, or NULL to convert every pixel; pixels outside them become the origin and are not valid</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthPointCloud(Mat* pX, Mat* pY, Mat* pZ, Mat* pValidMask = NULL, const std::vector<Rect>* pRegions = NULL) const;
+
+            /// <summary>
+            /// Sets the depths GetDepthPointCloud turns into points
+            /// </summary>
+            /// <param name="minDepth">nearest valid depth in millimeters</param>
+            /// <param name="maxDepth">farthest valid depth in millimeters</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the range is empty or beyond the sensor's</returns>
+            HRESULT SetPointCloudDepthRange(USHORT minDepth, USHORT maxDepth) { return m_pointCloudGenerator.SetDepthRange(minDepth, maxDepth); }
+
+            // Converts a range of rows of a packed depth image into another pixel format
+            typedef HRESULT (*DepthRowsConverter)(NUI_IMAGE_RESOLUTION resolution, UINT firstRow, UINT rowCount,
+                const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch);
+
         protected:
             // Functions:
             /// <summary>
@@ -65,6 +162,55 @@ namespace Microsoft {
             /// <param name="resolution">resolution of image</param>
             /// <returns>S_OK if image matches given width and height, an error code otherwise</returns>
             HRESULT VerifySize(const Mat* pImage, NUI_IMAGE_RESOLUTION resolution) const override;
+
+            /// <summary>
+            /// Wraps leased Kinect color frame data in an OpenCV image matrix header without copying it
+            /// </summary>
+            /// <param name="pLease">lease on the color frame</param>
+            /// <param name="pImage">pointer in which to return the OpenCV image matrix</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetColorView(const FrameLease* pLease, Mat* pImage) const override;
+
+            /// <summary>
+            /// Wraps leased Kinect depth frame data in an OpenCV matrix header without copying it
+            /// </summary>
+            /// <param name="pLease">lease on the depth frame</param>
+            /// <param name="pImage">pointer in which to return the OpenCV matrix</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetDepthView(const FrameLease* pLease, Mat* pImage) const override;
+
+        private:
+            // Functions:
+            /// <summary>
+            /// Converts the color frame into the given pixel format, in bands of rows on the
+            /// worker pool while the helper is dispatching
+            /// </summary>
+            /// <param name="pImage">pointer in which to return the image</param>
+            /// <param name="format">pixel format to convert into</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ConvertColorBands(Mat* pImage, ColorImageFormat format) const;
+
+            /// <summary>
+            /// Converts the depth frame with the given row converter, in bands of rows on the
+            /// worker pool while the helper is dispatching
+            /// </summary>
+            /// <param name="pImage">pointer in which to return the image</param>
+            /// <param name="converter">converts a range of rows into the image's pixel format</param>
+            /// <param name="bytesPerPixel">size of a pixel of the image in bytes</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ConvertDepthBands(Mat* pImage, DepthRowsConverter converter, SIZE_T bytesPerPixel) const;
+
+            /// <summary>
+            /// Verifies a point cloud plane is a continuous matrix of the depth resolution
+            /// </summary>
+            /// <param name="pPlane">pointer to the plane to verify</param>
+            /// <param name="type">Mat type the plane must have</param>
+            /// <returns>S_OK if the plane can be written, an error code otherwise</returns>
+            HRESULT VerifyPointCloudPlane(const Mat* pPlane, int type) const;
+
+            // Variables:
+            // Turns depth frames into points
+            PointCloudGenerator m_pointCloudGenerator;
         };
     }
 }
\ No newline at end of file
@@ -5,9 +5,19 @@
 //-----------------------------------------------------------------------------
 
 #include "OpenCVHelper.h"
+#include <strsafe.h>
 
 using namespace cv;
 
+namespace
+{
+    // Hysteresis thresholds of the Canny edge filters
+    const double COLOR_EDGE_LOW_THRESHOLD = 30.0;
+    const double COLOR_EDGE_HIGH_THRESHOLD = 50.0;
+    const double DEPTH_EDGE_LOW_THRESHOLD = 5.0;
+    const double DEPTH_EDGE_HIGH_THRESHOLD = 20.0;
+}
+
 const Scalar OpenCVHelper::SKELETON_COLORS[NUI_SKELETON_COUNT] =
 {
     Scalar(255, 0, 0),      // Blue
@@ -18,13 +28,22 @@ const Scalar OpenCVHelper::SKELETON_COLORS[NUI_SKELETON_COUNT] =
     Scalar(128, 128, 255)   // Pink
 };
 
+const Scalar OpenCVHelper::FOREGROUND_BOX_COLOR = Scalar(0, 0, 255);    // Red
+
 /// <summary>
 /// Constructor
 /// </summary>
 OpenCVHelper::OpenCVHelper() :
+    m_colorFilterID(-1),
     m_depthFilterID(-1),
-    m_colorFilterID(-1)
+    m_colorGraph(Microsoft::KinectBridge::COLOR_IMAGE_FORMAT_BGRX),
+    m_depthGraph(Microsoft::KinectBridge::COLOR_IMAGE_FORMAT_RGBA),
+    m_colorEdgeDetector(COLOR_EDGE_LOW_THRESHOLD, COLOR_EDGE_HIGH_THRESHOLD),
+    m_depthEdgeDetector(DEPTH_EDGE_LOW_THRESHOLD, DEPTH_EDGE_HIGH_THRESHOLD),
+    m_bIsDepthForegroundOnly(false),
+    m_lastReportTickCount(GetTickCount())
 {
+    InitializeSRWLock(&m_filterLock);
 }
 
 /// <summary>
@@ -33,7 +52,10 @@ OpenCVHelper::OpenCVHelper() :
 /// <param name="filterID">resource ID of filter to use</param>
 void OpenCVHelper::SetColorFilter(int filterID)
 {
+    AcquireSRWLockExclusive(&m_filterLock);
     m_colorFilterID = filterID;
+    BuildFilterGraph(&m_colorGraph, filterID, false);
+    ReleaseSRWLockExclusive(&m_filterLock);
 }
 
 /// <summary>
@@ -42,7 +64,17 @@ void OpenCVHelper::SetColorFilter(int filterID)
 /// <param name="filterID">resource ID of filter to use</param>
 void OpenCVHelper::SetDepthFilter(int filterID)
 {
+    AcquireSRWLockExclusive(&m_filterLock);
+
+    // Start the temporal filter afresh, as its history stopped when it was last switched away from
+    if (filterID == IDM_DEPTH_FILTER_TEMPORAL && m_depthFilterID != IDM_DEPTH_FILTER_TEMPORAL)
+    {
+        m_temporalDepthFilter.Reset();
+    }
+
     m_depthFilterID = filterID;
+    BuildFilterGraph(&m_depthGraph, filterID, true);
+    ReleaseSRWLockExclusive(&m_filterLock);
 }
 
 /// <summary>
@@ -64,42 +96,20 @@ HRESULT OpenCVHelper::ApplyColorFilter(Mat* pImg)
         return E_INVALIDARG;
     }
 
-    // Apply an effect based on the active filter
-    switch(m_colorFilterID)
+    // Apply the active filter, reading the frame as the sensor's BGRX pixels for edges
+    AcquireSRWLockExclusive(&m_filterLock);
+    HRESULT hr;
+    if (m_colorFilterID == IDM_COLOR_FILTER_CANNYEDGE)
     {
-    case IDM_COLOR_FILTER_GAUSSIANBLUR:
-        {
-            GaussianBlur(*pImg, *pImg, Size(7,7), 0);
-        }
-        break;
-    case IDM_COLOR_FILTER_DILATE:
-        {
-            dilate(*pImg, *pImg, Mat());
-        }
-        break;
-    case IDM_COLOR_FILTER_ERODE:
-        {
-            erode(*pImg, *pImg, Mat());
-        }
-        break;
-    case IDM_COLOR_FILTER_CANNYEDGE:
-        {
-            const double minThreshold = 30.0;
-            const double maxThreshold = 50.0;
-
-            // Convert image to grayscale for edge detection
-            cvtColor(*pImg, *pImg, CV_RGBA2GRAY);
-            // Remove noise
-            blur(*pImg, *pImg, Size(3,3));
-            // Find edges in image
-            Canny(*pImg, *pImg, minThreshold, maxThreshold);
-            // Convert back to color for output
-            cvtColor(*pImg, *pImg, CV_GRAY2RGBA);
-        }
-        break;
+        hr = m_colorEdgeDetector.Detect(*pImg, Microsoft::KinectBridge::COLOR_IMAGE_FORMAT_BGRX, pImg);
+    }
+    else
+    {
+        hr = m_colorGraph.Apply(pImg);
     }
+    ReleaseSRWLockExclusive(&m_filterLock);
 
-    return S_OK;
+    return hr;
 }
 
 /// <summary>
@@ -121,42 +131,278 @@ HRESULT OpenCVHelper::ApplyDepthFilter(Mat* pImg)
         return E_INVALIDARG;
     }
 
-    // Apply an effect based on the active filter
-    switch(m_depthFilterID)
+    // Apply the active filter, reading the colorized depth as red first for edges
+    AcquireSRWLockExclusive(&m_filterLock);
+    HRESULT hr;
+    if (m_depthFilterID == IDM_DEPTH_FILTER_CANNYEDGE)
+    {
+        hr = m_depthEdgeDetector.Detect(*pImg, Microsoft::KinectBridge::COLOR_IMAGE_FORMAT_RGBA, pImg);
+    }
+    else
+    {
+        hr = m_depthGraph.Apply(pImg);
+    }
+    ReleaseSRWLockExclusive(&m_filterLock);
+
+    return hr;
+}
+
+/// <summary>
+/// Draws the edges of a color frame, as the Canny edge filter does, reading the frame where it is
+/// </summary>
+/// <param name="colorFrame">BGRX color frame, such as a view of the sensor's buffer</param>
+/// <param name="pImg">pointer to Mat in which to draw the edges</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVHelper::DetectColorEdges(const Mat& colorFrame, Mat* pImg)
+{
+    AcquireSRWLockExclusive(&m_filterLock);
+    HRESULT hr = m_colorEdgeDetector.Detect(colorFrame, Microsoft::KinectBridge::COLOR_IMAGE_FORMAT_BGRX, pImg);
+    ReleaseSRWLockExclusive(&m_filterLock);
+
+    return hr;
+}
+
+/// <summary>
+/// Gets the depth plane filter corresponding to the given resource ID. Depth plane filters run
+/// on the depths in millimeters before they are colorized, rather than through ApplyDepthFilter.
+/// </summary>
+/// <param name="filterID">resource ID of the filter</param>
+/// <param name="pFilter">pointer in which to return the depth plane filter</param>
+/// <returns>true if the resource ID is that of a depth plane filter, false otherwise</returns>
+bool OpenCVHelper::GetDepthPlaneFilter(int filterID, Microsoft::KinectBridge::DepthPlaneFilter* pFilter)
+{
+    using namespace Microsoft::KinectBridge;
+
+    switch (filterID)
+    {
+    case IDM_DEPTH_FILTER_BILATERAL:
+        *pFilter = DEPTH_PLANE_FILTER_BILATERAL;
+        return true;
+    case IDM_DEPTH_FILTER_FILLHOLES:
+        *pFilter = DEPTH_PLANE_FILTER_FILL_HOLES;
+        return true;
+    case IDM_DEPTH_FILTER_DESPECKLE:
+        *pFilter = DEPTH_PLANE_FILTER_REMOVE_SPECKLES;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Smooths the depths of a frame with those of the frames before it, as the temporal depth filter does
+/// </summary>
+/// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+/// <param name="playerImage">player indices of the depths, of type CV_8U</param>
+/// <param name="pFilteredImage">pointer to Mat in which to return the smoothed depths</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVHelper::ApplyTemporalDepthFilter(const Mat& depthImage, const Mat& playerImage, Mat* pFilteredImage)
+{
+    // Fail if pointer is invalid
+    if (!pFilteredImage)
     {
+        return E_POINTER;
+    }
+
+    AcquireSRWLockExclusive(&m_filterLock);
+    HRESULT hr = m_temporalDepthFilter.Filter(depthImage, playerImage, pFilteredImage);
+    ReleaseSRWLockExclusive(&m_filterLock);
+
+    return hr;
+}
+
+/// <summary>
+/// Sets whether the depth background model learns from every depth frame, so its foreground
+/// can be found and the depth plane filters restricted to it
+/// </summary>
+/// <param name="foregroundOnly">true to model the background and filter only the foreground, false to filter every pixel</param>
+void OpenCVHelper::SetDepthForegroundOnly(bool foregroundOnly)
+{
+    AcquireSRWLockExclusive(&m_filterLock);
+
+    // Learn the background afresh, as the model stopped learning when it was last switched off
+    if (foregroundOnly && !m_bIsDepthForegroundOnly)
+    {
+        m_depthBackgroundModel.Reset();
+    }
+
+    m_bIsDepthForegroundOnly = foregroundOnly;
+    ReleaseSRWLockExclusive(&m_filterLock);
+}
+
+/// <summary>
+/// Adds the depths of a frame to the depth background model and finds their foreground
+/// </summary>
+/// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+/// <param name="pRegions">pointer in which to return the regions covering the foreground tiles</param>
+/// <param name="pBoxes">pointer in which to return the bounding boxes of the connected foreground tiles</param>
+/// <param name="pForegroundMask">pointer in which to return 255 for foreground pixels and 0 for the others, of type CV_8U, or NULL</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVHelper::FindDepthForeground(const Mat& depthImage, std::vector<Rect>* pRegions, std::vector<Rect>* pBoxes, Mat* pForegroundMask)
+{
+    // Fail if pointers are invalid
+    if (!pRegions || !pBoxes)
+    {
+        return E_POINTER;
+    }
+
+    AcquireSRWLockExclusive(&m_filterLock);
+    HRESULT hr = m_depthBackgroundModel.Update(depthImage, &m_depthForegroundMask);
+    if (SUCCEEDED(hr))
+    {
+        // Copy out under the lock, reusing the callers' storage from frame to frame
+        const std::vector<Rect>& regions = m_depthBackgroundModel.GetForegroundRegions();
+        const std::vector<Rect>& boxes = m_depthBackgroundModel.GetForegroundBoxes();
+        pRegions->assign(regions.begin(), regions.end());
+        pBoxes->assign(boxes.begin(), boxes.end());
+
+        if (pForegroundMask)
+        {
+            m_depthForegroundMask.copyTo(*pForegroundMask);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&m_filterLock);
+
+    return hr;
+}
+
+/// <summary>
+/// Draws the outlines of foreground bounding boxes in the given Mat
+/// </summary>
+/// <param name="pImg">pointer to Mat in which to draw the boxes</param>
+/// <param name="boxes">bounding boxes to draw</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVHelper::DrawForegroundBoxes(Mat* pImg, const std::vector<Rect>& boxes)
+{
+    // Fail if pointer is invalid
+    if (!pImg)
+    {
+        return E_POINTER;
+    }
+
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        rectangle(*pImg, boxes[i], FOREGROUND_BOX_COLOR);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Labels each foreground bounding box in the given Mat with the mean distance of the points in it
+/// </summary>
+/// <param name="pImg">pointer to Mat in which to draw the labels</param>
+/// <param name="boxes">bounding boxes to label</param>
+/// <param name="pointsZ">Z coordinates of the depth pixels in meters, of type CV_32F</param>
+/// <param name="pointMask">255 for the points to average and 0 for the others, of type CV_8U</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT OpenCVHelper::DrawForegroundDistances(Mat* pImg, const std::vector<Rect>& boxes, const Mat& pointsZ, const Mat& pointMask)
+{
+    // Fail if pointer is invalid
+    if (!pImg)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the points do not cover the image
+    if (pointsZ.type() != CV_32F || pointMask.type() != CV_8U || pointsZ.size() != pImg->size() || pointMask.size() != pImg->size())
+    {
+        return E_INVALIDARG;
+    }
+
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        const Rect& box = boxes[i];
+
+        // Boxes with no valid point in them are left unlabeled
+        Mat boxMask = pointMask(box);
+        if (countNonZero(boxMask) == 0)
+        {
+            continue;
+        }
+
+        char label[16];
+        StringCchPrintfA(label, _countof(label), "%.2f m", mean(pointsZ(box), boxMask)[0]);
+
+        // Write the label inside the top of the box, where it stays in the image
+        putText(*pImg, label, Point(box.x + 2, box.y + 12), FONT_HERSHEY_PLAIN, 0.8, FOREGROUND_BOX_COLOR);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the cost of each node of the active filters to the debugger output
+/// </summary>
+/// <param name="intervalMillis">do nothing unless this many milliseconds have passed since the last report</param>
+void OpenCVHelper::ReportFilterCosts(DWORD intervalMillis)
+{
+    DWORD tickCount = GetTickCount();
+    if (tickCount - m_lastReportTickCount < intervalMillis)
+    {
+        return;
+    }
+
+    m_lastReportTickCount = tickCount;
+
+    AcquireSRWLockShared(&m_filterLock);
+    if (!m_colorGraph.IsEmpty())
+    {
+        m_colorGraph.Report(L"color");
+    }
+
+    if (!m_depthGraph.IsEmpty())
+    {
+        m_depthGraph.Report(L"depth");
+    }
+
+    m_colorEdgeDetector.Report(L"color");
+    m_depthEdgeDetector.Report(L"depth");
+    m_temporalDepthFilter.Report(L"depth");
+    m_depthBackgroundModel.Report(L"depth");
+    ReleaseSRWLockShared(&m_filterLock);
+}
+
+/// <summary>
+/// Rebuilds a filter graph for the filter corresponding to the given resource ID
+/// </summary>
+/// <param name="pGraph">pointer to the graph to rebuild</param>
+/// <param name="filterID">resource ID of filter to use</param>
+/// <param name="isDepth">true to use the settings of the depth filters, false for the color filters</param>
+void OpenCVHelper::BuildFilterGraph(Microsoft::KinectBridge::FilterGraph* pGraph, int filterID, bool isDepth)
+{
+    using namespace Microsoft::KinectBridge;
+
+    // The Canny edge filters run on the edge detectors instead, and the depth plane filters on the
+    // depths before they are colorized, so their graphs are left empty
+    pGraph->Clear();
+
+    switch (filterID)
+    {
+    case IDM_COLOR_FILTER_GAUSSIANBLUR:
     case IDM_DEPTH_FILTER_GAUSSIANBLUR:
         {
-            GaussianBlur(*pImg, *pImg, Size(5,5), 0);
+            const double kernelSize = isDepth ? 5.0 : 7.0;
+            pGraph->AddNode(FILTER_TYPE_GAUSSIAN_BLUR, FilterGraph::SOURCE_NODE, kernelSize);
         }
         break;
+    case IDM_COLOR_FILTER_DILATE:
     case IDM_DEPTH_FILTER_DILATE:
         {
-            dilate(*pImg, *pImg, Mat());
+            // Blur before dilating, so that single noisy pixels are not grown into blocks
+            int node = FilterGraph::SOURCE_NODE;
+            pGraph->AddNode(FILTER_TYPE_GAUSSIAN_BLUR, node, 3.0, 0.0, &node);
+            pGraph->AddNode(FILTER_TYPE_DILATE, node, 1.0);
         }
         break;
+    case IDM_COLOR_FILTER_ERODE:
     case IDM_DEPTH_FILTER_ERODE:
         {
-            erode(*pImg, *pImg, Mat());
-        }
-        break;
-    case IDM_DEPTH_FILTER_CANNYEDGE:
-        {
-            const double minThreshold = 5.0;
-            const double maxThreshold = 20.0;
-
-            // Convert image to grayscale for edge detection
-            cvtColor(*pImg, *pImg, CV_RGBA2GRAY);
-            // Remove noise
-            blur(*pImg, *pImg, Size(3,3));
-            // Find edges in image
-            Canny(*pImg, *pImg, minThreshold, maxThreshold);
-            // Convert back to color for output
-            cvtColor(*pImg, *pImg, CV_GRAY2RGBA);
+            pGraph->AddNode(FILTER_TYPE_ERODE, FilterGraph::SOURCE_NODE, 1.0);
         }
         break;
     }
-
-    return S_OK;
 }
 
 /// <summary>
@@ -19,6 +19,10 @@
 #pragma warning(pop)
 
 #include "OpenCVFrameHelper.h"
+#include "FilterGraph.h"
+#include "EdgeDetector.h"
+#include "TemporalDepthFilter.h"
+#include "DepthBackgroundModel.h"
 
 using namespace cv;
 
@@ -28,6 +32,9 @@ class OpenCVHelper
     // Skeleton colors for each player index
     static const Scalar SKELETON_COLORS[NUI_SKELETON_COUNT];
 
+    // Color of the foreground bounding boxes
+    static const Scalar FOREGROUND_BOX_COLOR;
+
 public:
     /// <summary>
     /// Constructor
@@ -60,6 +67,73 @@ public:
     /// <returns>S_OK if successful, an error code otherwise</returns>
     HRESULT ApplyDepthFilter(Mat* pImg);
 
+    /// <summary>
+    /// Draws the edges of a color frame, as the Canny edge filter does, reading the frame where it is
+    /// </summary>
+    /// <param name="colorFrame">BGRX color frame, such as a view of the sensor's buffer</param>
+    /// <param name="pImg">pointer to Mat in which to draw the edges</param>
+    /// <returns>S_OK if successful, an error code otherwise</returns>
+    HRESULT DetectColorEdges(const Mat& colorFrame, Mat* pImg);
+
+    /// <summary>
+    /// Gets the depth plane filter corresponding to the given resource ID. Depth plane filters run
+    /// on the depths in millimeters before they are colorized, rather than through ApplyDepthFilter.
+    /// </summary>
+    /// <param name="filterID">resource ID of the filter</param>
+    /// <param name="pFilter">pointer in which to return the depth plane filter</param>
+    /// <returns>true if the resource ID is that of a depth plane filter, false otherwise</returns>
+    static bool GetDepthPlaneFilter(int filterID, Microsoft::KinectBridge::DepthPlaneFilter* pFilter);
+
+    /// <summary>
+    /// Smooths the depths of a frame with those of the frames before it, as the temporal depth filter does
+    /// </summary>
+    /// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+    /// <param name="playerImage">player indices of the depths, of type CV_8U</param>
+    /// <param name="pFilteredImage">pointer to Mat in which to return the smoothed depths</param>
+    /// <returns>S_OK if successful, an error code otherwise</returns>
+    HRESULT ApplyTemporalDepthFilter(const Mat& depthImage, const Mat& playerImage, Mat* pFilteredImage);
+
+    /// <summary>
+    /// Sets whether the depth background model learns from every depth frame, so its foreground
+    /// can be found and the depth plane filters restricted to it
+    /// </summary>
+    /// <param name="foregroundOnly">true to model the background and filter only the foreground, false to filter every pixel</param>
+    void SetDepthForegroundOnly(bool foregroundOnly);
+
+    /// <summary>
+    /// Adds the depths of a frame to the depth background model and finds their foreground
+    /// </summary>
+    /// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+    /// <param name="pRegions">pointer in which to return the regions covering the foreground tiles</param>
+    /// <param name="pBoxes">pointer in which to return the bounding boxes of the connected foreground tiles</param>
+    /// <param name="pForegroundMask">pointer in which to return 255 for foreground pixels and 0 for the others, of type CV_8U, or NULL</param>
+    /// <returns>S_OK if successful, an error code otherwise</returns>
+    HRESULT FindDepthForeground(const Mat& depthImage, std::vector<Rect>* pRegions, std::vector<Rect>* pBoxes, Mat* pForegroundMask);
+
+    /// <summary>
+    /// Draws the outlines of foreground bounding boxes in the given Mat
+    /// </summary>
+    /// <param name="pImg">pointer to Mat in which to draw the boxes</param>
+    /// <param name="boxes">bounding boxes to draw</param>
+    /// <returns>S_OK if successful, an error code otherwise</returns>
+    HRESULT DrawForegroundBoxes(Mat* pImg, const std::vector<Rect>& boxes);
+
+    /// <summary>
+    /// Labels each foreground bounding box in the given Mat with the mean distance of the points in it
+    /// </summary>
+    /// <param name="pImg">pointer to Mat in which to draw the labels</param>
+    /// <param name="boxes">bounding boxes to label</param>
+    /// <param name="pointsZ">Z coordinates of the depth pixels in meters, of type CV_32F</param>
+    /// <param name="pointMask">255 for the points to average and 0 for the others, of type CV_8U</param>
+    /// <returns>S_OK if successful, an error code otherwise</returns>
+    HRESULT DrawForegroundDistances(Mat* pImg, const std::vector<Rect>& boxes, const Mat& pointsZ, const Mat& pointMask);
+
+    /// <summary>
+    /// Writes the cost of each node of the active filters to the debugger output
+    /// </summary>
+    /// <param name="intervalMillis">do nothing unless this many milliseconds have passed since the last report</param>
+    void ReportFilterCosts(DWORD intervalMillis);
+
     /// <summary>
     /// Draws the skeletons from the skeleton frame in the given color image Mat
     /// </summary>
@@ -130,8 +204,41 @@ private:
     HRESULT GetCoordinatesForSkeletonPoint(Vector4 point, LONG* pX, LONG* pY, NUI_IMAGE_RESOLUTION colorResolution, 
         NUI_IMAGE_RESOLUTION depthResolution);
 
+    /// <summary>
+    /// Rebuilds a filter graph for the filter corresponding to the given resource ID
+    /// </summary>
+    /// <param name="pGraph">pointer to the graph to rebuild</param>
+    /// <param name="filterID">resource ID of filter to use</param>
+    /// <param name="isDepth">true to use the settings of the depth filters, false for the color filters</param>
+    static void BuildFilterGraph(Microsoft::KinectBridge::FilterGraph* pGraph, int filterID, bool isDepth);
+
     // Variables:
     // Resource IDs of the active filters
     int m_colorFilterID;
     int m_depthFilterID;
+
+    // Graphs running the active filters, which keep their buffers from frame to frame. Color
+    // frames are the sensor's BGRX pixels and colorized depth has red first.
+    Microsoft::KinectBridge::FilterGraph m_colorGraph;
+    Microsoft::KinectBridge::FilterGraph m_depthGraph;
+
+    // Canny edge filters, which keep their scratch planes from frame to frame
+    Microsoft::KinectBridge::EdgeDetector m_colorEdgeDetector;
+    Microsoft::KinectBridge::EdgeDetector m_depthEdgeDetector;
+
+    // Temporal depth filter, which keeps the history of every depth pixel from frame to frame
+    Microsoft::KinectBridge::TemporalDepthFilter m_temporalDepthFilter;
+
+    // Background model of the depths, which keeps every depth pixel's background from frame to frame
+    Microsoft::KinectBridge::DepthBackgroundModel m_depthBackgroundModel;
+    bool m_bIsDepthForegroundOnly;
+
+    // Foreground mask the background model writes, which keeps its buffer from frame to frame
+    Mat m_depthForegroundMask;
+
+    // Guards the graphs, edge detectors, temporal filter and background model, which are rebuilt on the UI thread and applied on the processing thread
+    SRWLOCK m_filterLock;
+
+    // Tick count of the last filter cost report
+    DWORD m_lastReportTickCount;
 };
\ No newline at end of file
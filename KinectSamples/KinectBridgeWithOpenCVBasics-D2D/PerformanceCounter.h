@@ -0,0 +1,24 @@
+//-----------------------------------------------------------------------------
+// <copyright file="PerformanceCounter.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Gets the current value of the performance counter
+        /// </summary>
+        /// <returns>counter value in ticks</returns>
+        inline LONGLONG GetTicks()
+        {
+            LARGE_INTEGER ticks;
+            QueryPerformanceCounter(&ticks);
+            return ticks.QuadPart;
+        }
+    }
+}
@@ -0,0 +1,270 @@
+//-----------------------------------------------------------------------------
+// <copyright file="PipelineProfiler.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "PipelineProfiler.h"
+
+#ifdef KINECTBRIDGE_ENABLE_PROFILING
+
+#include "PerformanceCounter.h"
+#include <strsafe.h>
+#include <math.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Profiler the pipeline records into
+    PipelineProfiler g_sharedProfiler;
+
+    // Display names, in PipelineStage order
+    LPCWSTR g_stageNames[PIPELINE_STAGE_COUNT] =
+    {
+        L"AcquireColor",
+        L"AcquireDepth",
+        L"AcquireSkeleton",
+        L"ConsumeFrameSet",
+        L"ColorConvert",
+        L"ColorFilter",
+        L"ColorDrawSkeletons",
+        L"ColorUpdateBitmap",
+        L"DepthConvert",
+        L"DepthBackground",
+        L"DepthFilter",
+        L"DepthDrawSkeletons",
+        L"DepthUpdateBitmap",
+        L"DepthPointCloud",
+        L"ProcessFrameSet",
+        L"Paint"
+    };
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+PipelineProfiler::PipelineProfiler()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_ticksPerSecond = frequency.QuadPart;
+    m_originTicks = GetTicks();
+    m_lastReportTicks = m_originTicks;
+
+    Reset();
+}
+
+/// <summary>
+/// Gets the profiler the pipeline records into
+/// </summary>
+/// <returns>shared profiler</returns>
+PipelineProfiler* PipelineProfiler::GetSharedProfiler()
+{
+    return &g_sharedProfiler;
+}
+
+/// <summary>
+/// Gets the current value of the performance counter
+/// </summary>
+/// <returns>counter value in ticks</returns>
+LONGLONG PipelineProfiler::GetTicks()
+{
+    return Microsoft::KinectBridge::GetTicks();
+}
+
+/// <summary>
+/// Records one run of a stage
+/// </summary>
+/// <param name="stage">stage that ran</param>
+/// <param name="startTicks">counter value when the stage started</param>
+/// <param name="endTicks">counter value when the stage ended</param>
+void PipelineProfiler::Record(PipelineStage stage, LONGLONG startTicks, LONGLONG endTicks)
+{
+    StageHistogram& histogram = m_stages[stage];
+    LONGLONG micros = (endTicks - startTicks) * 1000000 / m_ticksPerSecond;
+
+    InterlockedIncrement(&histogram.buckets[GetBucketIndex(micros)]);
+    InterlockedIncrement64(&histogram.count);
+    InterlockedExchangeAdd64(&histogram.totalMicros, micros);
+
+    LONGLONG maxMicros = histogram.maxMicros;
+    while (micros > maxMicros)
+    {
+        LONGLONG previous = InterlockedCompareExchange64(&histogram.maxMicros, micros, maxMicros);
+        if (previous == maxMicros)
+        {
+            break;
+        }
+        maxMicros = previous;
+    }
+
+    InterlockedExchange64(&histogram.lastStartTicks, startTicks);
+    InterlockedExchange64(&histogram.lastDurationMicros, micros);
+}
+
+/// <summary>
+/// Gets the latency summary of a stage
+/// </summary>
+/// <param name="stage">stage to summarize</param>
+/// <param name="pStatistics">pointer in which to return the summary</param>
+void PipelineProfiler::GetStageStatistics(PipelineStage stage, PipelineStageStatistics* pStatistics) const
+{
+    const StageHistogram& histogram = m_stages[stage];
+
+    // Work from a snapshot, since the stage may be recording meanwhile
+    LONG buckets[BUCKET_COUNT];
+    LONGLONG count = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        buckets[i] = histogram.buckets[i];
+        count += buckets[i];
+    }
+
+    LONGLONG maxMicros = histogram.maxMicros;
+
+    ZeroMemory(pStatistics, sizeof(*pStatistics));
+    pStatistics->count = count;
+    pStatistics->maxMicros = maxMicros;
+    pStatistics->lastStartMicros = static_cast<LONGLONG>((histogram.lastStartTicks - m_originTicks) * (1000000.0 / m_ticksPerSecond));
+    pStatistics->lastDurationMicros = histogram.lastDurationMicros;
+    if (0 == count)
+    {
+        return;
+    }
+
+    pStatistics->meanMicros = histogram.totalMicros / histogram.count;
+
+    // Walk the buckets until each percentile's rank is reached
+    const int percentileCount = 3;
+    const double percentiles[percentileCount] = { 0.50, 0.95, 0.99 };
+    LONGLONG* results[percentileCount] = { &pStatistics->p50Micros, &pStatistics->p95Micros, &pStatistics->p99Micros };
+
+    LONGLONG seen = 0;
+    int next = 0;
+    for (int i = 0; i < BUCKET_COUNT && next < percentileCount; ++i)
+    {
+        seen += buckets[i];
+        while (next < percentileCount && seen >= static_cast<LONGLONG>(ceil(percentiles[next] * count)))
+        {
+            // No percentile can exceed the longest run actually seen
+            LONGLONG upperBound = GetBucketUpperBound(i);
+            *results[next] = (upperBound < maxMicros) ? upperBound : maxMicros;
+            ++next;
+        }
+    }
+}
+
+/// <summary>
+/// Gets the display name of a stage
+/// </summary>
+/// <param name="stage">stage to name</param>
+/// <returns>name of the stage</returns>
+LPCWSTR PipelineProfiler::GetStageName(PipelineStage stage)
+{
+    return g_stageNames[stage];
+}
+
+/// <summary>
+/// Writes the latency summary of every stage that ran to the debugger output
+/// </summary>
+/// <param name="intervalMillis">do nothing unless this many milliseconds have passed since the last report</param>
+void PipelineProfiler::Report(DWORD intervalMillis /* = 0 */)
+{
+    // Only the caller that moves the last report time forward writes the report
+    LONGLONG nowTicks = GetTicks();
+    LONGLONG lastReportTicks = m_lastReportTicks;
+    if ((nowTicks - lastReportTicks) * 1000 < static_cast<LONGLONG>(intervalMillis) * m_ticksPerSecond ||
+        InterlockedCompareExchange64(&m_lastReportTicks, nowTicks, lastReportTicks) != lastReportTicks)
+    {
+        return;
+    }
+
+    OutputDebugString(L"KinectBridge pipeline latency (microseconds):\n");
+
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; ++i)
+    {
+        PipelineStage stage = static_cast<PipelineStage>(i);
+
+        PipelineStageStatistics statistics;
+        GetStageStatistics(stage, &statistics);
+        if (0 == statistics.count)
+        {
+            continue;
+        }
+
+        WCHAR line[256];
+        StringCchPrintf(line, _countof(line), L"  %-20s n=%I64d mean=%I64d p50=%I64d p95=%I64d p99=%I64d max=%I64d\n",
+            GetStageName(stage), statistics.count, statistics.meanMicros,
+            statistics.p50Micros, statistics.p95Micros, statistics.p99Micros, statistics.maxMicros);
+        OutputDebugString(line);
+    }
+}
+
+/// <summary>
+/// Discards everything recorded so far
+/// </summary>
+void PipelineProfiler::Reset()
+{
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; ++i)
+    {
+        StageHistogram& histogram = m_stages[i];
+        for (int j = 0; j < BUCKET_COUNT; ++j)
+        {
+            InterlockedExchange(&histogram.buckets[j], 0);
+        }
+
+        InterlockedExchange64(&histogram.count, 0);
+        InterlockedExchange64(&histogram.totalMicros, 0);
+        InterlockedExchange64(&histogram.maxMicros, 0);
+        InterlockedExchange64(&histogram.lastStartTicks, m_originTicks);
+        InterlockedExchange64(&histogram.lastDurationMicros, 0);
+    }
+}
+
+/// <summary>
+/// Gets the bucket a duration falls in
+/// </summary>
+/// <param name="micros">duration in microseconds</param>
+/// <returns>index of the bucket</returns>
+int PipelineProfiler::GetBucketIndex(LONGLONG micros)
+{
+    if (micros < SUB_BUCKET_COUNT)
+    {
+        return (micros < 0) ? 0 : static_cast<int>(micros);
+    }
+
+    // Shift the duration until it lands in the upper half of the sub-buckets
+    int shift = 0;
+    while ((micros >> shift) >= SUB_BUCKET_COUNT)
+    {
+        ++shift;
+    }
+
+    if (shift > DOUBLING_COUNT)
+    {
+        return BUCKET_COUNT - 1;
+    }
+
+    return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF_COUNT + static_cast<int>(micros >> shift) - SUB_BUCKET_HALF_COUNT;
+}
+
+/// <summary>
+/// Gets the largest duration that falls in a bucket
+/// </summary>
+/// <param name="bucketIndex">index of the bucket</param>
+/// <returns>duration in microseconds</returns>
+LONGLONG PipelineProfiler::GetBucketUpperBound(int bucketIndex)
+{
+    if (bucketIndex < SUB_BUCKET_COUNT)
+    {
+        return bucketIndex;
+    }
+
+    int shift = (bucketIndex - SUB_BUCKET_COUNT) / SUB_BUCKET_HALF_COUNT + 1;
+    LONGLONG subBucket = (bucketIndex - SUB_BUCKET_COUNT) % SUB_BUCKET_HALF_COUNT + SUB_BUCKET_HALF_COUNT;
+
+    return ((subBucket + 1) << shift) - 1;
+}
+
+#endif
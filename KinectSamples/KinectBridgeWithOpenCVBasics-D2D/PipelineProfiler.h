@@ -0,0 +1,243 @@
+//-----------------------------------------------------------------------------
+// <copyright file="PipelineProfiler.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+// Stage timing is only compiled in when KINECTBRIDGE_ENABLE_PROFILING is defined. Otherwise
+// the KINECTBRIDGE_PROFILE_* macros expand to nothing and no profiler code is built.
+#ifdef KINECTBRIDGE_ENABLE_PROFILING
+
+#include <windows.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Stages of the capture and display pipeline that are timed
+        /// </summary>
+        enum PipelineStage
+        {
+            // Acquisition thread: pulling a frame from the source into its ring
+            PIPELINE_STAGE_ACQUIRE_COLOR,
+            PIPELINE_STAGE_ACQUIRE_DEPTH,
+            PIPELINE_STAGE_ACQUIRE_SKELETON,
+
+            // Processing thread: taking a matched frame set out of the rings
+            PIPELINE_STAGE_CONSUME_FRAME_SET,
+
+            // Processing thread: color image conversion, filtering, skeleton drawing and bitmap update
+            PIPELINE_STAGE_COLOR_CONVERT,
+            PIPELINE_STAGE_COLOR_FILTER,
+            PIPELINE_STAGE_COLOR_DRAW_SKELETONS,
+            PIPELINE_STAGE_COLOR_UPDATE_BITMAP,
+
+            // Processing thread: depth image conversion, background modeling, filtering, skeleton drawing and bitmap update
+            PIPELINE_STAGE_DEPTH_CONVERT,
+            PIPELINE_STAGE_DEPTH_BACKGROUND,
+            PIPELINE_STAGE_DEPTH_FILTER,
+            PIPELINE_STAGE_DEPTH_DRAW_SKELETONS,
+            PIPELINE_STAGE_DEPTH_UPDATE_BITMAP,
+
+            // Any thread: turning a depth frame into a point cloud
+            PIPELINE_STAGE_DEPTH_POINT_CLOUD,
+
+            // Processing thread: everything done for one frame set
+            PIPELINE_STAGE_PROCESS_FRAME_SET,
+
+            // Window thread: painting the bitmaps
+            PIPELINE_STAGE_PAINT,
+
+            PIPELINE_STAGE_COUNT
+        };
+
+        /// <summary>
+        /// Latency summary of one pipeline stage. All times are in microseconds.
+        /// </summary>
+        struct PipelineStageStatistics
+        {
+            // Number of times the stage ran
+            LONGLONG count;
+
+            // Mean and percentile durations, accurate to within 1/16 of the value
+            LONGLONG meanMicros;
+            LONGLONG p50Micros;
+            LONGLONG p95Micros;
+            LONGLONG p99Micros;
+
+            // Exact longest duration
+            LONGLONG maxMicros;
+
+            // When the last run started, measured from the creation of the profiler, and how long it took
+            LONGLONG lastStartMicros;
+            LONGLONG lastDurationMicros;
+        };
+
+        /// <summary>
+        /// Collects the duration of every run of every pipeline stage into a log-linear
+        /// histogram per stage. Durations are measured with the performance counter and
+        /// recorded with interlocked operations only, so any thread can record while
+        /// another one reads the statistics.
+        /// </summary>
+        class PipelineProfiler
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            PipelineProfiler();
+
+            /// <summary>
+            /// Gets the profiler the pipeline records into
+            /// </summary>
+            /// <returns>shared profiler</returns>
+            static PipelineProfiler* GetSharedProfiler();
+
+            /// <summary>
+            /// Gets the current value of the performance counter
+            /// </summary>
+            /// <returns>counter value in ticks</returns>
+            static LONGLONG GetTicks();
+
+            /// <summary>
+            /// Records one run of a stage
+            /// </summary>
+            /// <param name="stage">stage that ran</param>
+            /// <param name="startTicks">counter value when the stage started</param>
+            /// <param name="endTicks">counter value when the stage ended</param>
+            void Record(PipelineStage stage, LONGLONG startTicks, LONGLONG endTicks);
+
+            /// <summary>
+            /// Gets the latency summary of a stage
+            /// </summary>
+            /// <param name="stage">stage to summarize</param>
+            /// <param name="pStatistics">pointer in which to return the summary</param>
+            void GetStageStatistics(PipelineStage stage, PipelineStageStatistics* pStatistics) const;
+
+            /// <summary>
+            /// Gets the display name of a stage
+            /// </summary>
+            /// <param name="stage">stage to name</param>
+            /// <returns>name of the stage</returns>
+            static LPCWSTR GetStageName(PipelineStage stage);
+
+            /// <summary>
+            /// Writes the latency summary of every stage that ran to the debugger output
+            /// </summary>
+            /// <param name="intervalMillis">do nothing unless this many milliseconds have passed since the last report</param>
+            void Report(DWORD intervalMillis = 0);
+
+            /// <summary>
+            /// Discards everything recorded so far
+            /// </summary>
+            void Reset();
+
+        private:
+            // Constants:
+            // Durations below this many microseconds get a bucket each; every doubling above
+            // is split into half as many buckets
+            static const int SUB_BUCKET_COUNT = 32;
+            static const int SUB_BUCKET_HALF_COUNT = SUB_BUCKET_COUNT / 2;
+
+            // Number of doublings above SUB_BUCKET_COUNT that are tracked, about 67 seconds
+            static const int DOUBLING_COUNT = 21;
+
+            static const int BUCKET_COUNT = SUB_BUCKET_COUNT + DOUBLING_COUNT * SUB_BUCKET_HALF_COUNT;
+
+            /// <summary>
+            /// Histogram and counters of one stage, on cache lines of its own so that stages
+            /// timed on different threads do not contend
+            /// </summary>
+            struct DECLSPEC_ALIGN(64) StageHistogram
+            {
+                volatile LONG buckets[BUCKET_COUNT];
+                volatile LONGLONG count;
+                volatile LONGLONG totalMicros;
+                volatile LONGLONG maxMicros;
+                volatile LONGLONG lastStartTicks;
+                volatile LONGLONG lastDurationMicros;
+            };
+
+            // Profilers are not copied, since stages record into a fixed instance
+            PipelineProfiler(const PipelineProfiler&);
+            PipelineProfiler& operator=(const PipelineProfiler&);
+
+            // Functions:
+            /// <summary>
+            /// Gets the bucket a duration falls in
+            /// </summary>
+            /// <param name="micros">duration in microseconds</param>
+            /// <returns>index of the bucket</returns>
+            static int GetBucketIndex(LONGLONG micros);
+
+            /// <summary>
+            /// Gets the largest duration that falls in a bucket
+            /// </summary>
+            /// <param name="bucketIndex">index of the bucket</param>
+            /// <returns>duration in microseconds</returns>
+            static LONGLONG GetBucketUpperBound(int bucketIndex);
+
+            // Variables:
+            StageHistogram m_stages[PIPELINE_STAGE_COUNT];
+
+            // Performance counter frequency, and counter value when the profiler was created
+            LONGLONG m_ticksPerSecond;
+            LONGLONG m_originTicks;
+
+            // Counter value at the last report
+            volatile LONGLONG m_lastReportTicks;
+        };
+
+        /// <summary>
+        /// Times the enclosing scope as one run of a stage
+        /// </summary>
+        class PipelineStageTimer
+        {
+        public:
+            /// <summary>
+            /// Constructor. Starts timing.
+            /// </summary>
+            /// <param name="stage">stage the scope belongs to</param>
+            explicit PipelineStageTimer(PipelineStage stage) :
+                m_stage(stage),
+                m_startTicks(PipelineProfiler::GetTicks())
+            {
+            }
+
+            /// <summary>
+            /// Destructor. Records the time since construction.
+            /// </summary>
+            ~PipelineStageTimer()
+            {
+                PipelineProfiler::GetSharedProfiler()->Record(m_stage, m_startTicks, PipelineProfiler::GetTicks());
+            }
+
+        private:
+            PipelineStageTimer(const PipelineStageTimer&);
+            PipelineStageTimer& operator=(const PipelineStageTimer&);
+
+            PipelineStage m_stage;
+            LONGLONG m_startTicks;
+        };
+    }
+}
+
+#define KINECTBRIDGE_PROFILE_CONCAT_INNER(a, b) a##b
+#define KINECTBRIDGE_PROFILE_CONCAT(a, b) KINECTBRIDGE_PROFILE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope as one run of a stage
+#define KINECTBRIDGE_PROFILE_STAGE(stage) \
+    Microsoft::KinectBridge::PipelineStageTimer KINECTBRIDGE_PROFILE_CONCAT(pipelineStageTimer, __LINE__)(Microsoft::KinectBridge::stage)
+
+// Writes the latency summary of every stage to the debugger output, at most once per interval
+#define KINECTBRIDGE_PROFILE_REPORT(intervalMillis) \
+    Microsoft::KinectBridge::PipelineProfiler::GetSharedProfiler()->Report(intervalMillis)
+
+#else
+
+#define KINECTBRIDGE_PROFILE_STAGE(stage)
+#define KINECTBRIDGE_PROFILE_REPORT(intervalMillis)
+
+#endif
@@ -0,0 +1,416 @@
+//-----------------------------------------------------------------------------
+// <copyright file="PixelKernels.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Pixel layouts a Kinect depth frame can be converted into
+        /// </summary>
+        enum DepthImageFormat
+        {
+            // 16-bit depth and player index, exactly as the sensor captured it
+            DEPTH_IMAGE_FORMAT_PACKED,
+
+            // 16-bit depth in millimeters
+            DEPTH_IMAGE_FORMAT_MILLIMETERS,
+
+            // 32-bit floating point depth in meters
+            DEPTH_IMAGE_FORMAT_METERS,
+
+            // 8-bit mask of the pixels that belong to a player
+            DEPTH_IMAGE_FORMAT_PLAYER_MASK,
+
+            DEPTH_IMAGE_FORMAT_COUNT
+        };
+
+        // Pixel formats. Each gives the type of the elements a pixel is stored in and how many
+        // elements make up a pixel, so kernels can walk rows with typed pointers.
+
+        /// <summary>
+        /// Kinect color pixel: blue, green, red and a padding byte, read as one 32-bit value
+        /// </summary>
+        struct BgrxPixelFormat
+        {
+            typedef UINT32 Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// Kinect depth pixel: depth in millimeters shifted up by NUI_IMAGE_PLAYER_INDEX_SHIFT, player index below it
+        /// </summary>
+        struct PackedDepthPixelFormat
+        {
+            typedef USHORT Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// Depth in millimeters with no player index
+        /// </summary>
+        struct DepthPixelFormat
+        {
+            typedef USHORT Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// Red, green, blue and an opaque alpha, read as one 32-bit value
+        /// </summary>
+        struct RgbaPixelFormat
+        {
+            typedef UINT32 Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// Blue, green and red bytes with no padding
+        /// </summary>
+        struct BgrPixelFormat
+        {
+            typedef BYTE Element;
+            static const UINT ELEMENTS_PER_PIXEL = 3;
+        };
+
+        /// <summary>
+        /// 8-bit luma
+        /// </summary>
+        struct Gray8PixelFormat
+        {
+            typedef BYTE Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// Depth in meters, 0 where the sensor has no depth
+        /// </summary>
+        struct MetersPixelFormat
+        {
+            typedef float Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// 255 where the pixel belongs to a player, 0 elsewhere
+        /// </summary>
+        struct PlayerMaskPixelFormat
+        {
+            typedef BYTE Element;
+            static const UINT ELEMENTS_PER_PIXEL = 1;
+        };
+
+        /// <summary>
+        /// Converts one pixel from the Source format into the Destination format. Only the
+        /// conversions that make sense are specialized; any other pair fails to compile.
+        /// </summary>
+        template <typename Source, typename Destination>
+        struct PixelKernel;
+
+        /// <summary>
+        /// BGRX to RGBA: swaps red and blue and makes the pixel opaque
+        /// </summary>
+        template <>
+        struct PixelKernel<BgrxPixelFormat, RgbaPixelFormat>
+        {
+            static void Convert(const UINT32* pIn, UINT32* pOut)
+            {
+                UINT32 pixel = *pIn;
+                *pOut = (pixel & 0x0000FF00) | ((pixel >> 16) & 0x000000FF) | ((pixel & 0x000000FF) << 16) | 0xFF000000;
+            }
+        };
+
+        /// <summary>
+        /// BGRX to BGR: drops the padding byte
+        /// </summary>
+        template <>
+        struct PixelKernel<BgrxPixelFormat, BgrPixelFormat>
+        {
+            static void Convert(const UINT32* pIn, BYTE* pOut)
+            {
+                UINT32 pixel = *pIn;
+                pOut[0] = static_cast<BYTE>(pixel);
+                pOut[1] = static_cast<BYTE>(pixel >> 8);
+                pOut[2] = static_cast<BYTE>(pixel >> 16);
+            }
+        };
+
+        /// <summary>
+        /// BGRX to gray, with the Rec. 601 weights scaled so they add up to 256
+        /// </summary>
+        template <>
+        struct PixelKernel<BgrxPixelFormat, Gray8PixelFormat>
+        {
+            static const UINT BLUE_WEIGHT = 29;
+            static const UINT GREEN_WEIGHT = 150;
+            static const UINT RED_WEIGHT = 77;
+
+            static void Convert(const UINT32* pIn, BYTE* pOut)
+            {
+                UINT32 pixel = *pIn;
+                UINT luma = BLUE_WEIGHT * (pixel & 0xFF) + GREEN_WEIGHT * ((pixel >> 8) & 0xFF) + RED_WEIGHT * ((pixel >> 16) & 0xFF);
+                *pOut = static_cast<BYTE>((luma + 128) >> 8);
+            }
+        };
+
+        /// <summary>
+        /// Packed depth to packed depth: a copy
+        /// </summary>
+        template <>
+        struct PixelKernel<PackedDepthPixelFormat, PackedDepthPixelFormat>
+        {
+            static void Convert(const USHORT* pIn, USHORT* pOut)
+            {
+                *pOut = *pIn;
+            }
+        };
+
+        /// <summary>
+        /// Packed depth to millimeters: drops the player index
+        /// </summary>
+        template <>
+        struct PixelKernel<PackedDepthPixelFormat, DepthPixelFormat>
+        {
+            static void Convert(const USHORT* pIn, USHORT* pOut)
+            {
+                *pOut = static_cast<USHORT>(*pIn >> NUI_IMAGE_PLAYER_INDEX_SHIFT);
+            }
+        };
+
+        /// <summary>
+        /// Packed depth to meters
+        /// </summary>
+        template <>
+        struct PixelKernel<PackedDepthPixelFormat, MetersPixelFormat>
+        {
+            static void Convert(const USHORT* pIn, float* pOut)
+            {
+                *pOut = (*pIn >> NUI_IMAGE_PLAYER_INDEX_SHIFT) * 0.001f;
+            }
+        };
+
+        /// <summary>
+        /// Packed depth to player mask
+        /// </summary>
+        template <>
+        struct PixelKernel<PackedDepthPixelFormat, PlayerMaskPixelFormat>
+        {
+            static void Convert(const USHORT* pIn, BYTE* pOut)
+            {
+                *pOut = (*pIn & NUI_IMAGE_PLAYER_INDEX_MASK) ? 255 : 0;
+            }
+        };
+
+        /// <summary>
+        /// Millimeters to millimeters: a copy
+        /// </summary>
+        template <>
+        struct PixelKernel<DepthPixelFormat, DepthPixelFormat>
+        {
+            static void Convert(const USHORT* pIn, USHORT* pOut)
+            {
+                *pOut = *pIn;
+            }
+        };
+
+        /// <summary>
+        /// Millimeters to meters
+        /// </summary>
+        template <>
+        struct PixelKernel<DepthPixelFormat, MetersPixelFormat>
+        {
+            static void Convert(const USHORT* pIn, float* pOut)
+            {
+                *pOut = *pIn * 0.001f;
+            }
+        };
+
+        /// <summary>
+        /// Width and height of a sensor resolution as compile-time constants
+        /// </summary>
+        template <NUI_IMAGE_RESOLUTION Resolution>
+        struct ResolutionTraits;
+
+        template <>
+        struct ResolutionTraits<NUI_IMAGE_RESOLUTION_80x60>
+        {
+            static const UINT WIDTH = 80;
+            static const UINT HEIGHT = 60;
+        };
+
+        template <>
+        struct ResolutionTraits<NUI_IMAGE_RESOLUTION_320x240>
+        {
+            static const UINT WIDTH = 320;
+            static const UINT HEIGHT = 240;
+        };
+
+        template <>
+        struct ResolutionTraits<NUI_IMAGE_RESOLUTION_640x480>
+        {
+            static const UINT WIDTH = 640;
+            static const UINT HEIGHT = 480;
+        };
+
+        template <>
+        struct ResolutionTraits<NUI_IMAGE_RESOLUTION_1280x960>
+        {
+            static const UINT WIDTH = 1280;
+            static const UINT HEIGHT = 960;
+        };
+
+        /// <summary>
+        /// Converts whole images of one resolution. The loop bounds are constants, so the
+        /// compiler can unroll and vectorize the row loop for each format pair.
+        /// </summary>
+        template <typename Source, typename Destination, NUI_IMAGE_RESOLUTION Resolution>
+        struct ImageKernel
+        {
+            typedef typename Source::Element SourceElement;
+            typedef typename Destination::Element DestinationElement;
+
+            static const UINT WIDTH = ResolutionTraits<Resolution>::WIDTH;
+            static const UINT HEIGHT = ResolutionTraits<Resolution>::HEIGHT;
+
+            // Bytes a row takes without padding
+            static const UINT SOURCE_ROW_SIZE = WIDTH * Source::ELEMENTS_PER_PIXEL * sizeof(SourceElement);
+            static const UINT DESTINATION_ROW_SIZE = WIDTH * Destination::ELEMENTS_PER_PIXEL * sizeof(DestinationElement);
+
+            /// <summary>
+            /// Converts one row of pixels
+            /// </summary>
+            /// <param name="pIn">first source pixel of the row</param>
+            /// <param name="pOut">first destination pixel of the row</param>
+            static void ConvertRow(const SourceElement* pIn, DestinationElement* pOut)
+            {
+                for (UINT x = 0; x < WIDTH; ++x)
+                {
+                    PixelKernel<Source, Destination>::Convert(pIn + x * Source::ELEMENTS_PER_PIXEL,
+                        pOut + x * Destination::ELEMENTS_PER_PIXEL);
+                }
+            }
+
+            /// <summary>
+            /// Converts a band of consecutive rows
+            /// </summary>
+            /// <param name="pSource">first byte of the first source row</param>
+            /// <param name="sourcePitch">bytes between the starts of source rows</param>
+            /// <param name="pDestination">first byte of the first destination row</param>
+            /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+            /// <param name="rowCount">number of rows to convert</param>
+            static void ConvertRows(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch, UINT rowCount)
+            {
+                for (UINT y = 0; y < rowCount; ++y)
+                {
+                    ConvertRow(reinterpret_cast<const SourceElement*>(pSource + y * sourcePitch),
+                        reinterpret_cast<DestinationElement*>(pDestination + y * destinationPitch));
+                }
+            }
+        };
+
+        /// <summary>
+        /// Converts a band of rows of an image of a resolution known at compile time. Bands
+        /// are converted independently, so an image split into bands comes out the same as
+        /// when converted whole.
+        /// </summary>
+        /// <param name="firstRow">first row of the band</param>
+        /// <param name="rowCount">number of rows in the band</param>
+        /// <param name="pSource">first byte of the source image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">first byte of the destination image</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if a pitch is shorter than a row or the band is outside the image</returns>
+        template <typename Source, typename Destination, NUI_IMAGE_RESOLUTION Resolution>
+        HRESULT ConvertPixelRows(UINT firstRow, UINT rowCount, const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch)
+        {
+            typedef ImageKernel<Source, Destination, Resolution> Kernel;
+
+            if (sourcePitch < static_cast<INT>(Kernel::SOURCE_ROW_SIZE) || destinationPitch < static_cast<INT>(Kernel::DESTINATION_ROW_SIZE)
+                || firstRow > Kernel::HEIGHT || rowCount > Kernel::HEIGHT - firstRow)
+            {
+                return E_INVALIDARG;
+            }
+
+            Kernel::ConvertRows(pSource + firstRow * sourcePitch, sourcePitch, pDestination + firstRow * destinationPitch, destinationPitch, rowCount);
+
+            return S_OK;
+        }
+
+        /// <summary>
+        /// Converts an image of a resolution known at compile time
+        /// </summary>
+        /// <param name="pSource">first byte of the source image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">first byte of the destination image</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <returns>S_OK if successful, E_INVALIDARG if a pitch is shorter than a row</returns>
+        template <typename Source, typename Destination, NUI_IMAGE_RESOLUTION Resolution>
+        HRESULT ConvertPixels(const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch)
+        {
+            return ConvertPixelRows<Source, Destination, Resolution>(0, ResolutionTraits<Resolution>::HEIGHT,
+                pSource, sourcePitch, pDestination, destinationPitch);
+        }
+
+        /// <summary>
+        /// Converts a band of rows of an image of a resolution known only at run time, by
+        /// picking the kernel compiled for it. Any Image type that can expose its rows and
+        /// pitch can use this.
+        /// </summary>
+        /// <param name="resolution">resolution of both images</param>
+        /// <param name="firstRow">first row of the band</param>
+        /// <param name="rowCount">number of rows in the band</param>
+        /// <param name="pSource">first byte of the source image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">first byte of the destination image</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Source, typename Destination>
+        HRESULT ConvertPixelRows(NUI_IMAGE_RESOLUTION resolution, UINT firstRow, UINT rowCount,
+            const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch)
+        {
+            if (!pSource || !pDestination)
+            {
+                return E_POINTER;
+            }
+
+            switch (resolution)
+            {
+            case NUI_IMAGE_RESOLUTION_80x60:
+                return ConvertPixelRows<Source, Destination, NUI_IMAGE_RESOLUTION_80x60>(firstRow, rowCount, pSource, sourcePitch, pDestination, destinationPitch);
+            case NUI_IMAGE_RESOLUTION_320x240:
+                return ConvertPixelRows<Source, Destination, NUI_IMAGE_RESOLUTION_320x240>(firstRow, rowCount, pSource, sourcePitch, pDestination, destinationPitch);
+            case NUI_IMAGE_RESOLUTION_640x480:
+                return ConvertPixelRows<Source, Destination, NUI_IMAGE_RESOLUTION_640x480>(firstRow, rowCount, pSource, sourcePitch, pDestination, destinationPitch);
+            case NUI_IMAGE_RESOLUTION_1280x960:
+                return ConvertPixelRows<Source, Destination, NUI_IMAGE_RESOLUTION_1280x960>(firstRow, rowCount, pSource, sourcePitch, pDestination, destinationPitch);
+            default:
+                return E_INVALIDARG;
+            }
+        }
+
+        /// <summary>
+        /// Converts an image of a resolution known only at run time, by picking the kernel
+        /// compiled for it. Any Image type that can expose its rows and pitch can use this.
+        /// </summary>
+        /// <param name="resolution">resolution of both images</param>
+        /// <param name="pSource">first byte of the source image</param>
+        /// <param name="sourcePitch">bytes between the starts of source rows</param>
+        /// <param name="pDestination">first byte of the destination image</param>
+        /// <param name="destinationPitch">bytes between the starts of destination rows</param>
+        /// <returns>S_OK if successful, an error code otherwise</returns>
+        template <typename Source, typename Destination>
+        HRESULT ConvertPixels(NUI_IMAGE_RESOLUTION resolution, const BYTE* pSource, INT sourcePitch, BYTE* pDestination, INT destinationPitch)
+        {
+            DWORD width, height;
+            NuiImageResolutionToSize(resolution, width, height);
+
+            return ConvertPixelRows<Source, Destination>(resolution, 0, height, pSource, sourcePitch, pDestination, destinationPitch);
+        }
+    }
+}
@@ -0,0 +1,301 @@
+//-----------------------------------------------------------------------------
+// <copyright file="PointCloudGenerator.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "PointCloudGenerator.h"
+#include <emmintrin.h>
+#include <malloc.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Pixels converted per SSE2 step
+    const UINT PIXELS_PER_STEP = 8;
+
+    // Alignment of the ray tables, so they are read with aligned loads
+    const SIZE_T RAY_ALIGNMENT = 16;
+
+    // Columns a region starts on a multiple of, so its rays stay aligned
+    const LONG RAY_ALIGNMENT_PIXELS = RAY_ALIGNMENT / sizeof(FLOAT);
+
+    // Largest depth a packed pixel can hold, in millimeters
+    const USHORT MAX_PACKED_DEPTH = 0xFFFF >> NUI_IMAGE_PLAYER_INDEX_SHIFT;
+
+    // Meters per millimeter
+    const FLOAT METERS_PER_MILLIMETER = 0.001f;
+}
+
+/// <summary>
+/// Constructor. Accepts the depths either range of the sensor can report.
+/// </summary>
+PointCloudGenerator::PointCloudGenerator() :
+    m_minDepth(NUI_IMAGE_DEPTH_MINIMUM_NEAR_MODE >> NUI_IMAGE_PLAYER_INDEX_SHIFT),
+    m_maxDepth(NUI_IMAGE_DEPTH_MAXIMUM >> NUI_IMAGE_PLAYER_INDEX_SHIFT)
+{
+    ZeroMemory(m_pRayX, sizeof(m_pRayX));
+    ZeroMemory(m_pRayY, sizeof(m_pRayY));
+    InitializeSRWLock(&m_lock);
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+PointCloudGenerator::~PointCloudGenerator()
+{
+    for (int i = 0; i < DEPTH_RESOLUTION_COUNT; ++i)
+    {
+        _aligned_free(m_pRayX[i]);
+        _aligned_free(m_pRayY[i]);
+    }
+}
+
+/// <summary>
+/// Sets the depths that are turned into points. Pixels outside them are masked out.
+/// </summary>
+/// <param name="minDepth">nearest valid depth in millimeters</param>
+/// <param name="maxDepth">farthest valid depth in millimeters</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the range is empty or beyond the sensor's</returns>
+HRESULT PointCloudGenerator::SetDepthRange(USHORT minDepth, USHORT maxDepth)
+{
+    // Depth 0 is what the sensor reports when it does not know, so it is never valid
+    if (minDepth == 0 || minDepth > maxDepth || maxDepth > MAX_PACKED_DEPTH)
+    {
+        return E_INVALIDARG;
+    }
+
+    AcquireSRWLockExclusive(&m_lock);
+    m_minDepth = minDepth;
+    m_maxDepth = maxDepth;
+    ReleaseSRWLockExclusive(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the depths that are turned into points
+/// </summary>
+/// <param name="pMinDepth">pointer in which to return the nearest valid depth in millimeters</param>
+/// <param name="pMaxDepth">pointer in which to return the farthest valid depth in millimeters</param>
+void PointCloudGenerator::GetDepthRange(USHORT* pMinDepth, USHORT* pMaxDepth) const
+{
+    AcquireSRWLockShared(&m_lock);
+    *pMinDepth = m_minDepth;
+    *pMaxDepth = m_maxDepth;
+    ReleaseSRWLockShared(&m_lock);
+}
+
+/// <summary>
+/// Converts a packed depth frame into points
+/// </summary>
+/// <param name="resolution">resolution of the depth frame</param>
+/// <param name="pDepth">packed depth pixels</param>
+/// <param name="depthPitch">bytes between the starts of depth rows</param>
+/// <param name="pX">width * height floats in which to return the X coordinates</param>
+/// <param name="pY">width * height floats in which to return the Y coordinates</param>
+/// <param name="pZ">width * height floats in which to return the Z coordinates</param>
+/// <param name="pValid">width * height bytes in which to return 255 for valid points and 0 for masked ones, or NULL</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT PointCloudGenerator::GeneratePoints(NUI_IMAGE_RESOLUTION resolution, const BYTE* pDepth, INT depthPitch,
+    FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const
+{
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+
+    return GeneratePointRows(resolution, 0, height, pDepth, depthPitch, pX, pY, pZ, pValid);
+}
+
+/// <summary>
+/// Converts a range of rows of a packed depth frame into points. The planes are laid
+/// out as for the whole frame, and only the points of the given rows are written.
+/// </summary>
+/// <param name="resolution">resolution of the depth frame</param>
+/// <param name="firstRow">first row to convert</param>
+/// <param name="rowCount">number of rows to convert</param>
+/// <param name="pDepth">packed depth pixels of the whole frame</param>
+/// <param name="depthPitch">bytes between the starts of depth rows</param>
+/// <param name="pX">width * height floats in which to return the X coordinates</param>
+/// <param name="pY">width * height floats in which to return the Y coordinates</param>
+/// <param name="pZ">width * height floats in which to return the Z coordinates</param>
+/// <param name="pValid">width * height bytes in which to return 255 for valid points and 0 for masked ones, or NULL</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT PointCloudGenerator::GeneratePointRows(NUI_IMAGE_RESOLUTION resolution, UINT firstRow, UINT rowCount, const BYTE* pDepth, INT depthPitch,
+    FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const
+{
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+    if (firstRow > height || rowCount > height - firstRow)
+    {
+        return E_INVALIDARG;
+    }
+
+    RECT region = {0, static_cast<LONG>(firstRow), static_cast<LONG>(width), static_cast<LONG>(firstRow + rowCount)};
+    return GeneratePointRegion(resolution, region, pDepth, depthPitch, pX, pY, pZ, pValid);
+}
+
+/// <summary>
+/// Converts a region of a packed depth frame into points. The planes are laid out as for the
+/// whole frame, and only the points of the region are written.
+/// </summary>
+/// <param name="resolution">resolution of the depth frame</param>
+/// <param name="region">pixels to convert, within the frame, whose left edge is a multiple of 4</param>
+/// <param name="pDepth">packed depth pixels of the whole frame</param>
+/// <param name="depthPitch">bytes between the starts of depth rows</param>
+/// <param name="pX">width * height floats in which to return the X coordinates</param>
+/// <param name="pY">width * height floats in which to return the Y coordinates</param>
+/// <param name="pZ">width * height floats in which to return the Z coordinates</param>
+/// <param name="pValid">width * height bytes in which to return 255 for valid points and 0 for masked ones, or NULL</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT PointCloudGenerator::GeneratePointRegion(NUI_IMAGE_RESOLUTION resolution, const RECT& region, const BYTE* pDepth, INT depthPitch,
+    FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const
+{
+    if (!pDepth || !pX || !pY || !pZ)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if the resolution is not one a depth stream has
+    if (resolution < NUI_IMAGE_RESOLUTION_80x60 || resolution >= DEPTH_RESOLUTION_COUNT)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Fail if the region is not in the frame, or would not keep the ray table aligned
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+    if (depthPitch < static_cast<INT>(width * sizeof(USHORT)) || region.left < 0 || region.top < 0 ||
+        region.left > region.right || region.top > region.bottom ||
+        static_cast<DWORD>(region.right) > width || static_cast<DWORD>(region.bottom) > height ||
+        region.left % RAY_ALIGNMENT_PIXELS != 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Build the table of this resolution on its first frame
+    AcquireSRWLockShared(&m_lock);
+    while (!m_pRayX[resolution])
+    {
+        ReleaseSRWLockShared(&m_lock);
+
+        AcquireSRWLockExclusive(&m_lock);
+        HRESULT hr = m_pRayX[resolution] ? S_OK : BuildRays(resolution);
+        ReleaseSRWLockExclusive(&m_lock);
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        AcquireSRWLockShared(&m_lock);
+    }
+
+    UINT left = static_cast<UINT>(region.left);
+    UINT columnCount = static_cast<UINT>(region.right - region.left);
+    for (UINT y = static_cast<UINT>(region.top); y < static_cast<UINT>(region.bottom); ++y)
+    {
+        UINT offset = y * width + left;
+        GenerateRow(reinterpret_cast<const USHORT*>(pDepth + y * depthPitch) + left, m_pRayX[resolution] + left, m_pRayY[resolution][y],
+            columnCount, pX + offset, pY + offset, pZ + offset, pValid ? pValid + offset : NULL);
+    }
+
+    ReleaseSRWLockShared(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Fills the ray table of a resolution. Called with m_lock held exclusively.
+/// </summary>
+/// <param name="resolution">depth resolution</param>
+/// <returns>S_OK if successful, E_OUTOFMEMORY if the table could not be allocated</returns>
+HRESULT PointCloudGenerator::BuildRays(NUI_IMAGE_RESOLUTION resolution) const
+{
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+
+    FLOAT* pRayX = static_cast<FLOAT*>(_aligned_malloc(width * sizeof(FLOAT), RAY_ALIGNMENT));
+    FLOAT* pRayY = static_cast<FLOAT*>(_aligned_malloc(height * sizeof(FLOAT), RAY_ALIGNMENT));
+    if (!pRayX || !pRayY)
+    {
+        _aligned_free(pRayX);
+        _aligned_free(pRayY);
+        return E_OUTOFMEMORY;
+    }
+
+    // Same projection as NuiTransformDepthImageToSkeleton, whose focal length is given for 320x240
+    FLOAT scaleX = NUI_CAMERA_DEPTH_NOMINAL_INVERSE_FOCAL_LENGTH_IN_PIXELS * 320.0f / width;
+    FLOAT scaleY = NUI_CAMERA_DEPTH_NOMINAL_INVERSE_FOCAL_LENGTH_IN_PIXELS * 240.0f / height;
+
+    for (UINT x = 0; x < width; ++x)
+    {
+        pRayX[x] = (static_cast<FLOAT>(x) - width / 2.0f) * scaleX;
+    }
+
+    for (UINT y = 0; y < height; ++y)
+    {
+        pRayY[y] = -(static_cast<FLOAT>(y) - height / 2.0f) * scaleY;
+    }
+
+    m_pRayX[resolution] = pRayX;
+    m_pRayY[resolution] = pRayY;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Converts a row of packed depth pixels into points, eight at a time
+/// </summary>
+void PointCloudGenerator::GenerateRow(const USHORT* pDepth, const FLOAT* pRayX, FLOAT rayY, UINT pixelCount,
+    FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const
+{
+    // Depths are at most 8191 after the shift, so signed 16-bit comparisons are safe
+    const __m128i minDepth = _mm_set1_epi16(static_cast<short>(m_minDepth - 1));
+    const __m128i maxDepth = _mm_set1_epi16(static_cast<short>(m_maxDepth + 1));
+    const __m128 metersPerMillimeter = _mm_set1_ps(METERS_PER_MILLIMETER);
+    const __m128 rowRayY = _mm_set1_ps(rayY);
+    const __m128i zero = _mm_setzero_si128();
+
+    UINT stepCount = pixelCount / PIXELS_PER_STEP;
+    for (UINT i = 0; i < stepCount; ++i)
+    {
+        UINT offset = i * PIXELS_PER_STEP;
+
+        __m128i depth = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepth + offset)), NUI_IMAGE_PLAYER_INDEX_SHIFT);
+        __m128i valid = _mm_and_si128(_mm_cmpgt_epi16(depth, minDepth), _mm_cmplt_epi16(depth, maxDepth));
+
+        // Masked pixels get a depth of 0, which puts them at the origin
+        depth = _mm_and_si128(depth, valid);
+        __m128 lowZ = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(depth, zero)), metersPerMillimeter);
+        __m128 highZ = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(depth, zero)), metersPerMillimeter);
+
+        _mm_storeu_ps(pX + offset, _mm_mul_ps(_mm_load_ps(pRayX + offset), lowZ));
+        _mm_storeu_ps(pX + offset + 4, _mm_mul_ps(_mm_load_ps(pRayX + offset + 4), highZ));
+        _mm_storeu_ps(pY + offset, _mm_mul_ps(rowRayY, lowZ));
+        _mm_storeu_ps(pY + offset + 4, _mm_mul_ps(rowRayY, highZ));
+        _mm_storeu_ps(pZ + offset, lowZ);
+        _mm_storeu_ps(pZ + offset + 4, highZ);
+
+        if (pValid)
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pValid + offset), _mm_packs_epi16(valid, valid));
+        }
+    }
+
+    for (UINT i = stepCount * PIXELS_PER_STEP; i < pixelCount; ++i)
+    {
+        USHORT depth = NuiDepthPixelToDepth(pDepth[i]);
+        bool isValid = depth >= m_minDepth && depth <= m_maxDepth;
+
+        FLOAT z = isValid ? depth * METERS_PER_MILLIMETER : 0.0f;
+        pX[i] = pRayX[i] * z;
+        pY[i] = rayY * z;
+        pZ[i] = z;
+
+        if (pValid)
+        {
+            pValid[i] = isValid ? 255 : 0;
+        }
+    }
+}
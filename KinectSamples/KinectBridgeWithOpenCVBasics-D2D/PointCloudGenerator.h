@@ -0,0 +1,134 @@
+//-----------------------------------------------------------------------------
+// <copyright file="PointCloudGenerator.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Converts packed depth frames into points in skeleton space, in meters. For each depth
+        /// resolution, tables hold the ray through every pixel, scaled to a depth of one meter,
+        /// so a point is its ray times its depth. The projection is separable, so the X of a ray
+        /// is kept per column and the Y per row. Points are returned as separate X, Y and Z
+        /// planes, and pixels without a depth in the valid range become the origin. Tables are
+        /// built on the first frame of each resolution, and several threads may convert at once.
+        /// </summary>
+        class PointCloudGenerator
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor. Accepts the depths either range of the sensor can report.
+            /// </summary>
+            PointCloudGenerator();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~PointCloudGenerator();
+
+            /// <summary>
+            /// Sets the depths that are turned into points. Pixels outside them are masked out.
+            /// </summary>
+            /// <param name="minDepth">nearest valid depth in millimeters</param>
+            /// <param name="maxDepth">farthest valid depth in millimeters</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the range is empty or beyond the sensor's</returns>
+            HRESULT SetDepthRange(USHORT minDepth, USHORT maxDepth);
+
+            /// <summary>
+            /// Gets the depths that are turned into points
+            /// </summary>
+            /// <param name="pMinDepth">pointer in which to return the nearest valid depth in millimeters</param>
+            /// <param name="pMaxDepth">pointer in which to return the farthest valid depth in millimeters</param>
+            void GetDepthRange(USHORT* pMinDepth, USHORT* pMaxDepth) const;
+
+            /// <summary>
+            /// Converts a packed depth frame into points
+            /// </summary>
+            /// <param name="resolution">resolution of the depth frame</param>
+            /// <param name="pDepth">packed depth pixels</param>
+            /// <param name="depthPitch">bytes between the starts of depth rows</param>
+            /// <param name="pX">width * height floats in which to return the X coordinates</param>
+            /// <param name="pY">width * height floats in which to return the Y coordinates</param>
+            /// <param name="pZ">width * height floats in which to return the Z coordinates</param>
+            /// <param name="pValid">width * height bytes in which to return 255 for valid points and 0 for masked ones, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GeneratePoints(NUI_IMAGE_RESOLUTION resolution, const BYTE* pDepth, INT depthPitch,
+                FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const;
+
+            /// <summary>
+            /// Converts a range of rows of a packed depth frame into points. The planes are laid
+            /// out as for the whole frame, and only the points of the given rows are written.
+            /// </summary>
+            /// <param name="resolution">resolution of the depth frame</param>
+            /// <param name="firstRow">first row to convert</param>
+            /// <param name="rowCount">number of rows to convert</param>
+            /// <param name="pDepth">packed depth pixels of the whole frame</param>
+            /// <param name="depthPitch">bytes between the starts of depth rows</param>
+            /// <param name="pX">width * height floats in which to return the X coordinates</param>
+            /// <param name="pY">width * height floats in which to return the Y coordinates</param>
+            /// <param name="pZ">width * height floats in which to return the Z coordinates</param>
+            /// <param name="pValid">width * height bytes in which to return 255 for valid points and 0 for masked ones, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GeneratePointRows(NUI_IMAGE_RESOLUTION resolution, UINT firstRow, UINT rowCount, const BYTE* pDepth, INT depthPitch,
+                FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const;
+
+            /// <summary>
+            /// Converts a region of a packed depth frame into points. The planes are laid out as for the
+            /// whole frame, and only the points of the region are written.
+            /// </summary>
+            /// <param name="resolution">resolution of the depth frame</param>
+            /// <param name="region">pixels to convert, within the frame, whose left edge is a multiple of 4</param>
+            /// <param name="pDepth">packed depth pixels of the whole frame</param>
+            /// <param name="depthPitch">bytes between the starts of depth rows</param>
+            /// <param name="pX">width * height floats in which to return the X coordinates</param>
+            /// <param name="pY">width * height floats in which to return the Y coordinates</param>
+            /// <param name="pZ">width * height floats in which to return the Z coordinates</param>
+            /// <param name="pValid">width * height bytes in which to return 255 for valid points and 0 for masked ones, or NULL</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GeneratePointRegion(NUI_IMAGE_RESOLUTION resolution, const RECT& region, const BYTE* pDepth, INT depthPitch,
+                FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const;
+
+        private:
+            // Constants:
+            // Number of resolutions a depth stream can have, from NUI_IMAGE_RESOLUTION_80x60 up
+            static const int DEPTH_RESOLUTION_COUNT = NUI_IMAGE_RESOLUTION_640x480 + 1;
+
+            // Generators are not copied, since they own their tables
+            PointCloudGenerator(const PointCloudGenerator&);
+            PointCloudGenerator& operator=(const PointCloudGenerator&);
+
+            // Functions:
+            /// <summary>
+            /// Fills the ray table of a resolution. Called with m_lock held exclusively.
+            /// </summary>
+            /// <param name="resolution">depth resolution</param>
+            /// <returns>S_OK if successful, E_OUTOFMEMORY if the table could not be allocated</returns>
+            HRESULT BuildRays(NUI_IMAGE_RESOLUTION resolution) const;
+
+            /// <summary>
+            /// Converts a row of packed depth pixels into points, eight at a time
+            /// </summary>
+            void GenerateRow(const USHORT* pDepth, const FLOAT* pRayX, FLOAT rayY, UINT pixelCount,
+                FLOAT* pX, FLOAT* pY, FLOAT* pZ, BYTE* pValid) const;
+
+            // Variables:
+            // X of the ray through each column and Y of the ray through each row per resolution,
+            // or NULL until first used
+            mutable FLOAT* m_pRayX[DEPTH_RESOLUTION_COUNT];
+            mutable FLOAT* m_pRayY[DEPTH_RESOLUTION_COUNT];
+
+            USHORT m_minDepth;
+            USHORT m_maxDepth;
+
+            // Held shared while converting and exclusively while building a table or changing the range
+            mutable SRWLOCK m_lock;
+        };
+    }
+}
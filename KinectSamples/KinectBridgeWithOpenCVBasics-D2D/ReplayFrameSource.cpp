@@ -0,0 +1,350 @@
+//-----------------------------------------------------------------------------
+// <copyright file="ReplayFrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "ReplayFrameSource.h"
+#include <algorithm>
+
+using namespace Microsoft::KinectBridge;
+
+// Period of the pacing timer in milliseconds
+static const DWORD REPLAY_TICK_MILLIS = 5;
+
+// Gap left between the last frame of the recording and the first frame of the next loop
+static const LONGLONG REPLAY_LOOP_GAP_MILLIS = 33;
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="isPaced">true to deliver frames with their recorded timing, false to deliver them as fast as they are read</param>
+/// <param name="isLooping">true to start over when the recording ends, false to stop delivering frames</param>
+ReplayFrameSource::ReplayFrameSource(bool isPaced /* = true */, bool isLooping /* = true */) :
+    SimulatedFrameSource(isPaced, REPLAY_TICK_MILLIS),
+    m_isLooping(isLooping),
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(NULL),
+    m_pView(NULL),
+    m_duration(0),
+    m_frameNumberSpan(0)
+{
+    m_fileName[0] = L'\0';
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+ReplayFrameSource::~ReplayFrameSource()
+{
+    Shutdown();
+    Close();
+}
+
+/// <summary>
+/// Opens a recording. Must be called before the source is initialized.
+/// </summary>
+/// <param name="fileName">path of the recording</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT ReplayFrameSource::Open(LPCWSTR fileName)
+{
+    // Fail if pointer is invalid
+    if (!fileName)
+    {
+        return E_POINTER;
+    }
+
+    Close();
+
+    m_hFile = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_hFile, &fileSize))
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    // Fail if file is too small to hold a header
+    if (fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FrameRecordingHeader)))
+    {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_hMapping)
+    {
+        m_pView = static_cast<const BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+
+    if (!m_pView)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    // Fail if file is not a recording we can read
+    FrameRecordingHeader header;
+    memcpy_s(&header, sizeof(header), m_pView, sizeof(header));
+    if (FrameRecorder::FRAME_RECORDING_MAGIC != header.magic || FrameRecorder::FRAME_RECORDING_VERSION != header.version)
+    {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    // Index the frames, stopping at a record cut short by an interrupted recording
+    const BYTE* pEnd = m_pView + fileSize.QuadPart;
+    const BYTE* pRecord = m_pView + sizeof(header);
+    while (static_cast<size_t>(pEnd - pRecord) >= sizeof(FrameRecordHeader))
+    {
+        ReplayRecord record;
+        memcpy_s(&record.header, sizeof(record.header), pRecord, sizeof(record.header));
+        record.pData = pRecord + sizeof(record.header);
+
+        if (record.header.stream >= FRAME_STREAM_COUNT || record.header.size < 0 || record.header.size > pEnd - record.pData)
+        {
+            break;
+        }
+
+        m_records[record.header.stream].push_back(record);
+        pRecord = record.pData + record.header.size;
+    }
+
+    // Time every stream against the earliest frame of the recording, so the streams stay in step
+    bool isEmpty = true;
+    LONGLONG firstTimeStamp = 0, lastTimeStamp = 0;
+    DWORD firstFrameNumber = 0, lastFrameNumber = 0;
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        for (std::vector<ReplayRecord>::const_iterator it = m_records[i].begin(); it != m_records[i].end(); ++it)
+        {
+            if (isEmpty || it->header.timeStamp < firstTimeStamp)
+            {
+                firstTimeStamp = it->header.timeStamp;
+                firstFrameNumber = it->header.frameNumber;
+            }
+
+            if (isEmpty || it->header.timeStamp > lastTimeStamp)
+            {
+                lastTimeStamp = it->header.timeStamp;
+                lastFrameNumber = it->header.frameNumber;
+            }
+
+            isEmpty = false;
+        }
+    }
+
+    if (isEmpty)
+    {
+        Close();
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        for (std::vector<ReplayRecord>::const_iterator it = m_records[i].begin(); it != m_records[i].end(); ++it)
+        {
+            m_relativeTimeStamps[i].push_back(it->header.timeStamp - firstTimeStamp);
+        }
+    }
+
+    m_duration = lastTimeStamp - firstTimeStamp + REPLAY_LOOP_GAP_MILLIS;
+    m_frameNumberSpan = lastFrameNumber - firstFrameNumber + 1;
+
+    wcscpy_s(m_fileName, ARRAYSIZE(m_fileName), fileName);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Closes the recording
+/// </summary>
+void ReplayFrameSource::Close()
+{
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        m_records[i].clear();
+        m_relativeTimeStamps[i].clear();
+    }
+
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = NULL;
+    }
+
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_fileName[0] = L'\0';
+    m_duration = 0;
+    m_frameNumberSpan = 0;
+}
+
+/// <summary>
+/// Returns a string identifying the device or recording behind the source
+/// </summary>
+/// <returns>path of the recording</returns>
+BSTR ReplayFrameSource::GetConnectionId() const
+{
+    return const_cast<BSTR>(m_fileName);
+}
+
+/// <summary>
+/// Checks whether the source can produce an image stream
+/// </summary>
+/// <param name="imageType">type of image stream</param>
+/// <param name="resolution">resolution of image stream</param>
+/// <returns>S_OK if the recording holds frames for the stream, an error code otherwise</returns>
+HRESULT ReplayFrameSource::CheckImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution) const
+{
+    const std::vector<ReplayRecord>& records = m_records[(NUI_IMAGE_TYPE_COLOR == imageType) ? FRAME_STREAM_COLOR : FRAME_STREAM_DEPTH];
+    for (std::vector<ReplayRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
+    {
+        if (it->header.resolution == resolution)
+        {
+            return S_OK;
+        }
+    }
+
+    return E_INVALIDARG;
+}
+
+/// <summary>
+/// Gets the number of frames of a stream that are due once the source has been running for a while
+/// </summary>
+/// <param name="stream">stream to count</param>
+/// <param name="elapsedMillis">number of milliseconds since the source was started</param>
+/// <returns>number of frames due</returns>
+LONG ReplayFrameSource::GetDueFrameCount(FrameStream stream, DWORD elapsedMillis) const
+{
+    const std::vector<LONGLONG>& timeStamps = m_relativeTimeStamps[stream];
+    if (timeStamps.empty())
+    {
+        return 0;
+    }
+
+    LONGLONG elapsed = elapsedMillis;
+    LONG loopCount = 0;
+    if (m_isLooping)
+    {
+        loopCount = static_cast<LONG>(elapsed / m_duration);
+        elapsed %= m_duration;
+    }
+
+    LONG dueInLoop = static_cast<LONG>(std::upper_bound(timeStamps.begin(), timeStamps.end(), elapsed) - timeStamps.begin());
+
+    return loopCount * static_cast<LONG>(timeStamps.size()) + dueInLoop;
+}
+
+/// <summary>
+/// Fills in an image frame
+/// </summary>
+/// <param name="stream">stream the frame belongs to</param>
+/// <param name="frameIndex">zero-based index of the frame within the stream</param>
+/// <param name="imageType">type of the image stream</param>
+/// <param name="resolution">resolution of the image stream</param>
+/// <param name="pImageFrame">frame whose time stamp and frame number are to be set</param>
+/// <param name="pBits">buffer to write the frame data to</param>
+/// <param name="pitch">number of bytes in each row of the buffer</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if the recorded frame does not fit the stream or the recording has ended</returns>
+HRESULT ReplayFrameSource::FillImageFrame(FrameStream stream, LONG frameIndex, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution,
+    NUI_IMAGE_FRAME* pImageFrame, BYTE* pBits, INT pitch)
+{
+    const ReplayRecord* pRecord;
+    LONG loop;
+    HRESULT hr = GetRecord(stream, frameIndex, &pRecord, &loop);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Frames recorded before a resolution change do not fit the stream as it is now
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+    if (pRecord->header.resolution != resolution || pRecord->header.pitch != pitch || pRecord->header.size != pitch * static_cast<INT>(height))
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    memcpy_s(pBits, pRecord->header.size, pRecord->pData, pRecord->header.size);
+
+    pImageFrame->dwFrameNumber = pRecord->header.frameNumber + loop * m_frameNumberSpan;
+    pImageFrame->liTimeStamp.QuadPart = pRecord->header.timeStamp + loop * m_duration;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Fills in a skeleton frame
+/// </summary>
+/// <param name="frameIndex">zero-based index of the frame within the stream</param>
+/// <param name="pSkeletonFrame">skeleton frame to fill in</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if the recording has ended</returns>
+HRESULT ReplayFrameSource::FillSkeletonFrame(LONG frameIndex, NUI_SKELETON_FRAME* pSkeletonFrame)
+{
+    const ReplayRecord* pRecord;
+    LONG loop;
+    HRESULT hr = GetRecord(FRAME_STREAM_SKELETON, frameIndex, &pRecord, &loop);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (sizeof(NUI_SKELETON_FRAME) != pRecord->header.size)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    memcpy_s(pSkeletonFrame, sizeof(*pSkeletonFrame), pRecord->pData, pRecord->header.size);
+
+    pSkeletonFrame->dwFrameNumber += loop * m_frameNumberSpan;
+    pSkeletonFrame->liTimeStamp.QuadPart += loop * m_duration;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Finds the recorded frame to deliver as a stream's frame
+/// </summary>
+/// <param name="stream">stream the frame belongs to</param>
+/// <param name="frameIndex">zero-based index of the frame within the stream</param>
+/// <param name="ppRecord">pointer in which to return the recorded frame</param>
+/// <param name="pLoop">pointer in which to return how many times the recording has looped</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no such frame</returns>
+HRESULT ReplayFrameSource::GetRecord(FrameStream stream, LONG frameIndex, const ReplayRecord** ppRecord, LONG* pLoop) const
+{
+    const std::vector<ReplayRecord>& records = m_records[stream];
+    if (records.empty())
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    const LONG recordCount = static_cast<LONG>(records.size());
+    LONG loop = frameIndex / recordCount;
+    if (loop > 0 && !m_isLooping)
+    {
+        return E_NUI_FRAME_NO_DATA;
+    }
+
+    *ppRecord = &records[frameIndex % recordCount];
+    *pLoop = loop;
+
+    return S_OK;
+}
@@ -0,0 +1,135 @@
+//-----------------------------------------------------------------------------
+// <copyright file="ReplayFrameSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include <vector>
+#include "SimulatedFrameSource.h"
+#include "FrameRecorder.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Frame source that plays back a recording written by FrameRecorder. The recording
+        /// is memory-mapped and its frames are delivered with their recorded timing, or as
+        /// fast as they are read when unpaced.
+        /// </summary>
+        class ReplayFrameSource : public SimulatedFrameSource
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            /// <param name="isPaced">true to deliver frames with their recorded timing, false to deliver them as fast as they are read</param>
+            /// <param name="isLooping">true to start over when the recording ends, false to stop delivering frames</param>
+            ReplayFrameSource(bool isPaced = true, bool isLooping = true);
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~ReplayFrameSource();
+
+            /// <summary>
+            /// Opens a recording. Must be called before the source is initialized.
+            /// </summary>
+            /// <param name="fileName">path of the recording</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Open(LPCWSTR fileName);
+
+            /// <summary>
+            /// Closes the recording
+            /// </summary>
+            void Close();
+
+            /// <summary>
+            /// Returns a string identifying the device or recording behind the source
+            /// </summary>
+            /// <returns>path of the recording</returns>
+            BSTR GetConnectionId() const override;
+
+        protected:
+            // Functions:
+            /// <summary>
+            /// Checks whether the source can produce an image stream
+            /// </summary>
+            /// <param name="imageType">type of image stream</param>
+            /// <param name="resolution">resolution of image stream</param>
+            /// <returns>S_OK if the recording holds frames for the stream, an error code otherwise</returns>
+            HRESULT CheckImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution) const override;
+
+            /// <summary>
+            /// Gets the number of frames of a stream that are due once the source has been running for a while
+            /// </summary>
+            /// <param name="stream">stream to count</param>
+            /// <param name="elapsedMillis">number of milliseconds since the source was started</param>
+            /// <returns>number of frames due</returns>
+            LONG GetDueFrameCount(FrameStream stream, DWORD elapsedMillis) const override;
+
+            /// <summary>
+            /// Fills in an image frame
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="imageType">type of the image stream</param>
+            /// <param name="resolution">resolution of the image stream</param>
+            /// <param name="pImageFrame">frame whose time stamp and frame number are to be set</param>
+            /// <param name="pBits">buffer to write the frame data to</param>
+            /// <param name="pitch">number of bytes in each row of the buffer</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if the recorded frame does not fit the stream or the recording has ended</returns>
+            HRESULT FillImageFrame(FrameStream stream, LONG frameIndex, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution,
+                NUI_IMAGE_FRAME* pImageFrame, BYTE* pBits, INT pitch) override;
+
+            /// <summary>
+            /// Fills in a skeleton frame
+            /// </summary>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="pSkeletonFrame">skeleton frame to fill in</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if the recording has ended</returns>
+            HRESULT FillSkeletonFrame(LONG frameIndex, NUI_SKELETON_FRAME* pSkeletonFrame) override;
+
+        private:
+            /// <summary>
+            /// Recorded frame, pointing into the mapped recording
+            /// </summary>
+            struct ReplayRecord
+            {
+                FrameRecordHeader header;
+                const BYTE* pData;
+            };
+
+            // Functions:
+            /// <summary>
+            /// Finds the recorded frame to deliver as a stream's frame
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="ppRecord">pointer in which to return the recorded frame</param>
+            /// <param name="pLoop">pointer in which to return how many times the recording has looped</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no such frame</returns>
+            HRESULT GetRecord(FrameStream stream, LONG frameIndex, const ReplayRecord** ppRecord, LONG* pLoop) const;
+
+            // Variables:
+            bool m_isLooping;
+
+            // Recording
+            WCHAR m_fileName[MAX_PATH];
+            HANDLE m_hFile;
+            HANDLE m_hMapping;
+            const BYTE* m_pView;
+
+            // Frames of each stream in recorded order, and their time stamps relative to the first frame of the recording
+            std::vector<ReplayRecord> m_records[FRAME_STREAM_COUNT];
+            std::vector<LONGLONG> m_relativeTimeStamps[FRAME_STREAM_COUNT];
+
+            // Length of one pass through the recording, in milliseconds and in frame numbers
+            LONGLONG m_duration;
+            DWORD m_frameNumberSpan;
+        };
+    }
+}
@@ -0,0 +1,595 @@
+//-----------------------------------------------------------------------------
+// <copyright file="SimulatedFrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "SimulatedFrameSource.h"
+
+using namespace Microsoft::KinectBridge;
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="isPaced">true to release frames on a timer, false to deliver them as fast as they are read</param>
+/// <param name="tickMillis">period of the pacing timer in milliseconds</param>
+SimulatedFrameSource::SimulatedFrameSource(bool isPaced, DWORD tickMillis) :
+    m_isPaced(isPaced),
+    m_tickMillis(tickMillis),
+    m_nuiInitFlags(0),
+    m_hStopEvent(NULL),
+    m_hPacingThread(NULL)
+{
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        StreamState& state = m_streams[i];
+        state.isOpen = false;
+        state.imageType = NUI_IMAGE_TYPE_COLOR;
+        state.resolution = NUI_IMAGE_RESOLUTION_INVALID;
+        state.flags = 0;
+        state.hNextFrameEvent = NULL;
+        state.dueCount = 0;
+        state.deliveredCount = 0;
+        state.pitch = 0;
+        state.size = 0;
+    }
+
+    InitializeCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Destructor. Derived classes must call Shutdown in their own destructor, since the
+/// pacing thread calls back into them.
+/// </summary>
+SimulatedFrameSource::~SimulatedFrameSource()
+{
+    Shutdown();
+
+    for (std::vector<BYTE*>::iterator it = m_retiredBuffers.begin(); it != m_retiredBuffers.end(); ++it)
+    {
+        FrameBufferPool::GetSharedPool()->Free(*it);
+    }
+
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Starts the source
+/// </summary>
+/// <param name="nuiInitFlags">NUI_INITIALIZE_FLAG_* values selecting the streams to use</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::Initialize(DWORD nuiInitFlags)
+{
+    // Fail if source is already running
+    if (m_hStopEvent)
+    {
+        return E_NUI_ALREADY_INITIALIZED;
+    }
+
+    m_nuiInitFlags = nuiInitFlags;
+    m_hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    // Every run starts again from the first frame
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        m_streams[i].dueCount = 0;
+        m_streams[i].deliveredCount = 0;
+    }
+
+    if (m_isPaced)
+    {
+        m_hPacingThread = CreateThread(NULL, 0, PacingThread, this, 0, NULL);
+        if (!m_hPacingThread)
+        {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            CloseHandle(m_hStopEvent);
+            m_hStopEvent = NULL;
+            return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops the source
+/// </summary>
+void SimulatedFrameSource::Shutdown()
+{
+    if (m_hPacingThread)
+    {
+        SetEvent(m_hStopEvent);
+        WaitForSingleObject(m_hPacingThread, INFINITE);
+        CloseHandle(m_hPacingThread);
+        m_hPacingThread = NULL;
+    }
+
+    if (m_hStopEvent)
+    {
+        CloseHandle(m_hStopEvent);
+        m_hStopEvent = NULL;
+    }
+
+    EnterCriticalSection(&m_lock);
+    for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+    {
+        CloseStream(m_streams[i]);
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Opens, or reopens, an image stream
+/// </summary>
+/// <param name="imageType">type of image stream to open</param>
+/// <param name="resolution">resolution of image stream</param>
+/// <param name="flags">image frame flags</param>
+/// <param name="frameBufferCount">number of frames to buffer</param>
+/// <param name="hNextFrameEvent">event to signal when a frame is available</param>
+/// <param name="phStreamHandle">pointer in which to return the stream handle</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::OpenImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, DWORD flags,
+    DWORD frameBufferCount, HANDLE hNextFrameEvent, HANDLE* phStreamHandle)
+{
+    // Fail if pointer is invalid
+    if (!phStreamHandle)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if source is not running
+    if (!m_hStopEvent)
+    {
+        return E_NUI_DEVICE_NOT_READY;
+    }
+
+    FrameStream stream;
+    DWORD bytesPerPixel;
+    DWORD requiredFlag;
+    if (NUI_IMAGE_TYPE_COLOR == imageType)
+    {
+        stream = FRAME_STREAM_COLOR;
+        bytesPerPixel = 4;
+        requiredFlag = NUI_INITIALIZE_FLAG_USES_COLOR;
+    }
+    else if (NUI_IMAGE_TYPE_DEPTH == imageType || NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX == imageType)
+    {
+        stream = FRAME_STREAM_DEPTH;
+        bytesPerPixel = sizeof(USHORT);
+        requiredFlag = (NUI_IMAGE_TYPE_DEPTH == imageType) ? NUI_INITIALIZE_FLAG_USES_DEPTH : NUI_INITIALIZE_FLAG_USES_DEPTH_AND_PLAYER_INDEX;
+    }
+    else
+    {
+        return E_INVALIDARG;
+    }
+
+    // Fail if the stream was not requested at initialization or cannot be produced
+    if (!(m_nuiInitFlags & requiredFlag))
+    {
+        return E_NUI_STREAM_NOT_ENABLED;
+    }
+
+    HRESULT hr = CheckImageStream(imageType, resolution);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+
+    EnterCriticalSection(&m_lock);
+
+    StreamState& state = m_streams[stream];
+    CloseStream(state);
+
+    state.isOpen = true;
+    state.imageType = imageType;
+    state.resolution = resolution;
+    state.flags = flags;
+    state.hNextFrameEvent = hNextFrameEvent;
+    state.pitch = static_cast<INT>(width * bytesPerPixel);
+    state.size = static_cast<INT>(height) * state.pitch;
+
+    // One buffer more than the caller may hold, so a new frame can always be filled
+    for (DWORD i = 0; i < frameBufferCount + 1 && SUCCEEDED(hr); ++i)
+    {
+        BYTE* pBuffer;
+        hr = FrameBufferPool::GetSharedPool()->Allocate(state.size, &pBuffer);
+        if (SUCCEEDED(hr))
+        {
+            state.buffers.push_back(pBuffer);
+            state.isBufferHeld.push_back(false);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        CloseStream(state);
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // An unpaced stream always has a frame ready
+    if (!m_isPaced)
+    {
+        SetEvent(hNextFrameEvent);
+    }
+
+    *phStreamHandle = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(stream) + 1);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Sets the image frame flags of an opened image stream
+/// </summary>
+/// <param name="hStreamHandle">stream handle</param>
+/// <param name="flags">image frame flags</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::SetImageStreamFlags(HANDLE hStreamHandle, DWORD flags)
+{
+    FrameStream stream;
+    HRESULT hr = GetImageStream(hStreamHandle, &stream);
+    if (SUCCEEDED(hr))
+    {
+        m_streams[stream].flags = flags;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Enables skeleton tracking
+/// </summary>
+/// <param name="hNextFrameEvent">event to signal when a skeleton frame is available</param>
+/// <param name="flags">skeleton tracking flags</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::EnableSkeletonTracking(HANDLE hNextFrameEvent, DWORD flags)
+{
+    // Fail if source is not running
+    if (!m_hStopEvent)
+    {
+        return E_NUI_DEVICE_NOT_READY;
+    }
+
+    // Fail if skeletons were not requested at initialization
+    if (!(m_nuiInitFlags & NUI_INITIALIZE_FLAG_USES_SKELETON))
+    {
+        return E_NUI_STREAM_NOT_ENABLED;
+    }
+
+    StreamState& state = m_streams[FRAME_STREAM_SKELETON];
+    state.flags = flags;
+
+    // Keep counting frames across repeated enables, like the sensor's frame numbers do
+    if (!state.isOpen)
+    {
+        state.isOpen = true;
+        state.hNextFrameEvent = hNextFrameEvent;
+
+        if (!m_isPaced)
+        {
+            SetEvent(hNextFrameEvent);
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the next frame of an image stream and locks its data
+/// </summary>
+/// <param name="hStreamHandle">stream handle</param>
+/// <param name="waitMillis">number of milliseconds to wait</param>
+/// <param name="pImage">pointer in which to return the frame</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::AcquireImageFrame(HANDLE hStreamHandle, DWORD waitMillis, FrameSourceImage* pImage)
+{
+    // Fail if pointer is invalid
+    if (!pImage)
+    {
+        return E_POINTER;
+    }
+
+    FrameStream stream;
+    HRESULT hr = GetImageStream(hStreamHandle, &stream);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    LONG frameIndex;
+    hr = WaitForFrame(stream, waitMillis, &frameIndex);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    StreamState& state = m_streams[stream];
+
+    // Take a buffer the caller is not holding, adding one if the caller holds them all
+    EnterCriticalSection(&m_lock);
+
+    size_t bufferIndex = 0;
+    while (bufferIndex < state.buffers.size() && state.isBufferHeld[bufferIndex])
+    {
+        ++bufferIndex;
+    }
+
+    if (bufferIndex == state.buffers.size())
+    {
+        BYTE* pBuffer;
+        hr = FrameBufferPool::GetSharedPool()->Allocate(state.size, &pBuffer);
+        if (FAILED(hr))
+        {
+            LeaveCriticalSection(&m_lock);
+            return hr;
+        }
+
+        state.buffers.push_back(pBuffer);
+        state.isBufferHeld.push_back(false);
+    }
+
+    state.isBufferHeld[bufferIndex] = true;
+    BYTE* pBits = state.buffers[bufferIndex];
+
+    LeaveCriticalSection(&m_lock);
+
+    ZeroMemory(pImage, sizeof(*pImage));
+    pImage->imageFrame.eImageType = state.imageType;
+    pImage->imageFrame.eResolution = state.resolution;
+    pImage->imageFrame.dwFrameFlags = state.flags;
+
+    hr = FillImageFrame(stream, frameIndex, state.imageType, state.resolution, &pImage->imageFrame, pBits, state.pitch);
+    if (FAILED(hr))
+    {
+        EnterCriticalSection(&m_lock);
+        state.isBufferHeld[bufferIndex] = false;
+        LeaveCriticalSection(&m_lock);
+        return hr;
+    }
+
+    pImage->lockedRect.Pitch = state.pitch;
+    pImage->lockedRect.size = state.size;
+    pImage->lockedRect.pBits = pBits;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Unlocks and releases a frame returned by AcquireImageFrame
+/// </summary>
+/// <param name="hStreamHandle">stream handle the frame came from</param>
+/// <param name="pImage">frame to release</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::ReleaseImageFrame(HANDLE hStreamHandle, FrameSourceImage* pImage)
+{
+    // Fail if pointer is invalid
+    if (!pImage)
+    {
+        return E_POINTER;
+    }
+
+    HRESULT hr = E_INVALIDARG;
+    BYTE* pBits = pImage->lockedRect.pBits;
+
+    EnterCriticalSection(&m_lock);
+
+    // The frame belongs either to the stream as it is now or to a buffer retired by a reopen
+    FrameStream stream;
+    if (SUCCEEDED(GetImageStream(hStreamHandle, &stream)))
+    {
+        StreamState& state = m_streams[stream];
+        for (size_t i = 0; i < state.buffers.size(); ++i)
+        {
+            if (state.buffers[i] == pBits)
+            {
+                state.isBufferHeld[i] = false;
+                hr = S_OK;
+                break;
+            }
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        for (std::vector<BYTE*>::iterator it = m_retiredBuffers.begin(); it != m_retiredBuffers.end(); ++it)
+        {
+            if (*it == pBits)
+            {
+                FrameBufferPool::GetSharedPool()->Free(pBits);
+                m_retiredBuffers.erase(it);
+                hr = S_OK;
+                break;
+            }
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    return hr;
+}
+
+/// <summary>
+/// Gets the next skeleton frame
+/// </summary>
+/// <param name="waitMillis">number of milliseconds to wait</param>
+/// <param name="pSkeletonFrame">pointer in which to return the skeleton frame</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SimulatedFrameSource::GetNextSkeletonFrame(DWORD waitMillis, NUI_SKELETON_FRAME* pSkeletonFrame)
+{
+    // Fail if pointer is invalid
+    if (!pSkeletonFrame)
+    {
+        return E_POINTER;
+    }
+
+    // Fail if skeleton tracking is not enabled
+    if (!m_streams[FRAME_STREAM_SKELETON].isOpen)
+    {
+        return E_NUI_STREAM_NOT_ENABLED;
+    }
+
+    LONG frameIndex;
+    HRESULT hr = WaitForFrame(FRAME_STREAM_SKELETON, waitMillis, &frameIndex);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ZeroMemory(pSkeletonFrame, sizeof(*pSkeletonFrame));
+    return FillSkeletonFrame(frameIndex, pSkeletonFrame);
+}
+
+/// <summary>
+/// Pacing thread entry point
+/// </summary>
+/// <param name="pParam">pointer to the source</param>
+/// <returns>thread exit code</returns>
+DWORD WINAPI SimulatedFrameSource::PacingThread(LPVOID pParam)
+{
+    SimulatedFrameSource* pThis = static_cast<SimulatedFrameSource*>(pParam);
+    return pThis->PacingThread();
+}
+
+/// <summary>
+/// Releases frames as they become due until the source is stopped
+/// </summary>
+/// <returns>thread exit code</returns>
+DWORD WINAPI SimulatedFrameSource::PacingThread()
+{
+    HANDLE hTimer = CreateWaitableTimer(NULL, FALSE, NULL);
+    if (!hTimer)
+    {
+        return 1;
+    }
+
+    // Relative due time in 100 nanosecond units, then every tick
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -static_cast<LONGLONG>(m_tickMillis) * 10000;
+    SetWaitableTimer(hTimer, &dueTime, m_tickMillis, NULL, NULL, FALSE);
+
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    const HANDLE events[] = {m_hStopEvent, hTimer};
+    while (WAIT_OBJECT_0 + 1 == WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE))
+    {
+        QueryPerformanceCounter(&now);
+        DWORD elapsedMillis = static_cast<DWORD>((now.QuadPart - start.QuadPart) * 1000 / frequency.QuadPart);
+
+        for (int i = 0; i < FRAME_STREAM_COUNT; ++i)
+        {
+            StreamState& state = m_streams[i];
+            if (!state.isOpen)
+            {
+                continue;
+            }
+
+            LONG dueCount = GetDueFrameCount(static_cast<FrameStream>(i), elapsedMillis);
+            if (dueCount > state.dueCount)
+            {
+                InterlockedExchange(&state.dueCount, dueCount);
+                SetEvent(state.hNextFrameEvent);
+            }
+        }
+    }
+
+    CancelWaitableTimer(hTimer);
+    CloseHandle(hTimer);
+
+    return 0;
+}
+
+/// <summary>
+/// Waits for the next frame of a stream to become available
+/// </summary>
+/// <param name="stream">stream to wait on</param>
+/// <param name="waitMillis">number of milliseconds to wait</param>
+/// <param name="pFrameIndex">pointer in which to return the index of the frame to deliver</param>
+/// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no frame arrived in time</returns>
+HRESULT SimulatedFrameSource::WaitForFrame(FrameStream stream, DWORD waitMillis, LONG* pFrameIndex)
+{
+    StreamState& state = m_streams[stream];
+
+    // Hand out every frame in order
+    if (!m_isPaced)
+    {
+        *pFrameIndex = state.deliveredCount++;
+        return S_OK;
+    }
+
+    // Like the sensor, skip to the newest released frame
+    for (;;)
+    {
+        // Reset before reading the count, so a frame released in between signals the event again
+        ResetEvent(state.hNextFrameEvent);
+
+        LONG dueCount = state.dueCount;
+        if (dueCount > state.deliveredCount)
+        {
+            state.deliveredCount = dueCount;
+            *pFrameIndex = dueCount - 1;
+            return S_OK;
+        }
+
+        if (0 == waitMillis || WAIT_OBJECT_0 != WaitForSingleObject(state.hNextFrameEvent, waitMillis))
+        {
+            return E_NUI_FRAME_NO_DATA;
+        }
+    }
+}
+
+/// <summary>
+/// Maps a stream handle back to its stream
+/// </summary>
+/// <param name="hStreamHandle">stream handle</param>
+/// <param name="pStream">pointer in which to return the stream</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the handle is not an open image stream</returns>
+HRESULT SimulatedFrameSource::GetImageStream(HANDLE hStreamHandle, FrameStream* pStream) const
+{
+    ULONG_PTR index = reinterpret_cast<ULONG_PTR>(hStreamHandle) - 1;
+    if (index != FRAME_STREAM_COLOR && index != FRAME_STREAM_DEPTH)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!m_streams[index].isOpen)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pStream = static_cast<FrameStream>(index);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Frees a stream's buffers, leaving held buffers to be freed when they are released
+/// </summary>
+/// <param name="state">stream to close</param>
+void SimulatedFrameSource::CloseStream(StreamState& state)
+{
+    for (size_t i = 0; i < state.buffers.size(); ++i)
+    {
+        if (state.isBufferHeld[i])
+        {
+            m_retiredBuffers.push_back(state.buffers[i]);
+        }
+        else
+        {
+            FrameBufferPool::GetSharedPool()->Free(state.buffers[i]);
+        }
+    }
+
+    state.buffers.clear();
+    state.isBufferHeld.clear();
+    state.isOpen = false;
+}
@@ -0,0 +1,228 @@
+//-----------------------------------------------------------------------------
+// <copyright file="SimulatedFrameSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include <vector>
+#include "FrameSource.h"
+#include "FrameBufferPool.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Base of frame sources that generate frames in software rather than read them from
+        /// a sensor. It owns the stream buffers, signals the stream events and paces delivery;
+        /// derived classes only fill in frame contents.
+        ///
+        /// A paced source releases frames on a timer at the rate the derived class reports, and
+        /// hands out the newest released frame like a sensor does. An unpaced source keeps its
+        /// events signalled and hands out every frame in order as fast as it is asked for them,
+        /// which is what profiling the processing path wants.
+        /// </summary>
+        class SimulatedFrameSource : public IFrameSource
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Destructor. Derived classes must call Shutdown in their own destructor, since the
+            /// pacing thread calls back into them.
+            /// </summary>
+            virtual ~SimulatedFrameSource();
+
+            /// <summary>
+            /// Starts the source
+            /// </summary>
+            /// <param name="nuiInitFlags">NUI_INITIALIZE_FLAG_* values selecting the streams to use</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Initialize(DWORD nuiInitFlags) override;
+
+            /// <summary>
+            /// Stops the source
+            /// </summary>
+            void Shutdown() override;
+
+            /// <summary>
+            /// Opens, or reopens, an image stream
+            /// </summary>
+            /// <param name="imageType">type of image stream to open</param>
+            /// <param name="resolution">resolution of image stream</param>
+            /// <param name="flags">image frame flags</param>
+            /// <param name="frameBufferCount">number of frames to buffer</param>
+            /// <param name="hNextFrameEvent">event to signal when a frame is available</param>
+            /// <param name="phStreamHandle">pointer in which to return the stream handle</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT OpenImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution, DWORD flags,
+                DWORD frameBufferCount, HANDLE hNextFrameEvent, HANDLE* phStreamHandle) override;
+
+            /// <summary>
+            /// Sets the image frame flags of an opened image stream
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="flags">image frame flags</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT SetImageStreamFlags(HANDLE hStreamHandle, DWORD flags) override;
+
+            /// <summary>
+            /// Enables skeleton tracking
+            /// </summary>
+            /// <param name="hNextFrameEvent">event to signal when a skeleton frame is available</param>
+            /// <param name="flags">skeleton tracking flags</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT EnableSkeletonTracking(HANDLE hNextFrameEvent, DWORD flags) override;
+
+            /// <summary>
+            /// Gets the next frame of an image stream and locks its data
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pImage">pointer in which to return the frame</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT AcquireImageFrame(HANDLE hStreamHandle, DWORD waitMillis, FrameSourceImage* pImage) override;
+
+            /// <summary>
+            /// Unlocks and releases a frame returned by AcquireImageFrame
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle the frame came from</param>
+            /// <param name="pImage">frame to release</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT ReleaseImageFrame(HANDLE hStreamHandle, FrameSourceImage* pImage) override;
+
+            /// <summary>
+            /// Gets the next skeleton frame
+            /// </summary>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pSkeletonFrame">pointer in which to return the skeleton frame</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT GetNextSkeletonFrame(DWORD waitMillis, NUI_SKELETON_FRAME* pSkeletonFrame) override;
+
+        protected:
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            /// <param name="isPaced">true to release frames on a timer, false to deliver them as fast as they are read</param>
+            /// <param name="tickMillis">period of the pacing timer in milliseconds</param>
+            SimulatedFrameSource(bool isPaced, DWORD tickMillis);
+
+            /// <summary>
+            /// Checks whether the source can produce an image stream
+            /// </summary>
+            /// <param name="imageType">type of image stream</param>
+            /// <param name="resolution">resolution of image stream</param>
+            /// <returns>S_OK if the stream can be opened, an error code otherwise</returns>
+            virtual HRESULT CheckImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution) const = 0;
+
+            /// <summary>
+            /// Gets the number of frames of a stream that are due once the source has been running for a while
+            /// </summary>
+            /// <param name="stream">stream to count</param>
+            /// <param name="elapsedMillis">number of milliseconds since the source was started</param>
+            /// <returns>number of frames due</returns>
+            virtual LONG GetDueFrameCount(FrameStream stream, DWORD elapsedMillis) const = 0;
+
+            /// <summary>
+            /// Fills in an image frame
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="imageType">type of the image stream</param>
+            /// <param name="resolution">resolution of the image stream</param>
+            /// <param name="pImageFrame">frame whose time stamp and frame number are to be set</param>
+            /// <param name="pBits">buffer to write the frame data to</param>
+            /// <param name="pitch">number of bytes in each row of the buffer</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no such frame, an error code otherwise</returns>
+            virtual HRESULT FillImageFrame(FrameStream stream, LONG frameIndex, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution,
+                NUI_IMAGE_FRAME* pImageFrame, BYTE* pBits, INT pitch) = 0;
+
+            /// <summary>
+            /// Fills in a skeleton frame
+            /// </summary>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="pSkeletonFrame">skeleton frame to fill in</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if there is no such frame, an error code otherwise</returns>
+            virtual HRESULT FillSkeletonFrame(LONG frameIndex, NUI_SKELETON_FRAME* pSkeletonFrame) = 0;
+
+        private:
+            /// <summary>
+            /// State of one simulated stream
+            /// </summary>
+            struct StreamState
+            {
+                bool isOpen;
+                NUI_IMAGE_TYPE imageType;
+                NUI_IMAGE_RESOLUTION resolution;
+                DWORD flags;
+                HANDLE hNextFrameEvent;
+
+                // Frames released by the pacing thread, and frames handed out
+                volatile LONG dueCount;
+                LONG deliveredCount;
+
+                // Frame buffers from the shared FrameBufferPool, frameBufferCount of which may be
+                // held by the caller at once
+                std::vector<BYTE*> buffers;
+                std::vector<bool> isBufferHeld;
+                INT pitch;
+                INT size;
+            };
+
+            // Functions:
+            /// <summary>
+            /// Pacing thread entry point
+            /// </summary>
+            /// <param name="pParam">pointer to the source</param>
+            /// <returns>thread exit code</returns>
+            static DWORD WINAPI PacingThread(LPVOID pParam);
+
+            /// <summary>
+            /// Releases frames as they become due until the source is stopped
+            /// </summary>
+            /// <returns>thread exit code</returns>
+            DWORD WINAPI PacingThread();
+
+            /// <summary>
+            /// Waits for the next frame of a stream to become available
+            /// </summary>
+            /// <param name="stream">stream to wait on</param>
+            /// <param name="waitMillis">number of milliseconds to wait</param>
+            /// <param name="pFrameIndex">pointer in which to return the index of the frame to deliver</param>
+            /// <returns>S_OK if successful, E_NUI_FRAME_NO_DATA if no frame arrived in time</returns>
+            HRESULT WaitForFrame(FrameStream stream, DWORD waitMillis, LONG* pFrameIndex);
+
+            /// <summary>
+            /// Maps a stream handle back to its stream
+            /// </summary>
+            /// <param name="hStreamHandle">stream handle</param>
+            /// <param name="pStream">pointer in which to return the stream</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the handle is not an open image stream</returns>
+            HRESULT GetImageStream(HANDLE hStreamHandle, FrameStream* pStream) const;
+
+            /// <summary>
+            /// Frees a stream's buffers, leaving held buffers to be freed when they are released
+            /// </summary>
+            /// <param name="state">stream to close</param>
+            void CloseStream(StreamState& state);
+
+            // Variables:
+            StreamState m_streams[FRAME_STREAM_COUNT];
+
+            // Buffers of reopened streams that were still held at the time
+            std::vector<BYTE*> m_retiredBuffers;
+
+            // Guards the stream buffers
+            CRITICAL_SECTION m_lock;
+
+            // Pacing
+            bool m_isPaced;
+            DWORD m_tickMillis;
+            DWORD m_nuiInitFlags;
+            HANDLE m_hStopEvent;
+            HANDLE m_hPacingThread;
+        };
+    }
+}
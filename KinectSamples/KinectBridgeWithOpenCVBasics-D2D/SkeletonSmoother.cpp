@@ -0,0 +1,314 @@
+//-----------------------------------------------------------------------------
+// <copyright file="SkeletonSmoother.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "SkeletonSmoother.h"
+#include <xmmintrin.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    // Parameters of each profile, in SkeletonSmoothingProfile order:
+    // smoothing, correction, prediction, jitter radius and maximum deviation radius in meters
+    const NUI_TRANSFORM_SMOOTH_PARAMETERS g_profileParameters[SKELETON_SMOOTHING_PROFILE_COUNT] =
+    {
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+        { 0.5f, 0.5f, 0.5f, 0.05f, 0.04f },
+        { 0.25f, 0.25f, 0.25f, 0.03f, 0.03f },
+        { 0.7f, 0.3f, 1.0f, 1.0f, 1.0f }
+    };
+
+    // Distances below this are treated as zero when dividing by them
+    const float MIN_DISTANCE = 1e-6f;
+
+    /// <summary>
+    /// Picks a where the mask is set and b elsewhere
+    /// </summary>
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    /// <summary>
+    /// Gets the length of four 3D vectors
+    /// </summary>
+    inline __m128 Length(__m128 x, __m128 y, __m128 z)
+    {
+        return _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+    }
+}
+
+/// <summary>
+/// Constructor. Starts with SKELETON_SMOOTHING_PROFILE_DEFAULT.
+/// </summary>
+SkeletonSmoother::SkeletonSmoother()
+{
+    InitializeCriticalSection(&m_lock);
+
+    m_pState = reinterpret_cast<FilterState*>((reinterpret_cast<UINT_PTR>(m_stateStorage) + 15) & ~static_cast<UINT_PTR>(15));
+
+    SetProfile(SKELETON_SMOOTHING_PROFILE_DEFAULT);
+    Reset();
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SkeletonSmoother::~SkeletonSmoother()
+{
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Gets the parameters of a profile
+/// </summary>
+/// <param name="profile">profile to look up</param>
+/// <param name="pParameters">pointer in which to return the parameters</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the profile is unknown</returns>
+HRESULT SkeletonSmoother::GetProfileParameters(SkeletonSmoothingProfile profile, NUI_TRANSFORM_SMOOTH_PARAMETERS* pParameters)
+{
+    if (profile < 0 || profile >= SKELETON_SMOOTHING_PROFILE_COUNT || !pParameters)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pParameters = g_profileParameters[profile];
+    return S_OK;
+}
+
+/// <summary>
+/// Switches to the parameters of a profile
+/// </summary>
+/// <param name="profile">profile to use</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the profile is unknown</returns>
+HRESULT SkeletonSmoother::SetProfile(SkeletonSmoothingProfile profile)
+{
+    NUI_TRANSFORM_SMOOTH_PARAMETERS parameters;
+    HRESULT hr = GetProfileParameters(profile, &parameters);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_parameters = parameters;
+    m_isEnabled = (SKELETON_SMOOTHING_PROFILE_NONE != profile);
+    LeaveCriticalSection(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Switches to custom parameters
+/// </summary>
+/// <param name="parameters">parameters to use</param>
+/// <returns>S_OK if successful, E_INVALIDARG if a parameter is out of range</returns>
+HRESULT SkeletonSmoother::SetParameters(const NUI_TRANSFORM_SMOOTH_PARAMETERS& parameters)
+{
+    // Same ranges NuiTransformSmooth accepts
+    if (parameters.fSmoothing < 0.0f || parameters.fSmoothing >= 1.0f ||
+        parameters.fCorrection < 0.0f || parameters.fCorrection > 1.0f ||
+        parameters.fPrediction < 0.0f ||
+        parameters.fJitterRadius < 0.0f ||
+        parameters.fMaxDeviationRadius < 0.0f)
+    {
+        return E_INVALIDARG;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_parameters = parameters;
+    m_isEnabled = true;
+    LeaveCriticalSection(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the parameters in use
+/// </summary>
+/// <param name="pParameters">pointer in which to return the parameters</param>
+/// <returns>true if smoothing is enabled, false if joints pass through</returns>
+bool SkeletonSmoother::GetParameters(NUI_TRANSFORM_SMOOTH_PARAMETERS* pParameters) const
+{
+    EnterCriticalSection(&m_lock);
+    *pParameters = m_parameters;
+    bool isEnabled = m_isEnabled;
+    LeaveCriticalSection(&m_lock);
+
+    return isEnabled;
+}
+
+/// <summary>
+/// Smooths the joints of a skeleton frame in place and advances the filter state
+/// </summary>
+/// <param name="pSkeletonFrame">skeleton frame to smooth</param>
+void SkeletonSmoother::Smooth(NUI_SKELETON_FRAME* pSkeletonFrame)
+{
+    NUI_TRANSFORM_SMOOTH_PARAMETERS parameters;
+    if (!GetParameters(&parameters))
+    {
+        // Start from scratch if smoothing is turned back on
+        Reset();
+        return;
+    }
+
+    FilterState& state = *m_pState;
+
+    // Gather the joints into the state arrays
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        const NUI_SKELETON_DATA& skeleton = pSkeletonFrame->SkeletonData[i];
+        bool isTracked = (NUI_SKELETON_TRACKED == skeleton.eTrackingState);
+
+        // A skeleton slot that lost its person or now holds another one keeps no history
+        DWORD trackingId = isTracked ? skeleton.dwTrackingID : 0;
+        bool isSamePerson = isTracked && (trackingId == m_trackingIds[i]);
+        m_trackingIds[i] = trackingId;
+
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            int joint = i * NUI_SKELETON_POSITION_COUNT + j;
+            const Vector4& position = skeleton.SkeletonPositions[j];
+            NUI_SKELETON_POSITION_TRACKING_STATE trackingState = skeleton.eSkeletonPositionTrackingState[j];
+
+            state.raw.x[joint] = position.x;
+            state.raw.y[joint] = position.y;
+            state.raw.z[joint] = position.z;
+
+            bool isValid = isTracked && (NUI_SKELETON_POSITION_NOT_TRACKED != trackingState) &&
+                (0.0f != position.x || 0.0f != position.y || 0.0f != position.z);
+            state.validity[joint] = isValid ? 1.0f : 0.0f;
+            if (!isValid || !isSamePerson)
+            {
+                state.frameCounts[joint] = 0.0f;
+            }
+
+            // Inferred joints are noisier, so they are smoothed more
+            float radiusScale = (NUI_SKELETON_POSITION_INFERRED == trackingState) ? 2.0f : 1.0f;
+            state.jitterRadii[joint] = parameters.fJitterRadius * radiusScale;
+            state.maxDeviationRadii[joint] = parameters.fMaxDeviationRadius * radiusScale;
+        }
+    }
+
+    FilterJoints(parameters);
+
+    // Scatter the smoothed joints back into the frame
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        NUI_SKELETON_DATA& skeleton = pSkeletonFrame->SkeletonData[i];
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            int joint = i * NUI_SKELETON_POSITION_COUNT + j;
+            if (0.0f != state.validity[joint])
+            {
+                skeleton.SkeletonPositions[j].x = state.smoothed.x[joint];
+                skeleton.SkeletonPositions[j].y = state.smoothed.y[joint];
+                skeleton.SkeletonPositions[j].z = state.smoothed.z[joint];
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Forgets the joint history, for example because the stream was reopened
+/// </summary>
+void SkeletonSmoother::Reset()
+{
+    ZeroMemory(m_trackingIds, sizeof(m_trackingIds));
+    ZeroMemory(m_pState, sizeof(*m_pState));
+}
+
+/// <summary>
+/// Runs the filter over every joint in the state
+/// </summary>
+/// <param name="parameters">parameters to filter with</param>
+void SkeletonSmoother::FilterJoints(const NUI_TRANSFORM_SMOOTH_PARAMETERS& parameters)
+{
+    FilterState& state = *m_pState;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 minDistance = _mm_set1_ps(MIN_DISTANCE);
+    const __m128 smoothing = _mm_set1_ps(parameters.fSmoothing);
+    const __m128 correction = _mm_set1_ps(parameters.fCorrection);
+    const __m128 prediction = _mm_set1_ps(parameters.fPrediction);
+
+    for (int i = 0; i < JOINT_COUNT; i += 4)
+    {
+        __m128 rawX = _mm_load_ps(state.raw.x + i);
+        __m128 rawY = _mm_load_ps(state.raw.y + i);
+        __m128 rawZ = _mm_load_ps(state.raw.z + i);
+        __m128 filteredX = _mm_load_ps(state.filtered.x + i);
+        __m128 filteredY = _mm_load_ps(state.filtered.y + i);
+        __m128 filteredZ = _mm_load_ps(state.filtered.z + i);
+        __m128 trendX = _mm_load_ps(state.trend.x + i);
+        __m128 trendY = _mm_load_ps(state.trend.y + i);
+        __m128 trendZ = _mm_load_ps(state.trend.z + i);
+        __m128 frameCount = _mm_load_ps(state.frameCounts + i);
+
+        // Damp raw joints that moved less than the jitter radius from the filtered position,
+        // in proportion to how far they moved
+        __m128 diffX = _mm_sub_ps(rawX, filteredX);
+        __m128 diffY = _mm_sub_ps(rawY, filteredY);
+        __m128 diffZ = _mm_sub_ps(rawZ, filteredZ);
+        __m128 jitterRadius = _mm_max_ps(_mm_load_ps(state.jitterRadii + i), minDistance);
+        __m128 weight = _mm_min_ps(_mm_div_ps(Length(diffX, diffY, diffZ), jitterRadius), one);
+        __m128 newX = _mm_add_ps(filteredX, _mm_mul_ps(diffX, weight));
+        __m128 newY = _mm_add_ps(filteredY, _mm_mul_ps(diffY, weight));
+        __m128 newZ = _mm_add_ps(filteredZ, _mm_mul_ps(diffZ, weight));
+
+        // Blend with the position the trend predicted for this frame
+        newX = _mm_add_ps(newX, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(filteredX, trendX), newX), smoothing));
+        newY = _mm_add_ps(newY, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(filteredY, trendY), newY), smoothing));
+        newZ = _mm_add_ps(newZ, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(filteredZ, trendZ), newZ), smoothing));
+
+        // A joint's second frame averages its two raw positions, and its first takes the raw position
+        __m128 isFirstFrame = _mm_cmpeq_ps(frameCount, zero);
+        __m128 isSecondFrame = _mm_cmpeq_ps(frameCount, one);
+        newX = Select(isSecondFrame, _mm_mul_ps(_mm_add_ps(rawX, _mm_load_ps(state.previousRaw.x + i)), half), newX);
+        newY = Select(isSecondFrame, _mm_mul_ps(_mm_add_ps(rawY, _mm_load_ps(state.previousRaw.y + i)), half), newY);
+        newZ = Select(isSecondFrame, _mm_mul_ps(_mm_add_ps(rawZ, _mm_load_ps(state.previousRaw.z + i)), half), newZ);
+        newX = Select(isFirstFrame, rawX, newX);
+        newY = Select(isFirstFrame, rawY, newY);
+        newZ = Select(isFirstFrame, rawZ, newZ);
+
+        // Move the trend toward the latest change in the filtered position; a joint's first frame has none
+        trendX = _mm_andnot_ps(isFirstFrame, _mm_add_ps(trendX, _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(newX, filteredX), trendX), correction)));
+        trendY = _mm_andnot_ps(isFirstFrame, _mm_add_ps(trendY, _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(newY, filteredY), trendY), correction)));
+        trendZ = _mm_andnot_ps(isFirstFrame, _mm_add_ps(trendZ, _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(newZ, filteredZ), trendZ), correction)));
+
+        // Predict ahead along the trend to make up for the filter's lag, but stay within the
+        // maximum deviation radius of the raw joint
+        diffX = _mm_mul_ps(trendX, prediction);
+        diffY = _mm_mul_ps(trendY, prediction);
+        diffZ = _mm_mul_ps(trendZ, prediction);
+        diffX = _mm_sub_ps(_mm_add_ps(newX, diffX), rawX);
+        diffY = _mm_sub_ps(_mm_add_ps(newY, diffY), rawY);
+        diffZ = _mm_sub_ps(_mm_add_ps(newZ, diffZ), rawZ);
+        __m128 deviation = _mm_max_ps(Length(diffX, diffY, diffZ), minDistance);
+        weight = _mm_min_ps(_mm_div_ps(_mm_load_ps(state.maxDeviationRadii + i), deviation), one);
+
+        _mm_store_ps(state.smoothed.x + i, _mm_add_ps(rawX, _mm_mul_ps(diffX, weight)));
+        _mm_store_ps(state.smoothed.y + i, _mm_add_ps(rawY, _mm_mul_ps(diffY, weight)));
+        _mm_store_ps(state.smoothed.z + i, _mm_add_ps(rawZ, _mm_mul_ps(diffZ, weight)));
+
+        _mm_store_ps(state.filtered.x + i, newX);
+        _mm_store_ps(state.filtered.y + i, newY);
+        _mm_store_ps(state.filtered.z + i, newZ);
+        _mm_store_ps(state.trend.x + i, trendX);
+        _mm_store_ps(state.trend.y + i, trendY);
+        _mm_store_ps(state.trend.z + i, trendZ);
+        _mm_store_ps(state.previousRaw.x + i, rawX);
+        _mm_store_ps(state.previousRaw.y + i, rawY);
+        _mm_store_ps(state.previousRaw.z + i, rawZ);
+
+        // Count the frame for valid joints only, so invalid joints start over when they return
+        frameCount = _mm_min_ps(_mm_add_ps(frameCount, one), two);
+        _mm_store_ps(state.frameCounts + i, _mm_mul_ps(frameCount, _mm_load_ps(state.validity + i)));
+    }
+}
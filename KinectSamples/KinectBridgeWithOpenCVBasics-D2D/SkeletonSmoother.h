@@ -0,0 +1,164 @@
+//-----------------------------------------------------------------------------
+// <copyright file="SkeletonSmoother.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Sets of smoothing parameters to choose between
+        /// </summary>
+        enum SkeletonSmoothingProfile
+        {
+            // Joints pass through as the tracker reported them
+            SKELETON_SMOOTHING_PROFILE_NONE,
+
+            // The parameters NuiTransformSmooth uses by default
+            SKELETON_SMOOTHING_PROFILE_DEFAULT,
+
+            // Light smoothing that stays close to the raw joints, for gestures and cursors
+            SKELETON_SMOOTHING_PROFILE_LOW_LATENCY,
+
+            // Heavy smoothing for steady display, at the cost of trailing fast motion
+            SKELETON_SMOOTHING_PROFILE_SMOOTH,
+
+            SKELETON_SMOOTHING_PROFILE_COUNT
+        };
+
+        /// <summary>
+        /// Holt double exponential filter over the joints of all skeletons in a frame, with the
+        /// same parameters as NuiTransformSmooth. Raw joints within the jitter radius of the last
+        /// filtered position are damped, the filtered position and its trend are updated, the
+        /// trend is extrapolated by the prediction factor, and the result is pulled back to within
+        /// the maximum deviation radius of the raw joint. Filter state is kept as one array per
+        /// coordinate covering every joint of every skeleton, so a frame is filtered in a single
+        /// SSE pass. The parameters may be changed from any thread while frames are smoothed.
+        /// </summary>
+        class SkeletonSmoother
+        {
+        public:
+            // Functions:
+            /// <summary>
+            /// Constructor. Starts with SKELETON_SMOOTHING_PROFILE_DEFAULT.
+            /// </summary>
+            SkeletonSmoother();
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~SkeletonSmoother();
+
+            /// <summary>
+            /// Gets the parameters of a profile
+            /// </summary>
+            /// <param name="profile">profile to look up</param>
+            /// <param name="pParameters">pointer in which to return the parameters</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the profile is unknown</returns>
+            static HRESULT GetProfileParameters(SkeletonSmoothingProfile profile, NUI_TRANSFORM_SMOOTH_PARAMETERS* pParameters);
+
+            /// <summary>
+            /// Switches to the parameters of a profile
+            /// </summary>
+            /// <param name="profile">profile to use</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the profile is unknown</returns>
+            HRESULT SetProfile(SkeletonSmoothingProfile profile);
+
+            /// <summary>
+            /// Switches to custom parameters
+            /// </summary>
+            /// <param name="parameters">parameters to use</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if a parameter is out of range</returns>
+            HRESULT SetParameters(const NUI_TRANSFORM_SMOOTH_PARAMETERS& parameters);
+
+            /// <summary>
+            /// Gets the parameters in use
+            /// </summary>
+            /// <param name="pParameters">pointer in which to return the parameters</param>
+            /// <returns>true if smoothing is enabled, false if joints pass through</returns>
+            bool GetParameters(NUI_TRANSFORM_SMOOTH_PARAMETERS* pParameters) const;
+
+            /// <summary>
+            /// Smooths the joints of a skeleton frame in place and advances the filter state
+            /// </summary>
+            /// <param name="pSkeletonFrame">skeleton frame to smooth</param>
+            void Smooth(NUI_SKELETON_FRAME* pSkeletonFrame);
+
+            /// <summary>
+            /// Forgets the joint history, for example because the stream was reopened
+            /// </summary>
+            void Reset();
+
+        private:
+            // Constants:
+            // Number of joints filtered per frame, a multiple of the SSE width
+            static const int JOINT_COUNT = NUI_SKELETON_COUNT * NUI_SKELETON_POSITION_COUNT;
+
+            /// <summary>
+            /// One coordinate array per axis, covering every joint of every skeleton
+            /// </summary>
+            struct JointPositions
+            {
+                float x[JOINT_COUNT];
+                float y[JOINT_COUNT];
+                float z[JOINT_COUNT];
+            };
+
+            /// <summary>
+            /// Filter state and per-frame inputs, 16-byte aligned for SSE loads and stores
+            /// </summary>
+            struct FilterState
+            {
+                // Joints of the current frame, and of the frame before
+                JointPositions raw;
+                JointPositions previousRaw;
+
+                // Filtered joints and their trend as of the last frame
+                JointPositions filtered;
+                JointPositions trend;
+
+                // Smoothed joints written back to the frame
+                JointPositions smoothed;
+
+                // Frames each joint has been valid for, saturating at 2
+                float frameCounts[JOINT_COUNT];
+
+                // 1 for joints that are valid in the current frame, 0 otherwise
+                float validity[JOINT_COUNT];
+
+                // Radii per joint, widened for joints the tracker inferred
+                float jitterRadii[JOINT_COUNT];
+                float maxDeviationRadii[JOINT_COUNT];
+            };
+
+            // Smoothers are not copied, since m_pState points into the instance
+            SkeletonSmoother(const SkeletonSmoother&);
+            SkeletonSmoother& operator=(const SkeletonSmoother&);
+
+            // Functions:
+            /// <summary>
+            /// Runs the filter over every joint in the state
+            /// </summary>
+            /// <param name="parameters">parameters to filter with</param>
+            void FilterJoints(const NUI_TRANSFORM_SMOOTH_PARAMETERS& parameters);
+
+            // Variables:
+            // Guards the parameters, which the UI may change while frames are smoothed
+            mutable CRITICAL_SECTION m_lock;
+            NUI_TRANSFORM_SMOOTH_PARAMETERS m_parameters;
+            bool m_isEnabled;
+
+            // Tracking ID each skeleton slot was last filtered for
+            DWORD m_trackingIds[NUI_SKELETON_COUNT];
+
+            // Storage for the filter state, and the aligned state within it
+            BYTE m_stateStorage[sizeof(FilterState) + 15];
+            FilterState* m_pState;
+        };
+    }
+}
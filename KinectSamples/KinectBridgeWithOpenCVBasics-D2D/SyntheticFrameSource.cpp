@@ -0,0 +1,439 @@
+//-----------------------------------------------------------------------------
+// <copyright file="SyntheticFrameSource.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "SyntheticFrameSource.h"
+#include <math.h>
+
+using namespace Microsoft::KinectBridge;
+
+// Connection id reported for the source
+static const WCHAR SYNTHETIC_CONNECTION_ID[] = L"SyntheticFrameSource";
+
+// Period of the pacing timer in milliseconds
+static const DWORD SYNTHETIC_TICK_MILLIS = 5;
+
+static const FLOAT TWO_PI = 6.2831853f;
+
+// Scene layout, in millimeters
+static const FLOAT CAMERA_HEIGHT_MM = 800.0f;
+static const FLOAT WALL_DEPTH_MM = 3600.0f;
+static const FLOAT WALL_TILT_MM = 600.0f;
+static const FLOAT MAXIMUM_DEPTH_MM = 4000.0f;
+
+// Width of the sweeping slab as a fraction of the image width
+static const FLOAT SLAB_WIDTH = 0.15f;
+
+// Player body ellipse around the hip center, in meters
+static const FLOAT BODY_CENTER_OFFSET = -0.085f;
+static const FLOAT BODY_HALF_WIDTH = 0.22f;
+static const FLOAT BODY_HALF_HEIGHT = 0.835f;
+static const FLOAT ARM_REACH = 0.3f;
+
+// BGR colors of the players in the color stream
+static const BYTE PLAYER_COLORS[SyntheticFrameSource::PLAYER_COUNT][3] =
+{
+    {40, 80, 200},
+    {220, 160, 40}
+};
+
+// Joint offsets from the hip center of a player standing with arms down, in meters
+static const FLOAT JOINT_OFFSETS[NUI_SKELETON_POSITION_COUNT][3] =
+{
+    { 0.00f,  0.00f,  0.00f},   // NUI_SKELETON_POSITION_HIP_CENTER
+    { 0.00f,  0.10f,  0.00f},   // NUI_SKELETON_POSITION_SPINE
+    { 0.00f,  0.45f,  0.00f},   // NUI_SKELETON_POSITION_SHOULDER_CENTER
+    { 0.00f,  0.65f,  0.00f},   // NUI_SKELETON_POSITION_HEAD
+    {-0.18f,  0.40f,  0.00f},   // NUI_SKELETON_POSITION_SHOULDER_LEFT
+    {-0.25f,  0.15f,  0.00f},   // NUI_SKELETON_POSITION_ELBOW_LEFT
+    {-0.28f, -0.08f,  0.00f},   // NUI_SKELETON_POSITION_WRIST_LEFT
+    {-0.29f, -0.15f,  0.00f},   // NUI_SKELETON_POSITION_HAND_LEFT
+    { 0.18f,  0.40f,  0.00f},   // NUI_SKELETON_POSITION_SHOULDER_RIGHT
+    { 0.25f,  0.15f,  0.00f},   // NUI_SKELETON_POSITION_ELBOW_RIGHT
+    { 0.28f, -0.08f,  0.00f},   // NUI_SKELETON_POSITION_WRIST_RIGHT
+    { 0.29f, -0.15f,  0.00f},   // NUI_SKELETON_POSITION_HAND_RIGHT
+    {-0.10f, -0.05f,  0.00f},   // NUI_SKELETON_POSITION_HIP_LEFT
+    {-0.11f, -0.45f,  0.00f},   // NUI_SKELETON_POSITION_KNEE_LEFT
+    {-0.12f, -0.85f,  0.00f},   // NUI_SKELETON_POSITION_ANKLE_LEFT
+    {-0.12f, -0.90f, -0.08f},   // NUI_SKELETON_POSITION_FOOT_LEFT
+    { 0.10f, -0.05f,  0.00f},   // NUI_SKELETON_POSITION_HIP_RIGHT
+    { 0.11f, -0.45f,  0.00f},   // NUI_SKELETON_POSITION_KNEE_RIGHT
+    { 0.12f, -0.85f,  0.00f},   // NUI_SKELETON_POSITION_ANKLE_RIGHT
+    { 0.12f, -0.90f, -0.08f}    // NUI_SKELETON_POSITION_FOOT_RIGHT
+};
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="isPaced">true to deliver frames at FRAMES_PER_SECOND, false to deliver them as fast as they are read</param>
+SyntheticFrameSource::SyntheticFrameSource(bool isPaced /* = true */) :
+    SimulatedFrameSource(isPaced, SYNTHETIC_TICK_MILLIS)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    Shutdown();
+}
+
+/// <summary>
+/// Returns a string identifying the device or recording behind the source
+/// </summary>
+/// <returns>connection id of the source</returns>
+BSTR SyntheticFrameSource::GetConnectionId() const
+{
+    return const_cast<BSTR>(SYNTHETIC_CONNECTION_ID);
+}
+
+/// <summary>
+/// Checks whether the source can produce an image stream
+/// </summary>
+/// <param name="imageType">type of image stream</param>
+/// <param name="resolution">resolution of image stream</param>
+/// <returns>S_OK if the stream can be opened, an error code otherwise</returns>
+HRESULT SyntheticFrameSource::CheckImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution) const
+{
+    // Offer the same resolutions as the sensor
+    if (NUI_IMAGE_TYPE_COLOR == imageType)
+    {
+        if (NUI_IMAGE_RESOLUTION_640x480 == resolution || NUI_IMAGE_RESOLUTION_1280x960 == resolution)
+        {
+            return S_OK;
+        }
+    }
+    else
+    {
+        if (NUI_IMAGE_RESOLUTION_80x60 == resolution || NUI_IMAGE_RESOLUTION_320x240 == resolution || NUI_IMAGE_RESOLUTION_640x480 == resolution)
+        {
+            return S_OK;
+        }
+    }
+
+    return E_INVALIDARG;
+}
+
+/// <summary>
+/// Gets the number of frames of a stream that are due once the source has been running for a while
+/// </summary>
+/// <param name="stream">stream to count</param>
+/// <param name="elapsedMillis">number of milliseconds since the source was started</param>
+/// <returns>number of frames due</returns>
+LONG SyntheticFrameSource::GetDueFrameCount(FrameStream stream, DWORD elapsedMillis) const
+{
+    return static_cast<LONG>(static_cast<ULONGLONG>(elapsedMillis) * FRAMES_PER_SECOND / 1000) + 1;
+}
+
+/// <summary>
+/// Fills in an image frame
+/// </summary>
+/// <param name="stream">stream the frame belongs to</param>
+/// <param name="frameIndex">zero-based index of the frame within the stream</param>
+/// <param name="imageType">type of the image stream</param>
+/// <param name="resolution">resolution of the image stream</param>
+/// <param name="pImageFrame">frame whose time stamp and frame number are to be set</param>
+/// <param name="pBits">buffer to write the frame data to</param>
+/// <param name="pitch">number of bytes in each row of the buffer</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SyntheticFrameSource::FillImageFrame(FrameStream stream, LONG frameIndex, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution,
+    NUI_IMAGE_FRAME* pImageFrame, BYTE* pBits, INT pitch)
+{
+    DWORD width, height;
+    NuiImageResolutionToSize(resolution, width, height);
+
+    Scene scene;
+    GetScene(frameIndex, &scene);
+
+    if (FRAME_STREAM_DEPTH == stream)
+    {
+        RenderDepth(scene, NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX == imageType, width, height, pBits, pitch);
+    }
+    else
+    {
+        RenderColor(scene, frameIndex, width, height, pBits, pitch);
+    }
+
+    pImageFrame->dwFrameNumber = static_cast<DWORD>(frameIndex);
+    pImageFrame->liTimeStamp.QuadPart = static_cast<LONGLONG>(frameIndex) * 1000 / FRAMES_PER_SECOND;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Fills in a skeleton frame
+/// </summary>
+/// <param name="frameIndex">zero-based index of the frame within the stream</param>
+/// <param name="pSkeletonFrame">skeleton frame to fill in</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT SyntheticFrameSource::FillSkeletonFrame(LONG frameIndex, NUI_SKELETON_FRAME* pSkeletonFrame)
+{
+    Scene scene;
+    GetScene(frameIndex, &scene);
+
+    pSkeletonFrame->dwFrameNumber = static_cast<DWORD>(frameIndex);
+    pSkeletonFrame->liTimeStamp.QuadPart = static_cast<LONGLONG>(frameIndex) * 1000 / FRAMES_PER_SECOND;
+
+    // Level floor below the sensor
+    pSkeletonFrame->vFloorClipPlane.y = 1.0f;
+    pSkeletonFrame->vFloorClipPlane.w = CAMERA_HEIGHT_MM / 1000.0f;
+    pSkeletonFrame->vNormalToGravity.y = 1.0f;
+
+    for (DWORD i = 0; i < PLAYER_COUNT; ++i)
+    {
+        const PlayerPose& pose = scene.players[i];
+        NUI_SKELETON_DATA& skeleton = pSkeletonFrame->SkeletonData[i];
+
+        // Tracking ids and user indices match the player indices in the depth stream
+        skeleton.eTrackingState = NUI_SKELETON_TRACKED;
+        skeleton.dwTrackingID = i + 1;
+        skeleton.dwUserIndex = i + 1;
+        skeleton.Position = pose.hipCenter;
+
+        // Arms swing outwards about the shoulders
+        const FLOAT cosine = cosf(pose.armAngle);
+        const FLOAT sine = sinf(pose.armAngle);
+
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            FLOAT x = JOINT_OFFSETS[j][0];
+            FLOAT y = JOINT_OFFSETS[j][1];
+
+            int shoulder = -1;
+            FLOAT direction = 0.0f;
+            if (j >= NUI_SKELETON_POSITION_ELBOW_LEFT && j <= NUI_SKELETON_POSITION_HAND_LEFT)
+            {
+                shoulder = NUI_SKELETON_POSITION_SHOULDER_LEFT;
+                direction = -1.0f;
+            }
+            else if (j >= NUI_SKELETON_POSITION_ELBOW_RIGHT && j <= NUI_SKELETON_POSITION_HAND_RIGHT)
+            {
+                shoulder = NUI_SKELETON_POSITION_SHOULDER_RIGHT;
+                direction = 1.0f;
+            }
+
+            if (shoulder >= 0)
+            {
+                FLOAT dx = x - JOINT_OFFSETS[shoulder][0];
+                FLOAT dy = y - JOINT_OFFSETS[shoulder][1];
+                x = JOINT_OFFSETS[shoulder][0] + dx * cosine - dy * sine * direction;
+                y = JOINT_OFFSETS[shoulder][1] + dx * sine * direction + dy * cosine;
+            }
+
+            Vector4& position = skeleton.SkeletonPositions[j];
+            position.x = pose.hipCenter.x + x;
+            position.y = pose.hipCenter.y + y;
+            position.z = pose.hipCenter.z + JOINT_OFFSETS[j][2];
+            position.w = 1.0f;
+
+            skeleton.eSkeletonPositionTrackingState[j] = NUI_SKELETON_POSITION_TRACKED;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Computes where the scene's objects are in a frame
+/// </summary>
+/// <param name="frameIndex">zero-based frame index</param>
+/// <param name="pScene">pointer in which to return the scene</param>
+void SyntheticFrameSource::GetScene(LONG frameIndex, Scene* pScene)
+{
+    const FLOAT t = static_cast<FLOAT>(frameIndex) / FRAMES_PER_SECOND;
+
+    // Players walk side to side and to and fro with different periods, so they cross and occlude each other
+    for (DWORD i = 0; i < PLAYER_COUNT; ++i)
+    {
+        PlayerPose& pose = pScene->players[i];
+        pose.hipCenter.x = 0.9f * sinf(TWO_PI * t / (6.0f + 3.0f * i) + 0.5f * TWO_PI * i);
+        pose.hipCenter.y = 0.0f;
+        pose.hipCenter.z = 2.2f + 0.8f * i + 0.4f * cosf(TWO_PI * t / (7.0f + 2.0f * i));
+        pose.hipCenter.w = 1.0f;
+        pose.armAngle = 0.6f * (1.0f - cosf(TWO_PI * t / (1.5f + 0.5f * i)));
+    }
+
+    pScene->wallAngle = 0.4f * t;
+
+    // The slab crosses the view every four seconds
+    const LONG sweepFrames = 4 * FRAMES_PER_SECOND;
+    FLOAT sweep = static_cast<FLOAT>(frameIndex % sweepFrames) / sweepFrames;
+    pScene->slabLeft = sweep * (1.0f + SLAB_WIDTH) - SLAB_WIDTH;
+    pScene->slabDepth = static_cast<USHORT>(1200.0f + 300.0f * sinf(TWO_PI * t / 5.0f));
+}
+
+/// <summary>
+/// Projects the players of a scene into an image
+/// </summary>
+/// <param name="scene">scene to project</param>
+/// <param name="width">image width in pixels</param>
+/// <param name="height">image height in pixels</param>
+/// <param name="focalLength">focal length in pixels</param>
+/// <param name="silhouettes">array of PLAYER_COUNT silhouettes to fill in</param>
+void SyntheticFrameSource::ProjectPlayers(const Scene& scene, DWORD width, DWORD height, FLOAT focalLength, Silhouette* silhouettes)
+{
+    for (DWORD i = 0; i < PLAYER_COUNT; ++i)
+    {
+        const PlayerPose& pose = scene.players[i];
+        const FLOAT scale = focalLength / pose.hipCenter.z;
+
+        // Raised arms widen the silhouette
+        const FLOAT halfWidth = BODY_HALF_WIDTH + ARM_REACH * sinf(pose.armAngle);
+
+        Silhouette& silhouette = silhouettes[i];
+        silhouette.centerX = 0.5f * width + pose.hipCenter.x * scale;
+        silhouette.centerY = 0.5f * height - (pose.hipCenter.y + BODY_CENTER_OFFSET) * scale;
+        silhouette.inverseRadiusX = 1.0f / (halfWidth * scale);
+        silhouette.inverseRadiusY = 1.0f / (BODY_HALF_HEIGHT * scale);
+        silhouette.depth = static_cast<USHORT>(pose.hipCenter.z * 1000.0f);
+    }
+}
+
+/// <summary>
+/// Returns which player, if any, covers a pixel
+/// </summary>
+/// <param name="silhouettes">array of PLAYER_COUNT silhouettes</param>
+/// <param name="x">pixel column</param>
+/// <param name="y">pixel row</param>
+/// <returns>zero-based index of the nearest player covering the pixel, or PLAYER_COUNT if there is none</returns>
+DWORD SyntheticFrameSource::HitTestPlayers(const Silhouette* silhouettes, FLOAT x, FLOAT y)
+{
+    DWORD nearest = PLAYER_COUNT;
+
+    for (DWORD i = 0; i < PLAYER_COUNT; ++i)
+    {
+        const Silhouette& silhouette = silhouettes[i];
+        FLOAT dx = (x - silhouette.centerX) * silhouette.inverseRadiusX;
+        FLOAT dy = (y - silhouette.centerY) * silhouette.inverseRadiusY;
+
+        if (dx * dx + dy * dy <= 1.0f && (PLAYER_COUNT == nearest || silhouette.depth < silhouettes[nearest].depth))
+        {
+            nearest = i;
+        }
+    }
+
+    return nearest;
+}
+
+/// <summary>
+/// Renders a depth frame
+/// </summary>
+/// <param name="scene">scene to render</param>
+/// <param name="isUsingPlayerIndex">true to write player indices into the low bits</param>
+/// <param name="width">image width in pixels</param>
+/// <param name="height">image height in pixels</param>
+/// <param name="pBits">buffer to write to</param>
+/// <param name="pitch">number of bytes in each row of the buffer</param>
+void SyntheticFrameSource::RenderDepth(const Scene& scene, bool isUsingPlayerIndex, DWORD width, DWORD height, BYTE* pBits, INT pitch)
+{
+    const FLOAT focalLength = NUI_CAMERA_DEPTH_NOMINAL_FOCAL_LENGTH_IN_PIXELS * width / 320.0f;
+
+    Silhouette silhouettes[PLAYER_COUNT];
+    ProjectPlayers(scene, width, height, focalLength, silhouettes);
+
+    const FLOAT centerX = 0.5f * width;
+    const FLOAT centerY = 0.5f * height;
+
+    // The back wall is a plane whose tilt turns over time
+    const FLOAT wallSlopeX = WALL_TILT_MM * cosf(scene.wallAngle) / centerX;
+    const FLOAT wallSlopeY = WALL_TILT_MM * sinf(scene.wallAngle) / centerY;
+
+    const FLOAT slabBegin = scene.slabLeft * width;
+    const FLOAT slabEnd = slabBegin + SLAB_WIDTH * width;
+
+    for (DWORD y = 0; y < height; ++y)
+    {
+        USHORT* pRow = reinterpret_cast<USHORT*>(pBits + y * pitch);
+
+        const FLOAT fy = static_cast<FLOAT>(y);
+        const FLOAT wallDepth = WALL_DEPTH_MM + wallSlopeY * (fy - centerY) - wallSlopeX * centerX;
+
+        // Rows below the horizon see the floor once it is nearer than the wall
+        const FLOAT floorDepth = (fy + 0.5f > centerY) ? CAMERA_HEIGHT_MM * focalLength / (fy + 0.5f - centerY) : MAXIMUM_DEPTH_MM + 1.0f;
+
+        for (DWORD x = 0; x < width; ++x)
+        {
+            const FLOAT fx = static_cast<FLOAT>(x);
+
+            FLOAT depth = wallDepth + wallSlopeX * fx;
+            if (floorDepth < depth)
+            {
+                depth = floorDepth;
+            }
+
+            if (fx >= slabBegin && fx < slabEnd && scene.slabDepth < depth)
+            {
+                depth = scene.slabDepth;
+            }
+
+            USHORT player = 0;
+            DWORD hit = HitTestPlayers(silhouettes, fx, fy);
+            if (hit < PLAYER_COUNT && silhouettes[hit].depth < depth)
+            {
+                depth = silhouettes[hit].depth;
+                player = static_cast<USHORT>(hit + 1);
+            }
+
+            // Like the sensor, report anything too far away as unknown
+            USHORT value = (depth > MAXIMUM_DEPTH_MM) ? 0 : static_cast<USHORT>(depth);
+            pRow[x] = static_cast<USHORT>((value << NUI_IMAGE_PLAYER_INDEX_SHIFT) | (isUsingPlayerIndex ? player : 0));
+        }
+    }
+}
+
+/// <summary>
+/// Renders a BGRX color frame
+/// </summary>
+/// <param name="scene">scene to render</param>
+/// <param name="frameIndex">zero-based frame index, which scrolls the background</param>
+/// <param name="width">image width in pixels</param>
+/// <param name="height">image height in pixels</param>
+/// <param name="pBits">buffer to write to</param>
+/// <param name="pitch">number of bytes in each row of the buffer</param>
+void SyntheticFrameSource::RenderColor(const Scene& scene, LONG frameIndex, DWORD width, DWORD height, BYTE* pBits, INT pitch)
+{
+    const FLOAT focalLength = NUI_CAMERA_COLOR_NOMINAL_FOCAL_LENGTH_IN_PIXELS * width / 640.0f;
+
+    Silhouette silhouettes[PLAYER_COUNT];
+    ProjectPlayers(scene, width, height, focalLength, silhouettes);
+
+    const FLOAT slabBegin = scene.slabLeft * width;
+    const FLOAT slabEnd = slabBegin + SLAB_WIDTH * width;
+    const DWORD scroll = static_cast<DWORD>(frameIndex) * 4;
+
+    for (DWORD y = 0; y < height; ++y)
+    {
+        BYTE* pPixel = pBits + y * pitch;
+        const BYTE green = static_cast<BYTE>(y * 255 / height);
+
+        for (DWORD x = 0; x < width; ++x, pPixel += 4)
+        {
+            const FLOAT fx = static_cast<FLOAT>(x);
+
+            DWORD hit = HitTestPlayers(silhouettes, fx, static_cast<FLOAT>(y));
+            if (hit < PLAYER_COUNT && !(fx >= slabBegin && fx < slabEnd && scene.slabDepth < silhouettes[hit].depth))
+            {
+                pPixel[0] = PLAYER_COLORS[hit][0];
+                pPixel[1] = PLAYER_COLORS[hit][1];
+                pPixel[2] = PLAYER_COLORS[hit][2];
+            }
+            else if (fx >= slabBegin && fx < slabEnd)
+            {
+                pPixel[0] = 128;
+                pPixel[1] = 128;
+                pPixel[2] = 128;
+            }
+            else
+            {
+                pPixel[0] = static_cast<BYTE>(x + scroll);
+                pPixel[1] = green;
+                pPixel[2] = 96;
+            }
+
+            pPixel[3] = 0xFF;
+        }
+    }
+}
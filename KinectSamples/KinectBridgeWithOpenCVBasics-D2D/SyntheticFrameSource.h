@@ -0,0 +1,178 @@
+//-----------------------------------------------------------------------------
+// <copyright file="SyntheticFrameSource.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <NuiApi.h>
+#include "SimulatedFrameSource.h"
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Frame source that renders a deterministic scene: a tilting back wall, a floor, a
+        /// slab sweeping across the view and two players walking about and waving. Every frame
+        /// depends only on its frame number, so runs can be compared frame for frame.
+        /// </summary>
+        class SyntheticFrameSource : public SimulatedFrameSource
+        {
+        public:
+            // Constants:
+            // Frames per second of every stream
+            static const DWORD FRAMES_PER_SECOND = 30;
+
+            // Number of players in the scene
+            static const DWORD PLAYER_COUNT = 2;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            /// <param name="isPaced">true to deliver frames at FRAMES_PER_SECOND, false to deliver them as fast as they are read</param>
+            SyntheticFrameSource(bool isPaced = true);
+
+            /// <summary>
+            /// Destructor
+            /// </summary>
+            ~SyntheticFrameSource();
+
+            /// <summary>
+            /// Returns a string identifying the device or recording behind the source
+            /// </summary>
+            /// <returns>connection id of the source</returns>
+            BSTR GetConnectionId() const override;
+
+        protected:
+            // Functions:
+            /// <summary>
+            /// Checks whether the source can produce an image stream
+            /// </summary>
+            /// <param name="imageType">type of image stream</param>
+            /// <param name="resolution">resolution of image stream</param>
+            /// <returns>S_OK if the stream can be opened, an error code otherwise</returns>
+            HRESULT CheckImageStream(NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution) const override;
+
+            /// <summary>
+            /// Gets the number of frames of a stream that are due once the source has been running for a while
+            /// </summary>
+            /// <param name="stream">stream to count</param>
+            /// <param name="elapsedMillis">number of milliseconds since the source was started</param>
+            /// <returns>number of frames due</returns>
+            LONG GetDueFrameCount(FrameStream stream, DWORD elapsedMillis) const override;
+
+            /// <summary>
+            /// Fills in an image frame
+            /// </summary>
+            /// <param name="stream">stream the frame belongs to</param>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="imageType">type of the image stream</param>
+            /// <param name="resolution">resolution of the image stream</param>
+            /// <param name="pImageFrame">frame whose time stamp and frame number are to be set</param>
+            /// <param name="pBits">buffer to write the frame data to</param>
+            /// <param name="pitch">number of bytes in each row of the buffer</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT FillImageFrame(FrameStream stream, LONG frameIndex, NUI_IMAGE_TYPE imageType, NUI_IMAGE_RESOLUTION resolution,
+                NUI_IMAGE_FRAME* pImageFrame, BYTE* pBits, INT pitch) override;
+
+            /// <summary>
+            /// Fills in a skeleton frame
+            /// </summary>
+            /// <param name="frameIndex">zero-based index of the frame within the stream</param>
+            /// <param name="pSkeletonFrame">skeleton frame to fill in</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT FillSkeletonFrame(LONG frameIndex, NUI_SKELETON_FRAME* pSkeletonFrame) override;
+
+        private:
+            /// <summary>
+            /// Pose of one player
+            /// </summary>
+            struct PlayerPose
+            {
+                // Hip center in skeleton space, in meters
+                Vector4 hipCenter;
+
+                // Angle the arms are raised by, in radians
+                FLOAT armAngle;
+            };
+
+            /// <summary>
+            /// Where the scene's objects are in one frame
+            /// </summary>
+            struct Scene
+            {
+                PlayerPose players[PLAYER_COUNT];
+
+                // Rotation of the back wall's tilt, in radians
+                FLOAT wallAngle;
+
+                // Left edge and depth of the sweeping slab, as a fraction of the image width and in millimeters
+                FLOAT slabLeft;
+                USHORT slabDepth;
+            };
+
+            /// <summary>
+            /// Player silhouette projected into an image
+            /// </summary>
+            struct Silhouette
+            {
+                FLOAT centerX;
+                FLOAT centerY;
+                FLOAT inverseRadiusX;
+                FLOAT inverseRadiusY;
+                USHORT depth;
+            };
+
+            // Functions:
+            /// <summary>
+            /// Computes where the scene's objects are in a frame
+            /// </summary>
+            /// <param name="frameIndex">zero-based frame index</param>
+            /// <param name="pScene">pointer in which to return the scene</param>
+            static void GetScene(LONG frameIndex, Scene* pScene);
+
+            /// <summary>
+            /// Projects the players of a scene into an image
+            /// </summary>
+            /// <param name="scene">scene to project</param>
+            /// <param name="width">image width in pixels</param>
+            /// <param name="height">image height in pixels</param>
+            /// <param name="focalLength">focal length in pixels</param>
+            /// <param name="silhouettes">array of PLAYER_COUNT silhouettes to fill in</param>
+            static void ProjectPlayers(const Scene& scene, DWORD width, DWORD height, FLOAT focalLength, Silhouette* silhouettes);
+
+            /// <summary>
+            /// Returns which player, if any, covers a pixel
+            /// </summary>
+            /// <param name="silhouettes">array of PLAYER_COUNT silhouettes</param>
+            /// <param name="x">pixel column</param>
+            /// <param name="y">pixel row</param>
+            /// <returns>zero-based index of the nearest player covering the pixel, or PLAYER_COUNT if there is none</returns>
+            static DWORD HitTestPlayers(const Silhouette* silhouettes, FLOAT x, FLOAT y);
+
+            /// <summary>
+            /// Renders a depth frame
+            /// </summary>
+            /// <param name="scene">scene to render</param>
+            /// <param name="isUsingPlayerIndex">true to write player indices into the low bits</param>
+            /// <param name="width">image width in pixels</param>
+            /// <param name="height">image height in pixels</param>
+            /// <param name="pBits">buffer to write to</param>
+            /// <param name="pitch">number of bytes in each row of the buffer</param>
+            static void RenderDepth(const Scene& scene, bool isUsingPlayerIndex, DWORD width, DWORD height, BYTE* pBits, INT pitch);
+
+            /// <summary>
+            /// Renders a BGRX color frame
+            /// </summary>
+            /// <param name="scene">scene to render</param>
+            /// <param name="frameIndex">zero-based frame index, which scrolls the background</param>
+            /// <param name="width">image width in pixels</param>
+            /// <param name="height">image height in pixels</param>
+            /// <param name="pBits">buffer to write to</param>
+            /// <param name="pitch">number of bytes in each row of the buffer</param>
+            static void RenderColor(const Scene& scene, LONG frameIndex, DWORD width, DWORD height, BYTE* pBits, INT pitch);
+        };
+    }
+}
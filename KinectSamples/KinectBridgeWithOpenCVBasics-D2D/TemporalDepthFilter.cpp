@@ -0,0 +1,191 @@
+//-----------------------------------------------------------------------------
+// <copyright file="TemporalDepthFilter.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "TemporalDepthFilter.h"
+#include "DepthFilters.h"
+#include "PerformanceCounter.h"
+#include <strsafe.h>
+
+using namespace cv;
+using namespace Microsoft::KinectBridge;
+
+const float TemporalDepthFilter::MIN_LEARNING_RATE = 1.0f / TemporalDepthFilter::MAX_AGE;
+const float TemporalDepthFilter::RESET_DEVIATIONS = 3.0f;
+
+/// <summary>
+/// Constructor
+/// </summary>
+TemporalDepthFilter::TemporalDepthFilter() :
+    m_frameCount(0),
+    m_pixelCount(0),
+    m_resetCount(0),
+    m_totalTicks(0)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_ticksPerSecond = frequency.QuadPart;
+
+    // A pixel averages its first frames evenly, then settles at the minimum rate
+    m_learningRates[0] = 1.0f;
+    for (BYTE age = 1; age <= MAX_AGE; ++age)
+    {
+        m_learningRates[age] = max(1.0f / age, MIN_LEARNING_RATE);
+    }
+}
+
+/// <summary>
+/// Forgets the history of every pixel, so the next frame is drawn as it is
+/// </summary>
+void TemporalDepthFilter::Reset()
+{
+    if (!m_ages.empty())
+    {
+        ZeroMemory(&m_ages[0], m_ages.size());
+    }
+}
+
+/// <summary>
+/// Adds a frame to the history and draws its smoothed depths
+/// </summary>
+/// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+/// <param name="playerImage">player indices of the depths, of type CV_8U, or an empty Mat to ignore players</param>
+/// <param name="pFilteredImage">pointer in which to return the smoothed depths, of type CV_16U and the size of the depths; may be the depth image</param>
+/// <returns>S_OK if successful, E_INVALIDARG if the images do not match, an error code otherwise</returns>
+HRESULT TemporalDepthFilter::Filter(const Mat& depthImage, const Mat& playerImage, Mat* pFilteredImage)
+{
+    if (!pFilteredImage)
+    {
+        return E_POINTER;
+    }
+
+    bool hasPlayers = !playerImage.empty();
+    if (depthImage.empty() || depthImage.type() != CV_16U ||
+        (hasPlayers && (playerImage.type() != CV_8U || playerImage.size() != depthImage.size())))
+    {
+        return E_INVALIDARG;
+    }
+
+    LONGLONG startTicks = GetTicks();
+
+    if (pFilteredImage->size() != depthImage.size() || pFilteredImage->type() != CV_16U)
+    {
+        pFilteredImage->create(depthImage.size(), CV_16U);
+    }
+
+    PrepareHistory(depthImage.total());
+
+    float* pMeans = &m_means[0];
+    float* pVariances = &m_variances[0];
+    BYTE* pAges = &m_ages[0];
+    BYTE* pPlayers = &m_players[0];
+    BYTE* pMissedFrames = &m_missedFrames[0];
+    const float resetDeviationsSquared = RESET_DEVIATIONS * RESET_DEVIATIONS;
+    LONGLONG resetCount = 0;
+
+    for (int y = 0; y < depthImage.rows; ++y)
+    {
+        const USHORT* pDepthRow = depthImage.ptr<USHORT>(y);
+        const BYTE* pPlayerRow = hasPlayers ? playerImage.ptr<BYTE>(y) : NULL;
+        USHORT* pOut = pFilteredImage->ptr<USHORT>(y);
+
+        for (int x = 0; x < depthImage.cols; ++x, ++pMeans, ++pVariances, ++pAges, ++pPlayers, ++pMissedFrames)
+        {
+            USHORT depth = pDepthRow[x];
+            BYTE player = hasPlayers ? pPlayerRow[x] : 0;
+
+            if (depth == 0 || depth > MAX_FILTER_DEPTH)
+            {
+                // Hold background pixels briefly; players move, so holding them would leave trails
+                if (*pAges > 0 && 0 == *pPlayers && *pMissedFrames < MAX_MISSED_FRAMES)
+                {
+                    ++*pMissedFrames;
+                    pOut[x] = static_cast<USHORT>(*pMeans + 0.5f);
+                }
+                else
+                {
+                    *pAges = 0;
+                    pOut[x] = depth;
+                }
+
+                continue;
+            }
+
+            float sample = static_cast<float>(depth);
+            float difference = sample - *pMeans;
+            float sensorVariance = GetSensorVariance(sample);
+
+            // Start over on a new pixel, or when the depth moved more than noise explains
+            if (0 == *pAges || player != *pPlayers ||
+                difference * difference > resetDeviationsSquared * (*pVariances + sensorVariance))
+            {
+                ++resetCount;
+                *pMeans = sample;
+                *pVariances = sensorVariance;
+                *pAges = 1;
+                *pPlayers = player;
+                *pMissedFrames = 0;
+                pOut[x] = depth;
+                continue;
+            }
+
+            // Exponentially weighted mean and variance, updated in place
+            if (*pAges < MAX_AGE)
+            {
+                ++*pAges;
+            }
+
+            float rate = m_learningRates[*pAges];
+            float step = rate * difference;
+            *pMeans += step;
+            *pVariances = (1.0f - rate) * (*pVariances + difference * step);
+            *pMissedFrames = 0;
+            pOut[x] = static_cast<USHORT>(*pMeans + 0.5f);
+        }
+    }
+
+    m_totalTicks += GetTicks() - startTicks;
+    m_resetCount += resetCount;
+    m_pixelCount += depthImage.total();
+    ++m_frameCount;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the frame count, share of pixels started over and mean time per frame to the debugger output
+/// </summary>
+/// <param name="filterName">name of the filter to write before the figures</param>
+void TemporalDepthFilter::Report(LPCWSTR filterName) const
+{
+    if (0 == m_frameCount)
+    {
+        return;
+    }
+
+    WCHAR line[256];
+    StringCchPrintf(line, _countof(line), L"KinectBridge temporal filter %s: n=%I64d reset=%.2f%% of pixels mean=%.1f microseconds\n",
+        filterName, m_frameCount, 100.0 * m_resetCount / m_pixelCount,
+        1000000.0 * m_totalTicks / m_ticksPerSecond / m_frameCount);
+    OutputDebugString(line);
+}
+
+/// <summary>
+/// Sizes the history for a resolution, forgetting it if it is not already that size
+/// </summary>
+/// <param name="pixelCount">number of pixels in a frame</param>
+void TemporalDepthFilter::PrepareHistory(size_t pixelCount)
+{
+    if (m_ages.size() == pixelCount)
+    {
+        return;
+    }
+
+    m_means.assign(pixelCount, 0.0f);
+    m_variances.assign(pixelCount, 0.0f);
+    m_ages.assign(pixelCount, 0);
+    m_players.assign(pixelCount, 0);
+    m_missedFrames.assign(pixelCount, 0);
+}
@@ -0,0 +1,100 @@
+//-----------------------------------------------------------------------------
+// <copyright file="TemporalDepthFilter.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+// Suppress warnings that come from compiling OpenCV code since we have no control over it
+#pragma warning(push)
+#pragma warning(disable : 6294 6031)
+#include <opencv2/core/core.hpp>
+#pragma warning(pop)
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Smooths depths in millimeters over time. Each pixel keeps an exponentially weighted mean
+        /// and variance of its depth, which each frame updates in constant time, and is drawn as its
+        /// mean. A pixel starts over from its new depth when the depth moves further from the mean
+        /// than its own noise and the sensor's would explain, or when its player index changes, so
+        /// moving players leave no trails. Background pixels that drop out for a frame or two are
+        /// drawn as their mean meanwhile. The history is kept as one array per field, and only
+        /// reallocated when the resolution changes. Not safe to use from several threads at once.
+        /// </summary>
+        class TemporalDepthFilter
+        {
+        public:
+            // Constants:
+            // Learning rate a pixel settles at once it has been steady for a few frames
+            static const float MIN_LEARNING_RATE;
+
+            // Distance from the mean, in standard deviations, at which a pixel starts over
+            static const float RESET_DEVIATIONS;
+
+            // Frames a background pixel is drawn as its mean while the sensor has no depth for it
+            static const BYTE MAX_MISSED_FRAMES = 2;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            TemporalDepthFilter();
+
+            /// <summary>
+            /// Forgets the history of every pixel, so the next frame is drawn as it is
+            /// </summary>
+            void Reset();
+
+            /// <summary>
+            /// Adds a frame to the history and draws its smoothed depths
+            /// </summary>
+            /// <param name="depthImage">depths in millimeters, of type CV_16U</param>
+            /// <param name="playerImage">player indices of the depths, of type CV_8U, or an empty Mat to ignore players</param>
+            /// <param name="pFilteredImage">pointer in which to return the smoothed depths, of type CV_16U and the size of the depths; may be the depth image</param>
+            /// <returns>S_OK if successful, E_INVALIDARG if the images do not match, an error code otherwise</returns>
+            HRESULT Filter(const cv::Mat& depthImage, const cv::Mat& playerImage, cv::Mat* pFilteredImage);
+
+            /// <summary>
+            /// Writes the frame count, share of pixels started over and mean time per frame to the debugger output
+            /// </summary>
+            /// <param name="filterName">name of the filter to write before the figures</param>
+            void Report(LPCWSTR filterName) const;
+
+        private:
+            // Constants:
+            // Age at which a pixel's learning rate reaches MIN_LEARNING_RATE
+            static const BYTE MAX_AGE = 8;
+
+            // Functions:
+            /// <summary>
+            /// Sizes the history for a resolution, forgetting it if it is not already that size
+            /// </summary>
+            /// <param name="pixelCount">number of pixels in a frame</param>
+            void PrepareHistory(size_t pixelCount);
+
+            // Variables:
+            // History of each pixel: mean and variance of its depth in millimeters, frames since it
+            // started over (0 for no history), player index and frames it has been missing for
+            std::vector<float> m_means;
+            std::vector<float> m_variances;
+            std::vector<BYTE> m_ages;
+            std::vector<BYTE> m_players;
+            std::vector<BYTE> m_missedFrames;
+
+            // Learning rate of each age
+            float m_learningRates[MAX_AGE + 1];
+
+            // Figures for Report
+            LONGLONG m_frameCount;
+            LONGLONG m_pixelCount;
+            LONGLONG m_resetCount;
+            LONGLONG m_totalTicks;
+            LONGLONG m_ticksPerSecond;
+        };
+    }
+}
@@ -0,0 +1,828 @@
+//-----------------------------------------------------------------------------
+// <copyright file="WorkerPool.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#include "WorkerPool.h"
+#include <new>
+#include <strsafe.h>
+
+using namespace Microsoft::KinectBridge;
+
+namespace
+{
+    /// <summary>
+    /// Where a registered wait is between its handles being signalled and its callback returning
+    /// </summary>
+    enum WaitState
+    {
+        // Handles are watched by the wait thread
+        WAIT_STATE_ARMED,
+
+        // A handle was signalled and the callback is queued
+        WAIT_STATE_QUEUED,
+
+        // The callback is running on a worker
+        WAIT_STATE_RUNNING,
+
+        // Unregistered, and neither queued nor running
+        WAIT_STATE_IDLE
+    };
+}
+
+/// <summary>
+/// Handles that trigger a callback when any of them is signalled
+/// </summary>
+struct WorkerPool::WaitRegistration
+{
+    // Link in the registered or retired list
+    WaitRegistration* pNext;
+
+    // Handles to watch
+    HANDLE handles[MAXIMUM_WAIT_HANDLE_COUNT];
+    DWORD handleCount;
+
+    // Work queued when a handle is signalled; a registration has at most one outstanding
+    WorkItem item;
+
+    WaitState state;
+    bool isRemoved;
+};
+
+/// <summary>
+/// Constructor
+/// </summary>
+WorkerPool::WorkerPool() :
+    m_pRegistrations(NULL),
+    m_pRetiredRegistrations(NULL),
+    m_requestedWaitVersion(0),
+    m_currentWaitVersion(0),
+    m_hWaitThread(NULL),
+    m_threadCount(0),
+    m_isStopping(false),
+    m_busyThreadCount(0),
+    m_pendingCount(0),
+    m_waitCount(0)
+{
+    InitializeCriticalSection(&m_lock);
+    InitializeConditionVariable(&m_workQueued);
+    InitializeConditionVariable(&m_stateChanged);
+
+    m_hWaitsChangedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    ZeroMemory(m_pQueueHeads, sizeof(m_pQueueHeads));
+    ZeroMemory(m_pQueueTails, sizeof(m_pQueueTails));
+    ZeroMemory(m_hWorkerThreads, sizeof(m_hWorkerThreads));
+    ZeroMemory(m_completedCount, sizeof(m_completedCount));
+}
+
+/// <summary>
+/// Destructor. Stops the threads and frees the registered waits.
+/// </summary>
+WorkerPool::~WorkerPool()
+{
+    Stop();
+
+    WaitRegistration* lists[] = { m_pRegistrations, m_pRetiredRegistrations };
+    for (int i = 0; i < _countof(lists); ++i)
+    {
+        WaitRegistration* pRegistration = lists[i];
+        while (pRegistration)
+        {
+            WaitRegistration* pNext = pRegistration->pNext;
+            delete pRegistration;
+            pRegistration = pNext;
+        }
+    }
+
+    if (m_hWaitsChangedEvent)
+    {
+        CloseHandle(m_hWaitsChangedEvent);
+    }
+
+    DeleteCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Starts the worker and wait threads
+/// </summary>
+/// <param name="threadCount">number of worker threads, or 0 for one per processor</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT WorkerPool::Start(DWORD threadCount /* = 0 */)
+{
+    if (m_hWaitThread)
+    {
+        return S_OK;
+    }
+
+    if (!m_hWaitsChangedEvent)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    if (0 == threadCount)
+    {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        threadCount = systemInfo.dwNumberOfProcessors;
+    }
+
+    if (threadCount > MAXIMUM_THREAD_COUNT)
+    {
+        threadCount = MAXIMUM_THREAD_COUNT;
+    }
+
+    m_isStopping = false;
+
+    m_hWaitThread = CreateThread(NULL, 0, WaitThread, this, 0, NULL);
+    if (!m_hWaitThread)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    for (m_threadCount = 0; m_threadCount < threadCount; ++m_threadCount)
+    {
+        m_hWorkerThreads[m_threadCount] = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
+        if (!m_hWorkerThreads[m_threadCount])
+        {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            Stop();
+            return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Waits for running work to finish and stops the threads. Work that has not started is discarded.
+/// </summary>
+void WorkerPool::Stop()
+{
+    if (!m_hWaitThread)
+    {
+        return;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_isStopping = true;
+    WakeAllConditionVariable(&m_workQueued);
+    WakeAllConditionVariable(&m_stateChanged);
+    LeaveCriticalSection(&m_lock);
+
+    SetEvent(m_hWaitsChangedEvent);
+
+    WaitForSingleObject(m_hWaitThread, INFINITE);
+    CloseHandle(m_hWaitThread);
+    m_hWaitThread = NULL;
+
+    for (DWORD i = 0; i < m_threadCount; ++i)
+    {
+        WaitForSingleObject(m_hWorkerThreads[i], INFINITE);
+        CloseHandle(m_hWorkerThreads[i]);
+        m_hWorkerThreads[i] = NULL;
+    }
+    m_threadCount = 0;
+
+    // Discard work that has not started. Registered waits are watched again if the pool restarts.
+    for (int i = 0; i < WORK_PRIORITY_COUNT; ++i)
+    {
+        while (m_pQueueHeads[i])
+        {
+            WorkItem* pItem = m_pQueueHeads[i];
+            m_pQueueHeads[i] = pItem->pNext;
+
+            if (pItem->pRegistration)
+            {
+                pItem->pRegistration->state = WAIT_STATE_ARMED;
+            }
+            else
+            {
+                // Bands a worker never started were run by the caller, but the job still holds a reference for them
+                if (pItem->callback == RowBandWork)
+                {
+                    ReleaseRowBandJob(reinterpret_cast<RowBandJob*>(pItem->pContext));
+                }
+                delete pItem;
+            }
+        }
+        m_pQueueTails[i] = NULL;
+    }
+    m_pendingCount = 0;
+}
+
+/// <summary>
+/// Queues a callback to run once on a worker thread
+/// </summary>
+/// <param name="callback">function to run</param>
+/// <param name="pContext">context to pass to the function</param>
+/// <param name="priority">priority of the work</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT WorkerPool::Submit(WorkCallback callback, void* pContext, WorkPriority priority)
+{
+    if (!callback || priority < 0 || priority >= WORK_PRIORITY_COUNT)
+    {
+        return E_INVALIDARG;
+    }
+
+    WorkItem* pItem = new (std::nothrow) WorkItem;
+    if (!pItem)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pItem->callback = callback;
+    pItem->pContext = pContext;
+    pItem->handleIndex = 0;
+    pItem->priority = priority;
+    pItem->pRegistration = NULL;
+
+    EnterCriticalSection(&m_lock);
+    Enqueue(pItem);
+    LeaveCriticalSection(&m_lock);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Runs a callback on a worker thread whenever one of a set of handles is signalled
+/// </summary>
+/// <param name="pHandles">handles to watch</param>
+/// <param name="handleCount">number of handles</param>
+/// <param name="callback">function to run, given the index of the signalled handle</param>
+/// <param name="pContext">context to pass to the function</param>
+/// <param name="priority">priority of the work</param>
+/// <param name="ppRegistration">pointer in which to return the registration</param>
+/// <returns>S_OK if successful, an error code otherwise</returns>
+HRESULT WorkerPool::RegisterWait(const HANDLE* pHandles, DWORD handleCount, WorkCallback callback, void* pContext,
+    WorkPriority priority, WaitRegistration** ppRegistration)
+{
+    if (!pHandles || 0 == handleCount || !callback || priority < 0 || priority >= WORK_PRIORITY_COUNT || !ppRegistration)
+    {
+        return E_INVALIDARG;
+    }
+
+    WaitRegistration* pRegistration = new (std::nothrow) WaitRegistration;
+    if (!pRegistration)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pRegistration->handleCount = handleCount;
+    pRegistration->item.callback = callback;
+    pRegistration->item.pContext = pContext;
+    pRegistration->item.handleIndex = 0;
+    pRegistration->item.priority = priority;
+    pRegistration->item.pRegistration = pRegistration;
+    pRegistration->state = WAIT_STATE_ARMED;
+    pRegistration->isRemoved = false;
+
+    EnterCriticalSection(&m_lock);
+
+    // All registered handles have to fit into a single wait, next to the change event
+    if (m_waitCount + handleCount > MAXIMUM_WAIT_HANDLE_COUNT)
+    {
+        LeaveCriticalSection(&m_lock);
+        delete pRegistration;
+        return E_OUTOFMEMORY;
+    }
+
+    CopyMemory(pRegistration->handles, pHandles, handleCount * sizeof(HANDLE));
+    m_waitCount += handleCount;
+
+    pRegistration->pNext = m_pRegistrations;
+    m_pRegistrations = pRegistration;
+
+    RefreshWaits();
+
+    LeaveCriticalSection(&m_lock);
+
+    *ppRegistration = pRegistration;
+    return S_OK;
+}
+
+/// <summary>
+/// Splits rows into bands and runs a callback on each, on the worker threads and the
+/// calling thread, returning once every band is done. The band count is picked from
+/// the size of the work and the number of threads, and work too small to split runs
+/// on the calling thread alone, as does all work while the pool is stopped. The
+/// calling thread takes any band no worker has started, so this may be called from
+/// a worker callback without waiting on busy workers.
+/// </summary>
+/// <param name="rowCount">number of rows</param>
+/// <param name="bytesPerRow">bytes read and written per row, used to size the bands</param>
+/// <param name="callback">function to run on each band</param>
+/// <param name="pContext">context to pass to the function</param>
+/// <param name="priority">priority of the bands handed to workers</param>
+void WorkerPool::ParallelForRowBands(UINT rowCount, SIZE_T bytesPerRow, RowBandCallback callback, void* pContext, WorkPriority priority)
+{
+    // One band per worker plus one for the calling thread, but none smaller than the minimum
+    SIZE_T bandCount = 1;
+    if (m_hWaitThread)
+    {
+        bandCount = min(static_cast<SIZE_T>(m_threadCount + 1), static_cast<SIZE_T>(rowCount));
+        bandCount = min(bandCount, rowCount * bytesPerRow / MINIMUM_ROW_BAND_SIZE);
+    }
+
+    RowBandJob* pJob = NULL;
+    if (bandCount > 1)
+    {
+        pJob = new (std::nothrow) RowBandJob;
+    }
+
+    if (!pJob)
+    {
+        callback(pContext, 0, rowCount);
+        return;
+    }
+
+    // The calling thread holds one reference and each band handed to a worker another
+    pJob->referenceCount = static_cast<LONG>(bandCount);
+    pJob->nextBand = 0;
+    pJob->remainingBandCount = static_cast<LONG>(bandCount);
+    pJob->bandCount = static_cast<UINT>(bandCount);
+    pJob->rowCount = rowCount;
+    pJob->callback = callback;
+    pJob->pContext = pContext;
+
+    for (SIZE_T i = 1; i < bandCount; ++i)
+    {
+        // Bands that could not be handed out are left to the calling thread
+        if (FAILED(Submit(RowBandWork, pJob, priority)))
+        {
+            InterlockedExchangeAdd(&pJob->referenceCount, -static_cast<LONG>(bandCount - i));
+            break;
+        }
+    }
+
+    RunRowBands(pJob);
+
+    // Wait for bands that workers took before the calling thread got to them. They are
+    // already running, so this is short and is not worth an event.
+    while (InterlockedCompareExchange(&pJob->remainingBandCount, 0, 0) != 0)
+    {
+        SwitchToThread();
+    }
+
+    ReleaseRowBandJob(pJob);
+}
+
+/// <summary>
+/// Changes the priority of the work a registered wait triggers
+/// </summary>
+/// <param name="pRegistration">registration returned by RegisterWait</param>
+/// <param name="priority">new priority</param>
+void WorkerPool::SetWaitPriority(WaitRegistration* pRegistration, WorkPriority priority)
+{
+    if (!pRegistration || priority < 0 || priority >= WORK_PRIORITY_COUNT)
+    {
+        return;
+    }
+
+    EnterCriticalSection(&m_lock);
+
+    // Queued work moves to the queue of its new priority
+    if (WAIT_STATE_QUEUED == pRegistration->state)
+    {
+        RemoveQueued(&pRegistration->item);
+        pRegistration->item.priority = priority;
+        Enqueue(&pRegistration->item);
+    }
+    else
+    {
+        pRegistration->item.priority = priority;
+    }
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Stops watching the handles of a registered wait. Once this returns, the callback is
+/// not running and will not run again, and the handles may be closed. Must not be
+/// called from the registration's own callback.
+/// </summary>
+/// <param name="pRegistration">registration returned by RegisterWait</param>
+void WorkerPool::UnregisterWait(WaitRegistration* pRegistration)
+{
+    if (!pRegistration)
+    {
+        return;
+    }
+
+    EnterCriticalSection(&m_lock);
+
+    if (!pRegistration->isRemoved)
+    {
+        pRegistration->isRemoved = true;
+        m_waitCount -= pRegistration->handleCount;
+
+        if (WAIT_STATE_QUEUED == pRegistration->state)
+        {
+            RemoveQueued(&pRegistration->item);
+            pRegistration->state = WAIT_STATE_IDLE;
+        }
+        else if (WAIT_STATE_ARMED == pRegistration->state)
+        {
+            pRegistration->state = WAIT_STATE_IDLE;
+        }
+
+        // Move to the retired list. The wait thread may still hold a pointer to the
+        // registration from before it picks up the change, so it is freed with the pool.
+        WaitRegistration** ppLink = &m_pRegistrations;
+        while (*ppLink != pRegistration)
+        {
+            ppLink = &(*ppLink)->pNext;
+        }
+        *ppLink = pRegistration->pNext;
+
+        pRegistration->pNext = m_pRetiredRegistrations;
+        m_pRetiredRegistrations = pRegistration;
+
+        RefreshWaits();
+    }
+
+    while (WAIT_STATE_RUNNING == pRegistration->state)
+    {
+        SleepConditionVariableCS(&m_stateChanged, &m_lock, INFINITE);
+    }
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Gets the pool's counters
+/// </summary>
+/// <param name="pStatistics">pointer in which to return the counters</param>
+void WorkerPool::GetStatistics(WorkerPoolStatistics* pStatistics) const
+{
+    EnterCriticalSection(&m_lock);
+
+    pStatistics->threadCount = static_cast<LONG>(m_threadCount);
+    pStatistics->busyThreadCount = m_busyThreadCount;
+    pStatistics->pendingCount = m_pendingCount;
+    pStatistics->waitCount = m_waitCount;
+    CopyMemory(pStatistics->completedCount, m_completedCount, sizeof(m_completedCount));
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Worker thread entry point
+/// </summary>
+/// <param name="pParam">pointer to the pool</param>
+/// <returns>thread exit code</returns>
+DWORD WINAPI WorkerPool::WorkerThread(LPVOID pParam)
+{
+    reinterpret_cast<WorkerPool*>(pParam)->RunWorker();
+    return 0;
+}
+
+/// <summary>
+/// Runs queued work until the pool stops
+/// </summary>
+void WorkerPool::RunWorker()
+{
+    EnterCriticalSection(&m_lock);
+
+    for (;;)
+    {
+        // Take the oldest work of the highest priority
+        WorkItem* pItem = NULL;
+        while (!m_isStopping)
+        {
+            for (int i = 0; i < WORK_PRIORITY_COUNT && !pItem; ++i)
+            {
+                pItem = m_pQueueHeads[i];
+            }
+
+            if (pItem)
+            {
+                break;
+            }
+
+            SleepConditionVariableCS(&m_workQueued, &m_lock, INFINITE);
+        }
+
+        if (m_isStopping)
+        {
+            break;
+        }
+
+        RemoveQueued(pItem);
+
+        WaitRegistration* pRegistration = pItem->pRegistration;
+        if (pRegistration)
+        {
+            pRegistration->state = WAIT_STATE_RUNNING;
+        }
+
+        ++m_busyThreadCount;
+        LeaveCriticalSection(&m_lock);
+
+        pItem->callback(pItem->pContext, pItem->handleIndex);
+
+        EnterCriticalSection(&m_lock);
+        --m_busyThreadCount;
+        ++m_completedCount[pItem->priority];
+
+        if (pRegistration)
+        {
+            // Watch the handles again, unless the wait was unregistered meanwhile
+            if (pRegistration->isRemoved)
+            {
+                pRegistration->state = WAIT_STATE_IDLE;
+            }
+            else
+            {
+                pRegistration->state = WAIT_STATE_ARMED;
+                ++m_requestedWaitVersion;
+                SetEvent(m_hWaitsChangedEvent);
+            }
+
+            WakeAllConditionVariable(&m_stateChanged);
+        }
+        else
+        {
+            delete pItem;
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+}
+
+/// <summary>
+/// Worker entry point for ParallelForRowBands
+/// </summary>
+/// <param name="pContext">pointer to the job</param>
+/// <param name="handleIndex">unused</param>
+void CALLBACK WorkerPool::RowBandWork(void* pContext, DWORD handleIndex)
+{
+    UNREFERENCED_PARAMETER(handleIndex);
+
+    RowBandJob* pJob = reinterpret_cast<RowBandJob*>(pContext);
+    RunRowBands(pJob);
+    ReleaseRowBandJob(pJob);
+}
+
+/// <summary>
+/// Runs bands of a job until none are left to take
+/// </summary>
+/// <param name="pJob">job to take bands from</param>
+void WorkerPool::RunRowBands(RowBandJob* pJob)
+{
+    for (;;)
+    {
+        UINT band = static_cast<UINT>(InterlockedIncrement(&pJob->nextBand) - 1);
+        if (band >= pJob->bandCount)
+        {
+            return;
+        }
+
+        // Spread the rows evenly, so bands differ by at most one row
+        UINT firstRow = static_cast<UINT>(static_cast<ULONGLONG>(pJob->rowCount) * band / pJob->bandCount);
+        UINT lastRow = static_cast<UINT>(static_cast<ULONGLONG>(pJob->rowCount) * (band + 1) / pJob->bandCount);
+        pJob->callback(pJob->pContext, firstRow, lastRow - firstRow);
+
+        InterlockedDecrement(&pJob->remainingBandCount);
+    }
+}
+
+/// <summary>
+/// Drops a reference to a job, freeing it with the last one
+/// </summary>
+/// <param name="pJob">job to release</param>
+void WorkerPool::ReleaseRowBandJob(RowBandJob* pJob)
+{
+    if (InterlockedDecrement(&pJob->referenceCount) == 0)
+    {
+        delete pJob;
+    }
+}
+
+/// <summary>
+/// Wait thread entry point
+/// </summary>
+/// <param name="pParam">pointer to the pool</param>
+/// <returns>thread exit code</returns>
+DWORD WINAPI WorkerPool::WaitThread(LPVOID pParam)
+{
+    reinterpret_cast<WorkerPool*>(pParam)->RunWaits();
+    return 0;
+}
+
+/// <summary>
+/// Watches the handles of the registered waits and queues their work until the pool stops
+/// </summary>
+void WorkerPool::RunWaits()
+{
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    WaitRegistration* pOwners[MAXIMUM_WAIT_OBJECTS];
+    DWORD handleIndices[MAXIMUM_WAIT_OBJECTS];
+
+    for (;;)
+    {
+        // Collect the handles of every armed wait, behind the change event
+        EnterCriticalSection(&m_lock);
+
+        if (m_isStopping)
+        {
+            LeaveCriticalSection(&m_lock);
+            break;
+        }
+
+        DWORD count = 0;
+        handles[count++] = m_hWaitsChangedEvent;
+        for (WaitRegistration* pRegistration = m_pRegistrations; pRegistration; pRegistration = pRegistration->pNext)
+        {
+            if (WAIT_STATE_ARMED != pRegistration->state)
+            {
+                continue;
+            }
+
+            for (DWORD i = 0; i < pRegistration->handleCount; ++i)
+            {
+                handles[count] = pRegistration->handles[i];
+                pOwners[count] = pRegistration;
+                handleIndices[count] = i;
+                ++count;
+            }
+        }
+
+        m_currentWaitVersion = m_requestedWaitVersion;
+        WakeAllConditionVariable(&m_stateChanged);
+
+        LeaveCriticalSection(&m_lock);
+
+        DWORD result = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+        if (WAIT_FAILED == result)
+        {
+            // A handle was closed while still registered, and the wait would fail again at once
+            DisarmFailedWaits(handles, pOwners, handleIndices, count);
+            continue;
+        }
+
+        // An abandoned mutex is owned by this thread now, so it counts as signalled
+        DWORD index;
+        if (result >= WAIT_ABANDONED_0 && result < WAIT_ABANDONED_0 + count)
+        {
+            index = result - WAIT_ABANDONED_0;
+        }
+        else
+        {
+            index = result - WAIT_OBJECT_0;
+        }
+
+        if (0 == index || index >= count)
+        {
+            // Index 0 is the change event: the waits changed or the pool is stopping
+            continue;
+        }
+
+        // Queue the work of the wait whose handle was signalled. Its handles are left out
+        // of the wait until the work has run.
+        WaitRegistration* pRegistration = pOwners[index];
+
+        EnterCriticalSection(&m_lock);
+
+        if (WAIT_STATE_ARMED == pRegistration->state && !pRegistration->isRemoved)
+        {
+            pRegistration->state = WAIT_STATE_QUEUED;
+            pRegistration->item.handleIndex = handleIndices[index];
+            Enqueue(&pRegistration->item);
+        }
+
+        LeaveCriticalSection(&m_lock);
+    }
+}
+
+/// <summary>
+/// Stops watching the waits whose handles can no longer be waited on, after a wait failed.
+/// Their callbacks do not run again, but they stay registered until unregistered. If no
+/// handle is found invalid, blocks until the waits change, so that a failing wait is not
+/// retried in a loop.
+/// </summary>
+/// <param name="handles">handles of the failed wait, the change event first</param>
+/// <param name="pOwners">registration each handle belongs to</param>
+/// <param name="handleIndices">index of each handle within its registration</param>
+/// <param name="count">number of handles</param>
+void WorkerPool::DisarmFailedWaits(const HANDLE* handles, WaitRegistration* const* pOwners, const DWORD* handleIndices, DWORD count)
+{
+    WCHAR line[128];
+    StringCchPrintf(line, _countof(line), L"KinectBridge worker pool: waiting on %u handles failed with error %u\n", count, GetLastError());
+    OutputDebugString(line);
+
+    EnterCriticalSection(&m_lock);
+
+    bool isChanged = m_currentWaitVersion < m_requestedWaitVersion;
+    for (DWORD i = 1; i < count; ++i)
+    {
+        WaitRegistration* pRegistration = pOwners[i];
+        if (WAIT_STATE_ARMED != pRegistration->state || pRegistration->isRemoved)
+        {
+            continue;
+        }
+
+        // Probing consumes the signal of an auto-reset event, so a signalled handle gets its work queued
+        DWORD result = WaitForSingleObject(handles[i], 0);
+        if (WAIT_FAILED == result)
+        {
+            StringCchPrintf(line, _countof(line), L"KinectBridge worker pool: handle %u of a wait is invalid, error %u\n",
+                handleIndices[i], GetLastError());
+            OutputDebugString(line);
+
+            pRegistration->state = WAIT_STATE_IDLE;
+            isChanged = true;
+        }
+        else if (WAIT_OBJECT_0 == result || WAIT_ABANDONED_0 == result)
+        {
+            pRegistration->state = WAIT_STATE_QUEUED;
+            pRegistration->item.handleIndex = handleIndices[i];
+            Enqueue(&pRegistration->item);
+            isChanged = true;
+        }
+    }
+
+    LeaveCriticalSection(&m_lock);
+
+    // The change event is the pool's own and stays valid while the wait thread runs
+    if (!isChanged)
+    {
+        WaitForSingleObject(m_hWaitsChangedEvent, INFINITE);
+    }
+}
+
+/// <summary>
+/// Appends work to the queue of its priority. Called with m_lock held.
+/// </summary>
+/// <param name="pItem">work to queue</param>
+void WorkerPool::Enqueue(WorkItem* pItem)
+{
+    pItem->pNext = NULL;
+
+    if (m_pQueueTails[pItem->priority])
+    {
+        m_pQueueTails[pItem->priority]->pNext = pItem;
+    }
+    else
+    {
+        m_pQueueHeads[pItem->priority] = pItem;
+    }
+    m_pQueueTails[pItem->priority] = pItem;
+
+    ++m_pendingCount;
+    WakeConditionVariable(&m_workQueued);
+}
+
+/// <summary>
+/// Removes work from its queue without running it. Called with m_lock held.
+/// </summary>
+/// <param name="pItem">queued work</param>
+void WorkerPool::RemoveQueued(WorkItem* pItem)
+{
+    WorkItem* pPrevious = NULL;
+    WorkItem* pCurrent = m_pQueueHeads[pItem->priority];
+    while (pCurrent && pCurrent != pItem)
+    {
+        pPrevious = pCurrent;
+        pCurrent = pCurrent->pNext;
+    }
+
+    if (!pCurrent)
+    {
+        return;
+    }
+
+    if (pPrevious)
+    {
+        pPrevious->pNext = pItem->pNext;
+    }
+    else
+    {
+        m_pQueueHeads[pItem->priority] = pItem->pNext;
+    }
+
+    if (m_pQueueTails[pItem->priority] == pItem)
+    {
+        m_pQueueTails[pItem->priority] = pPrevious;
+    }
+
+    --m_pendingCount;
+}
+
+/// <summary>
+/// Makes the wait thread pick up changes to the registered waits and waits until it
+/// has. Called with m_lock held.
+/// </summary>
+void WorkerPool::RefreshWaits()
+{
+    LONGLONG version = ++m_requestedWaitVersion;
+    SetEvent(m_hWaitsChangedEvent);
+
+    // Until the wait thread has rebuilt its handle list it may still be waiting on handles
+    // the caller is about to close
+    while (m_hWaitThread && !m_isStopping && m_currentWaitVersion < version)
+    {
+        SleepConditionVariableCS(&m_stateChanged, &m_lock, INFINITE);
+    }
+}
@@ -0,0 +1,310 @@
+//-----------------------------------------------------------------------------
+// <copyright file="WorkerPool.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation. All rights reserved.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+namespace Microsoft {
+    namespace KinectBridge {
+        /// <summary>
+        /// Order in which queued work is run. Work of a higher priority always runs before
+        /// work of a lower priority; work of the same priority runs in the order it was queued.
+        /// </summary>
+        enum WorkPriority
+        {
+            WORK_PRIORITY_HIGH,
+            WORK_PRIORITY_NORMAL,
+            WORK_PRIORITY_LOW,
+            WORK_PRIORITY_COUNT
+        };
+
+        /// <summary>
+        /// Function run by a worker thread
+        /// </summary>
+        /// <param name="pContext">context given when the work was submitted or registered</param>
+        /// <param name="handleIndex">index of the handle that was signalled, 0 for submitted work</param>
+        typedef void (CALLBACK *WorkCallback)(void* pContext, DWORD handleIndex);
+
+        /// <summary>
+        /// Function run on a band of rows by ParallelForRowBands
+        /// </summary>
+        /// <param name="pContext">context given to ParallelForRowBands</param>
+        /// <param name="firstRow">first row of the band</param>
+        /// <param name="rowCount">number of rows in the band</param>
+        typedef void (CALLBACK *RowBandCallback)(void* pContext, UINT firstRow, UINT rowCount);
+
+        /// <summary>
+        /// Counters describing the work done by a WorkerPool
+        /// </summary>
+        struct WorkerPoolStatistics
+        {
+            // Worker threads, and how many of them are running work right now
+            LONG threadCount;
+            LONG busyThreadCount;
+
+            // Work queued but not yet started, and registered waits
+            LONG pendingCount;
+            LONG waitCount;
+
+            // Work run since the pool was created, per priority
+            LONGLONG completedCount[WORK_PRIORITY_COUNT];
+        };
+
+        /// <summary>
+        /// Fixed set of worker threads that run submitted work and work triggered by waitable
+        /// handles, highest priority first. A single wait thread watches the handles of every
+        /// registered wait, so any number of sensors can share the same few threads instead of
+        /// each bringing threads of its own. A registered wait runs on one worker at a time: its
+        /// handles are not watched again until its callback returns.
+        /// </summary>
+        class WorkerPool
+        {
+        public:
+            /// <summary>
+            /// Handles that trigger a callback when any of them is signalled
+            /// </summary>
+            struct WaitRegistration;
+
+            // Constants:
+            // Largest number of worker threads
+            static const DWORD MAXIMUM_THREAD_COUNT = 32;
+
+            // Largest number of handles watched across all registered waits
+            static const DWORD MAXIMUM_WAIT_HANDLE_COUNT = MAXIMUM_WAIT_OBJECTS - 1;
+
+            // Fewest bytes a row band reads and writes; smaller work is not worth handing to another thread
+            static const SIZE_T MINIMUM_ROW_BAND_SIZE = 128 * 1024;
+
+            // Functions:
+            /// <summary>
+            /// Constructor
+            /// </summary>
+            WorkerPool();
+
+            /// <summary>
+            /// Destructor. Stops the threads and frees the registered waits.
+            /// </summary>
+            ~WorkerPool();
+
+            /// <summary>
+            /// Starts the worker and wait threads
+            /// </summary>
+            /// <param name="threadCount">number of worker threads, or 0 for one per processor</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Start(DWORD threadCount = 0);
+
+            /// <summary>
+            /// Waits for running work to finish and stops the threads. Work that has not started is discarded.
+            /// </summary>
+            void Stop();
+
+            /// <summary>
+            /// Queues a callback to run once on a worker thread
+            /// </summary>
+            /// <param name="callback">function to run</param>
+            /// <param name="pContext">context to pass to the function</param>
+            /// <param name="priority">priority of the work</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT Submit(WorkCallback callback, void* pContext, WorkPriority priority);
+
+            /// <summary>
+            /// Runs a callback on a worker thread whenever one of a set of handles is signalled
+            /// </summary>
+            /// <param name="pHandles">handles to watch</param>
+            /// <param name="handleCount">number of handles</param>
+            /// <param name="callback">function to run, given the index of the signalled handle</param>
+            /// <param name="pContext">context to pass to the function</param>
+            /// <param name="priority">priority of the work</param>
+            /// <param name="ppRegistration">pointer in which to return the registration</param>
+            /// <returns>S_OK if successful, an error code otherwise</returns>
+            HRESULT RegisterWait(const HANDLE* pHandles, DWORD handleCount, WorkCallback callback, void* pContext,
+                WorkPriority priority, WaitRegistration** ppRegistration);
+
+            /// <summary>
+            /// Splits rows into bands and runs a callback on each, on the worker threads and the
+            /// calling thread, returning once every band is done. The band count is picked from
+            /// the size of the work and the number of threads, and work too small to split runs
+            /// on the calling thread alone, as does all work while the pool is stopped. The
+            /// calling thread takes any band no worker has started, so this may be called from
+            /// a worker callback without waiting on busy workers.
+            /// </summary>
+            /// <param name="rowCount">number of rows</param>
+            /// <param name="bytesPerRow">bytes read and written per row, used to size the bands</param>
+            /// <param name="callback">function to run on each band</param>
+            /// <param name="pContext">context to pass to the function</param>
+            /// <param name="priority">priority of the bands handed to workers</param>
+            void ParallelForRowBands(UINT rowCount, SIZE_T bytesPerRow, RowBandCallback callback, void* pContext, WorkPriority priority);
+
+            /// <summary>
+            /// Changes the priority of the work a registered wait triggers
+            /// </summary>
+            /// <param name="pRegistration">registration returned by RegisterWait</param>
+            /// <param name="priority">new priority</param>
+            void SetWaitPriority(WaitRegistration* pRegistration, WorkPriority priority);
+
+            /// <summary>
+            /// Stops watching the handles of a registered wait. Once this returns, the callback is
+            /// not running and will not run again, and the handles may be closed. Must not be
+            /// called from the registration's own callback.
+            /// </summary>
+            /// <param name="pRegistration">registration returned by RegisterWait</param>
+            void UnregisterWait(WaitRegistration* pRegistration);
+
+            /// <summary>
+            /// Gets the pool's counters
+            /// </summary>
+            /// <param name="pStatistics">pointer in which to return the counters</param>
+            void GetStatistics(WorkerPoolStatistics* pStatistics) const;
+
+        private:
+            /// <summary>
+            /// Queued callback
+            /// </summary>
+            struct WorkItem
+            {
+                WorkItem* pNext;
+                WorkCallback callback;
+                void* pContext;
+                DWORD handleIndex;
+                WorkPriority priority;
+
+                // Registration the work belongs to, NULL for submitted work
+                WaitRegistration* pRegistration;
+            };
+
+            /// <summary>
+            /// Rows shared out by one ParallelForRowBands call. Workers may pick up their work
+            /// after the call has returned, so the job is freed by whoever releases it last.
+            /// </summary>
+            struct RowBandJob
+            {
+                volatile LONG referenceCount;
+
+                // Next band to take, and bands not yet finished
+                volatile LONG nextBand;
+                volatile LONG remainingBandCount;
+
+                UINT bandCount;
+                UINT rowCount;
+                RowBandCallback callback;
+                void* pContext;
+            };
+
+            // Pools are not copied, since threads refer to the instance
+            WorkerPool(const WorkerPool&);
+            WorkerPool& operator=(const WorkerPool&);
+
+            // Functions:
+            /// <summary>
+            /// Worker thread entry point
+            /// </summary>
+            /// <param name="pParam">pointer to the pool</param>
+            /// <returns>thread exit code</returns>
+            static DWORD WINAPI WorkerThread(LPVOID pParam);
+
+            /// <summary>
+            /// Runs queued work until the pool stops
+            /// </summary>
+            void RunWorker();
+
+            /// <summary>
+            /// Worker entry point for ParallelForRowBands
+            /// </summary>
+            /// <param name="pContext">pointer to the job</param>
+            /// <param name="handleIndex">unused</param>
+            static void CALLBACK RowBandWork(void* pContext, DWORD handleIndex);
+
+            /// <summary>
+            /// Runs bands of a job until none are left to take
+            /// </summary>
+            /// <param name="pJob">job to take bands from</param>
+            static void RunRowBands(RowBandJob* pJob);
+
+            /// <summary>
+            /// Drops a reference to a job, freeing it with the last one
+            /// </summary>
+            /// <param name="pJob">job to release</param>
+            static void ReleaseRowBandJob(RowBandJob* pJob);
+
+            /// <summary>
+            /// Wait thread entry point
+            /// </summary>
+            /// <param name="pParam">pointer to the pool</param>
+            /// <returns>thread exit code</returns>
+            static DWORD WINAPI WaitThread(LPVOID pParam);
+
+            /// <summary>
+            /// Watches the handles of the registered waits and queues their work until the pool stops
+            /// </summary>
+            void RunWaits();
+
+            /// <summary>
+            /// Stops watching the waits whose handles can no longer be waited on, after a wait failed
+            /// </summary>
+            /// <param name="handles">handles of the failed wait, the change event first</param>
+            /// <param name="pOwners">registration each handle belongs to</param>
+            /// <param name="handleIndices">index of each handle within its registration</param>
+            /// <param name="count">number of handles</param>
+            void DisarmFailedWaits(const HANDLE* handles, WaitRegistration* const* pOwners, const DWORD* handleIndices, DWORD count);
+
+            /// <summary>
+            /// Appends work to the queue of its priority. Called with m_lock held.
+            /// </summary>
+            /// <param name="pItem">work to queue</param>
+            void Enqueue(WorkItem* pItem);
+
+            /// <summary>
+            /// Removes work from its queue without running it. Called with m_lock held.
+            /// </summary>
+            /// <param name="pItem">queued work</param>
+            void RemoveQueued(WorkItem* pItem);
+
+            /// <summary>
+            /// Makes the wait thread pick up changes to the registered waits and waits until it
+            /// has. Called with m_lock held.
+            /// </summary>
+            void RefreshWaits();
+
+            // Variables:
+            // Guards everything below
+            mutable CRITICAL_SECTION m_lock;
+
+            // Signalled when work is queued or the pool stops
+            CONDITION_VARIABLE m_workQueued;
+
+            // Signalled when a registration's callback returns or the wait thread picks up changes
+            CONDITION_VARIABLE m_stateChanged;
+
+            // Queued work, oldest first, per priority
+            WorkItem* m_pQueueHeads[WORK_PRIORITY_COUNT];
+            WorkItem* m_pQueueTails[WORK_PRIORITY_COUNT];
+
+            // Registered waits, and waits that were unregistered but may still be referred to
+            WaitRegistration* m_pRegistrations;
+            WaitRegistration* m_pRetiredRegistrations;
+
+            // Wakes the wait thread to pick up changes to the registered waits
+            HANDLE m_hWaitsChangedEvent;
+
+            // Changes requested, and changes the wait thread has picked up
+            LONGLONG m_requestedWaitVersion;
+            LONGLONG m_currentWaitVersion;
+
+            // Threads
+            HANDLE m_hWaitThread;
+            HANDLE m_hWorkerThreads[MAXIMUM_THREAD_COUNT];
+            DWORD m_threadCount;
+            bool m_isStopping;
+
+            // Counters
+            LONG m_busyThreadCount;
+            LONG m_pendingCount;
+            LONG m_waitCount;
+            LONGLONG m_completedCount[WORK_PRIORITY_COUNT];
+        };
+    }
+}